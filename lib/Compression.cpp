@@ -6,10 +6,26 @@
 #include <md5.h>
 
 #include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace std;
 
 
+// Minimum LZ match length, also the number of bytes hashed to find matches
+#define LZ_MIN_MATCH ( 4 )
+
+// Number of bits in the LZ match finder hash table
+#define LZ_HASH_BITS ( 12 )
+
+// Maximum LZ match offset, offsets are stored in 2 bytes
+#define LZ_MAX_OFFSET ( 0xFFFF )
+
+// Length of the substrings that are counted when training a dictionary
+#define DICT_SEGMENT_SIZE ( 8 )
+
+
 void getMD5 ( const char *bytes, size_t len, char dst[16] )
 {
     MD5_CTX md5;
@@ -62,3 +78,257 @@ size_t compressBound ( size_t srcLen )
 {
     return mz_compressBound ( srcLen );
 }
+
+
+/* LZ compressed data is a series of sequences:
+
+    1 byte  token, 4 bits literal length, 4 bits match length - LZ_MIN_MATCH
+    ...     extra literal length bytes if the literal length is 15, each 255 byte means continue
+    ...     literal bytes
+    2 byte  match offset, counting back from the current position, may reach into the dictionary
+    ...     extra match length bytes if the match length is 15, same as above
+
+The last sequence only has literals, and ends the data.
+
+*/
+
+static inline uint32_t lzRead32 ( const uint8_t *ptr )
+{
+    uint32_t value;
+    memcpy ( &value, ptr, sizeof ( value ) );
+    return value;
+}
+
+static inline uint32_t lzHash ( uint32_t value )
+{
+    return ( value * 2654435761U ) >> ( 32 - LZ_HASH_BITS );
+}
+
+static bool lzWriteLength ( uint8_t *dst, size_t dstLen, size_t& pos, size_t length )
+{
+    for ( length -= 15; length >= 255; length -= 255 )
+    {
+        if ( pos >= dstLen )
+            return false;
+
+        dst[pos++] = 255;
+    }
+
+    if ( pos >= dstLen )
+        return false;
+
+    dst[pos++] = length;
+    return true;
+}
+
+static bool lzWriteSequence ( uint8_t *dst, size_t dstLen, size_t& pos,
+                              const uint8_t *literals, size_t literalLen, size_t offset, size_t matchLen )
+{
+    const size_t extraMatchLen = ( matchLen ? matchLen - LZ_MIN_MATCH : 0 );
+
+    if ( pos >= dstLen )
+        return false;
+
+    dst[pos++] = ( min<size_t> ( literalLen, 15 ) << 4 ) | min<size_t> ( extraMatchLen, 15 );
+
+    if ( literalLen >= 15 && ! lzWriteLength ( dst, dstLen, pos, literalLen ) )
+        return false;
+
+    if ( literalLen > dstLen - pos )
+        return false;
+
+    memcpy ( dst + pos, literals, literalLen );
+    pos += literalLen;
+
+    // Last sequence
+    if ( matchLen == 0 )
+        return true;
+
+    if ( dstLen - pos < 2 )
+        return false;
+
+    dst[pos++] = ( offset & 0xFF );
+    dst[pos++] = ( offset >> 8 );
+
+    if ( extraMatchLen >= 15 && ! lzWriteLength ( dst, dstLen, pos, extraMatchLen ) )
+        return false;
+
+    return true;
+}
+
+static bool lzReadLength ( const uint8_t *&src, const uint8_t *end, size_t& length )
+{
+    uint8_t byte;
+
+    do
+    {
+        if ( src >= end )
+            return false;
+
+        byte = *src++;
+        length += byte;
+    }
+    while ( byte == 255 );
+
+    return true;
+}
+
+size_t lzCompress ( const char *src, size_t srcLen, char *dst, size_t dstLen, const char *dict, size_t dictLen )
+{
+    // Matches can reach back into the dictionary, so search in the dictionary followed by the source
+    string buffer;
+
+    if ( dictLen )
+    {
+        buffer.reserve ( dictLen + srcLen );
+        buffer.append ( dict, dictLen );
+        buffer.append ( src, srcLen );
+    }
+
+    const uint8_t *data = ( const uint8_t * ) ( dictLen ? &buffer[0] : src );
+    const size_t end = dictLen + srcLen;
+
+    // Last position where each hashed prefix was seen, offset by 1 so 0 means none
+    vector<uint32_t> table ( 1 << LZ_HASH_BITS, 0 );
+
+    for ( size_t i = 0; i + LZ_MIN_MATCH <= dictLen; ++i )
+        table[lzHash ( lzRead32 ( data + i ) )] = i + 1;
+
+    size_t anchor = dictLen, pos = 0;
+
+    for ( size_t i = dictLen; i + LZ_MIN_MATCH <= end; )
+    {
+        const uint32_t prefix = lzRead32 ( data + i );
+        const uint32_t hash = lzHash ( prefix );
+        const size_t candidate = table[hash];
+
+        table[hash] = i + 1;
+
+        if ( candidate == 0 || i - ( candidate - 1 ) > LZ_MAX_OFFSET || lzRead32 ( data + candidate - 1 ) != prefix )
+        {
+            ++i;
+            continue;
+        }
+
+        const size_t match = candidate - 1;
+
+        size_t matchLen = LZ_MIN_MATCH;
+
+        while ( i + matchLen < end && data[match + matchLen] == data[i + matchLen] )
+            ++matchLen;
+
+        if ( ! lzWriteSequence ( ( uint8_t * ) dst, dstLen, pos, data + anchor, i - anchor, i - match, matchLen ) )
+            return 0;
+
+        i += matchLen;
+        anchor = i;
+    }
+
+    if ( ! lzWriteSequence ( ( uint8_t * ) dst, dstLen, pos, data + anchor, end - anchor, 0, 0 ) )
+        return 0;
+
+    return pos;
+}
+
+size_t lzUncompress ( const char *src, size_t srcLen, char *dst, size_t dstLen, const char *dict, size_t dictLen )
+{
+    const uint8_t *in = ( const uint8_t * ) src;
+    const uint8_t *const end = in + srcLen;
+
+    size_t pos = 0;
+
+    while ( in < end )
+    {
+        const uint8_t token = *in++;
+
+        size_t literalLen = ( token >> 4 );
+
+        if ( literalLen == 15 && ! lzReadLength ( in, end, literalLen ) )
+            return 0;
+
+        if ( literalLen > ( size_t ) ( end - in ) || literalLen > dstLen - pos )
+            return 0;
+
+        memcpy ( dst + pos, in, literalLen );
+        in += literalLen;
+        pos += literalLen;
+
+        // Last sequence
+        if ( in == end )
+            break;
+
+        if ( end - in < 2 )
+            return 0;
+
+        const size_t offset = in[0] | ( in[1] << 8 );
+        in += 2;
+
+        size_t matchLen = ( token & 15 );
+
+        if ( matchLen == 15 && ! lzReadLength ( in, end, matchLen ) )
+            return 0;
+
+        matchLen += LZ_MIN_MATCH;
+
+        if ( offset == 0 || offset > pos + dictLen || matchLen > dstLen - pos )
+            return 0;
+
+        // Copy byte by byte since the match can overlap the output, or start in the dictionary
+        for ( size_t i = 0; i < matchLen; ++i, ++pos )
+            dst[pos] = ( offset > pos ? dict[dictLen + pos - offset] : dst[pos - offset] );
+    }
+
+    return pos;
+}
+
+size_t lzCompressBound ( size_t srcLen )
+{
+    return srcLen + ( srcLen / 255 ) + 16;
+}
+
+string trainDictionary ( const vector<string>& samples, size_t dictSize )
+{
+    // Count the number of samples that contain each segment
+    unordered_map<string, uint32_t> counts;
+
+    for ( const string& sample : samples )
+    {
+        unordered_set<string> segments;
+
+        for ( size_t i = 0; i + DICT_SEGMENT_SIZE <= sample.size(); ++i )
+            segments.insert ( sample.substr ( i, DICT_SEGMENT_SIZE ) );
+
+        for ( const string& segment : segments )
+            ++counts[segment];
+    }
+
+    vector<pair<string, uint32_t>> sorted ( counts.begin(), counts.end() );
+
+    std::sort ( sorted.begin(), sorted.end(),
+                [] ( const pair<string, uint32_t>& a, const pair<string, uint32_t>& b )
+    {
+        return ( a.second != b.second ? a.second > b.second : a.first < b.first );
+    } );
+
+    // Keep the most common segments that appear in at least 2 samples
+    vector<string> kept;
+    size_t size = 0;
+
+    for ( const auto& kv : sorted )
+    {
+        if ( kv.second < 2 || size + DICT_SEGMENT_SIZE > dictSize )
+            break;
+
+        kept.push_back ( kv.first );
+        size += DICT_SEGMENT_SIZE;
+    }
+
+    // The most common segments go last, so they are closest to the data
+    string dict;
+    dict.reserve ( size );
+
+    for ( auto it = kept.rbegin(); it != kept.rend(); ++it )
+        dict += *it;
+
+    return dict;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 
 // MD5 calculation
@@ -14,3 +15,15 @@ bool checkMD5 ( const std::string& str, const char md5[16] );
 size_t compress ( const char *src, size_t srcLen, char *dst, size_t dstLen, int level = 9 );
 size_t uncompress ( const char *src, size_t srcLen, char *dst, size_t dstLen );
 size_t compressBound ( size_t srcLen );
+
+
+// Fast LZ compression, optionally with a preset dictionary that must be the same for both sides.
+// Returns 0 if dst is too small or the compressed data is invalid.
+size_t lzCompress ( const char *src, size_t srcLen, char *dst, size_t dstLen,
+                    const char *dict = 0, size_t dictLen = 0 );
+size_t lzUncompress ( const char *src, size_t srcLen, char *dst, size_t dstLen,
+                      const char *dict = 0, size_t dictLen = 0 );
+size_t lzCompressBound ( size_t srcLen );
+
+// Build a preset dictionary from sample data, by keeping the substrings common to the most samples
+std::string trainDictionary ( const std::vector<std::string>& samples, size_t dictSize );
@@ -254,6 +254,10 @@ private:
     // Controller states
     uint32_t _prevState = 0, _state = 0;
 
+    // Last published state and the time in microseconds it changed, see ControllerManager::publishSamples
+    uint32_t _sampledState = 0;
+    uint64_t _sampledChangedUs = 0;
+
     // Keyboard mappings
     KeyboardMappings _keyboardMappings;
 
@@ -1,12 +1,14 @@
 #include "ControllerManager.hpp"
 #include "Exceptions.hpp"
 #include "ErrorStrings.hpp"
+#include "TimerManager.hpp"
 
 #define INITGUID
 #define DIRECTINPUT_VERSION 0x0800 // Need at least version 8
 #include <dinput.h>
 #define COBJMACROS
 #include <windows.h>
+#include <mmsystem.h>
 
 #include <algorithm>
 #include <fstream>
@@ -224,9 +226,41 @@ bool ControllerManager::check()
         ++it;
     }
 
+    publishSamples();
     return true;
 }
 
+void ControllerManager::publishSamples()
+{
+    ControllerSamples latest;
+    latest.timestampUs = TimerManager::get().queryNowUs();
+
+    auto add = [&] ( Controller *controller )
+    {
+        if ( latest.count >= MAX_SAMPLED_CONTROLLERS )
+            return;
+
+        if ( controller->_state != controller->_sampledState )
+        {
+            controller->_sampledState = controller->_state;
+            controller->_sampledChangedUs = latest.timestampUs;
+        }
+
+        ControllerSamples::Sample& sample = latest.samples[latest.count++];
+        sample.controller = controller;
+        sample.isKeyboard = controller->isKeyboard();
+        sample.state = controller->_state;
+        sample.changedUs = controller->_sampledChangedUs;
+    };
+
+    add ( &keyboard );
+
+    for ( auto& kv : joysticks )
+        add ( kv.second.get() );
+
+    samples.store ( latest );
+}
+
 static BOOL CALLBACK enumJoystickAxes ( const DIDEVICEOBJECTINSTANCE *ddoi, void *userPtr )
 {
     if ( ! ( ddoi->dwType & DIDFT_AXIS ) )
@@ -818,10 +852,15 @@ MsgPtr ControllerManager::loadMappings ( const string& file )
 
 void ControllerManager::PollingThread::run()
 {
+    // Sleep ( 1 ) can take up to the system timer resolution, which defaults to ~15ms
+    timeBeginPeriod ( 1 );
+
     while ( ControllerManager::get().check() )
     {
         Sleep ( 1 );
     }
+
+    timeEndPeriod ( 1 );
 }
 
 void ControllerManager::startHighFreqPolling()
@@ -4,6 +4,7 @@
 #include "JoystickDetector.hpp"
 #include "Guid.hpp"
 #include "Thread.hpp"
+#include "SeqLock.hpp"
 
 #include <unordered_map>
 #include <unordered_set>
@@ -11,6 +12,50 @@
 #include <vector>
 
 
+// The maximum number of controllers in each ControllerSamples
+#define MAX_SAMPLED_CONTROLLERS ( 16 )
+
+
+// Timestamped states of all the controllers, published after every check
+struct ControllerSamples
+{
+    struct Sample
+    {
+        // The sampled controller, ONLY used as a key, since it may be detached after this was published
+        const Controller *controller;
+
+        // Indicates if this is the keyboard controller
+        bool isKeyboard;
+
+        // Controller state, see Controller::getState
+        uint32_t state;
+
+        // Time in microseconds when the state last changed
+        uint64_t changedUs;
+    };
+
+    // Time in microseconds when these states were sampled
+    uint64_t timestampUs = 0;
+
+    // Number of valid samples
+    uint32_t count = 0;
+
+    Sample samples[MAX_SAMPLED_CONTROLLERS];
+
+    // Find the sample for a controller, returns null if not found
+    const Sample *find ( const Controller *controller ) const
+    {
+        for ( uint32_t i = 0; i < count; ++i )
+        {
+            if ( samples[i].controller == controller )
+                return &samples[i];
+        }
+
+        return 0;
+    }
+};
+
+
 struct ControllerMappings : public SerializableSequence
 {
     std::unordered_map<std::string, MsgPtr> mappings;
@@ -87,6 +132,9 @@ public:
     // Start the high frequency polling thread
     void startHighFreqPolling();
 
+    // Get the latest controller states, this doesn't lock so it can be called while the polling thread is checking
+    ControllerSamples getLatestSamples() const { return samples.load(); }
+
     // Save / load mappings to / from a folder, returns the number of mappings saved / loaded
     size_t saveMappings ( const std::string& folder, const std::string& ext ) const;
     size_t loadMappings ( const std::string& folder, const std::string& ext );
@@ -120,6 +168,12 @@ private:
     // Main mutex
     mutable Mutex mutex;
 
+    // Latest controller states, ONLY written while holding the main mutex
+    SeqLock<ControllerSamples> samples;
+
+    // Publish the current controller states
+    void publishSamples();
+
     // Thread that polls the controllers at a high frequency
     class PollingThread : public Thread
     {
@@ -8,31 +8,41 @@
 #include <windows.h>
 #include <mmsystem.h>
 
+#include <algorithm>
+
 using namespace std;
 
 
 #define DEFAULT_TIMEOUT_MILLISECONDS ( 1000 )
 
 
-void EventManager::checkEvents ( uint64_t timeout )
+bool EventManager::checkEvents ( uint64_t timeout )
 {
     if ( ! _running )
-        return;
+        return false;
 
     ASSERT ( TimerManager::get().isInitialized() == true );
     ASSERT ( SocketManager::get().isInitialized() == true );
 
-    TimerManager::get().check();
+    if ( TimerManager::get().check() )
+        return true;
+
+    if ( ! _running )
+        return false;
+
+    if ( checkSources() )
+        return true;
 
     if ( ! _running )
-        return;
+        return false;
 
-    if ( TimerManager::get().getNextExpiry() != UINT64_MAX )
+    if ( TimerManager::get().getNextExpiryUs() != UINT64_MAX )
     {
         uint64_t newTimeout = 1;
 
-        if ( TimerManager::get().getNextExpiry() > TimerManager::get().getNow() )
-            newTimeout = TimerManager::get().getNextExpiry() - TimerManager::get().getNow();
+        // Round up to the next millisecond so we don't wake up before the timer expires
+        if ( TimerManager::get().getNextExpiryUs() > TimerManager::get().getNowUs() )
+            newTimeout = ( TimerManager::get().getNextExpiryUs() - TimerManager::get().getNowUs() + 999 ) / 1000;
 
         if ( newTimeout < timeout )
             timeout = newTimeout;
@@ -40,7 +50,40 @@ void EventManager::checkEvents ( uint64_t timeout )
 
     ASSERT ( timeout > 0 );
 
-    SocketManager::get().check ( timeout );
+    return SocketManager::get().check ( timeout );
+}
+
+bool EventManager::checkSources()
+{
+    if ( _sources.empty() )
+        return false;
+
+    // Copy the list since sources can be removed while dispatching
+    const vector<Source *> sources = _sources;
+
+    bool dispatched = false;
+
+    for ( Source *source : sources )
+    {
+        if ( find ( _sources.begin(), _sources.end(), source ) == _sources.end() )
+            continue;
+
+        if ( source->checkSource() )
+            dispatched = true;
+    }
+
+    return dispatched;
+}
+
+void EventManager::addSource ( Source *source )
+{
+    if ( find ( _sources.begin(), _sources.end(), source ) == _sources.end() )
+        _sources.push_back ( source );
+}
+
+void EventManager::removeSource ( Source *source )
+{
+    _sources.erase ( remove ( _sources.begin(), _sources.end(), source ), _sources.end() );
 }
 
 void EventManager::eventLoop()
@@ -50,10 +93,7 @@ void EventManager::eventLoop()
         timeBeginPeriod ( 1 ); // for select, see comment in SocketManager
 
         while ( _running )
-        {
-            Sleep ( 1 );
             checkEvents ( DEFAULT_TIMEOUT_MILLISECONDS );
-        }
 
         timeEndPeriod ( 1 ); // for select, see comment in SocketManager
     }
@@ -62,10 +102,7 @@ void EventManager::eventLoop()
         timeBeginPeriod ( 1 ); // for timeGetTime AND select
 
         while ( _running )
-        {
-            Sleep ( 1 );
             checkEvents ( DEFAULT_TIMEOUT_MILLISECONDS );
-        }
 
         timeEndPeriod ( 1 ); // for timeGetTime AND select
     }
@@ -87,7 +124,9 @@ bool EventManager::poll ( uint64_t timeout )
 
     while ( now < end )
     {
-        checkEvents ( end - now );
+        // Return as soon as something happens
+        if ( checkEvents ( end - now ) )
+            break;
 
         if ( ! _running )
             break;
@@ -135,11 +174,19 @@ void EventManager::stop()
 
     _running = false;
 
+    // Wake up the event loop so it stops immediately
+    wake();
+
     // LOG ( "Joining reaper thread" );
     // _reaperThread.join();
     // LOG ( "Joined reaper thread" );
 }
 
+void EventManager::wake()
+{
+    SocketManager::get().wake();
+}
+
 void EventManager::release()
 {
     LOG ( "Releasing everything" );
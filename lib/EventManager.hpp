@@ -4,6 +4,7 @@
 #include "BlockingQueue.hpp"
 
 #include <memory>
+#include <vector>
 
 
 #define CHECK_TIMERS        0x0001
@@ -15,15 +16,30 @@ class EventManager
 {
 public:
 
+    // Interface for other sources of events, these are checked before blocking on sockets
+    struct Source
+    {
+        // Dispatch any pending events without blocking, returns true if any events were dispatched
+        virtual bool checkSource() = 0;
+    };
+
+    // Add / remove an event source, sources should call wake when they have pending events
+    void addSource ( Source *source );
+    void removeSource ( Source *source );
+
     // Add a thread to be joined on the reaper thread, aka garbage collected when it finishes
     void addThread ( const ThreadPtr& thread );
 
     // Start the EventManager for polling, doesn't block
     void startPolling();
 
-    // Poll for events instead of start / stop, returns false if the EventManager has been stopped
+    // Poll for events instead of start / stop, returns false if the EventManager has been stopped.
+    // Returns as soon as any socket or timer events are dispatched, or wake is called, or the timeout.
     bool poll ( uint64_t timeout );
 
+    // Wake up a blocking poll or event loop, can be called on a different thread
+    void wake();
+
     // Start the EventManager, blocks until stop is called
     void start();
 
@@ -58,8 +74,14 @@ private:
     // Flag to indicate the event loop is running
     volatile bool _running = false;
 
-    // Check for events
-    void checkEvents ( uint64_t timeout );
+    // Other sources of events
+    std::vector<Source *> _sources;
+
+    // Check the other sources of events, returns true if any events were dispatched
+    bool checkSources();
+
+    // Check for events, blocks until the next event or the timeout, returns true if any events were dispatched
+    bool checkEvents ( uint64_t timeout );
 
     // Main event loop
     void eventLoop();
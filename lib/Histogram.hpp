@@ -0,0 +1,122 @@
+#pragma once
+
+#include "Protocol.hpp"
+
+#include <cereal/types/array.hpp>
+
+#include <array>
+#include <algorithm>
+
+
+// Number of sub-buckets per power of 2, so each bucket is at most 1/8 = 12.5% wider than its lower bound
+#define HISTOGRAM_SUB_BITS      ( 3 )
+#define HISTOGRAM_SUB_BUCKETS   ( 1 << HISTOGRAM_SUB_BITS )
+
+// Total number of buckets, values past the last bucket are counted in it
+#define HISTOGRAM_BUCKETS       ( 128 )
+
+// Resolution of the samples, ie counted in units of 1 / HISTOGRAM_UNITS; for latencies that is 0.1 ms
+#define HISTOGRAM_UNITS         ( 10 )
+
+
+// Log bucketed histogram (HDR style) to complement Statistics with percentiles. It has a fixed size, so it can
+// be sent in a single packet, and histograms of the same samples can be merged. Values up to 2^(SUB_BITS + 1)
+// units are counted exactly, after that each power of 2 is split into SUB_BUCKETS buckets.
+class Histogram : public SerializableSequence
+{
+public:
+
+    template<typename T>
+    void addSample ( T value )
+    {
+        const uint32_t units = ( value <= 0 ? 0 : uint32_t ( std::min ( double ( value ) * HISTOGRAM_UNITS, 4e9 ) ) );
+
+        if ( units > _max )
+            _max = units;
+
+        ++_buckets[getBucket ( units )];
+        ++_count;
+    }
+
+    void reset()
+    {
+        _count = _max = 0;
+        _buckets.fill ( 0 );
+    }
+
+    size_t getNumSamples() const
+    {
+        return _count;
+    }
+
+    // Get the value at the given percentile [0,100], which is the upper bound of the bucket it falls in,
+    // but never more than the largest sample.
+    double getPercentile ( double percentile ) const
+    {
+        if ( _count < 1 )
+            return 0;
+
+        const double target = std::max ( 1.0, _count * percentile / 100.0 );
+
+        size_t count = 0, i = 0;
+
+        for ( ; i + 1 < HISTOGRAM_BUCKETS; ++i )
+        {
+            count += _buckets[i];
+
+            if ( count >= target )
+                break;
+        }
+
+        // The last bucket has no upper bound
+        const uint32_t units = ( i + 1 == HISTOGRAM_BUCKETS ? _max : std::min ( getUpperBound ( i ), _max ) );
+
+        return units / double ( HISTOGRAM_UNITS );
+    }
+
+    void merge ( const Histogram& histogram )
+    {
+        for ( size_t i = 0; i < HISTOGRAM_BUCKETS; ++i )
+            _buckets[i] += histogram._buckets[i];
+
+        _max = std::max ( _max, histogram._max );
+        _count += histogram._count;
+    }
+
+    PROTOCOL_MESSAGE_BOILERPLATE ( Histogram, _count, _max, _buckets )
+
+private:
+
+    // Number of samples
+    uint32_t _count = 0;
+
+    // Largest sample in units
+    uint32_t _max = 0;
+
+    // Number of samples in each bucket
+    std::array<uint32_t, HISTOGRAM_BUCKETS> _buckets = {{ 0 }};
+
+    static size_t getBucket ( uint32_t units )
+    {
+        uint32_t shift = 0;
+
+        while ( ( units >> shift ) >= 2 * HISTOGRAM_SUB_BUCKETS )
+            ++shift;
+
+        // The top SUB_BITS + 1 bits select the sub-bucket, starting at SUB_BUCKETS for each shift
+        const size_t bucket = shift * HISTOGRAM_SUB_BUCKETS + ( units >> shift );
+
+        return std::min<size_t> ( bucket, HISTOGRAM_BUCKETS - 1 );
+    }
+
+    // Exclusive upper bound of a bucket in units
+    static uint32_t getUpperBound ( size_t bucket )
+    {
+        if ( bucket < 2 * HISTOGRAM_SUB_BUCKETS )
+            return bucket + 1;
+
+        const uint32_t shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+
+        return ( bucket % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS + 1 ) << shift;
+    }
+};
@@ -1,9 +1,23 @@
 #include "HttpDownload.hpp"
 #include "Logger.hpp"
 
+#include <windows.h>
+
+#include <algorithm>
+
 using namespace std;
 
 
+// Suffix of the incomplete file
+#define PART_SUFFIX ".part"
+
+// Minimum size of each parallel range request
+#define MIN_SEGMENT_SIZE ( 256 * 1024 )
+
+// Size of each read when resuming
+#define RESUME_BUFFER_SIZE ( 64 * 1024 )
+
+
 HttpDownload::HttpDownload ( Owner *owner, const string& url, const string& file )
     : owner ( owner )
     , url ( url )
@@ -11,56 +25,262 @@ HttpDownload::HttpDownload ( Owner *owner, const string& url, const string& file
 
 void HttpDownload::httpResponse ( HttpGet *httpGet, int code, const string& data, uint32_t remainingBytes )
 {
-    ASSERT ( _httpGet.get() == httpGet );
+    const auto it = find_if ( _segments.begin(), _segments.end(),
+                              [httpGet] ( const Segment & segment ) { return segment.httpGet.get() == httpGet; } );
+
+    ASSERT ( it != _segments.end() );
+
+    Segment& segment = *it;
 
-    LOG ( "Received HTTP response (%d): [ %u bytes ]", code, data.size() );
+    LOG ( "Received HTTP response (%d): [ %u bytes ]; begin=%u; end=%u; receivedBytes=%u",
+          code, data.size(), segment.begin, segment.end, segment.receivedBytes );
 
-    if ( code != 200 )
+    if ( code != 200 && code != 206 )
     {
-        httpFailed ( httpGet );
+        // The existing file.part is no good if the range can't be satisfied
+        if ( code == 416 && &segment == &_segments[0] )
+            DeleteFile ( ( file + PART_SUFFIX ).c_str() );
+
+        fail();
         return;
     }
 
-    _outputFile.write ( &data[0], data.size() );
+    const bool firstResponse = ! segment.responded;
 
-    if ( remainingBytes > 0 )
-        return;
+    if ( firstResponse )
+    {
+        segment.responded = true;
 
-    stop();
+        const uint32_t contentBegin = ( code == 206 ? httpGet->getContentBegin() : 0 );
 
-    if ( owner )
-        owner->downloadComplete ( this );
+        if ( contentBegin != segment.begin )
+        {
+            LOG ( "Server ignored range: contentBegin=%u", contentBegin );
+
+            // Start over next time if the server doesn't support resuming
+            if ( &segment == &_segments[0] )
+                DeleteFile ( ( file + PART_SUFFIX ).c_str() );
+
+            fail();
+            return;
+        }
+
+        if ( _totalBytes == 0 )
+            _totalBytes = httpGet->getTotalLength();
+
+        if ( segment.end == 0 )
+            segment.end = _totalBytes;
+    }
+
+    // Ignore any bytes past the end of this segment
+    const uint32_t len = min<size_t> ( data.size(), segment.end - segment.begin - segment.receivedBytes );
+
+    segment.buffer.append ( data, 0, len );
+    segment.receivedBytes += len;
+
+    if ( segment.begin + segment.receivedBytes == segment.end )
+        segment.httpGet.reset();
+
+    flush();
+
+    uint32_t downloadedBytes = _resumedBytes;
+
+    for ( const Segment& s : _segments )
+        downloadedBytes += s.receivedBytes;
+
+    if ( owner && _totalBytes )
+        owner->downloadProgress ( this, downloadedBytes, _totalBytes );
+
+    if ( _writtenBytes == _totalBytes )
+    {
+        finish();
+        return;
+    }
+
+    if ( firstResponse && code == 206 && _segments.size() == 1 && connections > 1 )
+        split();
 }
 
 void HttpDownload::httpFailed ( HttpGet *httpGet )
 {
-    ASSERT ( _httpGet.get() == httpGet );
-
     LOG ( "Download failed for: %s", httpGet->url );
 
+    // Failures while starting requests are handled after they have all been started
+    if ( _starting )
+    {
+        _startFailed = true;
+        return;
+    }
+
+    fail();
+}
+
+void HttpDownload::start()
+{
     stop();
 
-    if ( owner )
-        owner->downloadFailed ( this );
+    _segments.clear();
+    _writtenBytes = 0;
+    _totalBytes = 0;
+
+    MD5_Init ( &_md5 );
+
+    resume();
+
+    _resumedBytes = _writtenBytes;
+
+    _outputFile.open ( ( file + PART_SUFFIX ).c_str(), ios::binary | ( _writtenBytes ? ios::app : ios::trunc ) );
+
+    Segment segment;
+    segment.httpGet.reset ( new HttpGet ( this, url, DEFAULT_GET_TIMEOUT, HttpGet::Incremental ) );
+    segment.httpGet->setRange ( _writtenBytes );
+    segment.begin = _writtenBytes;
+
+    _segments.push_back ( segment );
+
+    _segments[0].httpGet->start();
 }
 
-void HttpDownload::httpProgress ( HttpGet *httpGet, uint32_t receivedBytes, uint32_t totalBytes )
+void HttpDownload::stop()
 {
-    if ( owner )
-        owner->downloadProgress ( this, receivedBytes, totalBytes );
+    _outputFile.close();
+
+    _segments.clear();
 }
 
-void HttpDownload::start()
+void HttpDownload::resume()
 {
-    _outputFile.open ( file.c_str(), ios::binary );
+    ifstream fin ( ( file + PART_SUFFIX ).c_str(), ios::binary );
+
+    if ( ! fin.good() )
+        return;
+
+    string buffer ( RESUME_BUFFER_SIZE, '\0' );
+
+    while ( fin.read ( &buffer[0], buffer.size() ) || fin.gcount() > 0 )
+    {
+        const size_t len = fin.gcount();
+
+        MD5_Update ( &_md5, &buffer[0], len );
 
-    _httpGet.reset ( new HttpGet ( this, url, DEFAULT_GET_TIMEOUT, HttpGet::Incremental ) );
-    _httpGet->start();
+        if ( owner )
+            owner->downloadData ( this, &buffer[0], len );
+
+        _writtenBytes += len;
+    }
+
+    LOG ( "Resuming from %u bytes", _writtenBytes );
 }
 
-void HttpDownload::stop()
+void HttpDownload::split()
 {
-    _outputFile.close();
+    const uint32_t begin = _segments[0].begin;
+    const uint32_t count = min ( connections, ( _totalBytes - begin ) / MIN_SEGMENT_SIZE );
+
+    if ( count <= 1 )
+        return;
+
+    const uint32_t size = ( _totalBytes - begin ) / count;
+
+    if ( _segments[0].receivedBytes >= size )
+        return;
+
+    _segments[0].end = begin + size;
+
+    for ( uint32_t i = 1; i < count; ++i )
+    {
+        Segment segment;
+        segment.httpGet.reset ( new HttpGet ( this, url, DEFAULT_GET_TIMEOUT, HttpGet::Incremental ) );
+        segment.begin = begin + i * size;
+        segment.end = ( i + 1 == count ? _totalBytes : segment.begin + size );
+        segment.httpGet->setRange ( segment.begin, segment.end );
+
+        _segments.push_back ( segment );
+    }
 
-    _httpGet.reset();
+    LOG ( "Split into %u segments of %u bytes", count, size );
+
+    _starting = true;
+    _startFailed = false;
+
+    for ( uint32_t i = 1; i < count; ++i )
+        _segments[i].httpGet->start();
+
+    _starting = false;
+
+    if ( _startFailed )
+        fail();
+}
+
+void HttpDownload::flush()
+{
+    for ( bool flushed = true; flushed; )
+    {
+        flushed = false;
+
+        for ( Segment& segment : _segments )
+        {
+            if ( segment.buffer.empty() || segment.begin + segment.receivedBytes - segment.buffer.size() != _writtenBytes )
+                continue;
+
+            _outputFile.write ( &segment.buffer[0], segment.buffer.size() );
+
+            MD5_Update ( &_md5, &segment.buffer[0], segment.buffer.size() );
+
+            if ( owner )
+                owner->downloadData ( this, &segment.buffer[0], segment.buffer.size() );
+
+            _writtenBytes += segment.buffer.size();
+
+            segment.buffer.clear();
+            flushed = true;
+        }
+    }
+}
+
+void HttpDownload::finish()
+{
+    const bool good = _outputFile.good();
+
+    stop();
+
+    unsigned char digest[16];
+    MD5_Final ( digest, &_md5 );
+
+    string hash;
+    for ( unsigned char c : digest )
+        hash += format ( "%02x", c );
+
+    LOG ( "Downloaded %u bytes; md5=%s", _writtenBytes, hash );
+
+    if ( ! md5.empty() && lowerCase ( md5 ) != hash )
+    {
+        LOG ( "Expected md5=%s", md5 );
+
+        DeleteFile ( ( file + PART_SUFFIX ).c_str() );
+
+        if ( owner )
+            owner->downloadFailed ( this );
+        return;
+    }
+
+    if ( ! good || ! MoveFileEx ( ( file + PART_SUFFIX ).c_str(), file.c_str(), MOVEFILE_REPLACE_EXISTING ) )
+    {
+        LOG ( "Failed to write: %s", file );
+
+        if ( owner )
+            owner->downloadFailed ( this );
+        return;
+    }
+
+    if ( owner )
+        owner->downloadComplete ( this );
+}
+
+void HttpDownload::fail()
+{
+    stop();
+
+    if ( owner )
+        owner->downloadFailed ( this );
 }
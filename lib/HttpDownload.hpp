@@ -2,11 +2,16 @@
 
 #include "HttpGet.hpp"
 
+#include <md5.h>
+
 #include <string>
 #include <memory>
 #include <fstream>
+#include <vector>
 
 
+// Downloads to file.part first, then renames it to file once complete and the MD5 matches.
+// A download that was interrupted resumes from the end of the existing file.part with a range request.
 class HttpDownload : private HttpGet::Owner
 {
 public:
@@ -18,27 +23,81 @@ public:
         virtual void downloadFailed ( HttpDownload *httpDownload ) = 0;
 
         virtual void downloadProgress ( HttpDownload *httpDownload, uint32_t downloadedBytes, uint32_t totalBytes ) = 0;
+
+        // Called with the file contents in order, including the already downloaded bytes when resuming
+        virtual void downloadData ( HttpDownload *httpDownload, const char *bytes, size_t len ) {}
     };
 
     Owner *owner = 0;
 
     const std::string url, file;
 
+    // Maximum number of parallel range requests, once the total size is known
+    uint32_t connections = 1;
+
+    // Expected MD5 of the whole file in hex, not checked if empty
+    std::string md5;
+
     HttpDownload ( Owner *owner, const std::string& url, const std::string& file );
 
     void start();
 
     void stop();
 
+    // Number of bytes written to the file so far, these are kept if the download fails
+    uint32_t getDownloadedBytes() const { return _writtenBytes; }
+
 private:
 
+    // Range of the file downloaded by one request
+    struct Segment
+    {
+        std::shared_ptr<HttpGet> httpGet;
+
+        uint32_t begin = 0, end = 0, receivedBytes = 0;
+
+        // Indicates if the response headers were received
+        bool responded = false;
+
+        // Received bytes that haven't been written yet
+        std::string buffer;
+    };
+
+    std::vector<Segment> _segments;
+
     std::ofstream _outputFile;
 
-    std::shared_ptr<HttpGet> _httpGet;
+    MD5_CTX _md5;
+
+    // Bytes written to the file, ie the contiguous range received from the start of the file
+    uint32_t _writtenBytes = 0;
+
+    // Size of the whole file, 0 if unknown
+    uint32_t _totalBytes = 0;
+
+    // Bytes that were already downloaded when the download started
+    uint32_t _resumedBytes = 0;
+
+    // Set while starting parallel requests, so a failure is only handled once they have all been started
+    bool _starting = false, _startFailed = false;
+
+    // Hash and pass along the existing bytes of file.part
+    void resume();
+
+    // Split the remaining bytes across parallel range requests
+    void split();
+
+    // Write any buffered bytes that continue from the end of the file
+    void flush();
+
+    // Rename file.part to file after checking the MD5
+    void finish();
+
+    void fail();
 
     void httpResponse ( HttpGet *httpGet, int code, const std::string& data, uint32_t remainingBytes ) override;
 
     void httpFailed ( HttpGet *httpGet ) override;
 
-    void httpProgress ( HttpGet *httpGet, uint32_t receivedBytes, uint32_t totalBytes ) override;
+    void httpProgress ( HttpGet *httpGet, uint32_t receivedBytes, uint32_t totalBytes ) override {}
 };
@@ -2,6 +2,7 @@
 #include "TcpSocket.hpp"
 #include "Exceptions.hpp"
 
+#include <cstdio>
 #include <sstream>
 
 using namespace std;
@@ -42,12 +43,18 @@ void HttpGet::start()
     _headerBuffer.clear();
     _dataBuffer.clear();
     _remainingBytes = 0;
+    _contentLength = 0;
+    _contentBegin = 0;
+    _totalLength = 0;
 
-    LOG ( "Connecting to: '%s:80'", _host );
+    // Use the default port unless the URL has one
+    const string address = ( _host.find ( ':' ) == string::npos ? _host + ":80" : _host );
+
+    LOG ( "Connecting to: '%s'", address );
 
     try
     {
-        _socket = TcpSocket::connect ( this, _host + ":80", true, timeout ); // Raw socket
+        _socket = TcpSocket::connect ( this, address, true, timeout ); // Raw socket
     }
     catch ( ... )
     {
@@ -64,7 +71,15 @@ void HttpGet::socketConnected ( Socket *socket )
 {
     ASSERT ( _socket.get() == socket );
 
-    const string request = format ( "GET %s HTTP/1.1\r\nUser-Agent: %s\r\nHost: %s\r\n\r\n", _path, USER_AGENT, _host );
+    string range;
+
+    if ( _rangeEnd )
+        range = format ( "Range: bytes=%u-%u\r\n", _rangeBegin, _rangeEnd - 1 );
+    else if ( _range )
+        range = format ( "Range: bytes=%u-\r\n", _rangeBegin );
+
+    const string request = format ( "GET %s HTTP/1.1\r\nUser-Agent: %s\r\nHost: %s\r\n%s\r\n",
+                                    _path, USER_AGENT, _host, range );
 
     LOG ( "Sending request:\n%s", request );
 
@@ -143,12 +158,20 @@ void HttpGet::parseResponse ( const string& data )
         {
             _remainingBytes = _contentLength;
 
+            if ( _statusCode != 206 )
+            {
+                _contentBegin = 0;
+                _totalLength = _contentLength;
+            }
+
             // Get the remaining response bytes from the header buffer
             const size_t responseBytes = ss.rdbuf()->in_avail();
 
+            // The body may arrive in a later read
             if ( responseBytes == 0 )
             {
-                finalize();
+                if ( _remainingBytes == 0 )
+                    finalize();
                 return;
             }
 
@@ -170,11 +193,26 @@ void HttpGet::parseResponse ( const string& data )
             LOG ( "contentLength=%u", _contentLength );
             continue;
         }
+
+        // Content-Range: bytes BEGIN-END/TOTAL
+        if ( header.find ( "Content-Range:" ) == 0 )
+        {
+            uint32_t end;
+
+            if ( sscanf ( header.c_str(), "Content-Range: bytes %u-%u/%u", &_contentBegin, &end, &_totalLength ) != 3 )
+                _contentBegin = _totalLength = 0;
+
+            LOG ( "contentBegin=%u; totalLength=%u", _contentBegin, _totalLength );
+            continue;
+        }
     }
 }
 
 void HttpGet::parseData ( const string& data )
 {
+    // The timeout is for each read, so long downloads don't time out
+    _timer->start ( timeout );
+
     _remainingBytes -= data.size();
 
     if ( owner && _contentLength )
@@ -36,12 +36,22 @@ public:
 
     void start();
 
+    // Only request the bytes from begin until end, or until the end of the file if end is 0, must be set before start.
+    // Servers that support ranges respond with 206 even for the whole file, others respond with 200.
+    void setRange ( uint32_t begin, uint32_t end = 0 ) { _range = true; _rangeBegin = begin; _rangeEnd = end; }
+
     int getStatusCode() const { return _statusCode; }
 
     const std::string& getResponse() const { return _dataBuffer; }
 
     uint32_t getContentLength() const { return _contentLength; }
 
+    // First byte of the response in the whole file, only non-zero for a partial (206) response
+    uint32_t getContentBegin() const { return _contentBegin; }
+
+    // Size of the whole file, from the Content-Range header, else the Content-Length
+    uint32_t getTotalLength() const { return _totalLength; }
+
 private:
 
     SocketPtr _socket;
@@ -54,7 +64,13 @@ private:
 
     std::string _headerBuffer, _dataBuffer;
 
-    uint32_t _contentLength, _remainingBytes;
+    uint32_t _contentLength = 0, _remainingBytes = 0;
+
+    uint32_t _contentBegin = 0, _totalLength = 0;
+
+    bool _range = false;
+
+    uint32_t _rangeBegin = 0, _rangeEnd = 0;
 
     void socketAccepted ( Socket *socket ) override {}
     void socketConnected ( Socket *socket ) override;
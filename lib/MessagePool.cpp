@@ -0,0 +1,146 @@
+#include "MessagePool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+using namespace std;
+
+
+namespace
+{
+
+// Free blocks are linked through their first bytes
+struct FreeBlock
+{
+    FreeBlock *next;
+};
+
+// All zero, so these are ready before any static constructors that might allocate messages
+struct Pool
+{
+    atomic_flag lock;
+    FreeBlock *head;
+    size_t blockSize;
+    uint32_t count;
+};
+
+Pool pools[MESSAGE_POOL_TYPES];
+
+atomic<uint32_t> heapAllocs, poolAllocs, heapFrees;
+
+class SpinLock
+{
+public:
+
+    SpinLock ( atomic_flag& flag ) : _flag ( flag )
+    {
+        while ( _flag.test_and_set ( memory_order_acquire ) )
+            ;
+    }
+
+    ~SpinLock()
+    {
+        _flag.clear ( memory_order_release );
+    }
+
+private:
+
+    atomic_flag& _flag;
+};
+
+} // namespace
+
+
+void *MessagePool::allocate ( uint8_t type, size_t size )
+{
+    Pool& pool = pools[type];
+
+    {
+        SpinLock lock ( pool.lock );
+
+        if ( pool.blockSize == 0 )
+            pool.blockSize = size;
+
+        if ( pool.head && size == pool.blockSize )
+        {
+            FreeBlock *block = pool.head;
+            pool.head = block->next;
+            --pool.count;
+
+            poolAllocs.fetch_add ( 1, memory_order_relaxed );
+            return block;
+        }
+    }
+
+    heapAllocs.fetch_add ( 1, memory_order_relaxed );
+    return ::operator new ( max ( size, sizeof ( FreeBlock ) ) );
+}
+
+void MessagePool::deallocate ( uint8_t type, void *ptr, size_t size )
+{
+    if ( ! ptr )
+        return;
+
+    Pool& pool = pools[type];
+
+    {
+        SpinLock lock ( pool.lock );
+
+        if ( size == pool.blockSize && pool.count < MESSAGE_POOL_MAX_FREE )
+        {
+            FreeBlock *block = static_cast<FreeBlock *> ( ptr );
+            block->next = pool.head;
+            pool.head = block;
+            ++pool.count;
+            return;
+        }
+    }
+
+    heapFrees.fetch_add ( 1, memory_order_relaxed );
+    ::operator delete ( ptr );
+}
+
+void MessagePool::clear()
+{
+    for ( Pool& pool : pools )
+    {
+        FreeBlock *head;
+
+        {
+            SpinLock lock ( pool.lock );
+
+            head = pool.head;
+            pool.head = 0;
+            pool.count = 0;
+        }
+
+        while ( head )
+        {
+            FreeBlock *next = head->next;
+            ::operator delete ( head );
+            head = next;
+        }
+    }
+}
+
+MessagePool::Stats MessagePool::getStats()
+{
+    Stats stats;
+    stats.heapAllocs = heapAllocs.load ( memory_order_relaxed );
+    stats.poolAllocs = poolAllocs.load ( memory_order_relaxed );
+    stats.heapFrees = heapFrees.load ( memory_order_relaxed );
+
+    for ( Pool& pool : pools )
+    {
+        SpinLock lock ( pool.lock );
+        stats.pooled += pool.count;
+    }
+
+    return stats;
+}
+
+void MessagePool::resetStats()
+{
+    heapAllocs = poolAllocs = heapFrees = 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Maximum number of free blocks kept for each message type, any extra blocks are returned to the heap
+#define MESSAGE_POOL_MAX_FREE   ( 64 )
+
+// Number of message types that can be pooled, indexed by MsgType
+#define MESSAGE_POOL_TYPES      ( 256 )
+
+
+// Free-list pools for message memory, one per MsgType, so the steady stream of inputs, acks, and GoBackN clones
+// mostly reuses blocks instead of going to the heap. Every protocol message gets class specific operator new
+// and delete from EMPTY_MESSAGE_BOILERPLATE, so this works for any "new Message()" call site.
+// Each pool only caches blocks of the size it first saw, so derived classes just fall through to the heap.
+// Pools are locked with a spinlock since messages can be freed on a different thread, see NetworkThread.
+class MessagePool
+{
+public:
+
+    // Allocation counters, for benchmarking
+    struct Stats
+    {
+        // Blocks allocated from the heap
+        uint32_t heapAllocs = 0;
+
+        // Blocks reused from a pool
+        uint32_t poolAllocs = 0;
+
+        // Blocks freed to the heap, ie not kept in a pool
+        uint32_t heapFrees = 0;
+
+        // Blocks currently kept in the pools
+        uint32_t pooled = 0;
+    };
+
+    static void *allocate ( uint8_t type, size_t size );
+
+    static void deallocate ( uint8_t type, void *ptr, size_t size );
+
+    // Return every free block to the heap
+    static void clear();
+
+    static Stats getStats();
+
+    static void resetStats();
+};
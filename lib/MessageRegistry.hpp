@@ -0,0 +1,111 @@
+#pragma once
+
+#include "Protocol.hpp"
+
+#include <array>
+
+
+// Compile time list of message types
+template<typename ... Ts>
+struct MessageList {};
+
+
+// Index sequence for building the decoder table
+template<size_t ... Is>
+struct MessageIndices {};
+
+template<size_t N, size_t ... Is>
+struct MakeMessageIndices : MakeMessageIndices < N - 1, N - 1, Is ... > {};
+
+template<size_t ... Is>
+struct MakeMessageIndices<0, Is ...>
+{
+    typedef MessageIndices<Is ...> type;
+};
+
+// Finds the decoder for a message type, by comparing against each type in the list
+template<typename ... Ts>
+struct FindMessageDecoder
+{
+    static constexpr Protocol::Decoder get ( size_t type ) { return 0; }
+};
+
+template<typename T, typename ... Ts>
+struct FindMessageDecoder<T, Ts ...>
+{
+    static constexpr Protocol::Decoder get ( size_t type )
+    {
+        return ( size_t ( T::MessageType ) == type ? &Protocol::decodeAs<T> : FindMessageDecoder<Ts ...>::get ( type ) );
+    }
+};
+
+// Calls the handler for the first type in the list that matches
+template<typename ... Ts>
+struct MessageDispatch
+{
+    template<typename Handler>
+    static bool call ( MsgType type, const MsgPtr& msg, Handler& handler ) { return false; }
+};
+
+template<typename T, typename ... Ts>
+struct MessageDispatch<T, Ts ...>
+{
+    template<typename Handler>
+    static bool call ( MsgType type, const MsgPtr& msg, Handler& handler )
+    {
+        if ( type != T::MessageType )
+            return MessageDispatch<Ts ...>::call ( type, msg, handler );
+
+        handler ( msg->getAs<T>() );
+        return true;
+    }
+};
+
+// Table of decoders indexed by MsgType, built at compile time from a list of message types.
+// Unlisted (ie deleted) message types have a null decoder.
+template<typename List>
+struct DecoderTable;
+
+template<typename ... Ts>
+struct DecoderTable<MessageList<Ts ...>>
+{
+    static const size_t Size = size_t ( MsgType::LastType );
+
+    static const std::array<Protocol::Decoder, Size> table;
+
+    static Protocol::Decoder get ( MsgType type )
+    {
+        return ( size_t ( type ) < Size ? table[size_t ( type )] : 0 );
+    }
+
+private:
+
+    template<size_t ... Is>
+    static constexpr std::array<Protocol::Decoder, Size> build ( MessageIndices<Is ...> )
+    {
+        return {{ FindMessageDecoder<Ts ...>::get ( Is ) ... }};
+    }
+};
+
+template<typename ... Ts>
+const std::array<Protocol::Decoder, DecoderTable<MessageList<Ts ...>>::Size> DecoderTable<MessageList<Ts ...>>::table =
+    DecoderTable<MessageList<Ts ...>>::build (
+        typename MakeMessageIndices<DecoderTable<MessageList<Ts ...>>::Size>::type() );
+
+
+// Call handler ( const T& ) with the message if its type is in the list, returns false if it isn't.
+// This only calls getMsgType once, the typed handlers are called directly.
+template<typename ... Ts, typename Handler>
+inline bool dispatchMessage ( MessageList<Ts ...>, const MsgPtr& msg, Handler&& handler )
+{
+    if ( ! msg )
+        return false;
+
+    return MessageDispatch<Ts ...>::call ( msg->getMsgType(), msg, handler );
+}
+
+template<typename ... Ts, typename Handler>
+inline bool dispatchMessage ( MessageList<Ts ...>, MsgType type, const MsgPtr& msg, Handler&& handler )
+{
+    return MessageDispatch<Ts ...>::call ( type, msg, handler );
+}
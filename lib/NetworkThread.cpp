@@ -0,0 +1,160 @@
+#include "NetworkThread.hpp"
+#include "EventManager.hpp"
+#include "Logger.hpp"
+
+using namespace std;
+
+
+// The maximum number of milliseconds to poll before checking if the thread should stop
+#define NETWORK_POLL_TIMEOUT ( 100 )
+
+
+void NetworkThread::post ( const Event& event )
+{
+    LOCK ( _eventsMutex );
+    _events.push_back ( event );
+    _eventsCond.signal();
+}
+
+void NetworkThread::dispatch()
+{
+    vector<Event> events;
+
+    {
+        LOCK ( _eventsMutex );
+        events.swap ( _events );
+    }
+
+    if ( events.empty() )
+        return;
+
+    GameLock lock ( this );
+
+    for ( const Event& event : events )
+        event();
+
+    // Events can hold the last reference to a socket or timer, so release them while still holding the lock
+    events.clear();
+}
+
+void NetworkThread::send ( const SocketPtr& socket, const MsgPtr& msg, const IpAddrPort& address )
+{
+    if ( ! socket )
+        return;
+
+    // Interrupt the network thread if it is blocked polling, so this is sent now
+    if ( outbound.push ( { socket, msg, address } ) )
+    {
+        EventManager::get().wake();
+        return;
+    }
+
+    // The queue is full, so send now with exclusive access
+    GameLock lock ( this );
+    socket->send ( msg, address );
+}
+
+void NetworkThread::waitEvents ( uint64_t timeout )
+{
+    LOCK ( _eventsMutex );
+
+    if ( _events.empty() && ! _stopping )
+        _eventsCond.wait ( _eventsMutex, timeout );
+}
+
+void NetworkThread::lockGame()
+{
+    {
+        LOCK ( _yieldMutex );
+        _gameWaiting = true;
+    }
+
+    // Interrupt the network thread if it is blocked polling
+    EventManager::get().wake();
+
+    _mutex.lock();
+}
+
+void NetworkThread::unlockGame()
+{
+    _mutex.unlock();
+
+    LOCK ( _yieldMutex );
+    _gameWaiting = false;
+    _yieldCond.signal();
+}
+
+void NetworkThread::flushOutbound()
+{
+    Outbound out;
+
+    while ( outbound.pop ( out ) )
+    {
+        if ( ! out.socket->isDisconnected() )
+            out.socket->send ( out.msg, out.address );
+    }
+}
+
+void NetworkThread::stop()
+{
+    _stopping = true;
+
+    {
+        LOCK ( _yieldMutex );
+        _yieldCond.signal();
+    }
+
+    {
+        LOCK ( _eventsMutex );
+        _eventsCond.signal();
+    }
+
+    EventManager::get().wake();
+}
+
+void NetworkThread::run()
+{
+    LOG ( "Network thread started" );
+
+    while ( ! _stopping )
+    {
+        {
+            LOCK ( _yieldMutex );
+
+            while ( _gameWaiting && ! _stopping )
+                _yieldCond.wait ( _yieldMutex );
+        }
+
+        LOCK ( _mutex );
+
+        if ( _stopping )
+            break;
+
+        _dispatching = true;
+
+        flushOutbound();
+
+        const bool running = EventManager::get().poll ( NETWORK_POLL_TIMEOUT );
+
+        flushOutbound();
+
+        _dispatching = false;
+
+        if ( ! running )
+            break;
+    }
+
+    _stopping = true;
+
+    // Unblock the game thread if it is waiting for events
+    LOCK ( _eventsMutex );
+    _eventsCond.signal();
+
+    LOG ( "Network thread stopped" );
+}
+
+void NetworkThread::join()
+{
+    stop();
+    Thread::join();
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "Thread.hpp"
+#include "Socket.hpp"
+#include "SpscQueue.hpp"
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+
+// Capacity of the outbound message queue
+#define NETWORK_QUEUE_SIZE ( 1024 )
+
+
+// Dedicated thread that polls the EventManager, so all socket and timer callbacks are dispatched on this thread.
+// Callbacks don't touch game state, instead they post events that the game thread runs in order with dispatch, so
+// this thread never waits for the game logic. Messages sent by the game thread are handed to this thread with the
+// outbound queue. The game thread only takes a GameLock while it uses sockets or timers directly, eg while running the
+// posted events. Taking a GameLock wakes the EventManager, which stops dispatching after the current socket, so the
+// game thread only waits for at most one callback.
+class NetworkThread : public Thread
+{
+public:
+
+    // Work posted by a callback on the network thread, to run on the game thread
+    typedef std::function<void()> Event;
+
+    // Message to be sent on the network thread
+    struct Outbound
+    {
+        SocketPtr socket;
+        MsgPtr msg;
+        IpAddrPort address;
+    };
+
+    // Exclusive access to sockets and timers for the game thread, interrupts the network thread if it is polling.
+    // Does nothing without a network thread, since then the game thread is the only one using them.
+    class GameLock
+    {
+    public:
+
+        GameLock ( NetworkThread *thread ) : _thread ( thread ) { if ( _thread ) _thread->lockGame(); }
+        ~GameLock() { if ( _thread ) _thread->unlockGame(); }
+
+    private:
+
+        NetworkThread *_thread;
+    };
+
+    // Messages to send, ONLY pushed by the game thread and popped by the network thread
+    SpscQueue<Outbound, NETWORK_QUEUE_SIZE> outbound;
+
+    // Post an event from a callback on the network thread, then wake up the game thread
+    void post ( const Event& event );
+
+    // Run the posted events in order while holding a GameLock, ONLY called by the game thread.
+    // The queue is only locked to swap it out, so callbacks can keep posting while the events run.
+    void dispatch();
+
+    // Send a message from the game thread, this is queued unless the queue is full
+    void send ( const SocketPtr& socket, const MsgPtr& msg, const IpAddrPort& address = NullAddress );
+
+    // Block until events are posted, or the timeout in milliseconds, or the thread stops.
+    // ONLY called by the game thread, without holding a GameLock.
+    void waitEvents ( uint64_t timeout );
+
+    // Indicates if the caller is a callback dispatched on the network thread.
+    // ONLY valid on the network thread, or on the game thread while holding a GameLock.
+    bool isDispatching() const { return _dispatching; }
+
+    // Stop the thread, doesn't stop the EventManager
+    void stop();
+
+    // Stops and joins the thread
+    ~NetworkThread() { join(); }
+
+    // Thread functions
+    void run() override;
+    void join() override;
+
+private:
+
+    // Held by the network thread while polling, and by the game thread while holding a GameLock
+    Mutex _mutex;
+
+    // Indicates the game thread is waiting for exclusive access, so the network thread should yield
+    bool _gameWaiting = false;
+
+    // Indicates the network thread is dispatching callbacks, ONLY accessed while holding _mutex
+    bool _dispatching = false;
+
+    // Flag to stop the thread
+    std::atomic<bool> _stopping { false };
+
+    // Signalled when the game thread is done with exclusive access
+    Mutex _yieldMutex;
+    CondVar _yieldCond;
+
+    // Posted events, ONLY accessed while holding _eventsMutex, which is signalled when events are posted
+    std::vector<Event> _events;
+    Mutex _eventsMutex;
+    CondVar _eventsCond;
+
+    // Acquire / release exclusive access for the game thread
+    void lockGame();
+    void unlockGame();
+
+    // Send all the outbound messages, ONLY called on the network thread
+    void flushOutbound();
+};
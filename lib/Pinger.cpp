@@ -25,7 +25,7 @@ void Pinger::start()
     ASSERT ( numPings > 0 );
 
     if ( owner )
-        owner->pingerSendPing ( this, MsgPtr ( new Ping ( TimerManager::get().getNow ( true ) ) ) );
+        owner->pingerSendPing ( this, MsgPtr ( new Ping ( TimerManager::get().getNowUs ( true ) ) ) );
 
     _pingCount = 1;
 
@@ -51,6 +51,7 @@ void Pinger::reset()
     stop();
 
     _stats.reset();
+    _histogram.reset();
     _packetLoss = 0;
 }
 
@@ -61,16 +62,18 @@ void Pinger::gotPong ( const MsgPtr& ping )
 
     if ( _pinging )
     {
-        const uint64_t now = TimerManager::get().getNow();
+        const uint64_t now = TimerManager::get().getNowUs ( true );
 
         if ( now < ping->getAs<Ping>().timestamp )
             return;
 
-        const uint64_t latency = ( now - ping->getAs<Ping>().timestamp ) / 2;
+        // Timestamps are in microseconds, but latency is in milliseconds
+        const double latency = ( now - ping->getAs<Ping>().timestamp ) / 2000.0;
 
-        LOG ( "latency=%llu ms", latency );
+        LOG ( "latency=%.3f ms", latency );
 
         _stats.addSample ( latency );
+        _histogram.addSample ( latency );
     }
     else
     {
@@ -90,14 +93,14 @@ void Pinger::timerExpired ( Timer *timer )
         _packetLoss = 100 * ( numPings - _stats.getNumSamples() ) / numPings;
 
         if ( owner )
-            owner->pingerCompleted ( this, _stats, _packetLoss );
+            owner->pingerCompleted ( this, _stats, _histogram, _packetLoss );
 
         stop();
         return;
     }
 
     if ( owner )
-        owner->pingerSendPing ( this, MsgPtr ( new Ping ( TimerManager::get().getNow() ) ) );
+        owner->pingerSendPing ( this, MsgPtr ( new Ping ( TimerManager::get().getNowUs() ) ) );
 
     ++_pingCount;
 
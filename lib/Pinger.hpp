@@ -3,10 +3,12 @@
 #include "Timer.hpp"
 #include "Protocol.hpp"
 #include "Statistics.hpp"
+#include "Histogram.hpp"
 
 
 struct Ping : public SerializableMessage
 {
+    // Local time in microseconds when the ping was sent
     uint64_t timestamp;
 
     Ping ( uint64_t timestamp ) : timestamp ( timestamp ) {}
@@ -25,7 +27,8 @@ public:
     {
         virtual void pingerSendPing ( Pinger *pinger, const MsgPtr& ping ) = 0;
 
-        virtual void pingerCompleted ( Pinger *pinger, const Statistics& stats, uint8_t packetLoss ) = 0;
+        virtual void pingerCompleted ( Pinger *pinger, const Statistics& stats, const Histogram& histogram,
+                                       uint8_t packetLoss ) = 0;
     };
 
     Owner *owner = 0;
@@ -48,6 +51,8 @@ public:
 
     const Statistics& getStats() const { return _stats; }
 
+    const Histogram& getHistogram() const { return _histogram; }
+
     uint8_t getPacketLoss() const { return _packetLoss; }
 
     bool isPinging() const { return _pinging; }
@@ -60,6 +65,8 @@ private:
 
     Statistics _stats;
 
+    Histogram _histogram;
+
     uint8_t _packetLoss = 0;
 
     bool _pinging = false;
@@ -1,10 +1,15 @@
 #include "Protocol.hpp"
 #include "Protocol.include.hpp"
+#include "MessageRegistry.hpp"
 #include "Protocol.inlineimpl.hpp"
+#include "ProtocolDictionary.hpp"
 #include "Compression.hpp"
 #include "Logger.hpp"
 #include "Enum.hpp"
 
+#include <array>
+#include <atomic>
+
 using namespace std;
 using namespace cereal;
 
@@ -13,6 +18,38 @@ using namespace cereal;
 // #define FORCE_COMPRESSION
 // #define DISABLE_UPDATE_HASH
 // #define DISABLE_CHECK_HASH
+// #define CAPTURE_PROTOCOL_CORPUS
+
+
+// Compression byte values for the extra codecs, otherwise the compression byte is the zlib level
+#define CODEC_FAST_LZ       ( 0x40 )
+#define CODEC_FAST_LZ_DICT  ( 0x41 )
+
+// Messages smaller than this are only compressed with the dictionary
+#define MIN_COMPRESS_SIZE ( 64 )
+
+// Messages up to this size are compressed with the dictionary
+#define MAX_DICT_COMPRESS_SIZE ( 512 )
+
+// Messages up to this size are compressed with the fast codec, larger messages use zlib
+#define MAX_FAST_COMPRESS_SIZE ( 256 * 1024 )
+
+// Number of messages of the same type to skip compressing, after compression didn't help
+#define COMPRESS_RETRY_INTERVAL ( 32 )
+
+// All message types, auto-generated from scanning all the headers
+typedef MessageList <
+#include "Protocol.typelist.hpp"
+> AllMessageTypes;
+
+typedef DecoderTable<AllMessageTypes> Decoders;
+
+#ifdef CAPTURE_PROTOCOL_CORPUS
+#include <fstream>
+
+// Raw message data is appended to this file, for training the dictionary with trainDictionary
+#define CORPUS_FILE "protocol.corpus"
+#endif
 
 
 /* Message binary structure:
@@ -20,7 +57,7 @@ using namespace cereal;
 Compressed:
 
     1 byte  message type
-    1 byte  compression level
+    1 byte  compression level (1-10) or codec
     4 byte  uncompressed size
     4 byte  compressed data size
     ...     compressed data
@@ -42,7 +79,7 @@ Not compressed:
 
 
 // Encode with compression
-string encodeStageTwo ( const MsgPtr& msg, const string& msgData );
+string encodeStageTwo ( const MsgPtr& msg, const string& msgData, uint8_t codecs );
 
 // Result of the decode
 ENUM ( DecodeResult, Failed, NotCompressed, Compressed );
@@ -51,22 +88,22 @@ ENUM ( DecodeResult, Failed, NotCompressed, Compressed );
 DecodeResult decodeStageTwo ( const char *bytes, size_t len, size_t& consumed, MsgType& type, string& msgData );
 
 
-string Protocol::encode ( const Serializable& message )
+string Protocol::encode ( const Serializable& message, uint8_t codecs )
 {
     MsgPtr msg ( const_cast<Serializable *> ( &message ), ignoreMsgPtr );
-    return encode ( msg );
+    return encode ( msg, codecs );
 }
 
-string Protocol::encode ( Serializable *message )
+string Protocol::encode ( Serializable *message, uint8_t codecs )
 {
     if ( ! message )
         return "";
 
     MsgPtr msg ( message );
-    return encode ( msg );
+    return encode ( msg, codecs );
 }
 
-string Protocol::encode ( const MsgPtr& msg )
+string Protocol::encode ( const MsgPtr& msg, uint8_t codecs )
 {
     if ( ! msg.get() )
         return "";
@@ -99,8 +136,19 @@ string Protocol::encode ( const MsgPtr& msg )
     // Encode hash at the end of message data
     archive ( msg->_hash );
 
+#ifdef CAPTURE_PROTOCOL_CORPUS
+    {
+        const string data = ss.str();
+        const uint32_t size = data.size();
+
+        ofstream fout ( CORPUS_FILE, ios::binary | ios::app );
+        fout.write ( ( const char * ) &size, sizeof ( size ) );
+        fout.write ( &data[0], data.size() );
+    }
+#endif // CAPTURE_PROTOCOL_CORPUS
+
     // Encode with compression
-    return encodeStageTwo ( msg, ss.str() );
+    return encodeStageTwo ( msg, ss.str(), codecs );
 }
 
 MsgPtr Protocol::decode ( const char *bytes, size_t len, size_t& consumed )
@@ -137,23 +185,19 @@ MsgPtr Protocol::decode ( const char *bytes, size_t len, size_t& consumed )
     istringstream ss ( data, stringstream::binary );
     BinaryInputArchive archive ( ss );
 
-    try
-    {
-        // Construct the correct message type
-        switch ( type )
-        {
-#include "Protocol.switchdecode.hpp"
+    // Find the decoder for the message type
+    const Protocol::Decoder decoder = Decoders::get ( type );
 
-            default:
-                consumed = 0;
-                return NullMsg;
-        }
-
-        // Decode base message data
-        msg->loadBase ( archive );
+    if ( ! decoder )
+    {
+        consumed = 0;
+        return NullMsg;
+    }
 
-        // Decode actual message data
-        msg->load ( archive );
+    try
+    {
+        // Construct the correct message type, and decode the base and actual message data
+        msg = decoder ( archive );
 
         // Decode hash at end of message data
         archive ( msg->_hash );
@@ -220,7 +264,91 @@ MsgPtr Protocol::decode ( const char *bytes, size_t len, size_t& consumed )
     return msg;
 }
 
-string encodeStageTwo ( const MsgPtr& msg, const string& msgData )
+string Protocol::encodeLocal ( const MsgPtr& msg )
+{
+    if ( ! msg.get() )
+        return "";
+
+    ostringstream ss ( stringstream::binary );
+    BinaryOutputArchive archive ( ss );
+
+    archive ( msg->getMsgType() );
+    msg->saveBase ( archive );
+    msg->save ( archive );
+
+    return ss.str();
+}
+
+MsgPtr Protocol::decodeLocal ( const char *bytes, size_t len )
+{
+    MsgPtr msg;
+
+    if ( len == 0 )
+        return NullMsg;
+
+    istringstream ss ( string ( bytes, len ), stringstream::binary );
+    BinaryInputArchive archive ( ss );
+
+    try
+    {
+        MsgType type;
+        archive ( type );
+
+        const Protocol::Decoder decoder = Decoders::get ( type );
+
+        if ( ! decoder )
+            return NullMsg;
+
+        msg = decoder ( archive );
+    }
+    catch ( ... )
+    {
+        return NullMsg;
+    }
+
+    if ( ss.rdbuf()->in_avail() != 0 )
+        return NullMsg;
+
+    return msg;
+}
+
+// Number of messages left to skip compressing for each message type, shared by every thread that encodes messages.
+// This is only a heuristic, so relaxed loads and stores are enough, a lost update just changes when we retry.
+static array<atomic<uint8_t>, 256> skipCompression;
+
+// Choose the codec for the message data, returns 0 for no compression
+static uint8_t chooseCodec ( const MsgPtr& msg, size_t size, uint8_t codecs )
+{
+    if ( ! msg->compressionLevel )
+        return 0;
+
+#ifndef FORCE_COMPRESSION
+    atomic<uint8_t>& skip = skipCompression[ ( uint8_t ) msg->getMsgType()];
+
+    const uint8_t count = skip.load ( memory_order_relaxed );
+
+    if ( count )
+    {
+        skip.store ( count - 1, memory_order_relaxed );
+        return 0;
+    }
+#endif
+
+    if ( ( codecs & Protocol::FastLzDict ) && size <= MAX_DICT_COMPRESS_SIZE )
+        return CODEC_FAST_LZ_DICT;
+
+#ifndef FORCE_COMPRESSION
+    if ( size < MIN_COMPRESS_SIZE )
+        return 0;
+#endif
+
+    if ( ( codecs & Protocol::FastLz ) && size <= MAX_FAST_COMPRESS_SIZE )
+        return CODEC_FAST_LZ;
+
+    return msg->compressionLevel;
+}
+
+string encodeStageTwo ( const MsgPtr& msg, const string& msgData, uint8_t codecs )
 {
     ostringstream ss ( stringstream::binary );
     BinaryOutputArchive archive ( ss );
@@ -228,30 +356,52 @@ string encodeStageTwo ( const MsgPtr& msg, const string& msgData )
     // Encode message type first without compression
     archive ( msg->getMsgType() );
 
+    const uint8_t codec = chooseCodec ( msg, msgData.size(), codecs );
+
     // Compress message data if needed
-    if ( msg->compressionLevel )
+    if ( codec )
     {
-        string buffer ( compressBound ( msgData.size() ), ( char ) 0 );
-        size_t size = compress ( &msgData[0], msgData.size(), &buffer[0], buffer.size(), msg->compressionLevel );
+        string buffer;
+        size_t size;
+
+        if ( codec == CODEC_FAST_LZ || codec == CODEC_FAST_LZ_DICT )
+        {
+            buffer.resize ( lzCompressBound ( msgData.size() ) );
+
+            if ( codec == CODEC_FAST_LZ_DICT )
+                size = lzCompress ( &msgData[0], msgData.size(), &buffer[0], buffer.size(),
+                                    protocolDictionary, sizeof ( protocolDictionary ) );
+            else
+                size = lzCompress ( &msgData[0], msgData.size(), &buffer[0], buffer.size() );
+        }
+        else
+        {
+            buffer.resize ( compressBound ( msgData.size() ) );
+            size = compress ( &msgData[0], msgData.size(), &buffer[0], buffer.size(), codec );
+        }
+
         buffer.resize ( size );
 
         // Only use compressed message data if actually smaller after the overhead
 #ifndef FORCE_COMPRESSION
-        if ( sizeof ( msgData.size() ) + sizeof ( buffer.size() ) + buffer.size() < msgData.size() )
+        if ( size && sizeof ( msgData.size() ) + sizeof ( buffer.size() ) + buffer.size() < msgData.size() )
 #endif
         {
-            archive ( msg->compressionLevel );
+            archive ( codec );
             archive ( msgData.size() );         // uncompressed size
             archive ( buffer );                 // compressed size + compressed data
             return ss.str();
         }
 
-        // Otherwise update compression level so we don't try to compress this again
+        // Otherwise update compression level so we don't try to compress this again,
+        // and skip compressing the next few messages of the same type.
         msg->compressionLevel = 0;
+        skipCompression[ ( uint8_t ) msg->getMsgType()].store ( COMPRESS_RETRY_INTERVAL, memory_order_relaxed );
     }
 
     // uncompressed data does not include uncompressedSize or any other sizes
-    archive ( msg->compressionLevel );
+    const uint8_t noCompression = 0;
+    archive ( noCompression );
     return ss.str() + msgData;
 }
 
@@ -309,7 +459,15 @@ DecodeResult decodeStageTwo ( const char *bytes, size_t len, size_t& consumed, M
     if ( compressionLevel )
     {
         string buffer ( uncompressedSize, ( char ) 0 );
-        size_t size = uncompress ( &msgData[0], msgData.size(), &buffer[0], buffer.size() );
+        size_t size;
+
+        if ( compressionLevel == CODEC_FAST_LZ_DICT )
+            size = lzUncompress ( &msgData[0], msgData.size(), &buffer[0], buffer.size(),
+                                  protocolDictionary, sizeof ( protocolDictionary ) );
+        else if ( compressionLevel == CODEC_FAST_LZ )
+            size = lzUncompress ( &msgData[0], msgData.size(), &buffer[0], buffer.size() );
+        else
+            size = uncompress ( &msgData[0], msgData.size(), &buffer[0], buffer.size() );
 
         if ( size != uncompressedSize )
         {
@@ -1,19 +1,27 @@
 #pragma once
 
 #include "Enum.hpp"
+#include "MessagePool.hpp"
 
 #include <cereal/archives/binary.hpp>
 
 #include <string>
+#include <atomic>
 #include <memory>
+#include <utility>
 #include <iostream>
 #include <sstream>
 
 
 #define EMPTY_MESSAGE_BOILERPLATE(NAME)                                                                     \
     NAME() {}                                                                                               \
+    static const MsgType MessageType = MsgType::NAME;                                                       \
     MsgPtr clone() const override;                                                                          \
-    MsgType getMsgType() const override;
+    MsgType getMsgType() const override;                                                                    \
+    static void *operator new ( size_t size )                                                               \
+        { return MessagePool::allocate ( ( uint8_t ) MsgType::NAME, size ); }                               \
+    static void operator delete ( void *ptr, size_t size )                                                  \
+        { MessagePool::deallocate ( ( uint8_t ) MsgType::NAME, ptr, size ); }
 
 #define DECLARE_MESSAGE_BOILERPLATE(NAME)                                                                   \
     EMPTY_MESSAGE_BOILERPLATE(NAME)                                                                         \
@@ -45,7 +53,7 @@ ENUM ( BaseType, SerializableMessage, SerializableSequence );
 
 // Common declarations
 struct Serializable;
-typedef std::shared_ptr<Serializable> MsgPtr;
+class MsgPtr;
 std::ostream& operator<< ( std::ostream& os, MsgType type );
 std::ostream& operator<< ( std::ostream& os, const MsgPtr& msg );
 std::ostream& operator<< ( std::ostream& os, const Serializable& msg );
@@ -54,24 +62,41 @@ std::ostream& operator<< ( std::ostream& os, const Serializable& msg );
 // Function that does nothing to a message pointer
 inline void ignoreMsgPtr ( Serializable * ) {}
 
-// Null message pointer
-const MsgPtr NullMsg;
-
 
 // Contains protocol methods
 class Protocol
 {
 public:
 
-    // Encode a message to a series of bytes
-    static std::string encode ( const Serializable& message );
-    static std::string encode ( Serializable *message );
-    static std::string encode ( const MsgPtr& msg );
+    // Extra codecs that can be used to encode messages, zlib is always supported.
+    // Decoding supports every codec, but encoding should only use the codecs the remote supports.
+    enum Codec : uint8_t { FastLz = 0x01, FastLzDict = 0x02 };
+
+    // All the extra codecs supported by this version. FastLzDict is left out until its dictionary is trained on
+    // captured traffic, see ProtocolDictionary.hpp, so it is only used when given explicitly.
+    static const uint8_t AllCodecs = FastLz;
+
+    // Encode a message to a series of bytes, using zlib or any of the given extra codecs
+    static std::string encode ( const Serializable& message, uint8_t codecs = 0 );
+    static std::string encode ( Serializable *message, uint8_t codecs = 0 );
+    static std::string encode ( const MsgPtr& msg, uint8_t codecs = 0 );
 
     // Decode a series of bytes into a message, consumed indicates the number of bytes read.
     // This returns null if the message failed to decode, NOTE consumed will still be updated.
     static MsgPtr decode ( const char *bytes, size_t len, size_t& consumed );
 
+    // Encode / decode a message without compression or hashing, ONLY for transports on the same machine.
+    // Decoding returns null if the message failed to decode or there are any unread bytes.
+    static std::string encodeLocal ( const MsgPtr& msg );
+    static MsgPtr decodeLocal ( const char *bytes, size_t len );
+
+    // Constructs and loads a message of a known type, see DecoderTable
+    typedef MsgPtr ( *Decoder ) ( cereal::BinaryInputArchive& ar );
+
+    // Decoder for type T, the base and message data are loaded without any virtual calls
+    template<typename T>
+    static MsgPtr decodeAs ( cereal::BinaryInputArchive& ar );
+
     static bool checkMsgType ( MsgType type )
     {
         return ( type > MsgType::FirstType && type < MsgType::LastType );
@@ -88,6 +113,18 @@ public:
     Serializable();
     virtual ~Serializable() {}
 
+    // Copies never share the reference count
+    Serializable ( const Serializable& other )
+        : compressionLevel ( other.compressionLevel ), _hash ( other._hash ), _hashValid ( other._hashValid ) {}
+
+    Serializable& operator= ( const Serializable& other )
+    {
+        compressionLevel = other.compressionLevel;
+        _hash = other._hash;
+        _hashValid = other._hashValid;
+        return *this;
+    }
+
     // Return a clone
     virtual MsgPtr clone() const = 0;
 
@@ -109,7 +146,8 @@ public:
     // Return a string representation of this message, defaults to the message type
     virtual std::string str() const { std::stringstream ss; ss << getMsgType(); return ss.str(); }
 
-    // Flag to indicate compression level
+    // Flag to indicate zlib compression level, 0 to disable compression for this message.
+    // Small and medium messages may use a faster codec instead, see Protocol::encode.
     mutable uint8_t compressionLevel;
 
 private:
@@ -120,10 +158,14 @@ private:
     mutable HashType _hash;
     mutable bool _hashValid = true;
 
+    // Number of owning MsgPtrs
+    mutable std::atomic<uint32_t> _refCount { 0 };
+
     // Serialize and deserialize the base type
     virtual void saveBase ( cereal::BinaryOutputArchive& ar ) const {}
     virtual void loadBase ( cereal::BinaryInputArchive& ar ) {}
 
+    friend class MsgPtr;
     friend struct Protocol;
     friend struct SerializableMessage;
     friend struct SerializableSequence;
@@ -174,4 +216,94 @@ private:
 
     void saveBase ( cereal::BinaryOutputArchive& ar ) const override { ar ( _sequence ); };
     void loadBase ( cereal::BinaryInputArchive& ar ) override { ar ( _sequence ); };
+
+    friend class Protocol;
+};
+
+
+// Intrusive reference counted message pointer, a drop-in for the std::shared_ptr<Serializable> this used to be.
+// The count lives in the message itself, so there is no separate control block allocation. It stays atomic
+// since messages are passed between threads, see NetworkThread.
+class MsgPtr
+{
+public:
+
+    MsgPtr() {}
+    MsgPtr ( std::nullptr_t ) {}
+
+    // Take ownership of a newly allocated message
+    explicit MsgPtr ( Serializable *msg ) : _msg ( msg ) { retain(); }
+
+    // Non-owning pointer, ie MsgPtr ( &msg, ignoreMsgPtr ), the caller must keep the message alive.
+    // Only ignoreMsgPtr is supported as the deleter.
+    MsgPtr ( Serializable *msg, void ( * ) ( Serializable * ) ) : _msg ( msg ), _owned ( false ) {}
+
+    MsgPtr ( const MsgPtr& other ) : _msg ( other._msg ), _owned ( other._owned ) { retain(); }
+
+    MsgPtr ( MsgPtr&& other ) : _msg ( other._msg ), _owned ( other._owned ) { other._msg = 0; }
+
+    ~MsgPtr() { release(); }
+
+    MsgPtr& operator= ( MsgPtr other )
+    {
+        std::swap ( _msg, other._msg );
+        std::swap ( _owned, other._owned );
+        return *this;
+    }
+
+    void reset() { MsgPtr().swap ( *this ); }
+    void reset ( Serializable *msg ) { MsgPtr ( msg ).swap ( *this ); }
+
+    void swap ( MsgPtr& other )
+    {
+        std::swap ( _msg, other._msg );
+        std::swap ( _owned, other._owned );
+    }
+
+    Serializable *get() const { return _msg; }
+    Serializable *operator->() const { return _msg; }
+    Serializable& operator*() const { return *_msg; }
+
+    explicit operator bool() const { return _msg; }
+
+    bool operator== ( const MsgPtr& other ) const { return _msg == other._msg; }
+    bool operator!= ( const MsgPtr& other ) const { return _msg != other._msg; }
+    bool operator== ( std::nullptr_t ) const { return ! _msg; }
+    bool operator!= ( std::nullptr_t ) const { return _msg; }
+
+private:
+
+    Serializable *_msg = 0;
+
+    bool _owned = true;
+
+    void retain()
+    {
+        if ( _msg && _owned )
+            _msg->_refCount.fetch_add ( 1, std::memory_order_relaxed );
+    }
+
+    void release()
+    {
+        if ( _msg && _owned && _msg->_refCount.fetch_sub ( 1, std::memory_order_acq_rel ) == 1 )
+            delete _msg;
+    }
 };
+
+
+// Null message pointer
+const MsgPtr NullMsg;
+
+
+template<typename T>
+MsgPtr Protocol::decodeAs ( cereal::BinaryInputArchive& ar )
+{
+    T *message = new T();
+    MsgPtr msg ( message );
+
+    // Qualified calls, since the type is already known
+    message->T::loadBase ( ar );
+    message->T::load ( ar );
+
+    return msg;
+}
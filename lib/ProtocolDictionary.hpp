@@ -0,0 +1,38 @@
+#pragma once
+
+
+// Preset dictionary used to compress small messages with Protocol::FastLzDict.
+//
+// Both sides must use exactly the same bytes, so changing this needs a new codec flag.
+// This is hand-seeded, not trained on captured traffic, with common serialized field patterns: zero runs,
+// small little-endian integers, string / array size prefixes, and repeated input values. Since it was never measured
+// against real traffic, Protocol::AllCodecs doesn't include FastLzDict. Replace this with a dictionary trained on
+// real traffic, by enabling CAPTURE_PROTOCOL_CORPUS in Protocol.cpp and running trainDictionary on the captured
+// messages, then compare the compressed sizes before adding FastLzDict to Protocol::AllCodecs.
+//
+// The most useful patterns are at the end, so they have the shortest match offsets.
+static const char protocolDictionary[] =
+    // Version strings and names
+    "3.0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0"
+    "\x05\0\0\0\0\0\0\0" "3.1.0"
+    "\x08\0\0\0\0\0\0\0" "Anonymous"
+    // IP addresses and ports
+    "127.0.0.1" "\x09\0\0\0\0\0\0\0"
+    "\x39\x30\0\0" "\x3A\x30\0\0"
+    // Small little-endian integers
+    "\x01\0\0\0\x02\0\0\0\x03\0\0\0\x04\0\0\0"
+    "\x05\0\0\0\x06\0\0\0\x07\0\0\0\x08\0\0\0"
+    "\x3C\0\0\0\x78\0\0\0\xB4\0\0\0\xF0\0\0\0"
+    // All bits set
+    "\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+    // Repeated directional inputs
+    "\x02\0\x02\0\x02\0\x02\0\x02\0\x02\0\x02\0\x02\0"
+    "\x04\0\x04\0\x04\0\x04\0\x04\0\x04\0\x04\0\x04\0"
+    "\x06\0\x06\0\x06\0\x06\0\x06\0\x06\0\x06\0\x06\0"
+    "\x08\0\x08\0\x08\0\x08\0\x08\0\x08\0\x08\0\x08\0"
+    "\x05\0\x05\0\x05\0\x05\0\x05\0\x05\0\x05\0\x05\0"
+    // Size prefixes for small strings and arrays
+    "\x01\0\0\0\0\0\0\0\x02\0\0\0\0\0\0\0\x04\0\0\0\0\0\0\0"
+    // Zero runs
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0"
+    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0";
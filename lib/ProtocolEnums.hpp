@@ -34,3 +34,7 @@ TransitionIndex,
 PaletteManager,
 MatchStartedMessage,
 MatchEndedMessage,
+ReplayIndex,
+ReplayInputs,
+ReplayKeyframe,
+Histogram,
@@ -0,0 +1,99 @@
+#include "RelayHistory.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+
+void RelayHistory::addRtt ( const IpAddrPort& relay, double rtt )
+{
+    add ( relay, max ( 0.0, rtt ) );
+}
+
+void RelayHistory::addFailure ( const IpAddrPort& relay )
+{
+    add ( relay, -1.0 );
+}
+
+void RelayHistory::add ( const IpAddrPort& relay, double result )
+{
+    LOCK ( _mutex );
+
+    Entry& entry = _entries[relay.str()];
+
+    entry.results[entry.count % RELAY_HISTORY_SIZE] = result;
+    ++entry.count;
+}
+
+double RelayHistory::getScore ( const IpAddrPort& relay ) const
+{
+    LOCK ( _mutex );
+
+    return getScore ( relay.str() );
+}
+
+double RelayHistory::getScore ( const string& relay ) const
+{
+    const auto it = _entries.find ( relay );
+
+    if ( it == _entries.end() )
+        return RELAY_UNKNOWN_SCORE;
+
+    const Entry& entry = it->second;
+    const size_t count = min<size_t> ( entry.count, RELAY_HISTORY_SIZE );
+
+    double total = 0;
+    size_t successes = 0;
+
+    for ( size_t i = 0; i < count; ++i )
+    {
+        if ( entry.results[i] < 0 )
+            continue;
+
+        total += entry.results[i];
+        ++successes;
+    }
+
+    // Never connected recently, so rank after every relay that has
+    if ( successes == 0 )
+        return RELAY_FAILURE_PENALTY * ( 1 + count );
+
+    const double failureRate = double ( count - successes ) / count;
+
+    return total / successes + failureRate * RELAY_FAILURE_PENALTY;
+}
+
+vector<IpAddrPort> RelayHistory::rank ( const vector<IpAddrPort>& relays ) const
+{
+    LOCK ( _mutex );
+
+    vector<pair<double, size_t>> scores;
+    scores.reserve ( relays.size() );
+
+    for ( size_t i = 0; i < relays.size(); ++i )
+        scores.push_back ( { getScore ( relays[i].str() ), i } );
+
+    stable_sort ( scores.begin(), scores.end(),
+                  [] ( const pair<double, size_t>& a, const pair<double, size_t>& b ) { return a.first < b.first; } );
+
+    vector<IpAddrPort> ranked;
+    ranked.reserve ( relays.size() );
+
+    for ( const auto& score : scores )
+        ranked.push_back ( relays[score.second] );
+
+    return ranked;
+}
+
+void RelayHistory::clear()
+{
+    LOCK ( _mutex );
+
+    _entries.clear();
+}
+
+RelayHistory& RelayHistory::get()
+{
+    static RelayHistory instance;
+    return instance;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "IpAddrPort.hpp"
+#include "Thread.hpp"
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+// Number of recent connection results kept per relay
+#define RELAY_HISTORY_SIZE      ( 8 )
+
+// Milliseconds added to the score for each failed connection, scaled by the failure rate
+#define RELAY_FAILURE_PENALTY   ( 1000.0 )
+
+// Score of a relay that hasn't been tried yet, so it ranks after relays that are known to be good
+#define RELAY_UNKNOWN_SCORE     ( 500.0 )
+
+
+// Short history of the connection RTT and failures of each relay server, used to rank them.
+// Both sides of the tunnel feed this with the results of connecting to the relays concurrently.
+class RelayHistory
+{
+public:
+
+    // Add a successful connection to a relay, with the measured RTT in milliseconds
+    void addRtt ( const IpAddrPort& relay, double rtt );
+
+    // Add a failed connection to a relay
+    void addFailure ( const IpAddrPort& relay );
+
+    // Get the score of a relay, lower is better
+    double getScore ( const IpAddrPort& relay ) const;
+
+    // Sort the relays from best to worst score, relays with equal scores keep their original order
+    std::vector<IpAddrPort> rank ( const std::vector<IpAddrPort>& relays ) const;
+
+    // Clear all history
+    void clear();
+
+    // Get the singleton instance
+    static RelayHistory& get();
+
+private:
+
+    // Recent connection results of a relay, RTTs in milliseconds, negative means a failure
+    struct Entry
+    {
+        std::array<double, RELAY_HISTORY_SIZE> results;
+
+        // Total number of results added, the latest is at ( count - 1 ) % RELAY_HISTORY_SIZE
+        size_t count = 0;
+    };
+
+    // Relay address string -> recent connection results
+    std::unordered_map<std::string, Entry> _entries;
+
+    // Both the main thread and the network thread may connect SmartSockets
+    mutable Mutex _mutex;
+
+    void add ( const IpAddrPort& relay, double result );
+
+    double getScore ( const std::string& relay ) const;
+};
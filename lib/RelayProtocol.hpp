@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+
+/* Relay protocol, a superset of the tunnel protocol in SmartSocket.cpp, served by tools/relay/Relay.cpp
+
+    Matchmaking over TCP is unchanged: TypedHostingPort, TypedConnectionAddress, MatchInfo, UdpData and TunInfo.
+
+    After a match, either side can send RelayData to the same UDP port it sent UdpData to. Each RelayData is
+    forwarded as-is to the UDP address the other side registered with its UdpData, so the receiver strips the
+    header. Only RelayData from the registered address of that side is forwarded.
+
+    SmartSocket only tries the relay after hole punching to the address in TunInfo is slow, and only relies on it
+    once RelayData from the other side was forwarded, see Socket::addRelayRoute.
+
+  Binary formats (little-endian):
+
+    UdpData is a uint8_t followed by the matchId. The uint8_t is a boolean flag indicating isClient.
+
+    RelayData is a uint8_t followed by the matchId, followed by the payload. The uint8_t is RELAY_DATA_FLAG plus
+    the isClient flag of the sender.
+
+    The uint8_t followed by the matchId always starts the datagram, so the server can select the shard that owns
+    the match before reading it, see relayShard.
+
+*/
+
+
+// Default TCP and UDP port of the relay server
+#define RELAY_DEFAULT_PORT      ( 3939 )
+
+// Size of the UdpData and RelayData header
+#define RELAY_HEADER_SIZE       ( 1 + sizeof ( uint32_t ) )
+
+// Flag for RelayData, added to the isClient flag
+#define RELAY_DATA_FLAG         ( 2 )
+
+// Largest datagram that is relayed
+#define RELAY_MAX_DATAGRAM      ( 2048 )
+
+
+// Write a UdpData or RelayData header
+inline void relayHeader ( char *buffer, uint8_t flag, uint32_t matchId )
+{
+    buffer[0] = ( char ) flag;
+    memcpy ( &buffer[1], &matchId, sizeof ( matchId ) );
+}
+
+// Read a UdpData or RelayData header, returns false if the datagram is too small
+inline bool relayHeader ( const char *buffer, size_t len, uint8_t& flag, uint32_t& matchId )
+{
+    if ( len < RELAY_HEADER_SIZE )
+        return false;
+
+    flag = ( uint8_t ) buffer[0];
+    memcpy ( &matchId, &buffer[1], sizeof ( matchId ) );
+    return ( matchId != 0 );
+}
+
+// Multiplier for hashing the matchId to a shard, the 32-bit golden ratio
+#define RELAY_SHARD_HASH        ( 0x9E3779B1u )
+
+// The shard that owns a matchId. This must match the socket the kernel selects, which loads the matchId
+// big-endian, see tools/relay/Relay.cpp. MatchIds are sequential, so they are hashed, otherwise the changing
+// low-order byte ends up in the top byte of the big-endian value and every match lands on the same shard.
+inline size_t relayShard ( uint32_t matchId, size_t numShards )
+{
+    uint32_t hash = ( ( matchId & 0xFF ) << 24 ) | ( ( matchId & 0xFF00 ) << 8 )
+                    | ( ( matchId >> 8 ) & 0xFF00 ) | ( matchId >> 24 );
+
+    hash ^= hash >> 16;
+    hash *= RELAY_SHARD_HASH;
+    hash >>= 16;
+
+    return hash % numShards;
+}
+
+// MatchInfo is "MatchInfo" followed by the matchId
+inline std::string encodeMatchInfo ( uint32_t matchId )
+{
+    return "MatchInfo" + std::string ( ( const char * ) &matchId, sizeof ( matchId ) );
+}
+
+// TunInfo is "TunInfo" followed by the matchId, followed by a NULL-terminated address string
+inline std::string encodeTunInfo ( uint32_t matchId, const std::string& address )
+{
+    return "TunInfo" + std::string ( ( const char * ) &matchId, sizeof ( matchId ) ) + address + '\0';
+}
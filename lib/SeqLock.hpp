@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+
+// Single writer sequence lock, readers never block the writer and never take a lock.
+// The writer increments the sequence to an odd value before writing, and back to even after.
+// Readers retry if the sequence was odd or changed while copying. T must be trivially copyable.
+template<typename T> class SeqLock
+{
+public:
+
+    // Store a new value, ONLY one thread may write at a time
+    void store ( const T& value )
+    {
+        const uint32_t seq = _seq.load ( std::memory_order_relaxed );
+
+        _seq.store ( seq + 1, std::memory_order_relaxed );
+        std::atomic_thread_fence ( std::memory_order_release );
+
+        memcpy ( &_value, &value, sizeof ( T ) );
+
+        _seq.store ( seq + 2, std::memory_order_release );
+    }
+
+    // Load the latest complete value, can be called from any thread
+    T load() const
+    {
+        T value;
+        uint32_t before, after;
+
+        do
+        {
+            before = _seq.load ( std::memory_order_acquire );
+
+            memcpy ( &value, &_value, sizeof ( T ) );
+
+            std::atomic_thread_fence ( std::memory_order_acquire );
+            after = _seq.load ( std::memory_order_relaxed );
+        }
+        while ( ( before & 1 ) || before != after );
+
+        return value;
+    }
+
+private:
+
+    // Odd while the value is being written
+    std::atomic<uint32_t> _seq { 0 };
+
+    T _value;
+};
@@ -0,0 +1,191 @@
+#include "SharedRing.hpp"
+#include "Exceptions.hpp"
+#include "Logger.hpp"
+
+#include <windows.h>
+
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+
+// Size of the message length prefix
+#define LENGTH_SIZE ( sizeof ( uint32_t ) )
+
+// Messages are padded so the length prefix never wraps around the end
+#define ALIGN_SIZE ( 4 )
+
+#define ALIGNED(LEN) ( ( ( LEN ) + ALIGN_SIZE - 1 ) & ~ ( ALIGN_SIZE - 1 ) )
+
+
+bool SharedRing::open ( const string& name, uint32_t capacity )
+{
+    close();
+
+    ASSERT ( capacity >= ALIGN_SIZE );
+    ASSERT ( ( capacity & ( capacity - 1 ) ) == 0 );
+
+    const uint32_t size = sizeof ( Header ) + capacity;
+
+    _mapping = CreateFileMapping ( INVALID_HANDLE_VALUE, 0, PAGE_READWRITE, 0, size, ( name + "_mem" ).c_str() );
+
+    if ( ! _mapping )
+    {
+        LOG ( "CreateFileMapping failed: %s", WinException::getLastError() );
+        return false;
+    }
+
+    const bool existing = ( GetLastError() == ERROR_ALREADY_EXISTS );
+
+    _header = ( Header * ) MapViewOfFile ( _mapping, FILE_MAP_ALL_ACCESS, 0, 0, size );
+
+    if ( ! _header )
+    {
+        LOG ( "MapViewOfFile failed: %s", WinException::getLastError() );
+        close();
+        return false;
+    }
+
+    // New shared memory is zeroed, so only the capacity needs to be set
+    if ( ! existing )
+        _header->capacity = capacity;
+
+    if ( _header->capacity != capacity )
+    {
+        LOG ( "Mismatched capacity: %u != %u", _header->capacity, capacity );
+        close();
+        return false;
+    }
+
+    _data = ( char * ) ( _header + 1 );
+
+    // Auto-reset event, so each signal wakes up the reader once
+    _event = CreateEvent ( 0, FALSE, FALSE, ( name + "_event" ).c_str() );
+
+    if ( ! _event )
+    {
+        LOG ( "CreateEvent failed: %s", WinException::getLastError() );
+        close();
+        return false;
+    }
+
+    LOG ( "Opened shared ring: '%s'; capacity=%u; existing=%u", name, capacity, existing );
+    return true;
+}
+
+void SharedRing::close()
+{
+    if ( _event )
+    {
+        CloseHandle ( ( HANDLE ) _event );
+        _event = 0;
+    }
+
+    if ( _header )
+    {
+        UnmapViewOfFile ( _header );
+        _header = 0;
+        _data = 0;
+    }
+
+    if ( _mapping )
+    {
+        CloseHandle ( ( HANDLE ) _mapping );
+        _mapping = 0;
+    }
+}
+
+bool SharedRing::write ( const char *bytes, size_t len )
+{
+    if ( ! isOpen() || len > _header->capacity )
+        return false;
+
+    const uint32_t size = LENGTH_SIZE + ALIGNED ( len );
+
+    const uint32_t writePos = _header->writePos.load ( memory_order_relaxed );
+    const uint32_t readPos = _header->readPos.load ( memory_order_acquire );
+
+    if ( size > _header->capacity - ( writePos - readPos ) )
+        return false;
+
+    const uint32_t length = len;
+
+    copyIn ( writePos, ( const char * ) &length, LENGTH_SIZE );
+    copyIn ( writePos + LENGTH_SIZE, bytes, len );
+
+    // Publish the message, then wake up the reader
+    _header->writePos.store ( writePos + size, memory_order_release );
+
+    SetEvent ( ( HANDLE ) _event );
+    return true;
+}
+
+bool SharedRing::read ( string& bytes )
+{
+    if ( ! isOpen() )
+        return false;
+
+    const uint32_t readPos = _header->readPos.load ( memory_order_relaxed );
+    const uint32_t writePos = _header->writePos.load ( memory_order_acquire );
+
+    if ( readPos == writePos )
+        return false;
+
+    uint32_t length = 0;
+
+    copyOut ( readPos, ( char * ) &length, LENGTH_SIZE );
+
+    if ( LENGTH_SIZE + ALIGNED ( length ) > writePos - readPos )
+    {
+        LOG ( "Invalid message length: %u; available=%u", length, writePos - readPos );
+        return false;
+    }
+
+    bytes.resize ( length );
+    copyOut ( readPos + LENGTH_SIZE, &bytes[0], length );
+
+    // Free the space for the writer
+    _header->readPos.store ( readPos + LENGTH_SIZE + ALIGNED ( length ), memory_order_release );
+    return true;
+}
+
+bool SharedRing::isEmpty() const
+{
+    if ( ! isOpen() )
+        return true;
+
+    return ( _header->readPos.load ( memory_order_relaxed ) == _header->writePos.load ( memory_order_acquire ) );
+}
+
+bool SharedRing::wait ( uint32_t timeout )
+{
+    if ( ! _event )
+        return false;
+
+    return ( WaitForSingleObject ( ( HANDLE ) _event, timeout ) == WAIT_OBJECT_0 );
+}
+
+void SharedRing::signal()
+{
+    if ( _event )
+        SetEvent ( ( HANDLE ) _event );
+}
+
+void SharedRing::copyIn ( uint32_t pos, const char *src, size_t len )
+{
+    const uint32_t index = pos & ( _header->capacity - 1 );
+    const size_t first = min<size_t> ( len, _header->capacity - index );
+
+    memcpy ( _data + index, src, first );
+    memcpy ( _data, src + first, len - first );
+}
+
+void SharedRing::copyOut ( uint32_t pos, char *dst, size_t len ) const
+{
+    const uint32_t index = pos & ( _header->capacity - 1 );
+    const size_t first = min<size_t> ( len, _header->capacity - index );
+
+    memcpy ( dst, _data + index, first );
+    memcpy ( dst + first, _data, len - first );
+}
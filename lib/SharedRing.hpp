@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+
+
+// Single producer single consumer ring buffer of variable sized messages, in named shared memory.
+// Each process opens its own instance with the same name, then one side ONLY writes and the other ONLY reads.
+class SharedRing
+{
+public:
+
+    // Basic constructor / destructor
+    SharedRing() {}
+    ~SharedRing() { close(); }
+
+    // Create or open the named shared memory and event, the capacity must be a power of 2
+    bool open ( const std::string& name, uint32_t capacity );
+
+    // Close the shared memory, which is freed once both sides close it
+    void close();
+
+    // Indicates if the shared memory is open
+    bool isOpen() const { return ( _header != 0 ); }
+
+    // Write a message then signal the event, returns false if there isn't enough space
+    bool write ( const char *bytes, size_t len );
+
+    // Read the next message, returns false if there are no messages
+    bool read ( std::string& bytes );
+
+    // Indicates if there are no messages to read
+    bool isEmpty() const;
+
+    // Block until the event is signaled or the timeout in milliseconds, returns true if signaled
+    bool wait ( uint32_t timeout );
+
+    // Signal the event without writing, ie to unblock a waiting thread
+    void signal();
+
+private:
+
+    // Shared memory header, the read and write positions are on separate cache lines
+    struct Header
+    {
+        uint32_t capacity;
+        char pad0[60];
+
+        // Total number of bytes written, only updated by the writer
+        std::atomic<uint32_t> writePos;
+        char pad1[60];
+
+        // Total number of bytes read, only updated by the reader
+        std::atomic<uint32_t> readPos;
+        char pad2[60];
+    };
+
+    // Shared memory and event handles
+    void *_mapping = 0, *_event = 0;
+
+    // Mapped shared memory
+    Header *_header = 0;
+
+    // Ring data, right after the header
+    char *_data = 0;
+
+    // Copy data in / out of the ring, wrapping around the end
+    void copyIn ( uint32_t pos, const char *src, size_t len );
+    void copyOut ( uint32_t pos, char *dst, size_t len ) const;
+
+    // Disable copying
+    SharedRing ( const SharedRing& );
+    const SharedRing& operator= ( const SharedRing& );
+};
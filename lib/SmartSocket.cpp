@@ -2,8 +2,11 @@
 #include "TcpSocket.hpp"
 #include "UdpSocket.hpp"
 #include "Logger.hpp"
+#include "RelayHistory.hpp"
+#include "TimerManager.hpp"
 
 #include <ws2tcpip.h>
+#include <algorithm>
 #include <fstream>
 
 using namespace std;
@@ -13,6 +16,9 @@ using namespace std;
 
 #define SEND_INTERVAL ( 50 )
 
+// Time to hole punch directly to the address in TunInfo, before relaying through the tunnel server instead
+#define PUNCH_TIMEOUT ( 2000 )
+
 static std::string GetAppPath()
 {
       TCHAR szEXEPath[MAX_PATH];
@@ -41,10 +47,12 @@ static const vector<IpAddrPort> relayServers = loadRelays();
 
 /* Tunnel protocol
 
-    1 - Host opens a TCP socket to the server and sends its TypedHostingPort.
-        Host should maintain the socket connection; reconnect and resend if needed.
+    1 - Host opens a TCP socket to EACH server concurrently and sends its TypedHostingPort to each.
+        Host should maintain the socket connections; reconnect and resend if needed.
 
-    2 - Client opens a TCP socket to the server and sends its TypedConnectionAddress.
+    2 - Client opens TCP sockets to all its remaining servers concurrently, ranked by RelayHistory.
+        The first server to connect has the lowest RTT, so the client sends its TypedConnectionAddress to it,
+        and closes the other sockets. If that server fails to match, the client races the remaining servers.
 
     2 - Server tries to match-make:
         If a matching host if found, the server sends MatchInfo to host AND client over TCP.
@@ -56,7 +64,14 @@ static const vector<IpAddrPort> relayServers = loadRelays();
     4 - Server recvs UdpData from the client and sends TunInfo ONCE to the host over TCP.
         Server recvs UdpData from the host and sends TunInfo ONCE to the client over TCP.
 
-    5 - Host and client can now connect over the address specified in TunInfo.
+    5 - Host and client can now connect over the address specified in TunInfo. Both keep sending NullMsg to it,
+        which punches a hole through each side's NAT.
+
+    6 - If not connected after PUNCH_TIMEOUT (eg. symmetric NATs), either side also sends its datagrams for the
+        other side through the server as RelayData, see RelayProtocol.hpp, while punching continues. Each side only
+        relies on the relay once it reads RelayData from the other side and nothing directly, and goes back to
+        direct when direct datagrams arrive again. Only tools/relay forwards RelayData, scripts/server.py drops it,
+        so with that server this is the same as punching until the connect timeout.
 
   Binary formats (little-endian):
 
@@ -161,8 +176,7 @@ SmartSocket::SmartSocket ( Owner *owner, uint16_t port, Socket::Protocol protoco
 
     _state = State::Listening;
 
-    _vpsAddress = relayServers.cbegin();
-    _vpsSocket = TcpSocket::connect ( this, *_vpsAddress, true ); // Raw socket
+    connectVpsServers();
 
     try
     {
@@ -196,8 +210,8 @@ SmartSocket::SmartSocket ( Owner *owner, const IpAddrPort& address, Socket::Prot
 
     if ( forceTun )
     {
-        _vpsAddress = relayServers.cbegin();
-        _vpsSocket = TcpSocket::connect ( this, *_vpsAddress, true );
+        _vpsCandidates = RelayHistory::get().rank ( relayServers );
+        connectVpsCandidates();
         return;
     }
 
@@ -221,7 +235,9 @@ void SmartSocket::disconnect()
     _tunAddress.clear();
 
     _directSocket.reset();
-    _vpsSocket.reset();
+    _vpsConnections.clear();
+    _vpsAddress.clear();
+    _vpsCandidates.clear();
     _tunSocket.reset();
 
     _sendTimer.reset();
@@ -250,27 +266,9 @@ void SmartSocket::socketConnected ( Socket *socket )
         if ( owner )
             owner->socketConnected ( this );
     }
-    else if ( socket == _vpsSocket.get() )
+    else if ( findVps ( socket ) != _vpsConnections.end() )
     {
-        if ( isServer() )
-        {
-            char buffer[3];
-            buffer[0] = ( _isDirectTCP ? 'T' : 'U' );
-            memcpy ( &buffer[1], ( char * ) &address.port, sizeof ( uint16_t ) );
-
-            _vpsSocket->send ( buffer, sizeof ( buffer ) );
-        }
-        else
-        {
-            const string buffer = ( _isDirectTCP ? "T" : "U" ) + address.str();
-
-            _vpsSocket->send ( &buffer[0], buffer.size() );
-
-            _connectTimer.reset ( new Timer ( this ) );
-            _connectTimer->start ( _connectTimeout );
-        }
-
-        // Wait for callback to gotMatch
+        vpsConnected ( socket );
     }
     else
     {
@@ -290,8 +288,8 @@ void SmartSocket::socketDisconnected ( Socket *socket )
 
         _directSocket.reset();
 
-        _vpsAddress = relayServers.cbegin();
-        _vpsSocket = TcpSocket::connect ( this, *_vpsAddress, true ); // Raw socket
+        _vpsCandidates = RelayHistory::get().rank ( relayServers );
+        connectVpsCandidates();
 
         if ( owner )
             ( ( SmartSocket::Owner * ) owner )->smartSocketSwitchedToUDP ( this );
@@ -307,32 +305,9 @@ void SmartSocket::socketDisconnected ( Socket *socket )
         if ( owner )
             owner->socketDisconnected ( this );
     }
-    else if ( socket == _vpsSocket.get() )
+    else if ( findVps ( socket ) != _vpsConnections.end() )
     {
-        LOG_SMART_SOCKET ( this, "vpsSocket disconnected" );
-
-        ASSERT ( _vpsAddress != relayServers.cend() );
-
-        ++_vpsAddress;
-
-        if ( _vpsAddress != relayServers.cend() )
-        {
-            _connectTimer.reset();
-            _vpsSocket = TcpSocket::connect ( this, *_vpsAddress, true ); // Raw socket
-            return;
-        }
-
-        _vpsSocket.reset();
-
-        if ( isConnected() || isServer() )
-            return;
-
-        Socket::Owner *const owner = this->owner;
-
-        disconnect();
-
-        if ( owner )
-            owner->socketDisconnected ( this );
+        vpsDisconnected ( socket );
     }
     else
     {
@@ -348,10 +323,16 @@ void SmartSocket::socketRead ( Socket *socket, const MsgPtr& msg, const IpAddrPo
 
 void SmartSocket::socketRead ( Socket *socket, const char *buffer, size_t len, const IpAddrPort& address )
 {
-    ASSERT ( socket == _vpsSocket.get() );
+    const auto it = findVps ( socket );
+
+    ASSERT ( it != _vpsConnections.end() );
 
-    _vpsSocket->_readPos += len;
-    LOG ( "Read [ %u bytes ] from '%s'; %u bytes remaining in buffer", len, address, _vpsSocket->_readPos );
+    // Copy since gotMatch may change the connections
+    const SocketPtr vpsSocket = it->socket;
+    const IpAddrPort vpsAddress = it->address;
+
+    vpsSocket->_readPos += len;
+    LOG ( "Read [ %u bytes ] from '%s'; %u bytes remaining in buffer", len, address, vpsSocket->_readPos );
 
     if ( len > 0 && len <= 256 )
         LOG ( "Hex: %s", formatAsHex ( buffer, len ) );
@@ -362,25 +343,25 @@ void SmartSocket::socketRead ( Socket *socket, const char *buffer, size_t len, c
 
     for ( ;; )
     {
-        id = MatchInfo::decode ( &_vpsSocket->_readBuffer[0], _vpsSocket->_readPos, consumed );
+        id = MatchInfo::decode ( &vpsSocket->_readBuffer[0], vpsSocket->_readPos, consumed );
 
         if ( id )
         {
-            LOG_SMART_SOCKET ( this, "gotMatch ( %u )", id );
+            LOG_SMART_SOCKET ( this, "gotMatch ( %u, '%s' )", id, vpsAddress );
 
-            _vpsSocket->consumeBuffer ( consumed );
+            vpsSocket->consumeBuffer ( consumed );
 
-            gotMatch ( id );
+            gotMatch ( id, vpsAddress );
             continue;
         }
 
-        tun = TunInfo::decode ( &_vpsSocket->_readBuffer[0], _vpsSocket->_readPos, consumed );
+        tun = TunInfo::decode ( &vpsSocket->_readBuffer[0], vpsSocket->_readPos, consumed );
 
         if ( tun.matchId )
         {
             LOG_SMART_SOCKET ( this, "gotTunInfo ( %u, '%s' )", tun.matchId, tun.address );
 
-            _vpsSocket->consumeBuffer ( consumed );
+            vpsSocket->consumeBuffer ( consumed );
 
             gotTunInfo ( tun.matchId, tun.address );
             continue;
@@ -413,21 +394,42 @@ void SmartSocket::timerExpired ( Timer *timer )
                 const TunnelClient& tunClient = kv.second;
                 const UdpData data ( isClient(), tunClient.matchId );
 
-                ASSERT ( _vpsAddress != relayServers.cend() );
+                ASSERT ( tunClient.vpsAddress.empty() == false );
+
+                _tunSocket->send ( data.buffer, sizeof ( data.buffer ), tunClient.vpsAddress );
+
+                if ( tunClient.address.empty() )
+                    continue;
+
+                if ( ! _tunSocket->isRelayProbing ( tunClient.address )
+                        && TimerManager::get().getNowUs ( true ) - tunClient.punchStartUs >= 1000 * PUNCH_TIMEOUT )
+                {
+                    LOG_SMART_SOCKET ( this, "matchId=%u; address='%s'; Hole punching slow, also sending via '%s'",
+                                       tunClient.matchId, tunClient.address, tunClient.vpsAddress );
 
-                _tunSocket->send ( data.buffer, sizeof ( data.buffer ), *_vpsAddress );
+                    _tunSocket->probeRelayRoute ( tunClient.address );
+                }
 
-                if ( ! tunClient.address.empty() )
-                    _tunSocket->send ( NullMsg, tunClient.address );
+                _tunSocket->send ( NullMsg, tunClient.address );
             }
         }
         else if ( _matchId )
         {
             const UdpData data ( isClient(), _matchId );
 
-            ASSERT ( _vpsAddress != relayServers.cend() );
+            ASSERT ( _vpsAddress.empty() == false );
 
-            _tunSocket->send ( data.buffer, sizeof ( data.buffer ), *_vpsAddress );
+            _tunSocket->send ( data.buffer, sizeof ( data.buffer ), _vpsAddress );
+
+            if ( ! _tunAddress.empty() && ! _tunSocket->isRelayProbing ( _tunAddress )
+                    && TimerManager::get().getNowUs ( true ) - _punchStartUs >= 1000 * PUNCH_TIMEOUT )
+            {
+                LOG_SMART_SOCKET ( this, "matchId=%u; address='%s'; Hole punching slow, also sending via '%s'",
+                                   _matchId, _tunAddress, _vpsAddress );
+
+                // GoBackN keeps resending the connect request, which now goes directly and through the relay
+                _tunSocket->probeRelayRoute ( _tunAddress );
+            }
 
             if ( ! _tunAddress.empty() )
                 _tunSocket->send ( NullMsg, _tunAddress );
@@ -452,6 +454,9 @@ void SmartSocket::timerExpired ( Timer *timer )
         {
             LOG_SMART_SOCKET ( this, "matchId=%u; address='%s'; Client timed out", it->first, it->second.address );
 
+            if ( ! it->second.address.empty() )
+                _tunSocket->removeRelayRoute ( it->second.address );
+
             _pendingClients.erase ( it );
         }
 
@@ -466,7 +471,166 @@ void SmartSocket::timerExpired ( Timer *timer )
     }
 }
 
-void SmartSocket::gotMatch ( uint32_t matchId )
+vector<SmartSocket::VpsConnection>::iterator SmartSocket::findVps ( Socket *socket )
+{
+    return find_if ( _vpsConnections.begin(), _vpsConnections.end(),
+                     [socket] ( const VpsConnection& vps ) { return vps.socket.get() == socket; } );
+}
+
+bool SmartSocket::connectVps ( const IpAddrPort& relay )
+{
+    VpsConnection vps;
+    vps.address = relay;
+    vps.startUs = TimerManager::get().getNowUs ( true );
+
+    try
+    {
+        vps.socket = TcpSocket::connect ( this, relay, true ); // Raw socket
+    }
+    catch ( ... )
+    {
+        LOG_SMART_SOCKET ( this, "Failed to connect to '%s'", relay );
+        RelayHistory::get().addFailure ( relay );
+        return false;
+    }
+
+    _vpsConnections.push_back ( vps );
+    return true;
+}
+
+void SmartSocket::connectVpsServers()
+{
+    for ( const IpAddrPort& relay : relayServers )
+        connectVps ( relay );
+}
+
+void SmartSocket::connectVpsCandidates()
+{
+    ASSERT ( isClient() == true );
+
+    _vpsConnections.clear();
+    _vpsAddress.clear();
+
+    for ( auto it = _vpsCandidates.begin(); it != _vpsCandidates.end(); )
+    {
+        if ( connectVps ( *it ) )
+            ++it;
+        else
+            it = _vpsCandidates.erase ( it );
+    }
+
+    LOG_SMART_SOCKET ( this, "Racing %u tunnel servers", _vpsConnections.size() );
+}
+
+void SmartSocket::vpsConnected ( Socket *socket )
+{
+    const auto it = findVps ( socket );
+
+    ASSERT ( it != _vpsConnections.end() );
+
+    it->connected = true;
+
+    const double rtt = ( TimerManager::get().getNowUs ( true ) - it->startUs ) / 1000.0;
+
+    RelayHistory::get().addRtt ( it->address, rtt );
+
+    LOG_SMART_SOCKET ( this, "Connected to '%s' in %.1f ms", it->address, rtt );
+
+    if ( isServer() )
+    {
+        char buffer[3];
+        buffer[0] = ( _isDirectTCP ? 'T' : 'U' );
+        memcpy ( &buffer[1], ( char * ) &address.port, sizeof ( uint16_t ) );
+
+        it->socket->send ( buffer, sizeof ( buffer ) );
+
+        // Wait for callback to gotMatch
+        return;
+    }
+
+    ASSERT ( _vpsAddress.empty() == true );
+
+    // The first server to connect won the race, drop the rest, they can be raced again if this one doesn't match
+    const VpsConnection vps = *it;
+
+    _vpsConnections.clear();
+    _vpsConnections.push_back ( vps );
+
+    _vpsAddress = vps.address;
+    _vpsCandidates.erase ( remove ( _vpsCandidates.begin(), _vpsCandidates.end(), _vpsAddress ),
+                           _vpsCandidates.end() );
+
+    const string buffer = ( _isDirectTCP ? "T" : "U" ) + address.str();
+
+    vps.socket->send ( &buffer[0], buffer.size() );
+
+    _connectTimer.reset ( new Timer ( this ) );
+    _connectTimer->start ( _connectTimeout );
+
+    // Wait for callback to gotMatch
+}
+
+void SmartSocket::vpsDisconnected ( Socket *socket )
+{
+    const auto it = findVps ( socket );
+
+    ASSERT ( it != _vpsConnections.end() );
+
+    const IpAddrPort vpsAddress = it->address;
+
+    LOG_SMART_SOCKET ( this, "vpsSocket disconnected from '%s'", vpsAddress );
+
+    if ( ! it->connected )
+        RelayHistory::get().addFailure ( vpsAddress );
+
+    // Keep the socket alive until the end of this callback
+    const SocketPtr vpsSocket = it->socket;
+
+    _vpsConnections.erase ( it );
+
+    if ( isServer() )
+    {
+        if ( _vpsConnections.empty() )
+            LOG_SMART_SOCKET ( this, "No tunnel servers left" );
+        return;
+    }
+
+    _vpsCandidates.erase ( remove ( _vpsCandidates.begin(), _vpsCandidates.end(), vpsAddress ),
+                           _vpsCandidates.end() );
+
+    if ( isConnected() )
+        return;
+
+    if ( vpsAddress == _vpsAddress )
+    {
+        // The chosen server failed to match, so abandon its tunnel
+        _vpsAddress.clear();
+        _connectTimer.reset();
+        _matchId = 0;
+        _tunAddress.clear();
+        _tunSocket.reset();
+    }
+    else if ( ! _vpsConnections.empty() )
+    {
+        // Still racing the others
+        return;
+    }
+
+    if ( ! _vpsCandidates.empty() )
+        connectVpsCandidates();
+
+    if ( ! _vpsConnections.empty() )
+        return;
+
+    Socket::Owner *const owner = this->owner;
+
+    disconnect();
+
+    if ( owner )
+        owner->socketDisconnected ( this );
+}
+
+void SmartSocket::gotMatch ( uint32_t matchId, const IpAddrPort& vpsAddress )
 {
     ASSERT ( matchId != 0 );
 
@@ -474,6 +638,7 @@ void SmartSocket::gotMatch ( uint32_t matchId )
     {
         TunnelClient tunClient;
         tunClient.matchId = matchId;
+        tunClient.vpsAddress = vpsAddress;
         tunClient.timer.reset ( new Timer ( this ) );
         tunClient.timer->start ( _connectTimeout );
 
@@ -484,9 +649,11 @@ void SmartSocket::gotMatch ( uint32_t matchId )
     {
         _matchId = matchId;
 
-        ASSERT ( _vpsAddress != relayServers.cend() );
+        ASSERT ( vpsAddress == _vpsAddress );
 
-        _tunSocket = UdpSocket::bind ( this, *_vpsAddress );
+        _tunSocket = UdpSocket::bind ( this, _vpsAddress );
+        _tunSocket->setCodecs ( _codecs );
+        _tunSocket->setMultipath ( _multipath );
     }
 
     if ( _sendTimer )
@@ -510,7 +677,10 @@ void SmartSocket::gotTunInfo ( uint32_t matchId, const IpAddrPort& address )
             if ( tunClient.matchId == matchId )
             {
                 tunClient.address = address;
+                tunClient.punchStartUs = TimerManager::get().getNowUs ( true );
                 tunClient.timer->start ( _connectTimeout );
+
+                _tunSocket->addRelayRoute ( address, tunClient.vpsAddress, false, matchId );
                 break;
             }
         }
@@ -520,11 +690,13 @@ void SmartSocket::gotTunInfo ( uint32_t matchId, const IpAddrPort& address )
         _connectTimer.reset();
 
         _tunAddress = address;
+        _punchStartUs = TimerManager::get().getNowUs ( true );
 
         ASSERT ( _tunSocket.get() != 0 );
         ASSERT ( _tunSocket->isUDP() == true );
 
         _tunSocket->getAsUDP().connect ( address );
+        _tunSocket->addRelayRoute ( address, _vpsAddress, true, matchId );
     }
 }
 
@@ -555,6 +727,33 @@ bool SmartSocket::isTunnel() const
     return ( isClient() && _tunSocket && !_tunSocket->getAsUDP().isConnectionLess() && _tunSocket->isConnected() );
 }
 
+void SmartSocket::setMultipath ( bool enabled )
+{
+    _multipath = enabled;
+
+    if ( _tunSocket )
+        _tunSocket->setMultipath ( enabled );
+}
+
+array<Socket::PathStats, 2> SmartSocket::getPathStats() const
+{
+    if ( isTunnel() )
+        return _tunSocket->getPathStats();
+
+    return array<PathStats, 2>();
+}
+
+void SmartSocket::setCodecs ( uint8_t codecs )
+{
+    _codecs = codecs;
+
+    if ( _directSocket )
+        _directSocket->setCodecs ( codecs );
+
+    if ( _tunSocket )
+        _tunSocket->setCodecs ( codecs );
+}
+
 SocketPtr SmartSocket::accept ( Socket::Owner *owner )
 {
     if ( _isDirectAccept && _directSocket )
@@ -43,6 +43,15 @@ public:
     // If this client UDP socket is connected over the UDP tunnel
     bool isTunnel() const;
 
+    // Set the extra codecs used to encode messages, applies to both the direct and tunnel sockets
+    void setCodecs ( uint8_t codecs ) override;
+
+    // Send unreliable messages over both the direct and relay paths, only applies to the tunnel socket
+    void setMultipath ( bool enabled ) override;
+
+    // Get the tunnel socket's path stats
+    std::array<PathStats, 2> getPathStats() const override;
+
     // Send raw bytes directly, a return value of false indicates socket is disconnected
     bool send ( const char *buffer, size_t len );
     bool send ( const char *buffer, size_t len, const IpAddrPort& address );
@@ -66,11 +75,31 @@ private:
     // Socket that tries to listen / connect directly
     SocketPtr _directSocket;
 
-    // Socket that connects to the notification and tunnel server
-    SocketPtr _vpsSocket;
+    // Connection to a notification and tunnel server
+    struct VpsConnection
+    {
+        // Server address
+        IpAddrPort address;
+
+        // Raw TCP socket to the server
+        SocketPtr socket;
+
+        // Time in microseconds when the connection was started, to measure the RTT
+        uint64_t startUs = 0;
+
+        // If the socket has connected
+        bool connected = false;
+    };
+
+    // Connections to the tunnel servers. The server stays connected to all of them, so a client can match through
+    // any of them. The client races connections to its remaining candidates, and only keeps the first to connect.
+    std::vector<VpsConnection> _vpsConnections;
 
-    // Current tunnel server to try
-    std::vector<IpAddrPort>::const_iterator _vpsAddress;
+    // Client's tunnel server, empty until one is chosen
+    IpAddrPort _vpsAddress;
+
+    // Client's remaining tunnel servers to try, best first
+    std::vector<IpAddrPort> _vpsCandidates;
 
     // Timeout for UDP tunnel match
     TimerPtr _connectTimer;
@@ -84,6 +113,9 @@ private:
     // Address of the server's UDP hole
     IpAddrPort _tunAddress;
 
+    // Time in microseconds when hole punching to _tunAddress started
+    uint64_t _punchStartUs = 0;
+
     // Connecting client data
     struct TunnelClient
     {
@@ -95,6 +127,12 @@ private:
 
         // Address of the client's UDP hole
         IpAddrPort address;
+
+        // Tunnel server that matched this client
+        IpAddrPort vpsAddress;
+
+        // Time in microseconds when hole punching to the client's address started
+        uint64_t punchStartUs = 0;
     };
 
     // Remote connecting matchId -> remote client data
@@ -119,8 +157,24 @@ private:
     // Timer callback
     void timerExpired ( Timer *timer ) override;
 
+    // Find the tunnel server connection for a socket
+    std::vector<VpsConnection>::iterator findVps ( Socket *socket );
+
+    // Start connecting to a tunnel server, returns false if that failed immediately
+    bool connectVps ( const IpAddrPort& relay );
+
+    // Connect to all the tunnel servers from the server side
+    void connectVpsServers();
+
+    // Race connections to the remaining tunnel servers from the client side
+    void connectVpsCandidates();
+
+    // Handle a tunnel server connection
+    void vpsConnected ( Socket *socket );
+    void vpsDisconnected ( Socket *socket );
+
     // Got a match from the tunnel server
-    void gotMatch ( uint32_t matchId );
+    void gotMatch ( uint32_t matchId, const IpAddrPort& vpsAddress );
 
     // Got the final tunnel info from the tunnel server
     void gotTunInfo ( uint32_t matchId, const IpAddrPort& address );
@@ -5,6 +5,8 @@
 #include "SmartSocket.hpp"
 #include "Exceptions.hpp"
 #include "ErrorStrings.hpp"
+#include "RelayProtocol.hpp"
+#include "TimerManager.hpp"
 
 #include <winsock2.h>
 #include <windows.h>
@@ -98,6 +100,9 @@ void Socket::init()
             continue;
         }
 
+        // Don't let the game process inherit this socket, otherwise its port stays bound while the game runs
+        SetHandleInformation ( ( HANDLE ) _fd, HANDLE_FLAG_INHERIT, 0 );
+
         if ( enableForceReusePort && ( isServer() || isUDP() ) )
         {
             const char yes = 1;
@@ -273,6 +278,11 @@ bool Socket::send ( const char *buffer, size_t len )
 }
 
 bool Socket::send ( const char *buffer, size_t len, const IpAddrPort& address )
+{
+    return sendDatagram ( buffer, len, address, false );
+}
+
+bool Socket::sendDatagram ( const char *buffer, size_t len, const IpAddrPort& address, bool multipath )
 {
     if ( _fd == 0 || isDisconnected() )
     {
@@ -284,6 +294,46 @@ bool Socket::send ( const char *buffer, size_t len, const IpAddrPort& address )
     ASSERT ( _fd != 0 );
     ASSERT ( address.addr.empty() == false );
 
+    const auto it = _relayRoutes.find ( address );
+
+    if ( it == _relayRoutes.end() )
+        return sendTo ( buffer, len, address );
+
+    RelayRoute& route = it->second;
+
+    bool directSent = false, relaySent = false;
+
+    const uint64_t nowUs = TimerManager::get().queryNowUs();
+
+    // Hole punches are empty datagrams, always send those directly so punching continues while relayed.
+    // Also keep trying the direct path now and then, the peer stops relaying once direct datagrams arrive.
+    if ( ! route.active || multipath || len == 0
+            || nowUs - route.lastDirectSentUs >= 1000 * RELAY_DIRECT_PROBE_INTERVAL )
+    {
+        directSent = sendTo ( buffer, len, address );
+        route.paths[0].sent += directSent;
+        route.lastDirectSentUs = nowUs;
+    }
+
+    if ( route.active || route.probing || multipath )
+    {
+        // Wrap the datagram in a RelayData header, the relay server forwards it to the peer
+        string datagram ( RELAY_HEADER_SIZE + len, ( char ) 0 );
+        relayHeader ( &datagram[0], route.flag, route.matchId );
+
+        if ( len )
+            memcpy ( &datagram[RELAY_HEADER_SIZE], buffer, len );
+
+        LOG_SOCKET ( this, "Relaying [ %u bytes ] for '%s' via '%s'", len, address, route.relay );
+        relaySent = sendTo ( &datagram[0], datagram.size(), route.relay );
+        route.paths[1].sent += relaySent;
+    }
+
+    return ( directSent || relaySent );
+}
+
+bool Socket::sendTo ( const char *buffer, size_t len, const IpAddrPort& address )
+{
     size_t totalBytes = 0;
 
     while ( totalBytes < len || len == 0 )
@@ -409,6 +459,10 @@ void Socket::socketRead()
         return;
     }
 
+    // Unwrap RelayData and drop multipath copies, see readRelayed
+    if ( isUDP() && ! _relayRoutes.empty() && ! readRelayed ( bufferStart, bufferLen, address ) )
+        return;
+
 #ifndef RELEASE
     // Simulated packet loss
     if ( rand() % 100 < _packetLoss )
@@ -499,7 +553,10 @@ MsgPtr Socket::share ( int processId )
     LOG ( "Sharing:" );
     LOG ( "address='%s'; protocol=%s; state=%s", address, protocol, _state );
 
-    return MsgPtr ( new SocketShareData ( address, protocol, _readBuffer, _readPos, _state, info ) );
+    MsgPtr data ( new SocketShareData ( address, protocol, _readBuffer, _readPos, _state, info ) );
+    data->getAs<SocketShareData>().codecs = _codecs;
+    data->getAs<SocketShareData>().relayRoutes = _relayRoutes;
+    return data;
 }
 
 SocketShareData::SocketShareData ( const IpAddrPort& address,
@@ -517,7 +574,7 @@ SocketShareData::SocketShareData ( const IpAddrPort& address,
 
 void SocketShareData::save ( cereal::BinaryOutputArchive& ar ) const
 {
-    ar ( address, protocol, readBuffer, readPos, isRaw, state, connectTimeout,
+    ar ( address, protocol, readBuffer, readPos, isRaw, state, connectTimeout, codecs,
          info->dwServiceFlags1,
          info->dwServiceFlags2,
          info->dwServiceFlags3,
@@ -543,14 +600,14 @@ void SocketShareData::save ( cereal::BinaryOutputArchive& ar ) const
          info->dwProviderReserved,
          info->szProtocol );
 
-    ar ( udpType, Protocol::encode ( gbnState ), childSockets );
+    ar ( udpType, Protocol::encode ( gbnState ), childSockets, relayRoutes );
 }
 
 void SocketShareData::load ( cereal::BinaryInputArchive& ar )
 {
     info.reset ( new WSAPROTOCOL_INFO() );
 
-    ar ( address, protocol, readBuffer, readPos, isRaw, state, connectTimeout,
+    ar ( address, protocol, readBuffer, readPos, isRaw, state, connectTimeout, codecs,
          info->dwServiceFlags1,
          info->dwServiceFlags2,
          info->dwServiceFlags3,
@@ -577,7 +634,7 @@ void SocketShareData::load ( cereal::BinaryInputArchive& ar )
          info->szProtocol );
 
     string buffer;
-    ar ( udpType, buffer, childSockets );
+    ar ( udpType, buffer, childSockets, relayRoutes );
 
     size_t consumed;
     gbnState = Protocol::decode ( &buffer[0], buffer.size(), consumed );
@@ -644,3 +701,149 @@ void Socket::setCheckSumFail ( uint8_t percentage )
     _hashFailRate = percentage;
 }
 
+
+void Socket::addRelayRoute ( const IpAddrPort& peer, const IpAddrPort& relay, bool isClient, uint32_t matchId )
+{
+    ASSERT ( isUDP() == true );
+    ASSERT ( peer.empty() == false );
+    ASSERT ( relay.empty() == false );
+    ASSERT ( matchId != 0 );
+
+    RelayRoute& route = _relayRoutes[peer];
+    route.relay = relay;
+    route.flag = RELAY_DATA_FLAG + ( isClient ? 1 : 0 );
+    route.matchId = matchId;
+
+    // Wait a full RELAY_DIRECT_TIMEOUT without direct datagrams before relaying
+    route.lastDirectUs = TimerManager::get().queryNowUs();
+}
+
+void Socket::probeRelayRoute ( const IpAddrPort& peer )
+{
+    const auto it = _relayRoutes.find ( peer );
+
+    if ( it == _relayRoutes.end() || it->second.probing )
+        return;
+
+    LOG_SOCKET ( this, "Probing '%s' via '%s'; matchId=%u", peer, it->second.relay, it->second.matchId );
+
+    it->second.probing = true;
+}
+
+void Socket::removeRelayRoute ( const IpAddrPort& peer )
+{
+    _relayRoutes.erase ( peer );
+}
+
+bool Socket::readRelayed ( char *buffer, size_t& len, IpAddrPort& address )
+{
+    auto it = _relayRoutes.find ( address );
+
+    bool relayed = false;
+
+    uint8_t flag;
+    uint32_t matchId;
+
+    if ( it == _relayRoutes.end() && relayHeader ( buffer, len, flag, matchId ) )
+    {
+        // RelayData forwarded from the other side of a relay route, so it reads as if it came from the peer
+        for ( it = _relayRoutes.begin(); it != _relayRoutes.end(); ++it )
+        {
+            const RelayRoute& route = it->second;
+
+            if ( route.relay == address && route.matchId == matchId && route.flag == ( flag ^ 1 ) )
+                break;
+        }
+
+        if ( it == _relayRoutes.end() )
+            return true;
+
+        len -= RELAY_HEADER_SIZE;
+        memmove ( buffer, buffer + RELAY_HEADER_SIZE, len );
+        address = it->first;
+        relayed = true;
+    }
+    else if ( it == _relayRoutes.end() )
+    {
+        return true;
+    }
+
+    RelayRoute& route = it->second;
+
+    const uint64_t nowUs = TimerManager::get().queryNowUs();
+
+    if ( ! relayed )
+    {
+        route.lastDirectUs = nowUs;
+
+        if ( route.active )
+        {
+            // The direct path works again, so stop relaying
+            LOG_SOCKET ( this, "Direct to '%s' again; matchId=%u", it->first, route.matchId );
+
+            route.active = route.probing = false;
+        }
+    }
+    else if ( ! route.active && nowUs - route.lastDirectUs >= 1000 * RELAY_DIRECT_TIMEOUT )
+    {
+        // The relay forwards RelayData, and the peer can't reach us directly, so assume we can't reach it directly
+        // either. Multipath copies alone don't count, since those are sent while the direct path is still working.
+        LOG_SOCKET ( this, "Relaying '%s' via '%s'; matchId=%u", it->first, route.relay, route.matchId );
+
+        route.active = true;
+    }
+
+    // FNV-1a hash, only to recognize the same datagram received over the other path
+    uint32_t hash = 2166136261u;
+
+    for ( size_t i = 0; i < len; ++i )
+        hash = ( hash ^ ( uint8_t ) buffer[i] ) * 16777619u;
+
+    PathStats& path = route.paths[relayed];
+
+    ++path.received;
+
+    for ( RelayRoute::Received& received : route.received )
+    {
+        if ( received.timeUs && received.hash == hash && received.relayed != relayed )
+        {
+            route.paths[received.relayed].lead.addSample ( ( nowUs - received.timeUs ) / 1000.0 );
+            received.timeUs = 0;
+            return false;
+        }
+    }
+
+    ++path.first;
+
+    RelayRoute::Received& received = route.received[route.receivedPos];
+    received.hash = hash;
+    received.timeUs = nowUs;
+    received.relayed = relayed;
+
+    route.receivedPos = ( route.receivedPos + 1 ) % MULTIPATH_HISTORY;
+    return true;
+}
+
+array<Socket::PathStats, 2> Socket::getPeerPathStats ( const IpAddrPort& peer ) const
+{
+    const auto it = _relayRoutes.find ( peer );
+
+    if ( it == _relayRoutes.end() )
+        return array<PathStats, 2>();
+
+    return it->second.paths;
+}
+
+bool Socket::isRelayProbing ( const IpAddrPort& peer ) const
+{
+    const auto it = _relayRoutes.find ( peer );
+
+    return ( it != _relayRoutes.end() && it->second.probing );
+}
+
+bool Socket::isRelayed ( const IpAddrPort& peer ) const
+{
+    const auto it = _relayRoutes.find ( peer );
+
+    return ( it != _relayRoutes.end() && it->second.active );
+}
@@ -3,13 +3,25 @@
 #include "IpAddrPort.hpp"
 #include "GoBackN.hpp"
 #include "Enum.hpp"
+#include "Statistics.hpp"
 
+#include <array>
 #include <vector>
 #include <memory>
+#include <unordered_map>
 
 
 #define DEFAULT_CONNECT_TIMEOUT ( 5000 )
 
+// Number of recently received datagrams remembered per relay route, to drop copies received over the other path
+#define MULTIPATH_HISTORY       ( 32 )
+
+// Milliseconds without a direct datagram from a peer before RelayData from it activates its relay route
+#define RELAY_DIRECT_TIMEOUT    ( 1000 )
+
+// Milliseconds between direct copies of datagrams to a relayed peer, so relaying stops once the direct path works
+#define RELAY_DIRECT_PROBE_INTERVAL ( 1000 )
+
 
 #define LOG_SOCKET(SOCKET, FORMAT, ...)                                                                             \
     LOG ( "%s socket=%08x; fd=%08x; state=%s; address='%s'; isRaw=%u; " FORMAT,                                     \
@@ -110,12 +122,93 @@ public:
         return send ( MsgPtr ( const_cast<Serializable *> ( &message ), ignoreMsgPtr ), address );
     }
 
+    // Set the extra codecs (see Protocol::Codec) used to encode messages, only set what the remote can decode
+    virtual void setCodecs ( uint8_t codecs ) { _codecs = codecs; }
+    virtual uint8_t getCodecs() const { return _codecs; }
+
     // Set the packet loss for testing purposes
     void setPacketLoss ( uint8_t percentage );
 
     // Set the check sum fail percentage for testing purposes
     void setCheckSumFail ( uint8_t percentage );
 
+    // Datagram counts of one path to a relayed peer, see setMultipath
+    struct PathStats
+    {
+        // Datagrams sent and received over this path
+        uint32_t sent = 0, received = 0;
+
+        // Received datagrams that were not already received over the other path
+        uint32_t first = 0;
+
+        // How many milliseconds earlier this path delivered datagrams that were also received over the other path
+        Statistics lead;
+    };
+
+    // Route to a peer through a relay server
+    struct RelayRoute
+    {
+        // Relay server address
+        IpAddrPort relay;
+
+        // RelayData flag of this side
+        uint8_t flag = 0;
+
+        // Tunnel matchId
+        uint32_t matchId = 0;
+
+        // If datagrams to the peer are also sent through the relay, to find out if it forwards RelayData
+        bool probing = false;
+
+        // If datagrams to the peer are only sent through the relay, once RelayData from the peer was forwarded
+        bool active = false;
+
+        // Time in microseconds of the last datagram received directly from the peer, or when the route was added.
+        // Not shared, so it restarts when the route is rebuilt from shared data.
+        uint64_t lastDirectUs = 0;
+
+        // Time in microseconds of the last datagram sent directly to the peer, not shared
+        uint64_t lastDirectSentUs = 0;
+
+        // Direct (index 0) and relay (index 1) path stats, not shared
+        std::array<PathStats, 2> paths;
+
+        // Recently received datagrams, not shared
+        struct Received
+        {
+            uint32_t hash = 0;
+            uint64_t timeUs = 0;
+            bool relayed = false;
+        };
+
+        std::array<Received, MULTIPATH_HISTORY> received;
+        size_t receivedPos = 0;
+
+        template<class Archive>
+        void serialize ( Archive& ar ) { ar ( relay, flag, matchId, probing, active ); }
+    };
+
+    // Add a relay route for a UDP peer, isClient and matchId are this side's tunnel match, see RelayProtocol.hpp.
+    // RelayData forwarded from the peer is always read as if it came directly from the peer. Once probing, datagrams
+    // to the peer are sent directly and as RelayData. The route only becomes active, sending just RelayData, once
+    // RelayData from the peer arrives and nothing has been received directly from it for RELAY_DIRECT_TIMEOUT, so a
+    // relay that doesn't forward RelayData is never relied on. It goes back to direct when direct datagrams arrive.
+    // Hole punches (empty datagrams) and a datagram every RELAY_DIRECT_PROBE_INTERVAL are always sent directly as well.
+    void addRelayRoute ( const IpAddrPort& peer, const IpAddrPort& relay, bool isClient, uint32_t matchId );
+    void probeRelayRoute ( const IpAddrPort& peer );
+    void removeRelayRoute ( const IpAddrPort& peer );
+    bool isRelayProbing ( const IpAddrPort& peer ) const;
+    bool isRelayed ( const IpAddrPort& peer ) const;
+
+    // Send unreliable messages (ie SerializableMessage) to a relayed peer over both the direct and relay paths,
+    // so each arrives as early as the faster path allows. The copy that arrives second is dropped.
+    virtual void setMultipath ( bool enabled ) { _multipath = enabled; }
+    virtual bool isMultipath() const { return _multipath; }
+
+    // Get the direct (index 0) and relay (index 1) path stats to the remote address, empty if it isn't relayed
+    virtual std::array<PathStats, 2> getPathStats() const { return getPeerPathStats ( getRemoteAddress() ); }
+    std::array<PathStats, 2> getPeerPathStats ( const IpAddrPort& peer ) const;
+
     // Cast this to another socket type
     TcpSocket& getAsTCP();
     const TcpSocket& getAsTCP() const;
@@ -155,12 +248,21 @@ protected:
     // Initial connect timeout
     uint64_t _connectTimeout = DEFAULT_CONNECT_TIMEOUT;
 
+    // Extra codecs used to encode messages
+    uint8_t _codecs = 0;
+
     // Packet loss percentage for testing purposes
     uint8_t _packetLoss = 0;
 
     // Hash failure percentage for testing purposes
     uint8_t _hashFailRate = 0;
 
+    // Peer address -> relay route, only for UDP sockets
+    std::unordered_map<IpAddrPort, RelayRoute> _relayRoutes;
+
+    // Send unreliable messages over every path
+    bool _multipath = false;
+
     // Reset the read buffer to its initial size
     void resetBuffer();
 
@@ -184,6 +286,16 @@ protected:
     // Initialize the socket fd with the provided address and protocol
     void init();
 
+    // Send a UDP datagram, if multipath then a relayed datagram is sent over both paths, see setMultipath
+    bool sendDatagram ( const char *buffer, size_t len, const IpAddrPort& address, bool multipath );
+
+    // Send a UDP datagram to the address as-is
+    bool sendTo ( const char *buffer, size_t len, const IpAddrPort& address );
+
+    // Read a UDP datagram from a relayed peer, unwraps RelayData and updates the path stats.
+    // Returns false if the datagram is a copy that was already received over the other path.
+    bool readRelayed ( char *buffer, size_t& len, IpAddrPort& address );
+
     // Read raw bytes directly, 0 on success, otherwise returns the socket error code
     int recv ( char *buffer, size_t& len );
     int recvfrom ( char *buffer, size_t& len, IpAddrPort& address );
@@ -200,12 +312,14 @@ struct SocketShareData : public SerializableSequence
     uint8_t isRaw = 0;
     Socket::State state;
     uint64_t connectTimeout = DEFAULT_CONNECT_TIMEOUT;
+    uint8_t codecs = 0;
     std::shared_ptr<WSAPROTOCOL_INFO> info;
 
     // Extra data for UDP sockets
     uint8_t udpType = 0;
     MsgPtr gbnState;
     std::unordered_map<IpAddrPort, GoBackN> childSockets;
+    std::unordered_map<IpAddrPort, Socket::RelayRoute> relayRoutes;
 
     SocketShareData ( const IpAddrPort& address,
                       Socket::Protocol protocol,
@@ -10,10 +10,14 @@
 using namespace std;
 
 
-void SocketManager::check ( uint64_t timeout )
+// Without the wake up socket, select can't be interrupted by wake, so wait at most this long like the old event loop
+#define NO_WAKE_TIMEOUT_MILLISECONDS ( 1 )
+
+
+bool SocketManager::check ( uint64_t timeout )
 {
     if ( ! _initialized )
-        return;
+        return false;
 
     if ( _changed )
     {
@@ -41,13 +45,25 @@ void SocketManager::check ( uint64_t timeout )
         _changed = false;
     }
 
-    if ( _activeSockets.empty() )
-        return;
+    const int wakeFd = _wakeFd;
+
+    if ( ! wakeFd && timeout > NO_WAKE_TIMEOUT_MILLISECONDS )
+        timeout = NO_WAKE_TIMEOUT_MILLISECONDS;
+
+    // Nothing to select on, but still wait so the event loop doesn't spin
+    if ( _activeSockets.empty() && ! wakeFd )
+    {
+        Sleep ( timeout );
+        return _wakePending.exchange ( false );
+    }
 
     fd_set readFds, writeFds;
     FD_ZERO ( &readFds );
     FD_ZERO ( &writeFds );
 
+    if ( wakeFd )
+        FD_SET ( wakeFd, &readFds );
+
     for ( Socket *socket : _activeSockets )
     {
         if ( socket->isConnecting() && socket->isTCP() )
@@ -69,13 +85,28 @@ void SocketManager::check ( uint64_t timeout )
         THROW_WIN_EXCEPTION ( WSAGetLastError(), "select failed", ERROR_NETWORK_GENERIC );
 
     if ( count == 0 )
-        return;
+        return _wakePending.exchange ( false );
 
     ASSERT ( TimerManager::get().isInitialized() == true );
     TimerManager::get().updateNow();
 
+    if ( wakeFd && FD_ISSET ( wakeFd, &readFds ) )
+    {
+        // Drain all pending wake ups
+        char buffer[64];
+        while ( recv ( wakeFd, buffer, sizeof ( buffer ), 0 ) > 0 );
+    }
+
+    // Return to the caller as soon as possible if woken up, ready sockets are still ready on the next check.
+    // This is cleared after draining, so a wake that skipped sending a byte is never missed.
+    if ( _wakePending.exchange ( false ) )
+        return true;
+
     for ( Socket *socket : _activeSockets )
     {
+        if ( _wakePending )
+            break;
+
         if ( _allocatedSockets.find ( socket ) == _allocatedSockets.end() )
             continue;
 
@@ -104,6 +135,20 @@ void SocketManager::check ( uint64_t timeout )
             }
         }
     }
+
+    return true;
+}
+
+void SocketManager::wake()
+{
+    // Only one byte is needed until check consumes the wake up, so repeated wakes don't flood the socket
+    if ( _wakePending.exchange ( true ) )
+        return;
+
+    const int fd = _wakeFd;
+
+    if ( fd )
+        ::send ( fd, "", 1, 0 );
 }
 
 void SocketManager::add ( Socket *socket )
@@ -151,6 +196,34 @@ void SocketManager::initialize()
 
     if ( error != NO_ERROR )
         THROW_WIN_EXCEPTION ( error, "WSAStartup failed", ERROR_NETWORK_INIT );
+
+    // Create the loopback wake up socket, this is optional so failures are only logged
+    int fd = socket ( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+
+    sockaddr_in addr;
+    int addrLen = sizeof ( addr );
+    memset ( &addr, 0, sizeof ( addr ) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+
+    u_long nonBlocking = 1;
+
+    if ( fd == ( int ) INVALID_SOCKET
+            || bind ( fd, ( sockaddr * ) &addr, sizeof ( addr ) ) == SOCKET_ERROR
+            || getsockname ( fd, ( sockaddr * ) &addr, &addrLen ) == SOCKET_ERROR
+            || connect ( fd, ( sockaddr * ) &addr, sizeof ( addr ) ) == SOCKET_ERROR
+            || ioctlsocket ( fd, FIONBIO, &nonBlocking ) != 0 )
+    {
+        LOG ( "Failed to create wake up socket: %s", WinException::getAsString ( WSAGetLastError() ) );
+
+        if ( fd != ( int ) INVALID_SOCKET )
+            closesocket ( fd );
+        return;
+    }
+
+    // Drop any wake up left from before, otherwise the next wake would not send a byte
+    _wakePending = false;
+    _wakeFd = fd;
 }
 
 void SocketManager::deinitialize()
@@ -162,6 +235,11 @@ void SocketManager::deinitialize()
 
     SocketManager::get().clear();
 
+    const int fd = _wakeFd.exchange ( 0 );
+
+    if ( fd )
+        closesocket ( fd );
+
     WSACleanup();
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <unordered_set>
+#include <atomic>
 
 
 class Socket;
@@ -10,8 +11,13 @@ class SocketManager
 {
 public:
 
-    // Check for socket events
-    void check ( uint64_t timeout );
+    // Check for socket events, blocks until a socket is ready, the timeout, or wake is called.
+    // Returns true if any socket events were dispatched or we were woken up.
+    bool check ( uint64_t timeout );
+
+    // Wake up a blocking check, can be called on a different thread.
+    // A check that is already dispatching stops after the current socket, the rest are dispatched by the next check.
+    void wake();
 
     // Add / remove / clear socket instances
     void add ( Socket *socket );
@@ -43,6 +49,12 @@ private:
     // Flag to indicate if initialized
     bool _initialized = false;
 
+    // Loopback UDP socket connected to itself, used to wake up a blocking check
+    std::atomic<int> _wakeFd { 0 };
+
+    // Set by wake until the wake up is consumed by check, only the first wake sends a byte to the wake up socket
+    std::atomic<bool> _wakePending { false };
+
     // Private constructor, etc. for singleton class
     SocketManager();
     SocketManager ( const SocketManager& );
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+
+// Lock-free single producer single consumer queue with a fixed capacity, which must be a power of 2.
+// One thread ONLY pushes and another thread ONLY pops, neither ever blocks.
+template<typename T, size_t N> class SpscQueue
+{
+    static_assert ( N > 0 && ( N & ( N - 1 ) ) == 0, "Capacity must be a power of 2" );
+
+public:
+
+    // Push an element, returns false if the queue is full
+    bool push ( const T& t )
+    {
+        const size_t head = _head.load ( std::memory_order_relaxed );
+
+        if ( head - _tail.load ( std::memory_order_acquire ) == N )
+            return false;
+
+        _elements[head & ( N - 1 )] = t;
+
+        // Publish the element to the consumer
+        _head.store ( head + 1, std::memory_order_release );
+        return true;
+    }
+
+    // Pop an element, returns false if the queue is empty
+    bool pop ( T& t )
+    {
+        const size_t tail = _tail.load ( std::memory_order_relaxed );
+
+        if ( tail == _head.load ( std::memory_order_acquire ) )
+            return false;
+
+        t = std::move ( _elements[tail & ( N - 1 )] );
+
+        // Release any resources held by the slot before handing it back to the producer
+        _elements[tail & ( N - 1 )] = T();
+
+        _tail.store ( tail + 1, std::memory_order_release );
+        return true;
+    }
+
+    // Indicates if there are no elements, only exact when called by the consumer
+    bool empty() const
+    {
+        return ( _tail.load ( std::memory_order_relaxed ) == _head.load ( std::memory_order_acquire ) );
+    }
+
+    // Number of elements, only a snapshot when called from either thread
+    size_t size() const
+    {
+        return ( _head.load ( std::memory_order_acquire ) - _tail.load ( std::memory_order_acquire ) );
+    }
+
+private:
+
+    T _elements[N];
+
+    // Total number of elements pushed, only updated by the producer
+    std::atomic<size_t> _head { 0 };
+
+    // Keep the producer and consumer positions on separate cache lines
+    char _pad[64];
+
+    // Total number of elements popped, only updated by the consumer
+    std::atomic<size_t> _tail { 0 };
+};
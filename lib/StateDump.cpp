@@ -0,0 +1,234 @@
+#include "StateDump.hpp"
+#include "Compression.hpp"
+
+#include <cereal/types/string.hpp>
+
+#include <algorithm>
+#include <fstream>
+
+using namespace std;
+using namespace cereal;
+
+
+// States are dumped while the game is stopping, so favour compression speed
+#define STATE_DUMP_COMPRESSION_LEVEL ( 1 )
+
+// Unchanged gaps smaller than this are still saved, since each separate range has a fixed cost
+#define MIN_SKIPPED_BYTES ( 32 )
+
+
+bool StateDump::save ( const string& filename, const MemDumpList& layout, uint64_t desyncFrame,
+                       const vector<pair<uint64_t, const char *>>& states )
+{
+    ofstream fout ( filename.c_str(), ofstream::binary );
+
+    if ( ! fout.good() )
+        return false;
+
+    try
+    {
+        BinaryOutputArchive archive ( fout );
+
+        const uint32_t version = STATE_DUMP_VERSION;
+        const uint32_t count = states.size();
+
+        archive ( version );
+        layout.save ( archive );
+        archive ( desyncFrame, count );
+
+        string buffer ( compressBound ( layout.totalSize ), ( char ) 0 );
+
+        for ( const auto& state : states )
+        {
+            const size_t size = compress ( state.second, layout.totalSize, &buffer[0], buffer.size(),
+                                           STATE_DUMP_COMPRESSION_LEVEL );
+
+            if ( size == 0 )
+                return false;
+
+            archive ( state.first, string ( &buffer[0], size ) );
+        }
+    }
+    catch ( ... )
+    {
+        return false;
+    }
+
+    return fout.good();
+}
+
+bool StateDump::load ( const string& filename )
+{
+    ifstream fin ( filename.c_str(), ifstream::binary );
+
+    if ( ! fin.good() )
+        return false;
+
+    layout.clear();
+    frames.clear();
+
+    try
+    {
+        BinaryInputArchive archive ( fin );
+
+        uint32_t version = 0, count = 0;
+
+        archive ( version );
+
+        if ( version != STATE_DUMP_VERSION )
+            return false;
+
+        layout.load ( archive );
+        archive ( desyncFrame, count );
+
+        frames.resize ( count );
+
+        for ( Frame& frame : frames )
+        {
+            string compressed;
+            archive ( frame.indexedFrame, compressed );
+
+            frame.bytes.resize ( layout.totalSize );
+
+            if ( uncompress ( &compressed[0], compressed.size(), &frame.bytes[0], frame.bytes.size() )
+                    != layout.totalSize )
+            {
+                return false;
+            }
+        }
+    }
+    catch ( ... )
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool WriteActivity::save ( const string& filename, const MemDumpList& layout, uint32_t frameCount,
+                           const string& changed )
+{
+    ASSERT ( changed.size() == layout.totalSize );
+
+    ofstream fout ( filename.c_str(), ofstream::binary );
+
+    if ( ! fout.good() )
+        return false;
+
+    string buffer ( compressBound ( changed.size() ), ( char ) 0 );
+
+    const size_t size = compress ( &changed[0], changed.size(), &buffer[0], buffer.size() );
+
+    if ( size == 0 )
+        return false;
+
+    buffer.resize ( size );
+
+    try
+    {
+        BinaryOutputArchive archive ( fout );
+
+        const uint32_t version = WRITE_ACTIVITY_VERSION;
+
+        archive ( version );
+        layout.save ( archive );
+        archive ( frameCount, buffer );
+    }
+    catch ( ... )
+    {
+        return false;
+    }
+
+    return fout.good();
+}
+
+bool WriteActivity::load ( const string& filename )
+{
+    ifstream fin ( filename.c_str(), ifstream::binary );
+
+    if ( ! fin.good() )
+        return false;
+
+    layout.clear();
+    changed.clear();
+
+    try
+    {
+        BinaryInputArchive archive ( fin );
+
+        uint32_t version = 0;
+        string compressed;
+
+        archive ( version );
+
+        if ( version != WRITE_ACTIVITY_VERSION )
+            return false;
+
+        layout.load ( archive );
+        archive ( frameCount, compressed );
+
+        changed.resize ( layout.totalSize );
+
+        if ( uncompress ( &compressed[0], compressed.size(), &changed[0], changed.size() ) != layout.totalSize )
+            return false;
+    }
+    catch ( ... )
+    {
+        return false;
+    }
+
+    return true;
+}
+
+void WriteActivity::minimize ( const MemDumpList& fullAddrs, MemDumpList& minAddrs ) const
+{
+    ASSERT ( changed.size() == fullAddrs.totalSize );
+
+    size_t offset = 0;
+
+    for ( const MemDump& mem : fullAddrs.addrs )
+    {
+        vector<bool> keep ( mem.size );
+
+        for ( size_t i = 0; i < mem.size; ++i )
+            keep[i] = ( changed[offset + i] != 0 );
+
+        for ( const MemDumpPtr& ptr : mem.ptrs )
+            fill ( keep.begin() + ptr.srcOffset, keep.begin() + ptr.srcOffset + sizeof ( char * ), true );
+
+        offset += mem.getTotalSize();
+
+        // Find each range of kept bytes, merging across small gaps
+        for ( size_t start = 0; start < mem.size; )
+        {
+            if ( ! keep[start] )
+            {
+                ++start;
+                continue;
+            }
+
+            size_t end = start;
+
+            for ( size_t i = start; i < mem.size && i < end + MIN_SKIPPED_BYTES; ++i )
+            {
+                if ( keep[i] )
+                    end = i + 1;
+            }
+
+            vector<MemDumpPtr> ptrs;
+
+            for ( const MemDumpPtr& ptr : mem.ptrs )
+            {
+                if ( ptr.srcOffset >= start && ptr.srcOffset < end )
+                    ptrs.push_back ( MemDumpPtr ( ptr.srcOffset - start, ptr.dstOffset, ptr.size, ptr.ptrs ) );
+            }
+
+            minAddrs.append ( MemDump ( mem.addr + start, end - start, ptrs ) );
+
+            start = end;
+        }
+    }
+
+    if ( ! minAddrs.empty() )
+        minAddrs.update();
+}
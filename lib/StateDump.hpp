@@ -0,0 +1,69 @@
+#pragma once
+
+#include "MemDump.hpp"
+
+#include <string>
+#include <vector>
+
+
+// Version of the state dump file format
+#define STATE_DUMP_VERSION ( 1 )
+
+// Version of the write activity file format
+#define WRITE_ACTIVITY_VERSION ( 1 )
+
+
+// Raw game states for a range of frames, each state uses the same layout as a saved rollback state
+struct StateDump
+{
+    struct Frame
+    {
+        // IndexedFrame value of this state
+        uint64_t indexedFrame;
+
+        // Uncompressed state bytes, layout.totalSize long
+        std::string bytes;
+    };
+
+    // Layout of each state
+    MemDumpList layout;
+
+    // IndexedFrame value where the desync was detected
+    uint64_t desyncFrame = 0;
+
+    // States in chronological order
+    std::vector<Frame> frames;
+
+    // Save raw states with the given layout, each state is layout.totalSize bytes long
+    static bool save ( const std::string& filename, const MemDumpList& layout, uint64_t desyncFrame,
+                       const std::vector<std::pair<uint64_t, const char *>>& states );
+
+    // Load the layout and all the states
+    bool load ( const std::string& filename );
+};
+
+
+// Bytes of the game state that changed between consecutive frames, using the same layout as a rollback state
+struct WriteActivity
+{
+    // Layout of the game state
+    MemDumpList layout;
+
+    // Number of frames that were compared
+    uint32_t frameCount = 0;
+
+    // Non-zero for each byte that changed, layout.totalSize long
+    std::string changed;
+
+    // Save the changed bytes mask with the given layout
+    static bool save ( const std::string& filename, const MemDumpList& layout, uint32_t frameCount,
+                       const std::string& changed );
+
+    // Load the layout and changed bytes mask
+    bool load ( const std::string& filename );
+
+    // Append the parts of fullAddrs that changed to minAddrs, pointers to child memory are always kept.
+    // Bytes that never changed in the recorded frames are dropped, so they won't be restored on rollback
+    // if an unrecorded code path writes them. Record activity that covers every game mode before using this.
+    void minimize ( const MemDumpList& fullAddrs, MemDumpList& minAddrs ) const;
+};
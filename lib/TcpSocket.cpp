@@ -53,6 +53,7 @@ TcpSocket::TcpSocket ( Socket::Owner *owner, const SocketShareData& data )
     this->owner = owner;
 
     _connectTimeout = data.connectTimeout;
+    _codecs = data.codecs;
     _state = data.state;
     _readBuffer = data.readBuffer;
     _readPos = data.readPos;
@@ -113,6 +114,8 @@ SocketPtr TcpSocket::accept ( Socket::Owner *owner )
         return 0;
     }
 
+    SetHandleInformation ( ( HANDLE ) newFd, HANDLE_FLAG_INHERIT, 0 );
+
     return SocketPtr ( new TcpSocket ( owner, newFd, IpAddrPort ( ( sockaddr * ) &sas ), _isRaw ) );
 }
 
@@ -128,7 +131,7 @@ bool TcpSocket::send ( SerializableSequence *message, const IpAddrPort& address
 
 bool TcpSocket::send ( const MsgPtr& msg, const IpAddrPort& address )
 {
-    const string buffer = ::Protocol::encode ( msg );
+    const string buffer = ::Protocol::encode ( msg, _codecs );
 
     LOG ( "Encoded '%s' to [ %u bytes ]", msg, buffer.size() );
 
@@ -16,7 +16,12 @@ Timer::~Timer()
 
 void Timer::start ( uint64_t delay )
 {
-    _delay = delay;
+    _delay = 1000 * delay;
+}
+
+void Timer::startUs ( uint64_t delayUs )
+{
+    _delay = delayUs;
 }
 
 void Timer::stop()
@@ -15,20 +15,44 @@ void TimerManager::updateNow()
 
     if ( _useHiResTimer )
     {
-        QueryPerformanceCounter ( ( LARGE_INTEGER * ) &_ticks );
-        _now = ( 1000 * _ticks ) / _ticksPerSecond;
+        uint64_t ticks;
+        QueryPerformanceCounter ( ( LARGE_INTEGER * ) &ticks );
+
+        const uint64_t nowUs = scaleTicks ( ticks, 1000000 );
+
+        _ticks = ticks;
+        _nowUs = nowUs;
+        _now = nowUs / 1000;
     }
     else
     {
         // Note: timeGetTime should be called between timeBeginPeriod / timeEndPeriod to ensure accuracy
-        _now = timeGetTime();
+        const uint64_t now = timeGetTime();
+
+        _now = now;
+        _nowUs = 1000 * now;
     }
 }
 
-void TimerManager::check()
+uint64_t TimerManager::queryNowUs() const
 {
     if ( ! _initialized )
-        return;
+        return 0;
+
+    if ( _useHiResTimer )
+    {
+        uint64_t ticks;
+        QueryPerformanceCounter ( ( LARGE_INTEGER * ) &ticks );
+        return scaleTicks ( ticks, 1000000 );
+    }
+
+    return 1000 * uint64_t ( timeGetTime() );
+}
+
+bool TimerManager::check()
+{
+    if ( ! _initialized )
+        return false;
 
     if ( _changed )
     {
@@ -37,7 +61,7 @@ void TimerManager::check()
             if ( _activeTimers.find ( timer ) != _activeTimers.end() )
                 continue;
 
-            LOG ( "Added timer %08x; delay='%llu ms'", timer, timer->_delay );
+            LOG ( "Added timer %08x; delay='%llu us'", timer, timer->_delay );
             _activeTimers.insert ( timer );
         }
 
@@ -56,23 +80,26 @@ void TimerManager::check()
         _changed = false;
     }
 
-    _nextExpiry = UINT64_MAX;
+    _nextExpiryUs = UINT64_MAX;
 
     if ( _activeTimers.empty() )
-        return;
+        return false;
 
     updateNow();
 
+    bool expired = false;
+
     for ( Timer *timer : _activeTimers )
     {
         if ( _allocatedTimers.find ( timer ) == _allocatedTimers.end() )
             continue;
 
-        if ( timer->_expiry > 0 && _now >= timer->_expiry )
+        if ( timer->_expiry > 0 && _nowUs >= timer->_expiry )
         {
             LOG ( "Expired timer %08x", timer );
 
             timer->_delay = timer->_expiry = 0;
+            expired = true;
 
             if ( timer->owner )
             {
@@ -85,15 +112,17 @@ void TimerManager::check()
 
         if ( timer->_delay > 0 )
         {
-            LOG ( "Started timer %08x; delay='%llu ms'", timer, timer->_delay );
+            LOG ( "Started timer %08x; delay='%llu us'", timer, timer->_delay );
 
-            timer->_expiry = _now + timer->_delay;
+            timer->_expiry = _nowUs + timer->_delay;
             timer->_delay = 0;
         }
 
-        if ( timer->_expiry > 0 && timer->_expiry < _nextExpiry )
-            _nextExpiry = timer->_expiry;
+        if ( timer->_expiry > 0 && timer->_expiry < _nextExpiryUs )
+            _nextExpiryUs = timer->_expiry;
     }
+
+    return expired;
 }
 
 void TimerManager::add ( Timer *timer )
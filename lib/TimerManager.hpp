@@ -1,6 +1,8 @@
 #pragma once
 
 #include <unordered_set>
+#include <cstdint>
+#include <atomic>
 
 
 class Timer;
@@ -13,8 +15,11 @@ public:
     // Update current time
     void updateNow();
 
-    // Check for timer events
-    void check();
+    // Sample the frame clock, this should be called once at the start of each frame
+    void updateFrameClock() { updateNow(); _frameClockUs = _nowUs; }
+
+    // Check for timer events, returns true if any timers expired
+    bool check();
 
     // Add / remove / clear timer instances
     void add ( Timer *timer );
@@ -33,8 +38,22 @@ public:
     uint64_t getNow() const { return _now; }
     uint64_t getNow ( bool update ) { if ( update ) updateNow(); return _now; }
 
-    // Get the next time when a timer will expire
-    uint64_t getNextExpiry() const { return _nextExpiry; }
+    // Get the current time in microseconds
+    uint64_t getNowUs() const { return _nowUs; }
+    uint64_t getNowUs ( bool update ) { if ( update ) updateNow(); return _nowUs; }
+
+    // Get the current time in nanoseconds, only as precise as the underlying timer
+    uint64_t getNowNs() const { return ( _useHiResTimer ? scaleTicks ( _ticks, 1000000000 ) : 1000 * _nowUs ); }
+    uint64_t getNowNs ( bool update ) { if ( update ) updateNow(); return getNowNs(); }
+
+    // Query the current time in microseconds without updating, safe to call from other threads
+    uint64_t queryNowUs() const;
+
+    // Get the time in microseconds when the frame clock was last sampled
+    uint64_t getFrameClockUs() const { return _frameClockUs; }
+
+    // Get the next time in microseconds when a timer will expire
+    uint64_t getNextExpiryUs() const { return _nextExpiryUs; }
 
     // Get the singleton instance
     static TimerManager& get();
@@ -48,13 +67,22 @@ private:
     bool _useHiResTimer;
 
     // Hi-res timer variables
-    uint64_t _ticksPerSecond = 0, _ticks = 0;
+    uint64_t _ticksPerSecond = 0;
+
+    // The current time is updated by both the game thread and the network thread, see NetworkThread
+    std::atomic<uint64_t> _ticks { 0 };
 
     // The current time in milliseconds
-    uint64_t _now = 0;
+    std::atomic<uint64_t> _now { 0 };
+
+    // The current time in microseconds
+    std::atomic<uint64_t> _nowUs { 0 };
 
-    // The next time when a timer will expire
-    uint64_t _nextExpiry = 0;
+    // The time in microseconds when the frame clock was last sampled
+    uint64_t _frameClockUs = 0;
+
+    // The next time in microseconds when a timer will expire
+    uint64_t _nextExpiryUs = 0;
 
     // Flag to indicate the set of allocated timers has changed
     bool _changed = false;
@@ -62,6 +90,13 @@ private:
     // Flag to indicate if initialized
     bool _initialized = false;
 
+    // Convert hi-res timer ticks to the given units per second, without overflowing for large tick counts
+    uint64_t scaleTicks ( uint64_t ticks, uint64_t unitsPerSecond ) const
+    {
+        return ( ticks / _ticksPerSecond ) * unitsPerSecond
+               + ( ( ticks % _ticksPerSecond ) * unitsPerSecond ) / _ticksPerSecond;
+    }
+
     // Private constructor, etc. for singleton class
     TimerManager();
     TimerManager ( const TimerManager& );
@@ -3,6 +3,7 @@
 #include "Protocol.hpp"
 #include "Exceptions.hpp"
 #include "ErrorStrings.hpp"
+#include "TimerManager.hpp"
 
 #include <winsock2.h>
 #include <windows.h>
@@ -53,9 +54,17 @@ UdpSocket::UdpSocket ( Socket::Owner *owner, const SocketShareData& data )
     ASSERT ( data.protocol == Protocol::UDP );
 
     _connectTimeout = data.connectTimeout;
+    _codecs = data.codecs;
     _state = data.state;
     _readBuffer = data.readBuffer;
     _readPos = data.readPos;
+    _relayRoutes = data.relayRoutes;
+
+    // The time of the last direct datagram isn't shared, so wait a full RELAY_DIRECT_TIMEOUT again before relaying
+    const uint64_t nowUs = TimerManager::get().queryNowUs();
+
+    for ( auto& kv : _relayRoutes )
+        kv.second.lastDirectUs = nowUs;
 
     ASSERT ( data.info->iSocketType == SOCK_DGRAM );
     ASSERT ( data.info->iProtocol == IPPROTO_UDP );
@@ -239,7 +248,7 @@ bool UdpSocket::send ( const MsgPtr& msg, const IpAddrPort& address )
     {
         case BaseType::SerializableMessage:
             _gbn.delayKeepAliveOnce();
-            return sendRaw ( msg, address );
+            return sendRaw ( msg, address, _multipath );
 
         case BaseType::SerializableSequence:
             _gbn.sendViaGoBackN ( msg );
@@ -251,7 +260,15 @@ bool UdpSocket::send ( const MsgPtr& msg, const IpAddrPort& address )
     }
 }
 
-bool UdpSocket::sendRaw ( const MsgPtr& msg, const IpAddrPort& address )
+array<Socket::PathStats, 2> UdpSocket::getPathStats() const
+{
+    if ( isChild() && _parentSocket )
+        return _parentSocket->getPeerPathStats ( address );
+
+    return Socket::getPathStats();
+}
+
+bool UdpSocket::sendRaw ( const MsgPtr& msg, const IpAddrPort& address, bool multipath )
 {
 #ifndef RELEASE
     // Simulate hash fail
@@ -271,7 +288,7 @@ bool UdpSocket::sendRaw ( const MsgPtr& msg, const IpAddrPort& address )
     }
 #endif // NOT RELEASE
 
-    const string buffer = ::Protocol::encode ( msg );
+    const string buffer = ::Protocol::encode ( msg, _codecs );
 
     LOG ( "Encoded '%s' to [ %u bytes ]", msg, buffer.size() );
 
@@ -280,11 +297,14 @@ bool UdpSocket::sendRaw ( const MsgPtr& msg, const IpAddrPort& address )
 
     // Real UDP sockets send directly
     if ( isReal()  )
-        return Socket::send ( &buffer[0], buffer.size(), address.empty() ? this->address : address );
+        return sendDatagram ( &buffer[0], buffer.size(), address.empty() ? this->address : address, multipath );
 
     // Child UDP sockets send via parent if not disconnected
     if ( isChild() && _parentSocket )
-        return _parentSocket->Socket::send ( &buffer[0], buffer.size(), address.empty() ? this->address : address );
+    {
+        return _parentSocket->sendDatagram ( &buffer[0], buffer.size(), address.empty() ? this->address : address,
+                                             multipath );
+    }
 
     LOG_UDP_SOCKET ( this, "Cannot send over disconnected socket" );
     return false;
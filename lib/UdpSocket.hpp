@@ -72,6 +72,9 @@ public:
     bool send ( SerializableSequence *message, const IpAddrPort& address = NullAddress ) override;
     bool send ( const MsgPtr& message, const IpAddrPort& address = NullAddress ) override;
 
+    // Child UDP sockets get the path stats from the parent socket, since that is where the relay routes are
+    std::array<PathStats, 2> getPathStats() const override;
+
     // Get / set the interval to send packets, should be non-zero
     uint64_t getSendInterval() const { return _gbn.getSendInterval(); }
     void setSendInterval ( uint64_t interval );
@@ -129,8 +132,8 @@ private:
     // Callback into the correctly addressed socket
     void socketReadAddressed ( const MsgPtr& msg, const IpAddrPort& address );
 
-    // Send a protocol message directly, not over GoBackN
-    bool sendRaw ( const MsgPtr& msg, const IpAddrPort& address );
+    // Send a protocol message directly, not over GoBackN, see Socket::sendDatagram for multipath
+    bool sendRaw ( const MsgPtr& msg, const IpAddrPort& address, bool multipath = false );
 
     // Construct a server socket
     UdpSocket ( Socket::Owner *owner, uint16_t port, const Type& type, bool isRaw );
@@ -0,0 +1,414 @@
+#include "UnzipStream.hpp"
+#include "Logger.hpp"
+
+#include <miniz.h>
+
+#include <windows.h>
+
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+
+// Zip record signatures
+#define LOCAL_HEADER_SIGNATURE      ( 0x04034b50 )
+#define CENTRAL_HEADER_SIGNATURE    ( 0x02014b50 )
+#define END_RECORD_SIGNATURE        ( 0x06054b50 )
+#define DATA_DESCRIPTOR_SIGNATURE   ( 0x08074b50 )
+
+// Size of a local file header without the name and extra field
+#define LOCAL_HEADER_SIZE           ( 30 )
+
+// General purpose flags
+#define FLAG_ENCRYPTED              ( 0x1 )
+#define FLAG_DATA_DESCRIPTOR        ( 0x8 )
+
+// Compression methods
+#define METHOD_STORED               ( 0 )
+#define METHOD_DEFLATED             ( 8 )
+
+// Size of a data descriptor with the optional signature
+#define DATA_DESCRIPTOR_SIZE        ( 16 )
+
+// Maximum number of bytes the inflater reads past the end of the compressed data
+#define MAX_INFLATE_OVERREAD        ( 8 )
+
+// Size of the buffer for inflated bytes
+#define INFLATE_BUFFER_SIZE         ( 64 * 1024 )
+
+
+static uint16_t read16 ( const char *bytes )
+{
+    const uint8_t *b = ( const uint8_t * ) bytes;
+    return b[0] | ( b[1] << 8 );
+}
+
+static uint32_t read32 ( const char *bytes )
+{
+    const uint8_t *b = ( const uint8_t * ) bytes;
+    return b[0] | ( b[1] << 8 ) | ( b[2] << 16 ) | ( uint32_t ( b[3] ) << 24 );
+}
+
+// Only relative paths inside the extract folder are allowed
+static bool isSafePath ( const string& name )
+{
+    if ( name.empty() || name[0] == '/' || name[0] == '\\' )
+        return false;
+
+    return ( name.find ( ':' ) == string::npos && name.find ( ".." ) == string::npos );
+}
+
+
+struct UnzipStream::Inflater
+{
+    mz_stream stream;
+
+    char buffer[INFLATE_BUFFER_SIZE];
+
+    Inflater()
+    {
+        memset ( &stream, 0, sizeof ( stream ) );
+        mz_inflateInit2 ( &stream, -MZ_DEFAULT_WINDOW_BITS ); // Raw deflate
+    }
+
+    ~Inflater()
+    {
+        mz_inflateEnd ( &stream );
+    }
+};
+
+
+UnzipStream::UnzipStream ( const string& folder ) : folder ( folder )
+{
+}
+
+UnzipStream::~UnzipStream()
+{
+}
+
+bool UnzipStream::write ( const char *bytes, size_t len )
+{
+    if ( _state == State::Failed )
+        return false;
+
+    // Ignore the central directory, everything has already been extracted
+    if ( _state == State::Finished )
+        return true;
+
+    _buffer.append ( bytes, len );
+
+    size_t pos = 0;
+
+    while ( pos < _buffer.size() && _state != State::Finished && _state != State::Failed )
+    {
+        size_t consumed = 0;
+
+        switch ( _state )
+        {
+            case State::LocalHeader:
+                consumed = readLocalHeader ( &_buffer[pos], _buffer.size() - pos );
+                break;
+
+            case State::FileData:
+                consumed = readFileData ( &_buffer[pos], _buffer.size() - pos );
+                break;
+
+            case State::DataDescriptor:
+                consumed = readDataDescriptor ( &_buffer[pos], _buffer.size() - pos );
+                break;
+
+            default:
+                break;
+        }
+
+        if ( consumed == 0 )
+            break;
+
+        pos += consumed;
+    }
+
+    if ( _state == State::Finished || _state == State::Failed )
+        _buffer.clear();
+    else
+        _buffer.erase ( 0, pos );
+
+    return ( _state != State::Failed );
+}
+
+size_t UnzipStream::readLocalHeader ( const char *bytes, size_t len )
+{
+    if ( len < 4 )
+        return 0;
+
+    const uint32_t signature = read32 ( bytes );
+
+    if ( signature == CENTRAL_HEADER_SIGNATURE || signature == END_RECORD_SIGNATURE )
+    {
+        LOG ( "Finished extracting %u files", _fileCount );
+        _state = State::Finished;
+        return len;
+    }
+
+    if ( signature != LOCAL_HEADER_SIGNATURE )
+    {
+        fail ( "Invalid local header signature" );
+        return 0;
+    }
+
+    if ( len < LOCAL_HEADER_SIZE )
+        return 0;
+
+    const uint16_t nameLength = read16 ( bytes + 26 );
+    const uint16_t extraLength = read16 ( bytes + 28 );
+    const size_t headerSize = LOCAL_HEADER_SIZE + nameLength + extraLength;
+
+    if ( len < headerSize )
+        return 0;
+
+    _flags = read16 ( bytes + 6 );
+    _method = read16 ( bytes + 8 );
+    _crc = read32 ( bytes + 14 );
+    _compressedSize = read32 ( bytes + 18 );
+    _uncompressedSize = read32 ( bytes + 22 );
+    _name.assign ( bytes + LOCAL_HEADER_SIZE, nameLength );
+
+    _remainingBytes = _compressedSize;
+    _writtenBytes = 0;
+    _computedCrc = mz_crc32 ( MZ_CRC32_INIT, 0, 0 );
+
+    LOG ( "Entry: '%s'; method=%u; flags=%04X; compressedSize=%u; uncompressedSize=%u",
+          _name, _method, _flags, _compressedSize, _uncompressedSize );
+
+    if ( ! isSafePath ( _name ) )
+    {
+        fail ( "Unsafe entry path" );
+        return 0;
+    }
+
+    if ( _flags & FLAG_ENCRYPTED )
+    {
+        fail ( "Encrypted entry" );
+        return 0;
+    }
+
+    // The size of stored data is unknown with a data descriptor
+    if ( _method != METHOD_DEFLATED && ( _method != METHOD_STORED || ( _flags & FLAG_DATA_DESCRIPTOR ) ) )
+    {
+        fail ( "Unsupported compression" );
+        return 0;
+    }
+
+    // Create the parent folders, and the folder itself for folder entries
+    for ( size_t i = 0; i < _name.size(); ++i )
+    {
+        if ( _name[i] == '/' || _name[i] == '\\' )
+            CreateDirectory ( ( folder + _name.substr ( 0, i ) ).c_str(), 0 );
+    }
+
+    if ( _name.back() == '/' || _name.back() == '\\' )
+    {
+        if ( _compressedSize != 0 )
+        {
+            fail ( "Folder entry with data" );
+            return 0;
+        }
+
+        return headerSize;
+    }
+
+    _file.open ( ( folder + _name ).c_str(), ios::binary | ios::trunc );
+
+    if ( ! _file.good() )
+    {
+        fail ( "Could not open output file" );
+        return 0;
+    }
+
+    if ( _method == METHOD_DEFLATED )
+        _inflater.reset ( new Inflater() );
+
+    _state = State::FileData;
+
+    if ( _method == METHOD_STORED && _remainingBytes == 0 )
+        finishEntry();
+
+    return headerSize;
+}
+
+size_t UnzipStream::readFileData ( const char *bytes, size_t len )
+{
+    const bool knownSize = ! ( _flags & FLAG_DATA_DESCRIPTOR );
+
+    if ( knownSize )
+        len = min<size_t> ( len, _remainingBytes );
+
+    if ( _method == METHOD_STORED )
+    {
+        output ( bytes, len );
+
+        _remainingBytes -= len;
+
+        if ( _remainingBytes == 0 )
+            finishEntry();
+
+        return len;
+    }
+
+    if ( knownSize && _remainingBytes == 0 )
+    {
+        fail ( "Empty deflate stream" );
+        return 0;
+    }
+
+    mz_stream& stream = _inflater->stream;
+
+    stream.next_in = ( const unsigned char * ) bytes;
+    stream.avail_in = len;
+
+    for ( ;; )
+    {
+        stream.next_out = ( unsigned char * ) _inflater->buffer;
+        stream.avail_out = sizeof ( _inflater->buffer );
+
+        const int status = mz_inflate ( &stream, MZ_NO_FLUSH );
+
+        const size_t inflated = sizeof ( _inflater->buffer ) - stream.avail_out;
+
+        output ( _inflater->buffer, inflated );
+
+        if ( status == MZ_STREAM_END )
+        {
+            const size_t consumed = len - stream.avail_in;
+
+            if ( knownSize && consumed != _remainingBytes )
+            {
+                fail ( "Mismatched compressed size" );
+                return 0;
+            }
+
+            // Inflating may read a few bytes past the end of the stream, so leave some bytes to search for the
+            // data descriptor, which has the actual compressed size.
+            _backtrack = ( knownSize ? 0 : min<size_t> ( consumed, MAX_INFLATE_OVERREAD ) );
+            _compressedSize = stream.total_in;
+
+            _inflater.reset();
+            finishEntry();
+            return consumed - _backtrack;
+        }
+
+        if ( status != MZ_OK && ! ( status == MZ_BUF_ERROR && inflated == 0 ) )
+        {
+            fail ( "Inflate failed" );
+            return 0;
+        }
+
+        // Keep going while the output buffer was filled, since there may be more output pending
+        if ( stream.avail_in == 0 && inflated < sizeof ( _inflater->buffer ) )
+            break;
+
+        if ( status == MZ_BUF_ERROR )
+            break;
+    }
+
+    const size_t consumed = len - stream.avail_in;
+
+    if ( knownSize )
+    {
+        _remainingBytes -= consumed;
+
+        if ( _remainingBytes == 0 && consumed > 0 )
+        {
+            fail ( "Truncated deflate stream" );
+            return 0;
+        }
+    }
+
+    return consumed;
+}
+
+size_t UnzipStream::readDataDescriptor ( const char *bytes, size_t len )
+{
+    // The first bytes were already read by the inflater, find how many of those were actually past the end of the
+    // compressed data by matching the compressed size in the descriptor. The signature is optional.
+    for ( uint32_t overread = _backtrack + 1; overread-- > 0; )
+    {
+        const char *descriptor = bytes + _backtrack - overread;
+        const uint32_t compressedSize = _compressedSize - overread;
+
+        // Wait for the whole descriptor, the central directory always follows it
+        if ( descriptor + DATA_DESCRIPTOR_SIZE > bytes + len )
+            return 0;
+
+        for ( size_t offset : { 4, 0 } )
+        {
+            if ( offset && read32 ( descriptor ) != DATA_DESCRIPTOR_SIGNATURE )
+                continue;
+
+            if ( read32 ( descriptor + offset + 4 ) != compressedSize )
+                continue;
+
+            _crc = read32 ( descriptor + offset );
+            _compressedSize = compressedSize;
+            _uncompressedSize = read32 ( descriptor + offset + 8 );
+
+            _flags &= ~FLAG_DATA_DESCRIPTOR;
+
+            finishEntry();
+            return ( descriptor - bytes ) + offset + 12;
+        }
+    }
+
+    fail ( "Invalid data descriptor" );
+    return 0;
+}
+
+void UnzipStream::output ( const char *bytes, size_t len )
+{
+    if ( len == 0 )
+        return;
+
+    _computedCrc = mz_crc32 ( _computedCrc, ( const unsigned char * ) bytes, len );
+    _writtenBytes += len;
+
+    _file.write ( bytes, len );
+}
+
+void UnzipStream::finishEntry()
+{
+    // Wait for the data descriptor for the real CRC and sizes
+    if ( _flags & FLAG_DATA_DESCRIPTOR )
+    {
+        _state = State::DataDescriptor;
+        return;
+    }
+
+    _file.close();
+
+    if ( _file.fail() )
+    {
+        fail ( "Could not write output file" );
+        return;
+    }
+
+    if ( _writtenBytes != _uncompressedSize || _computedCrc != _crc )
+    {
+        LOG ( "Expected size=%u; crc=%08X; actual size=%u; crc=%08X", _uncompressedSize, _crc, _writtenBytes, _computedCrc );
+        fail ( "Mismatched CRC or size" );
+        return;
+    }
+
+    ++_fileCount;
+
+    _state = State::LocalHeader;
+}
+
+void UnzipStream::fail ( const char *reason )
+{
+    LOG ( "Extract failed for '%s': %s", _name, reason );
+
+    _file.close();
+    _inflater.reset();
+
+    _state = State::Failed;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <memory>
+
+
+// An archive is extracted into a folder next to it with the same name minus the extension,
+// and this marker file next to the archive indicates that the folder is complete.
+#define EXTRACTED_MARKER_SUFFIX ".extracted"
+
+
+// Extracts a zip archive while it is being downloaded, by reading each local file header and its data in order.
+// Only stored and deflated entries are supported, anything else fails the extraction.
+class UnzipStream
+{
+public:
+
+    // Extract into this folder, which should end with a path separator
+    const std::string folder;
+
+    // Basic constructor / destructor
+    UnzipStream ( const std::string& folder );
+    ~UnzipStream();
+
+    // Extract from the next bytes of the archive, returns false once the extraction has failed
+    bool write ( const char *bytes, size_t len );
+
+    // Indicates if every entry was extracted, ie the central directory was reached
+    bool isFinished() const { return ( _state == State::Finished ); }
+
+    // Indicates if the extraction failed
+    bool hasFailed() const { return ( _state == State::Failed ); }
+
+    // Number of files extracted so far
+    uint32_t getFileCount() const { return _fileCount; }
+
+private:
+
+    enum class State : uint8_t { LocalHeader, FileData, DataDescriptor, Finished, Failed };
+
+    State _state = State::LocalHeader;
+
+    // Archive bytes that haven't been processed yet
+    std::string _buffer;
+
+    // Current entry
+    std::string _name;
+    uint16_t _flags = 0, _method = 0;
+    uint32_t _crc = 0, _compressedSize = 0, _uncompressedSize = 0;
+
+    // Progress of the current entry
+    uint32_t _remainingBytes = 0, _writtenBytes = 0, _computedCrc = 0;
+
+    // Number of bytes before the data descriptor that were already read by the inflater
+    uint32_t _backtrack = 0;
+
+    std::ofstream _file;
+
+    uint32_t _fileCount = 0;
+
+    // Inflate stream, only allocated for deflated entries
+    struct Inflater;
+    std::unique_ptr<Inflater> _inflater;
+
+    // Each of these returns the number of bytes consumed, or 0 if more bytes are needed
+    size_t readLocalHeader ( const char *bytes, size_t len );
+    size_t readFileData ( const char *bytes, size_t len );
+    size_t readDataDescriptor ( const char *bytes, size_t len );
+
+    // Write uncompressed bytes to the current file
+    void output ( const char *bytes, size_t len );
+
+    // Check the current file and move on to the next entry
+    void finishEntry();
+
+    void fail ( const char *reason );
+};
@@ -0,0 +1,38 @@
+#include "InputResender.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+
+uint32_t InputResender::start()
+{
+    _waiting = true;
+    _waited = _resends = 0;
+    _interval = getInterval();
+
+    return _interval;
+}
+
+uint32_t InputResender::next()
+{
+    _waited += _interval;
+    ++_resends;
+    _interval = getInterval();
+
+    return _interval;
+}
+
+void InputResender::reset()
+{
+    _waiting = false;
+    _waited = _resends = _interval = 0;
+}
+
+uint32_t InputResender::getInterval() const
+{
+    if ( _resends < min<uint32_t> ( repairs, MAX_INPUT_REPAIRS ) )
+        return REPAIR_INPUTS_INTERVAL;
+
+    return RESEND_INPUTS_INTERVAL;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+
+// The number of milliseconds between repair resends, ie about one frame
+#define REPAIR_INPUTS_INTERVAL      ( 16 )
+
+// The number of milliseconds before resending inputs while waiting for more inputs, after any repair resends
+#define RESEND_INPUTS_INTERVAL      ( 100 )
+
+// The maximum number of repair resends, so the overhead stays bounded
+#define MAX_INPUT_REPAIRS           ( 10 )
+
+
+// Schedules resending the latest inputs while waiting on remote inputs.
+// Every PlayerInputs carries the last NUM_INPUTS frames, so any later packet completely repairs a lost one.
+// The costly loss is at the tail, when both sides stop advancing and only resends are sent, so the first few
+// resends of each wait are sent quickly instead of every RESEND_INPUTS_INTERVAL. Each repair costs one extra
+// packet, but only while waiting, so the number of repairs is the tunable overhead.
+class InputResender
+{
+public:
+
+    // Number of fast repair resends at the start of each wait, 0 to only resend every RESEND_INPUTS_INTERVAL
+    uint32_t repairs = 0;
+
+    // Start waiting, returns the number of milliseconds until the first resend
+    uint32_t start();
+
+    // Called after each resend, returns the number of milliseconds until the next resend
+    uint32_t next();
+
+    // Stop waiting
+    void reset();
+
+    bool isWaiting() const { return _waiting; }
+
+    // Number of milliseconds waited so far, as of the latest resend
+    uint32_t getWaited() const { return _waited; }
+
+    // Number of resends so far in this wait
+    uint32_t getResends() const { return _resends; }
+
+private:
+
+    bool _waiting = false;
+
+    uint32_t _waited = 0, _resends = 0;
+
+    // Current resend interval
+    uint32_t _interval = 0;
+
+    uint32_t getInterval() const;
+};
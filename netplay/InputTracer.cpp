@@ -0,0 +1,110 @@
+#include "InputTracer.hpp"
+#include "Messages.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+
+// Format the stats and percentiles of some latencies on one line
+static string formatLatencies ( const Statistics& stats, const Histogram& histogram )
+{
+    if ( histogram.getNumSamples() == 0 )
+        return "  (no samples)\n";
+
+    return format ( "  samples=%u; mean=%.2f ms; stddev=%.2f ms; worst=%.2f ms; "
+                    "p50=%.1f ms; p90=%.1f ms; p99=%.1f ms; p99.9=%.1f ms\n",
+                    stats.getNumSamples(), stats.getMean(), stats.getStdDev(), stats.getWorst(),
+                    histogram.getPercentile ( 50 ), histogram.getPercentile ( 90 ),
+                    histogram.getPercentile ( 99 ), histogram.getPercentile ( 99.9 ) );
+}
+
+
+void InputTracer::captured ( IndexedFrame indexedFrame, uint64_t captureUs )
+{
+    _latestLocal = { indexedFrame, captureUs };
+
+    _pendingLocal.push_back ( _latestLocal );
+}
+
+void InputTracer::stamp ( PlayerInputs& playerInputs, uint64_t nowUs ) const
+{
+    if ( ! _latestLocal.startUs
+            || _latestLocal.indexedFrame.parts.index != playerInputs.getIndex()
+            || _latestLocal.indexedFrame.parts.frame < playerInputs.getStartFrame()
+            || _latestLocal.indexedFrame.parts.frame >= playerInputs.getEndFrame() )
+    {
+        return;
+    }
+
+    playerInputs.traceFrame = _latestLocal.indexedFrame;
+    playerInputs.traceAge = uint32_t ( min<uint64_t> ( nowUs - _latestLocal.startUs, UINT_MAX ) );
+    playerInputs.invalidate();
+}
+
+void InputTracer::gotInputs ( const PlayerInputs& playerInputs, uint64_t nowUs )
+{
+    if ( ! playerInputs.traceFrame.value || playerInputs.traceFrame.value == _latestRemote.value )
+        return;
+
+    _latestRemote = playerInputs.traceFrame;
+
+    // Estimate when the remote input was captured in our clock
+    const uint64_t age = playerInputs.traceAge + oneWayUs;
+
+    if ( age >= nowUs )
+        return;
+
+    _pendingRemote.push_back ( { playerInputs.traceFrame, nowUs - age } );
+}
+
+void InputTracer::applied ( IndexedFrame indexedFrame, uint64_t nowUs )
+{
+    resolve ( _pendingLocal, _local, indexedFrame, nowUs );
+    resolve ( _pendingRemote, _remote, indexedFrame, nowUs );
+}
+
+void InputTracer::resolve ( vector<Trace>& pending, Latencies& latencies, IndexedFrame indexedFrame, uint64_t nowUs )
+{
+    for ( auto it = pending.begin(); it != pending.end(); )
+    {
+        // Traces from previous transition indices never got written to the game, so drop them
+        if ( it->indexedFrame.parts.index < indexedFrame.parts.index )
+        {
+            it = pending.erase ( it );
+            continue;
+        }
+
+        if ( it->indexedFrame.parts.index == indexedFrame.parts.index
+                && it->indexedFrame.parts.frame <= indexedFrame.parts.frame )
+        {
+            const double latency = ( nowUs - it->startUs ) / 1000.0;
+
+            latencies.stats.addSample ( latency );
+            latencies.histogram.addSample ( latency );
+            it = pending.erase ( it );
+            continue;
+        }
+
+        ++it;
+    }
+}
+
+string InputTracer::report() const
+{
+    return "Local input latency:\n" + formatLatencies ( _local.stats, _local.histogram )
+           + format ( "Remote input latency, assuming a one-way network latency of %.2f ms:\n", oneWayUs / 1000.0 )
+           + formatLatencies ( _remote.stats, _remote.histogram );
+}
+
+void InputTracer::reset()
+{
+    _pendingLocal.clear();
+    _pendingRemote.clear();
+    _latestLocal = { {{ 0, 0 }}, 0 };
+    _latestRemote.value = 0;
+    _local.stats.reset();
+    _local.histogram.reset();
+    _remote.stats.reset();
+    _remote.histogram.reset();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Constants.hpp"
+#include "Statistics.hpp"
+#include "Histogram.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Forward declarations
+struct PlayerInputs;
+
+
+// Traces the end-to-end latency of local input changes, from when the controller state changed to when the input
+// is written to the game, both locally and on the remote side. The remote side doesn't share our clock, so the
+// traced age of the input is sent instead of the capture time, plus the estimated one-way network latency.
+// The remote latencies are only as accurate as that estimate, which assumes a symmetric route, see report.
+class InputTracer
+{
+public:
+
+    // Estimated one-way network latency in microseconds, added to the age of remote traces
+    uint64_t oneWayUs = 0;
+
+    // A local input change captured at captureUs will be written to the game on the given frame
+    void captured ( IndexedFrame indexedFrame, uint64_t captureUs );
+
+    // Stamp the latest local trace onto outgoing inputs, if it is in range
+    void stamp ( PlayerInputs& playerInputs, uint64_t nowUs ) const;
+
+    // Start tracing a remote input change from incoming inputs received at nowUs
+    void gotInputs ( const PlayerInputs& playerInputs, uint64_t nowUs );
+
+    // Resolve the traces up to the given frame, since those inputs have now been written to the game
+    void applied ( IndexedFrame indexedFrame, uint64_t nowUs );
+
+    // Get the stats and histograms of local and remote input latencies in milliseconds
+    const Statistics& getLocalStats() const { return _local.stats; }
+    const Histogram& getLocalHistogram() const { return _local.histogram; }
+    const Statistics& getRemoteStats() const { return _remote.stats; }
+    const Histogram& getRemoteHistogram() const { return _remote.histogram; }
+
+    // Format a report of both latencies, including the one-way latency assumed for the remote traces
+    std::string report() const;
+
+    void reset();
+
+private:
+
+    // Pending trace, with the start time in the local clock
+    struct Trace
+    {
+        IndexedFrame indexedFrame;
+        uint64_t startUs;
+    };
+
+    // Pending local and remote traces
+    std::vector<Trace> _pendingLocal, _pendingRemote;
+
+    // Latest local trace, which is sent until a newer one replaces it
+    Trace _latestLocal = { {{ 0, 0 }}, 0 };
+
+    // Latest remote trace, so each one is only counted once
+    IndexedFrame _latestRemote = {{ 0, 0 }};
+
+    // Resolved latencies
+    struct Latencies
+    {
+        Statistics stats;
+        Histogram histogram;
+    };
+
+    Latencies _local, _remote;
+
+    // Resolve the pending traces up to the given frame
+    void resolve ( std::vector<Trace>& pending, Latencies& latencies, IndexedFrame indexedFrame, uint64_t nowUs );
+};
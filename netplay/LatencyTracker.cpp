@@ -0,0 +1,119 @@
+#include "LatencyTracker.hpp"
+#include "Messages.hpp"
+#include "TimerManager.hpp"
+#include "Algorithms.hpp"
+#include "Logger.hpp"
+
+#include <cmath>
+
+using namespace std;
+
+
+// Number of standard deviations of jitter to cover when raising the delay
+#define RAISE_MARGIN ( 2.0 )
+
+// Number of standard deviations of jitter to cover when lowering the delay, higher to avoid flip-flopping
+#define LOWER_MARGIN ( 3.0 )
+
+
+void LatencyTracker::stamp ( PlayerInputs& playerInputs ) const
+{
+    const uint32_t now = TimerManager::get().getNow ( true );
+
+    playerInputs.sendTime = now;
+
+    if ( _remoteSendTime )
+    {
+        playerInputs.echoTime = _remoteSendTime;
+        playerInputs.echoHold = min<uint32_t> ( now - _remoteRecvTime, UINT16_MAX );
+    }
+
+    playerInputs.invalidate();
+}
+
+void LatencyTracker::gotInputs ( const PlayerInputs& playerInputs, uint32_t now )
+{
+    // Remote didn't stamp this message
+    if ( ! playerInputs.sendTime )
+        return;
+
+    // Only track the newest remote send time, since inputs can arrive out of order
+    if ( ! _remoteSendTime || int32_t ( playerInputs.sendTime - _remoteSendTime ) > 0 )
+    {
+        _remoteSendTime = playerInputs.sendTime;
+        _remoteRecvTime = now;
+    }
+
+    // Only sample each echoed time once, since the same echo is repeated until a newer one arrives
+    if ( ! playerInputs.echoTime || playerInputs.echoTime == _lastEchoTime )
+        return;
+
+    _lastEchoTime = playerInputs.echoTime;
+
+    const uint32_t elapsed = now - playerInputs.echoTime;
+
+    if ( elapsed < playerInputs.echoHold || elapsed - playerInputs.echoHold > MAX_LATENCY_SAMPLE )
+        return;
+
+    _stats.addSample ( elapsed - playerInputs.echoHold );
+}
+
+uint8_t LatencyTracker::computeFrames ( double numStdDevs ) const
+{
+    // One-way latency is half the round trip time
+    const double latency = ( _stats.getMean() + numStdDevs * _stats.getStdDev() ) / 2;
+
+    return ( uint8_t ) clamped<double> ( ceil ( latency / ( 1000.0 / 60 ) ), 0, 0xFE );
+}
+
+uint8_t LatencyTracker::computeDelay ( uint8_t frames, uint8_t rollback ) const
+{
+    // Delay only must cover the full latency
+    if ( rollback == 0 )
+        return min<uint8_t> ( frames + 1, 0xFE );
+
+    // Cover the latency with delay, keeping the rollback to absorb spikes
+    if ( policy == AutoDelayPolicy::MinimizeRollbacks )
+        return frames;
+
+    // Spend the rollback budget first, then cover the rest with delay
+    return ( frames > rollback ? frames - rollback : 0 );
+}
+
+bool LatencyTracker::recommend ( uint8_t& delay, uint8_t& rollback )
+{
+    if ( ! isEnabled() || _stats.getNumSamples() < MIN_LATENCY_SAMPLES )
+        return false;
+
+    LOG ( "policy=%s; samples=%u; mean=%.2f ms; jitter=%.2f ms; worst=%.2f ms",
+          policy, _stats.getNumSamples(), _stats.getMean(), _stats.getStdDev(), _stats.getWorst() );
+
+    uint8_t newRollback = rollback;
+
+    if ( rollback != 0 && policy == AutoDelayPolicy::MinimizeDelay )
+        newRollback = clamped<uint8_t> ( rollbackBudget, 1, MAX_ROLLBACK );
+
+    // Raise the delay as soon as the latency needs it, but only lower it if it is still lower with the wider
+    // margin, otherwise keep the current delay so it doesn't flip-flop between windows.
+    uint8_t newDelay = computeDelay ( computeFrames ( RAISE_MARGIN ), newRollback );
+
+    if ( newDelay < delay )
+        newDelay = min ( delay, computeDelay ( computeFrames ( LOWER_MARGIN ), newRollback ) );
+
+    _stats.reset();
+
+    if ( newDelay == delay && newRollback == rollback )
+        return false;
+
+    LOG ( "delay: %u -> %u; rollback: %u -> %u", delay, newDelay, rollback, newRollback );
+
+    delay = newDelay;
+    rollback = newRollback;
+    return true;
+}
+
+void LatencyTracker::reset()
+{
+    _stats.reset();
+    _remoteSendTime = _remoteRecvTime = _lastEchoTime = 0;
+}
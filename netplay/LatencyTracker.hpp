@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Statistics.hpp"
+#include "Enum.hpp"
+
+#include <cstdint>
+
+
+// Minimum number of round trip samples before a delay recommendation is made
+#define MIN_LATENCY_SAMPLES ( 120 )
+
+// Maximum round trip time that is considered a valid sample, in milliseconds
+#define MAX_LATENCY_SAMPLE ( 2000 )
+
+// Default number of rollback frames to use when minimizing delay
+#define DEFAULT_ROLLBACK_BUDGET ( 4 )
+
+
+// Forward declarations
+struct PlayerInputs;
+
+
+// Policy for automatically adjusting the delay / rollback between games, Unknown means disabled
+ENUM ( AutoDelayPolicy, MinimizeRollbacks, MinimizeDelay );
+
+
+// Continuously measures the round trip time using timestamps piggybacked on PlayerInputs.
+// Each side stamps its send time, and echoes back the last remote send time plus how long it was held,
+// so the round trip time is: now - echoTime - echoHold.
+class LatencyTracker
+{
+public:
+
+    // Policy used to compute the recommended delay / rollback
+    AutoDelayPolicy policy;
+
+    // Number of rollback frames to keep when minimizing delay
+    uint8_t rollbackBudget = DEFAULT_ROLLBACK_BUDGET;
+
+    // Stamp the local send time and the echoed remote time onto outgoing inputs
+    void stamp ( PlayerInputs& playerInputs ) const;
+
+    // Update the timestamps and stats from incoming inputs, received at the given time in milliseconds
+    void gotInputs ( const PlayerInputs& playerInputs, uint32_t now );
+
+    // Recommend a new delay / rollback given the current values, returns true if they should be changed.
+    // The stats are reset once a recommendation has been evaluated, so each window measures the latest conditions.
+    bool recommend ( uint8_t& delay, uint8_t& rollback );
+
+    // Reset all timestamps and stats
+    void reset();
+
+    // Round trip time stats for the current window
+    const Statistics& getStats() const { return _stats; }
+
+    bool isEnabled() const { return ( policy != AutoDelayPolicy::Unknown ); }
+
+private:
+
+    // Round trip time stats, in milliseconds
+    Statistics _stats;
+
+    // Latest remote send time and the local time it was received
+    uint32_t _remoteSendTime = 0, _remoteRecvTime = 0;
+
+    // Last echoed local send time that was sampled, so each echo is only counted once
+    uint32_t _lastEchoTime = 0;
+
+    // Compute the one-way latency in frames, with a margin of the given number of standard deviations
+    uint8_t computeFrames ( double numStdDevs ) const;
+
+    // Compute the delay needed to cover the given latency in frames, with the given rollback
+    uint8_t computeDelay ( uint8_t frames, uint8_t rollback ) const;
+};
@@ -4,6 +4,7 @@
 #include "Protocol.hpp"
 #include "Logger.hpp"
 #include "Statistics.hpp"
+#include "Histogram.hpp"
 #include "Version.hpp"
 #include "Compression.hpp"
 #include "CharacterSelect.hpp"
@@ -55,7 +56,7 @@ struct ClientMode : public SerializableSequence
 {
     ENUM_BOILERPLATE ( ClientMode, Host, Client, SpectateNetplay, SpectateBroadcast, Broadcast, Offline )
 
-    enum { Training = 0x01, GameStarted = 0x02, UdpTunnel = 0x04, IsWine = 0x08, VersusCPU = 0x10 };
+    enum { Training = 0x01, GameStarted = 0x02, UdpTunnel = 0x04, IsWine = 0x08, VersusCPU = 0x10, FastCodecs = 0x20 };
 
     uint8_t flags = 0;
 
@@ -83,6 +84,7 @@ struct ClientMode : public SerializableSequence
     bool isGameStarted() const { return ( flags & GameStarted ); }
     bool isUdpTunnel() const { return ( flags & UdpTunnel ); }
     bool isWine() const { return ( flags & IsWine ); }
+    bool isFastCodecs() const { return ( flags & FastCodecs ); }
     bool isSinglePlayer() const { return ( isNetplay() || isVersusCPU() ); }
 
     std::string flagString() const
@@ -104,6 +106,9 @@ struct ClientMode : public SerializableSequence
         if ( flags & VersusCPU )
             str += std::string ( str.empty() ? "" : ", " ) + "VersusCPU";
 
+        if ( flags & FastCodecs )
+            str += std::string ( str.empty() ? "" : ", " ) + "FastCodecs";
+
         return str;
     }
 
@@ -120,17 +125,20 @@ struct ClientMode : public SerializableSequence
 struct PingStats : public SerializableSequence
 {
     Statistics latency;
+    Histogram histogram;
     uint8_t packetLoss = 0;
 
-    PingStats ( const Statistics& latency, uint8_t packetLoss ) : latency ( latency ), packetLoss ( packetLoss ) {}
+    PingStats ( const Statistics& latency, const Histogram& histogram, uint8_t packetLoss )
+        : latency ( latency ), histogram ( histogram ), packetLoss ( packetLoss ) {}
 
     void clear()
     {
         latency.reset();
+        histogram.reset();
         packetLoss = 0;
     }
 
-    PROTOCOL_MESSAGE_BOILERPLATE ( PingStats, latency, packetLoss )
+    PROTOCOL_MESSAGE_BOILERPLATE ( PingStats, latency, histogram, packetLoss )
 };
 
 
@@ -139,8 +147,9 @@ struct VersionConfig : public SerializableSequence
     ClientMode mode;
     Version version;
 
+    // Always advertises support for decoding the extra protocol codecs
     VersionConfig ( const ClientMode& mode, uint8_t flags = 0 )
-        : mode ( mode.value, mode.flags | flags ), version ( LocalVersion ) {}
+        : mode ( mode.value, mode.flags | flags | ClientMode::FastCodecs ), version ( LocalVersion ) {}
 
     PROTOCOL_MESSAGE_BOILERPLATE ( VersionConfig, mode, version )
 };
@@ -493,11 +502,25 @@ struct PlayerInputs : public SerializableMessage, public BaseInputs
     // Represents the input range [frame - NUM_INPUTS + 1, frame + 1)
     std::array<uint16_t, NUM_INPUTS> inputs;
 
+    // Local time when this was sent, and the last remote sendTime echoed back, see LatencyTracker
+    uint32_t sendTime = 0, echoTime = 0;
+
+    // Milliseconds between receiving the echoed remote timestamp and sending this message
+    uint16_t echoHold = 0;
+
+    // Sender's frame advantage when this was sent, see TimeSync
+    int8_t frameAdvantage = 0;
+
+    // Frame of the latest traced input change, and its age in microseconds when this was sent, see InputTracer
+    IndexedFrame traceFrame = {{ 0, 0 }};
+    uint32_t traceAge = 0;
+
     PlayerInputs ( IndexedFrame indexedFrame ) { this->indexedFrame = indexedFrame; }
 
     std::string str() const override { return format ( "PlayerInputs[%s]", indexedFrame ); }
 
-    PROTOCOL_MESSAGE_BOILERPLATE ( PlayerInputs, indexedFrame.value, inputs )
+    PROTOCOL_MESSAGE_BOILERPLATE ( PlayerInputs, indexedFrame.value, inputs, sendTime, echoTime, echoHold,
+                                   frameAdvantage, traceFrame.value, traceAge )
 };
 
 
@@ -23,6 +23,10 @@ ENUM ( Options,
        MaxDelay,
        DefaultRollback,
        Fullscreen,
+       NetworkThread,
+       Multipath,
+       InputRepairs,
+       RecordReplay,
        // Debug options
        Tests,
        Stdout,
@@ -32,11 +36,13 @@ ENUM ( Options,
        PidLog,
        SyncTest,
        Replay,
+       Discovery,
        // Special options
        NoFork,
        AppDir,
        SessionId,
-       HeldStartDuration );
+       HeldStartDuration,
+       AutoDelay );
 
 
 // Forward declaration
@@ -2,15 +2,36 @@
 #include "StringUtils.hpp"
 #include "Algorithms.hpp"
 
+#include <sys/stat.h>
+
 #include <fstream>
 #include <sstream>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 using namespace std;
 
 
 #define PALETTES_FILE_SUFFIX "_palettes.txt"
 
 
+// Indicates if the first file was modified after the second, or only the first file exists
+static bool isNewerFile ( const string& first, const string& second )
+{
+    struct stat a, b;
+
+    if ( stat ( first.c_str(), &a ) != 0 )
+        return false;
+
+    if ( stat ( second.c_str(), &b ) != 0 )
+        return true;
+
+    return ( a.st_mtime > b.st_mtime );
+}
+
+
 uint32_t PaletteManager::computeHighlightColor ( uint32_t color )
 {
     const uint32_t r = ( color & 0xFF );
@@ -48,13 +69,7 @@ void PaletteManager::cache ( const uint32_t **allPaletteData )
 void PaletteManager::apply ( uint32_t **allPaletteData ) const
 {
     for ( uint32_t i = 0; i < _originals.size(); ++i )
-    {
-        for ( uint32_t j = 0; j < _originals[i].size(); ++j )
-        {
-            allPaletteData[i][j] = ( allPaletteData[i][j] & 0xFF000000 )
-                                   | ( 0xFFFFFF & SWAP_R_AND_B ( get ( i, j ) ) );
-        }
-    }
+        applyPalette ( i, allPaletteData[i] );
 }
 
 void PaletteManager::cache ( const uint32_t *allPaletteData )
@@ -71,22 +86,56 @@ void PaletteManager::cache ( const uint32_t *allPaletteData )
 void PaletteManager::apply ( uint32_t *allPaletteData ) const
 {
     for ( uint32_t i = 0; i < 36; ++i )
-    {
-        for ( uint32_t j = 0; j < 256; ++j )
-        {
-            allPaletteData [ i * 256 + j ] = ( allPaletteData [ i * 256 + j ] & 0xFF000000 )
-                                             | ( 0xFFFFFF & SWAP_R_AND_B ( get ( i, j ) ) );
-        }
-    }
+        applyPalette ( i, &allPaletteData [ i * 256 ] );
 }
 
 void PaletteManager::apply ( uint32_t paletteNumber, uint32_t *singlePaletteData ) const
 {
+    applyPalette ( paletteNumber, singlePaletteData );
+}
+
+void PaletteManager::applyPalette ( uint32_t paletteNumber, uint32_t *paletteData ) const
+{
+    const uint32_t *originals = &_originals[paletteNumber][0];
+    const uint32_t *overrides = &_overrides[paletteNumber][0];
+    const uint32_t *overridden = &_overridden[paletteNumber][0];
+
+#ifdef __SSE2__
+    const __m128i bits = _mm_set_epi32 ( 8, 4, 2, 1 );
+    const __m128i alpha = _mm_set1_epi32 ( 0xFF000000 );
+    const __m128i green = _mm_set1_epi32 ( 0xFF00 );
+    const __m128i low = _mm_set1_epi32 ( 0xFF );
+
+    // 4 colors at a time, same as the scalar version below
+    for ( uint32_t j = 0; j < 256; j += 4 )
+    {
+        // Expand the 4 overridden bits to a mask per color
+        const __m128i mask = _mm_cmpeq_epi32 ( bits,
+                                               _mm_and_si128 ( bits, _mm_set1_epi32 ( overridden[j / 32] >> ( j % 32 ) ) ) );
+
+        const __m128i color = _mm_or_si128 (
+                                  _mm_and_si128 ( mask, _mm_loadu_si128 ( ( const __m128i * ) &overrides[j] ) ),
+                                  _mm_andnot_si128 ( mask, _mm_loadu_si128 ( ( const __m128i * ) &originals[j] ) ) );
+
+        // SWAP_R_AND_B without the alpha
+        const __m128i swapped = _mm_or_si128 (
+                                    _mm_or_si128 ( _mm_slli_epi32 ( _mm_and_si128 ( color, low ), 16 ),
+                                                   _mm_and_si128 ( color, green ) ),
+                                    _mm_and_si128 ( _mm_srli_epi32 ( color, 16 ), low ) );
+
+        // Keep the existing alpha
+        const __m128i data = _mm_loadu_si128 ( ( const __m128i * ) &paletteData[j] );
+
+        _mm_storeu_si128 ( ( __m128i * ) &paletteData[j], _mm_or_si128 ( _mm_and_si128 ( data, alpha ), swapped ) );
+    }
+#else
     for ( uint32_t j = 0; j < 256; ++j )
     {
-        singlePaletteData[j] = ( singlePaletteData [j] & 0xFF000000 )
-                               | ( 0xFFFFFF & SWAP_R_AND_B ( get ( paletteNumber, j ) ) );
+        const uint32_t color = ( ( overridden[j / 32] >> ( j % 32 ) ) & 1 ) ? overrides[j] : originals[j];
+
+        paletteData[j] = ( paletteData[j] & 0xFF000000 ) | ( 0xFFFFFF & SWAP_R_AND_B ( color ) );
     }
+#endif // __SSE2__
 }
 
 uint32_t PaletteManager::getOriginal ( uint32_t paletteNumber, uint32_t colorNumber ) const
@@ -96,6 +145,10 @@ uint32_t PaletteManager::getOriginal ( uint32_t paletteNumber, uint32_t colorNum
 
 uint32_t PaletteManager::get ( uint32_t paletteNumber, uint32_t colorNumber ) const
 {
+    if ( paletteNumber < _overridden.size() && colorNumber < 256 )
+        return ( isOverridden ( paletteNumber, colorNumber ) ? _overrides[paletteNumber][colorNumber]
+                 : getOriginal ( paletteNumber, colorNumber ) );
+
     const auto it = _palettes.find ( paletteNumber );
 
     if ( it != _palettes.end() )
@@ -113,6 +166,12 @@ void PaletteManager::set ( uint32_t paletteNumber, uint32_t colorNumber, uint32_
 {
     _palettes[paletteNumber][colorNumber] = 0xFFFFFF & color;
 
+    if ( paletteNumber < _overridden.size() && colorNumber < 256 )
+    {
+        _overrides[paletteNumber][colorNumber] = 0xFFFFFF & color;
+        _overridden[paletteNumber][colorNumber / 32] |= ( 1u << ( colorNumber % 32 ) );
+    }
+
 #ifndef DISABLE_SERIALIZATION
     invalidate();
 #endif
@@ -130,6 +189,9 @@ void PaletteManager::clear ( uint32_t paletteNumber, uint32_t colorNumber )
             clear ( paletteNumber );
     }
 
+    if ( paletteNumber < _overridden.size() && colorNumber < 256 )
+        _overridden[paletteNumber][colorNumber / 32] &= ~ ( 1u << ( colorNumber % 32 ) );
+
 #ifndef DISABLE_SERIALIZATION
     invalidate();
 #endif
@@ -139,6 +201,9 @@ void PaletteManager::clear ( uint32_t paletteNumber )
 {
     _palettes.erase ( paletteNumber );
 
+    if ( paletteNumber < _overridden.size() )
+        _overridden[paletteNumber].fill ( 0 );
+
 #ifndef DISABLE_SERIALIZATION
     invalidate();
 #endif
@@ -148,6 +213,9 @@ void PaletteManager::clear()
 {
     _palettes.clear();
 
+    for ( auto& overridden : _overridden )
+        overridden.fill ( 0 );
+
 #ifndef DISABLE_SERIALIZATION
     invalidate();
 #endif
@@ -158,6 +226,27 @@ bool PaletteManager::empty() const
     return _palettes.empty();
 }
 
+void PaletteManager::flatten()
+{
+    for ( auto& overridden : _overridden )
+        overridden.fill ( 0 );
+
+    for ( const auto& palette : _palettes )
+    {
+        if ( palette.first >= _overridden.size() )
+            continue;
+
+        for ( const auto& kv : palette.second )
+        {
+            if ( kv.first >= 256 )
+                continue;
+
+            _overrides[palette.first][kv.first] = 0xFFFFFF & kv.second;
+            _overridden[palette.first][kv.first / 32] |= ( 1u << ( kv.first % 32 ) );
+        }
+    }
+}
+
 void PaletteManager::optimize()
 {
     for ( uint32_t i = 0; i < 36; ++i )
@@ -187,12 +276,82 @@ void PaletteManager::optimize()
         }
     }
 
+    flatten();
+
 #ifndef DISABLE_SERIALIZATION
     invalidate();
 #endif
 }
 
 bool PaletteManager::save ( const string& folder, const string& charaName )
+{
+    const bool good = exportText ( folder, charaName );
+
+    // Replace this character's records, keeping every other character
+    PalettePack::Charas charas;
+    {
+        PalettePack pack;
+
+        if ( pack.open ( folder + PALETTES_PACK_FILE ) )
+            pack.read ( charas );
+    }
+
+    toRecords ( _palettes, charas[charaName] );
+
+    return PalettePack::write ( folder + PALETTES_PACK_FILE, charas ) && good;
+}
+
+bool PaletteManager::load ( const string& folder, const string& charaName )
+{
+    const string textFile = folder + charaName + PALETTES_FILE_SUFFIX;
+    const string packFile = folder + PALETTES_PACK_FILE;
+
+    // A text file edited after the pack was written takes priority
+    if ( ! isNewerFile ( textFile, packFile ) )
+    {
+        PalettePack pack;
+
+        if ( pack.open ( packFile ) && load ( pack, charaName ) )
+            return true;
+    }
+
+    return importText ( folder, charaName );
+}
+
+bool PaletteManager::load ( const PalettePack& pack, const string& charaName )
+{
+    uint32_t count = 0;
+    const PalettePack::Record *records = pack.find ( charaName, count );
+
+    if ( ! records )
+        return false;
+
+    // Records are sorted, so each palette's colors are inserted at the end
+    map<uint32_t, uint32_t> *palette = 0;
+
+    for ( uint32_t i = 0; i < count; ++i )
+    {
+        if ( i == 0 || records[i].paletteNumber != records[i - 1].paletteNumber )
+            palette = &_palettes[records[i].paletteNumber];
+
+        palette->emplace_hint ( palette->end(), records[i].colorNumber, 0 )->second = 0xFFFFFF & records[i].color;
+    }
+
+    optimize();
+    return true;
+}
+
+bool PaletteManager::importText ( const string& folder, const string& charaName )
+{
+    const bool good = parseText ( folder + charaName + PALETTES_FILE_SUFFIX, _palettes );
+
+    if ( good )
+        optimize();
+
+    return good;
+}
+
+bool PaletteManager::exportText ( const string& folder, const string& charaName )
 {
     optimize();
 
@@ -232,9 +391,24 @@ bool PaletteManager::save ( const string& folder, const string& charaName )
     return good;
 }
 
-bool PaletteManager::load ( const string& folder, const string& charaName )
+bool PaletteManager::importAllText ( const string& folder, const vector<string>& charaNames )
+{
+    PalettePack::Charas charas;
+
+    for ( const string& charaName : charaNames )
+    {
+        map<uint32_t, map<uint32_t, uint32_t>> palettes;
+
+        if ( parseText ( folder + charaName + PALETTES_FILE_SUFFIX, palettes ) )
+            toRecords ( palettes, charas[charaName] );
+    }
+
+    return PalettePack::write ( folder + PALETTES_PACK_FILE, charas );
+}
+
+bool PaletteManager::parseText ( const string& file, map<uint32_t, map<uint32_t, uint32_t>>& palettes )
 {
-    ifstream fin ( ( folder + charaName + PALETTES_FILE_SUFFIX ).c_str() );
+    ifstream fin ( file.c_str() );
     bool good = fin.good();
 
     if ( good )
@@ -264,16 +438,32 @@ bool PaletteManager::load ( const string& folder, const string& charaName )
             stringstream ss ( parts[1].substr ( 1 ) );
             ss >> hex >> color;
 
-            _palettes[paletteNumber][colorNumber] = color;
+            palettes[paletteNumber][colorNumber] = color;
         }
-
-        optimize();
-
-#ifndef DISABLE_SERIALIZATION
-        invalidate();
-#endif
     }
 
     fin.close();
     return good;
 }
+
+void PaletteManager::toRecords ( const map<uint32_t, map<uint32_t, uint32_t>>& palettes,
+                                 vector<PalettePack::Record>& records )
+{
+    records.clear();
+
+    for ( const auto& palette : palettes )
+    {
+        if ( palette.first > 0xFFFF )
+            continue;
+
+        for ( const auto& kv : palette.second )
+        {
+            if ( kv.first > 0xFFFF )
+                continue;
+
+            const PalettePack::Record record = { uint16_t ( palette.first ), uint16_t ( kv.first ), 0xFFFFFF & kv.second };
+
+            records.push_back ( record );
+        }
+    }
+}
@@ -5,10 +5,13 @@
 #include <cereal/types/map.hpp>
 #endif
 
+#include "PalettePack.hpp"
+
 #include <cstdint>
 #include <map>
 #include <array>
 #include <string>
+#include <vector>
 
 
 #define COLOR_RGB(R, G, B) \
@@ -45,18 +48,59 @@ public:
 
     bool empty() const;
 
+    // Export the text file and update the palette pack in the folder
     bool save ( const std::string& folder, const std::string& charaName );
+
+    // Load from the palette pack in the folder, unless the text file is newer or the pack doesn't have this character
     bool load ( const std::string& folder, const std::string& charaName );
 
+    // Load from an open palette pack
+    bool load ( const PalettePack& pack, const std::string& charaName );
+
+    // Text file import / export
+    bool importText ( const std::string& folder, const std::string& charaName );
+    bool exportText ( const std::string& folder, const std::string& charaName );
+
+    // Build the palette pack in the folder from the text files of each character
+    static bool importAllText ( const std::string& folder, const std::vector<std::string>& charaNames );
+
 #ifndef DISABLE_SERIALIZATION
-    PROTOCOL_MESSAGE_BOILERPLATE ( PaletteManager, _palettes )
+    EMPTY_MESSAGE_BOILERPLATE ( PaletteManager )
+
+    void save ( cereal::BinaryOutputArchive& ar ) const override { ar ( _palettes ); }
+    void load ( cereal::BinaryInputArchive& ar ) override { ar ( _palettes ); flatten(); }
 #endif
 
 private:
 
+    // Overridden colors by palette and color number, this is what gets saved and sent
     std::map<uint32_t, std::map<uint32_t, uint32_t>> _palettes;
 
     std::array<std::array<uint32_t, 256>, 36> _originals;
 
+    // Dense copy of the overrides in _palettes, only valid where the bit in _overridden is set
+    std::array<std::array<uint32_t, 256>, 36> _overrides;
+
+    // Bitmask of overridden colors for each palette
+    std::array<std::array<uint32_t, 8>, 36> _overridden = {{}};
+
+    bool isOverridden ( uint32_t paletteNumber, uint32_t colorNumber ) const
+    {
+        return ( _overridden[paletteNumber][colorNumber / 32] >> ( colorNumber % 32 ) ) & 1;
+    }
+
+    // Rebuild the dense overrides from _palettes
+    void flatten();
+
+    // Apply the overrides or original colors to a single palette in the game's format
+    void applyPalette ( uint32_t paletteNumber, uint32_t *paletteData ) const;
+
     void optimize();
+
+    // Parse a text file into the overrides by palette and color number
+    static bool parseText ( const std::string& file, std::map<uint32_t, std::map<uint32_t, uint32_t>>& palettes );
+
+    // Convert the overrides to palette pack records
+    static void toRecords ( const std::map<uint32_t, std::map<uint32_t, uint32_t>>& palettes,
+                            std::vector<PalettePack::Record>& records );
 };
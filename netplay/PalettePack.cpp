@@ -0,0 +1,204 @@
+#include "PalettePack.hpp"
+#include "Exceptions.hpp"
+#include "Logger.hpp"
+
+#include <windows.h>
+
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+using namespace std;
+
+
+#define PACK_MAGIC      "CCPP"
+
+#define PACK_VERSION    ( 1 )
+
+
+bool PalettePack::open ( const string& file )
+{
+    close();
+
+    _file = CreateFile ( file.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
+
+    if ( _file == INVALID_HANDLE_VALUE )
+    {
+        _file = 0;
+        return false;
+    }
+
+    const DWORD size = GetFileSize ( _file, 0 );
+
+    if ( size == INVALID_FILE_SIZE || size < sizeof ( Header ) )
+    {
+        LOG ( "Invalid palette pack size: %u", size );
+        close();
+        return false;
+    }
+
+    _mapping = CreateFileMapping ( _file, 0, PAGE_READONLY, 0, 0, 0 );
+
+    if ( ! _mapping )
+    {
+        LOG ( "CreateFileMapping failed: %s", WinException::getLastError() );
+        close();
+        return false;
+    }
+
+    _header = ( const Header * ) MapViewOfFile ( _mapping, FILE_MAP_READ, 0, 0, 0 );
+
+    if ( ! _header )
+    {
+        LOG ( "MapViewOfFile failed: %s", WinException::getLastError() );
+        close();
+        return false;
+    }
+
+    // Check everything fits before trusting any offsets
+    const uint64_t expected = sizeof ( Header )
+                              + uint64_t ( _header->charaCount ) * sizeof ( Entry )
+                              + uint64_t ( _header->recordCount ) * sizeof ( Record );
+
+    if ( memcmp ( _header->magic, PACK_MAGIC, sizeof ( _header->magic ) ) != 0
+            || _header->version != PACK_VERSION || expected != size )
+    {
+        LOG ( "Invalid palette pack: version=%u; charaCount=%u; recordCount=%u; size=%u",
+              _header->version, _header->charaCount, _header->recordCount, size );
+        close();
+        return false;
+    }
+
+    _entries = ( const Entry * ) ( _header + 1 );
+    _records = ( const Record * ) ( _entries + _header->charaCount );
+
+    for ( uint32_t i = 0; i < _header->charaCount; ++i )
+    {
+        if ( _entries[i].name[NameSize - 1] != 0
+                || uint64_t ( _entries[i].offset ) + _entries[i].count > _header->recordCount )
+        {
+            LOG ( "Invalid palette pack entry: %u", i );
+            close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void PalettePack::close()
+{
+    if ( _header )
+    {
+        UnmapViewOfFile ( ( void * ) _header );
+        _header = 0;
+    }
+
+    if ( _mapping )
+    {
+        CloseHandle ( _mapping );
+        _mapping = 0;
+    }
+
+    if ( _file )
+    {
+        CloseHandle ( _file );
+        _file = 0;
+    }
+
+    _entries = 0;
+    _records = 0;
+}
+
+const PalettePack::Record *PalettePack::find ( const string& charaName, uint32_t& count ) const
+{
+    if ( ! _header )
+        return 0;
+
+    // The index is sorted by name
+    const Entry *begin = _entries, *end = _entries + _header->charaCount;
+
+    const Entry *it = lower_bound ( begin, end, charaName,
+                                    [] ( const Entry & entry, const string & name ) { return name.compare ( entry.name ) > 0; } );
+
+    if ( it == end || charaName != it->name )
+        return 0;
+
+    count = it->count;
+    return &_records[it->offset];
+}
+
+void PalettePack::read ( Charas& charas ) const
+{
+    if ( ! _header )
+        return;
+
+    for ( uint32_t i = 0; i < _header->charaCount; ++i )
+    {
+        const Record *records = &_records[_entries[i].offset];
+
+        charas[_entries[i].name].assign ( records, records + _entries[i].count );
+    }
+}
+
+bool PalettePack::write ( const string& file, const Charas& charas )
+{
+    Header header;
+    memcpy ( header.magic, PACK_MAGIC, sizeof ( header.magic ) );
+    header.version = PACK_VERSION;
+    header.charaCount = 0;
+    header.recordCount = 0;
+
+    vector<Entry> entries;
+
+    // Charas is sorted by name, so the index is too
+    for ( const auto& kv : charas )
+    {
+        if ( kv.first.empty() || kv.first.size() >= NameSize || kv.second.empty() )
+            continue;
+
+        Entry entry;
+        memset ( entry.name, 0, sizeof ( entry.name ) );
+        memcpy ( entry.name, kv.first.c_str(), kv.first.size() );
+        entry.offset = header.recordCount;
+        entry.count = kv.second.size();
+
+        entries.push_back ( entry );
+
+        header.recordCount += entry.count;
+    }
+
+    header.charaCount = entries.size();
+
+    // Write to a temporary file first, so readers never see a partial pack
+    const string tmpFile = file + ".tmp";
+
+    ofstream fout ( tmpFile.c_str(), ios::binary );
+    bool good = fout.good();
+
+    if ( good )
+    {
+        fout.write ( ( const char * ) &header, sizeof ( header ) );
+
+        if ( ! entries.empty() )
+            fout.write ( ( const char * ) &entries[0], entries.size() * sizeof ( Entry ) );
+
+        for ( const Entry& entry : entries )
+            fout.write ( ( const char * ) &charas.find ( entry.name )->second[0], entry.count * sizeof ( Record ) );
+
+        good = fout.good();
+    }
+
+    fout.close();
+
+    if ( good && ! MoveFileEx ( tmpFile.c_str(), file.c_str(), MOVEFILE_REPLACE_EXISTING ) )
+    {
+        LOG ( "MoveFileEx failed: %s", WinException::getLastError() );
+        good = false;
+    }
+
+    if ( ! good )
+        DeleteFile ( tmpFile.c_str() );
+
+    return good;
+}
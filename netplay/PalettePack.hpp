@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+
+
+// Name of the palette pack file in the palettes folder
+#define PALETTES_PACK_FILE "palettes.bin"
+
+
+// Binary file with the palette overrides of every character, read through a read-only file mapping.
+// The layout is a header, an index of characters sorted by name, then all the override records.
+class PalettePack
+{
+public:
+
+    // Maximum length of a character name, including the null terminator
+    static const uint32_t NameSize = 16;
+
+    // Single overridden color
+    struct Record
+    {
+        uint16_t paletteNumber;
+        uint16_t colorNumber;
+        uint32_t color;
+    };
+
+    // Override records by character name
+    typedef std::map<std::string, std::vector<Record>> Charas;
+
+    // Basic constructor / destructor
+    PalettePack() {}
+    ~PalettePack() { close(); }
+
+    // Map an existing pack file, returns false if it is missing or invalid
+    bool open ( const std::string& file );
+
+    // Unmap the file
+    void close();
+
+    // Indicates if a pack file is mapped
+    bool isOpen() const { return ( _header != 0 ); }
+
+    // Find the records for a character, returns 0 if the character isn't in the pack
+    const Record *find ( const std::string& charaName, uint32_t& count ) const;
+
+    // Copy the records of every character
+    void read ( Charas& charas ) const;
+
+    // Write a new pack file, replacing any existing one
+    static bool write ( const std::string& file, const Charas& charas );
+
+private:
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t charaCount;
+        uint32_t recordCount;
+    };
+
+    struct Entry
+    {
+        char name[NameSize];
+        uint32_t offset;
+        uint32_t count;
+    };
+
+    // File and mapping handles
+    void *_file = 0, *_mapping = 0;
+
+    // Mapped file contents
+    const Header *_header = 0;
+    const Entry *_entries = 0;
+    const Record *_records = 0;
+};
@@ -5,6 +5,7 @@
 #include "EventManager.hpp"
 #include "Exceptions.hpp"
 #include "ErrorStringsExt.hpp"
+#include "TimerManager.hpp"
 
 #include <windows.h>
 #include <direct.h>
@@ -23,14 +24,174 @@ using namespace std;
 
 #define PIPE_CONNECT_TIMEOUT    ( 60000 )
 
+// Interval to check if the startup hook thread should stop
+#define STARTUP_HOOK_INTERVAL   ( 100 )
+
 #define CC_KEY_CONFIG           "System\\_App.ini"
 
+// Shared memory ring names, formatted with the game process ID and the sending side
+#define IPC_RING_NAME           "Local\\cccaster_ipc_%08x_%s"
+
+#define IPC_RING_CAPACITY       ( 4 * 1024 * 1024 )
+
+// Interval to check if the ring wait thread should stop
+#define IPC_RING_WAIT_INTERVAL  ( 1000 )
+
 
 string ProcessManager::gameDir;
 
 string ProcessManager::appDir;
 
 
+struct ProcessManager::RingWaitThread : public Thread
+{
+    SharedRing& ring;
+
+    volatile bool stopping = false;
+
+    RingWaitThread ( SharedRing& ring ) : ring ( ring ) {}
+
+    void run() override
+    {
+        while ( ! stopping )
+        {
+            if ( ring.wait ( IPC_RING_WAIT_INTERVAL ) && ! stopping && ! ring.isEmpty() )
+                EventManager::get().wake();
+        }
+    }
+};
+
+
+// Unblock ConnectNamedPipe by connecting to the pipe ourselves
+static void unblockPipe()
+{
+    HANDLE tmpPipe = CreateFile ( NAMED_PIPE, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                  0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
+
+    if ( tmpPipe == INVALID_HANDLE_VALUE )
+        return;
+
+    CloseHandle ( tmpPipe );
+}
+
+struct ProcessManager::PipeConnectThread : public Thread
+{
+    void *pipe;
+
+    volatile bool done = false;
+
+    bool failed = false;
+
+    Exception exc;
+
+    uint16_t ipcPort = 0;
+
+    int processId = 0;
+
+    PipeConnectThread ( void *pipe ) : pipe ( pipe ) {}
+
+    void run() override
+    {
+        try
+        {
+            connect();
+        }
+        catch ( const Exception& exc )
+        {
+            this->exc = exc;
+            failed = true;
+        }
+
+        done = true;
+        EventManager::get().wake();
+    }
+
+    void connect()
+    {
+        if ( ! ConnectNamedPipe ( pipe, 0 ) )
+        {
+            int error = GetLastError();
+
+            if ( error != ERROR_PIPE_CONNECTED )
+                THROW_WIN_EXCEPTION ( error, "ConnectNamedPipe failed", ERROR_PIPE_START );
+        }
+
+        read ( &ipcPort, sizeof ( ipcPort ) );
+        read ( &processId, sizeof ( processId ) );
+    }
+
+    void read ( void *buffer, DWORD size )
+    {
+        DWORD bytes;
+
+        if ( ! ReadFile ( pipe, buffer, size, &bytes, 0 ) )
+            THROW_WIN_EXCEPTION ( GetLastError(), "ReadFile failed", ERROR_PIPE_RW );
+
+        if ( bytes != size )
+            THROW_EXCEPTION ( "read %d bytes, expected %d", ERROR_PIPE_RW, bytes, size );
+    }
+};
+
+// Clicks through the startup dialog as soon as it is shown, instead of waiting for the next poll
+struct ProcessManager::StartupHookThread : public Thread
+{
+    volatile bool stopping = false;
+
+    static bool isStartupWindow ( HWND hwnd )
+    {
+        char buffer[4096];
+        GetWindowText ( hwnd, buffer, sizeof ( buffer ) );
+
+        return ( trimmed ( buffer ).find ( CC_STARTUP_TITLE ) == 0 );
+    }
+
+    static void CALLBACK winEventProc ( HWINEVENTHOOK hook, DWORD event, HWND hwnd,
+                                        LONG idObject, LONG idChild, DWORD threadId, DWORD time )
+    {
+        if ( ! hwnd || idObject != OBJID_WINDOW )
+            return;
+
+        // The button may be shown before or after the dialog itself
+        HWND dialog = GetAncestor ( hwnd, GA_ROOT );
+
+        if ( ! dialog || ! isStartupWindow ( dialog ) )
+            return;
+
+        HWND button = FindWindowEx ( dialog, 0, 0, CC_STARTUP_BUTTON );
+
+        if ( button && IsWindowVisible ( dialog ) )
+        {
+            LOG ( "Startup dialog shown" );
+            PostMessage ( button, BM_CLICK, 0, 0 );
+        }
+    }
+
+    void run() override
+    {
+        HWINEVENTHOOK hook = SetWinEventHook ( EVENT_OBJECT_SHOW, EVENT_OBJECT_SHOW, 0, winEventProc, 0, 0,
+                                               WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS );
+
+        if ( ! hook )
+        {
+            LOG ( "SetWinEventHook failed: %s", WinException::getLastError() );
+            return;
+        }
+
+        // Out of context hooks are called while this thread pumps messages
+        while ( ! stopping )
+        {
+            MsgWaitForMultipleObjects ( 0, 0, FALSE, STARTUP_HOOK_INTERVAL, QS_ALLINPUT );
+
+            MSG msg;
+            while ( PeekMessage ( &msg, 0, 0, 0, PM_REMOVE ) )
+                DispatchMessage ( &msg );
+        }
+
+        UnhookWinEvent ( hook );
+    }
+};
+
+
 ProcessManager::ProcessManager ( Owner *owner ) : owner ( owner ) {}
 
 ProcessManager::~ProcessManager()
@@ -49,7 +210,7 @@ void ProcessManager::socketAccepted ( Socket *serverSocket )
 
     ASSERT ( _ipcSocket->address.addr == "127.0.0.1" );
 
-    _ipcSocket->send ( new IpcConnected() );
+    _ipcSocket->send ( new IpcConnected ( _sendRing.isOpen() && _recvRing.isOpen() ) );
 }
 
 void ProcessManager::socketConnected ( Socket *socket )
@@ -57,7 +218,7 @@ void ProcessManager::socketConnected ( Socket *socket )
     ASSERT ( socket == _ipcSocket.get() );
     ASSERT ( _ipcSocket->address.addr == "127.0.0.1" );
 
-    _ipcSocket->send ( new IpcConnected() );
+    _ipcSocket->send ( new IpcConnected ( _sendRing.isOpen() && _recvRing.isOpen() ) );
 }
 
 void ProcessManager::socketDisconnected ( Socket *socket )
@@ -68,6 +229,10 @@ void ProcessManager::socketDisconnected ( Socket *socket )
 
     LOG ( "IPC disconnected" );
 
+    // A pre-warmed game was closed, openGame will launch it again
+    if ( _holding )
+        return;
+
     if ( owner )
         owner->ipcDisconnected();
 }
@@ -84,11 +249,31 @@ void ProcessManager::socketRead ( Socket *socket, const MsgPtr& msg, const IpAdd
         _connected = true;
         _gameStartTimer.reset();
 
-        if ( owner )
+        if ( _startupHookThread )
+        {
+            _startupHookThread->stopping = true;
+            _startupHookThread.reset();
+        }
+
+        // Only use the shared memory rings if both sides opened them, otherwise fallback to the IPC socket
+        _useRing = ( msg->getAs<IpcConnected>().sharedRing && _sendRing.isOpen() && _recvRing.isOpen() );
+
+        if ( ! _useRing )
+            closeRings();
+
+        LOG ( "IPC connected after %.1f ms; sharedRing=%u",
+              ( TimerManager::get().getNowUs ( true ) - _launchTimeUs ) / 1000.0, _useRing );
+
+        // Wait for openGame if pre-warming
+        if ( owner && ! _holding )
             owner->ipcConnected();
         return;
     }
 
+    // Socket messages are only sent after the ring, so dispatch anything still in the ring first
+    if ( _useRing )
+        readRing();
+
     owner->ipcRead ( msg );
 }
 
@@ -102,7 +287,7 @@ void ProcessManager::timerExpired ( Timer *timer )
 
         LOG ( "Failed to start game" );
 
-        if ( owner )
+        if ( owner && ! _holding )
             owner->ipcDisconnected();
         return;
     }
@@ -123,7 +308,45 @@ void ProcessManager::timerExpired ( Timer *timer )
         return;
 }
 
+void ProcessManager::prewarmGame ( bool highPriority )
+{
+    if ( _pipe )
+        return;
+
+    LOG ( "Pre-warming game" );
+
+    _holding = true;
+
+    try
+    {
+        launchGame ( highPriority );
+    }
+    catch ( const Exception& exc )
+    {
+        // Not fatal yet, openGame will try again
+        disconnectPipe();
+    }
+}
+
 void ProcessManager::openGame ( bool highPriority )
+{
+    if ( _pipe && _holding )
+    {
+        LOG ( "Using pre-warmed game" );
+
+        _holding = false;
+
+        if ( isConnected() && owner )
+            owner->ipcConnected();
+        return;
+    }
+
+    _holding = false;
+
+    launchGame ( highPriority );
+}
+
+void ProcessManager::launchGame ( bool highPriority )
 {
     LOG ( "Opening pipe" );
 
@@ -138,7 +361,10 @@ void ProcessManager::openGame ( bool highPriority )
                 0 );                                                 // use default security attributes
 
     if ( _pipe == INVALID_HANDLE_VALUE )
+    {
+        _pipe = 0;
         THROW_WIN_EXCEPTION ( GetLastError(), "CreateNamedPipe failed", ERROR_PIPE_OPEN );
+    }
 
     LOG ( "appDir='%s'", appDir );
     LOG ( "gameDir='%s'", gameDir );
@@ -161,6 +387,12 @@ void ProcessManager::openGame ( bool highPriority )
         args[i] = stringArgs[i].c_str();
     args[stringArgs.size()] = NULL;
 
+    // Watch for the startup dialog before the game can show it
+    _startupHookThread.reset ( new StartupHookThread() );
+    _startupHookThread->start();
+
+    _launchTimeUs = TimerManager::get().getNowUs ( true );
+
     intptr_t returnCode = _spawnv ( _P_DETACH, path.c_str(), args );
     if ( returnCode < 0 )
         THROW_EXCEPTION ( "errno=%d", ERROR_PIPE_START, errno );
@@ -173,13 +405,7 @@ void ProcessManager::openGame ( bool highPriority )
         {
             Sleep ( PIPE_CONNECT_TIMEOUT );
 
-            HANDLE tmpPipe = CreateFile ( NAMED_PIPE, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
-                                          0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
-
-            if ( tmpPipe == INVALID_HANDLE_VALUE )
-                return;
-
-            CloseHandle ( tmpPipe );
+            unblockPipe();
         }
     };
 
@@ -187,24 +413,42 @@ void ProcessManager::openGame ( bool highPriority )
     thread->start();
     EventManager::get().addThread ( thread );
 
-    if ( ! ConnectNamedPipe ( _pipe, 0 ) )
-    {
-        int error = GetLastError();
+    // Wait for the DLL in the background, so the event loop keeps running while the game loads
+    _pipeConnectThread.reset ( new PipeConnectThread ( _pipe ) );
+    _pipeConnectThread->start();
 
-        if ( error != ERROR_PIPE_CONNECTED )
-            THROW_WIN_EXCEPTION ( GetLastError(), "ConnectNamedPipe failed", ERROR_PIPE_START );
-    }
+    EventManager::get().addSource ( this );
 
-    LOG ( "Pipe connected" );
+    _gameStartTimer.reset ( new Timer ( this ) );
+    _gameStartTimer->start ( GAME_START_INTERVAL );
+    _gameStartCount = 0;
+}
+
+void ProcessManager::pipeConnected()
+{
+    ASSERT ( _pipeConnectThread.get() != 0 );
+
+    _pipeConnectThread->join();
+
+    const shared_ptr<PipeConnectThread> thread = _pipeConnectThread;
+    _pipeConnectThread.reset();
+
+    if ( thread->failed )
+    {
+        if ( _holding )
+        {
+            LOG ( "Failed to pre-warm game" );
+            disconnectPipe();
+            return;
+        }
 
-    DWORD bytes;
-    IpAddrPort ipcHost ( "127.0.0.1", 0 );
+        disconnectPipe();
+        throw thread->exc;
+    }
 
-    if ( ! ReadFile ( _pipe, &ipcHost.port, sizeof ( ipcHost.port ), &bytes, 0 ) )
-        THROW_WIN_EXCEPTION ( GetLastError(), "ReadFile failed", ERROR_PIPE_RW );
+    LOG ( "Pipe connected after %.1f ms", ( TimerManager::get().getNowUs ( true ) - _launchTimeUs ) / 1000.0 );
 
-    if ( bytes != sizeof ( ipcHost.port ) )
-        THROW_EXCEPTION ( "read %d bytes, expected %d", ERROR_PIPE_RW, bytes, sizeof ( ipcHost.port ) );
+    IpAddrPort ipcHost ( "127.0.0.1", thread->ipcPort );
 
     LOG ( "ipcHost='%s'", ipcHost );
 
@@ -212,22 +456,16 @@ void ProcessManager::openGame ( bool highPriority )
 
     LOG ( "ipcSocket=%08x", _ipcSocket.get() );
 
-    if ( ! ReadFile ( _pipe, &_processId, sizeof ( _processId ), &bytes, 0 ) )
-        THROW_WIN_EXCEPTION ( GetLastError(), "ReadFile failed", ERROR_PIPE_RW );
-
-    if ( bytes != sizeof ( _processId ) )
-        THROW_EXCEPTION ( "read %d bytes, expected %d", ERROR_PIPE_RW, bytes, sizeof ( _processId ) );
+    _processId = thread->processId;
 
     LOG ( "processId=%08x", _processId );
 
-    _gameStartTimer.reset ( new Timer ( this ) );
-    _gameStartTimer->start ( GAME_START_INTERVAL );
-    _gameStartCount = 0;
+    openRings ( false );
 }
 
 void ProcessManager::closeGame()
 {
-    if ( ! isConnected() )
+    if ( ! _pipe )
         return;
 
     disconnectPipe();
@@ -245,9 +483,24 @@ void ProcessManager::closeGame()
 
 void ProcessManager::disconnectPipe()
 {
+    if ( _pipeConnectThread )
+    {
+        unblockPipe();
+        _pipeConnectThread->join();
+        _pipeConnectThread.reset();
+    }
+
+    if ( _startupHookThread )
+    {
+        _startupHookThread->stopping = true;
+        _startupHookThread.reset();
+    }
+
     _gameStartTimer.reset();
     _ipcSocket.reset();
 
+    closeRings();
+
     if ( _pipe )
     {
         CloseHandle ( ( HANDLE ) _pipe );
@@ -451,6 +704,105 @@ bool ProcessManager::ipcSend ( const MsgPtr& msg )
 {
     if ( ! isConnected() )
         return false;
+    else if ( _useRing )
+        return ringSend ( msg );
     else
         return _ipcSocket->send ( msg );
 }
+
+void ProcessManager::openRings ( bool isDll )
+{
+    closeRings();
+
+    const string exeRing = format ( IPC_RING_NAME, _processId, "exe" );
+    const string dllRing = format ( IPC_RING_NAME, _processId, "dll" );
+
+    if ( ! _sendRing.open ( isDll ? dllRing : exeRing, IPC_RING_CAPACITY )
+            || ! _recvRing.open ( isDll ? exeRing : dllRing, IPC_RING_CAPACITY ) )
+    {
+        LOG ( "Failed to open shared rings, using IPC socket" );
+        closeRings();
+        return;
+    }
+
+    _ringWaitThread.reset ( new RingWaitThread ( _recvRing ) );
+    _ringWaitThread->start();
+
+    EventManager::get().addSource ( this );
+}
+
+void ProcessManager::closeRings()
+{
+    if ( _ringWaitThread )
+    {
+        _ringWaitThread->stopping = true;
+        _recvRing.signal();
+        _ringWaitThread->join();
+        _ringWaitThread.reset();
+    }
+
+    EventManager::get().removeSource ( this );
+
+    _sendRing.close();
+    _recvRing.close();
+    _useRing = false;
+    _ringSendFallback = false;
+}
+
+bool ProcessManager::ringSend ( const MsgPtr& msg )
+{
+    if ( _ringSendFallback )
+        return _ipcSocket->send ( msg );
+
+    const string bytes = Protocol::encodeLocal ( msg );
+
+    // Never wait for the other side to read, since this is called from the game thread.
+    // Instead send this and all later messages over the IPC socket, the reader drains the ring before
+    // dispatching any socket messages, so the order is preserved.
+    if ( bytes.empty() || bytes.size() > IPC_RING_CAPACITY / 2 || ! _sendRing.write ( &bytes[0], bytes.size() ) )
+    {
+        LOG ( "Falling back to IPC socket for '%s'; size=%u", msg, bytes.size() );
+        _ringSendFallback = true;
+        return _ipcSocket->send ( msg );
+    }
+
+    return true;
+}
+
+bool ProcessManager::readRing()
+{
+    bool dispatched = false;
+    string bytes;
+
+    while ( _useRing && _recvRing.read ( bytes ) )
+    {
+        dispatched = true;
+
+        MsgPtr msg = Protocol::decodeLocal ( &bytes[0], bytes.size() );
+
+        if ( ! msg )
+        {
+            LOG ( "Failed to decode shared ring message; size=%u", bytes.size() );
+            continue;
+        }
+
+        if ( owner )
+            owner->ipcRead ( msg );
+    }
+
+    return dispatched;
+}
+
+bool ProcessManager::checkSource()
+{
+    if ( _pipeConnectThread && _pipeConnectThread->done )
+    {
+        pipeConnected();
+        return true;
+    }
+
+    if ( ! _useRing )
+        return false;
+
+    return readRing();
+}
@@ -4,6 +4,8 @@
 #include "Timer.hpp"
 #include "Protocol.hpp"
 #include "Messages.hpp"
+#include "SharedRing.hpp"
+#include "EventManager.hpp"
 
 #include <array>
 
@@ -13,12 +15,21 @@
 #define INLINE_INPUT(INPUT)                 uint16_t ( ( INPUT ) & 0x000Fu ), uint16_t ( ( ( INPUT ) & 0xFFF0u ) >> 4 )
 
 
-struct IpcConnected : public SerializableSequence { EMPTY_MESSAGE_BOILERPLATE ( IpcConnected ) };
+struct IpcConnected : public SerializableSequence
+{
+    // If the sender has opened the shared memory rings
+    uint8_t sharedRing = 0;
+
+    IpcConnected ( bool sharedRing ) : sharedRing ( sharedRing ) {}
+
+    PROTOCOL_MESSAGE_BOILERPLATE ( IpcConnected, sharedRing )
+};
 
 
 class ProcessManager
     : private Socket::Owner
     , private Timer::Owner
+    , private EventManager::Source
 {
 public:
 
@@ -63,10 +74,16 @@ public:
     ProcessManager ( Owner *owner );
     ~ProcessManager();
 
-    // Open / close the game from the EXE side
+    // Launch the game in the background from the EXE side, ipcConnected is held until openGame is called
+    void prewarmGame ( bool highPriority = false );
+
+    // Open / close the game from the EXE side, this uses the pre-warmed game if there is one
     void openGame ( bool highPriority = false );
     void closeGame();
 
+    // Indicates if the game has been launched, but not necessarily connected yet
+    bool isLaunched() const { return _pipe; }
+
     // Connect / disconnect the IPC pipe and socket from the DLL side
     void connectPipe();
     void disconnectPipe();
@@ -74,7 +91,10 @@ public:
     // Indicates if the IPC pipe and socket are connected
     bool isConnected() const;
 
-    // Send a message over the IPC socket
+    // Indicates if IPC messages are sent over shared memory instead of the socket
+    bool isSharedRing() const { return _useRing; }
+
+    // Send a message over the shared memory ring if both sides support it, otherwise over the IPC socket
     bool ipcSend ( Serializable& msg );
     bool ipcSend ( Serializable *msg );
     bool ipcSend ( const MsgPtr& msg );
@@ -120,6 +140,54 @@ private:
     // IPC connected flag
     bool _connected = false;
 
+    // Indicates the game was pre-warmed and openGame hasn't been called yet
+    bool _holding = false;
+
+    // Time in microseconds when the game was launched
+    uint64_t _launchTimeUs = 0;
+
+    // Thread that waits for the DLL to connect to the named pipe
+    struct PipeConnectThread;
+    std::shared_ptr<PipeConnectThread> _pipeConnectThread;
+
+    // Thread that watches for the startup dialog
+    struct StartupHookThread;
+    std::shared_ptr<StartupHookThread> _startupHookThread;
+
+    // Launch the game and start waiting for the DLL to connect
+    void launchGame ( bool highPriority );
+
+    // Connect the IPC socket once the DLL has connected to the named pipe
+    void pipeConnected();
+
+    // Shared memory rings for sending and receiving IPC messages.
+    // The IPC socket is still used to detect disconnects, and as a fallback if these fail to open.
+    SharedRing _sendRing, _recvRing;
+
+    // Only use the rings after both sides have opened them
+    bool _useRing = false;
+
+    // Set once a message didn't fit in the send ring, after which all messages are sent over the IPC socket.
+    // Switching back would let later ring messages overtake earlier socket messages.
+    bool _ringSendFallback = false;
+
+    // Thread that waits for the receive ring and wakes up the event loop
+    struct RingWaitThread;
+    std::shared_ptr<RingWaitThread> _ringWaitThread;
+
+    // Open / close the shared memory rings
+    void openRings ( bool isDll );
+    void closeRings();
+
+    // Send a message over the shared memory ring, falls back to the IPC socket if it doesn't fit
+    bool ringSend ( const MsgPtr& msg );
+
+    // Dispatch all messages in the receive ring, returns true if any were dispatched
+    bool readRing();
+
+    // Finish connecting the named pipe, and dispatch messages from the receive ring
+    bool checkSource() override;
+
     // IPC socket callbacks
     void socketAccepted ( Socket *socket ) override;
     void socketConnected ( Socket *socket ) override;
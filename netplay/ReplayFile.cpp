@@ -0,0 +1,398 @@
+#include "ReplayFile.hpp"
+#include "Messages.hpp"
+#include "Logger.hpp"
+#include "BlockingQueue.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+
+#define REPLAY_MAGIC "CCRP"
+
+#define REPLAY_MAGIC_SIZE ( 4 )
+
+// Size of the footer: index offset + magic
+#define REPLAY_FOOTER_SIZE ( sizeof ( uint64_t ) + REPLAY_MAGIC_SIZE )
+
+
+// Add a record to the seek index
+static void addToIndex ( ReplayIndex& index, const MsgPtr& msg, uint64_t offset )
+{
+    switch ( msg->getMsgType() )
+    {
+        case MsgType::ReplayInputs:
+        {
+            const uint32_t i = msg->getAs<ReplayInputs>().index;
+
+            if ( i >= index.inputs.size() )
+                index.inputs.resize ( i + 1, 0 );
+
+            index.inputs[i] = offset;
+            break;
+        }
+
+        case MsgType::RngState:
+        {
+            const uint32_t i = msg->getAs<RngState>().index;
+
+            if ( i >= index.rngStates.size() )
+                index.rngStates.resize ( i + 1, 0 );
+
+            index.rngStates[i] = offset;
+            break;
+        }
+
+        case MsgType::InitialGameState:
+            index.initialStates.push_back ( offset );
+            break;
+
+        case MsgType::ReplayKeyframe:
+            index.keyframeFrames.push_back ( msg->getAs<ReplayKeyframe>().indexedFrame.value );
+            index.keyframes.push_back ( offset );
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+struct ReplayWriter::WriterThread : public Thread
+{
+    ReplayWriter& writer;
+
+    // Records to write, a null message stops the thread
+    BlockingQueue<MsgPtr> records;
+
+    WriterThread ( ReplayWriter& writer ) : writer ( writer ) {}
+
+    void run() override
+    {
+        for ( ;; )
+        {
+            const MsgPtr msg = records.pop();
+
+            if ( ! msg )
+                break;
+
+            addToIndex ( writer._index, msg, writer.write ( msg ) );
+        }
+    }
+};
+
+
+bool ReplayWriter::open ( const string& replayFile )
+{
+    close();
+
+    _fout.open ( replayFile.c_str(), ios::binary | ios::trunc );
+
+    if ( ! _fout.good() )
+    {
+        LOG ( "Failed to open replay file: '%s'", replayFile );
+        _fout.close();
+        return false;
+    }
+
+    const uint32_t version = REPLAY_FILE_VERSION;
+
+    _fout.write ( REPLAY_MAGIC, REPLAY_MAGIC_SIZE );
+    _fout.write ( ( const char * ) &version, sizeof ( version ) );
+
+    _index = ReplayIndex();
+    _inputs.reset();
+    _lastKeyframe.value = 0;
+
+    _writerThread.reset ( new WriterThread ( *this ) );
+    _writerThread->start();
+
+    LOG ( "Recording replay: '%s'", replayFile );
+    return true;
+}
+
+void ReplayWriter::close()
+{
+    if ( ! isOpen() )
+        return;
+
+    flushInputs();
+
+    // Wait for all the queued records
+    _writerThread->records.push ( NullMsg );
+    _writerThread->join();
+    _writerThread.reset();
+
+    const uint64_t offset = write ( MsgPtr ( new ReplayIndex ( _index ) ) );
+
+    _fout.write ( ( const char * ) &offset, sizeof ( offset ) );
+    _fout.write ( REPLAY_MAGIC, REPLAY_MAGIC_SIZE );
+    _fout.close();
+
+    LOG ( "Finished replay: %u indices; %u keyframes", _index.inputs.size(), _index.keyframes.size() );
+}
+
+void ReplayWriter::setInputs ( IndexedFrame indexedFrame, uint32_t gameMode, NetplayState netplayState,
+                               uint16_t p1, uint16_t p2 )
+{
+    if ( ! isOpen() )
+        return;
+
+    if ( _inputs && _inputs->getAs<ReplayInputs>().index != indexedFrame.parts.index )
+        flushInputs();
+
+    if ( ! _inputs )
+        _inputs.reset ( new ReplayInputs ( indexedFrame.parts.index, gameMode, netplayState ) );
+
+    ReplayInputs& inputs = _inputs->getAs<ReplayInputs>();
+
+    if ( indexedFrame.parts.frame >= inputs.p1.size() )
+    {
+        inputs.p1.resize ( indexedFrame.parts.frame + 1, 0 );
+        inputs.p2.resize ( indexedFrame.parts.frame + 1, 0 );
+    }
+
+    inputs.p1[indexedFrame.parts.frame] = p1;
+    inputs.p2[indexedFrame.parts.frame] = p2;
+}
+
+void ReplayWriter::writeRngState ( const MsgPtr& msgRngState )
+{
+    if ( ! isOpen() || ! msgRngState )
+        return;
+
+    // Copy since the original is also sent over the network, and encoding isn't thread safe
+    queue ( MsgPtr ( new RngState ( msgRngState->getAs<RngState>() ) ) );
+}
+
+void ReplayWriter::writeInitialState ( const MsgPtr& msgInitialState )
+{
+    if ( ! isOpen() || ! msgInitialState )
+        return;
+
+    queue ( MsgPtr ( new InitialGameState ( msgInitialState->getAs<InitialGameState>() ) ) );
+}
+
+bool ReplayWriter::shouldWriteKeyframe ( IndexedFrame indexedFrame ) const
+{
+    if ( ! isOpen() )
+        return false;
+
+    if ( indexedFrame.parts.index != _lastKeyframe.parts.index )
+        return true;
+
+    return ( indexedFrame.parts.frame >= _lastKeyframe.parts.frame + REPLAY_KEYFRAME_INTERVAL );
+}
+
+void ReplayWriter::writeKeyframe ( const MsgPtr& msgKeyframe )
+{
+    if ( ! isOpen() || ! msgKeyframe )
+        return;
+
+    const IndexedFrame indexedFrame = msgKeyframe->getAs<ReplayKeyframe>().indexedFrame;
+
+    ASSERT ( _lastKeyframe.value == 0 || indexedFrame.value > _lastKeyframe.value );
+
+    queue ( msgKeyframe );
+
+    _lastKeyframe = indexedFrame;
+}
+
+void ReplayWriter::flushInputs()
+{
+    if ( ! _inputs )
+        return;
+
+    queue ( _inputs );
+    _inputs.reset();
+}
+
+void ReplayWriter::queue ( const MsgPtr& msg )
+{
+    _writerThread->records.push ( msg );
+}
+
+uint64_t ReplayWriter::write ( const MsgPtr& msg )
+{
+    const uint64_t offset = _fout.tellp();
+    const string bytes = Protocol::encode ( msg );
+    const uint32_t size = bytes.size();
+
+    _fout.write ( ( const char * ) &size, sizeof ( size ) );
+    _fout.write ( &bytes[0], bytes.size() );
+    return offset;
+}
+
+bool ReplayReader::isReplayFile ( const string& replayFile )
+{
+    ifstream fin ( replayFile.c_str(), ios::binary );
+
+    char magic[REPLAY_MAGIC_SIZE];
+
+    if ( ! fin.read ( magic, sizeof ( magic ) ) )
+        return false;
+
+    return ( memcmp ( magic, REPLAY_MAGIC, REPLAY_MAGIC_SIZE ) == 0 );
+}
+
+bool ReplayReader::open ( const string& replayFile )
+{
+    _fin.close();
+    _fin.clear();
+    _fin.open ( replayFile.c_str(), ios::binary );
+
+    char magic[REPLAY_MAGIC_SIZE];
+    uint32_t version = 0;
+
+    if ( ! _fin.read ( magic, sizeof ( magic ) ) || memcmp ( magic, REPLAY_MAGIC, REPLAY_MAGIC_SIZE ) != 0
+            || ! _fin.read ( ( char * ) &version, sizeof ( version ) ) || version != REPLAY_FILE_VERSION )
+    {
+        LOG ( "Invalid replay file: '%s'; version=%u", replayFile, version );
+        return false;
+    }
+
+    // Read the footer
+    uint64_t offset = 0;
+
+    _fin.seekg ( 0, ios::end );
+    _fileSize = _fin.tellg();
+
+    if ( _fileSize >= REPLAY_MAGIC_SIZE + sizeof ( version ) + REPLAY_FOOTER_SIZE )
+    {
+        _fin.seekg ( _fileSize - REPLAY_FOOTER_SIZE );
+        _fin.read ( ( char * ) &offset, sizeof ( offset ) );
+        _fin.read ( magic, sizeof ( magic ) );
+
+        if ( ! _fin || memcmp ( magic, REPLAY_MAGIC, REPLAY_MAGIC_SIZE ) != 0 )
+            offset = 0;
+    }
+
+    MsgPtr msg = ( offset ? read ( offset, MsgType::ReplayIndex ) : NullMsg );
+
+    if ( msg )
+        _index = msg->getAs<ReplayIndex>();
+
+    if ( ! msg || ! isIndexValid() )
+    {
+        LOG ( "Missing or invalid seek index, rebuilding" );
+        rebuildIndex();
+    }
+
+    LOG ( "Opened replay: '%s'; %u indices; %u keyframes", replayFile, _index.inputs.size(), _index.keyframes.size() );
+    return true;
+}
+
+MsgPtr ReplayReader::getInputs ( uint32_t index )
+{
+    if ( index >= _index.inputs.size() || ! _index.inputs[index] )
+        return 0;
+
+    return read ( _index.inputs[index], MsgType::ReplayInputs );
+}
+
+MsgPtr ReplayReader::getRngState ( uint32_t index )
+{
+    if ( index >= _index.rngStates.size() || ! _index.rngStates[index] )
+        return 0;
+
+    return read ( _index.rngStates[index], MsgType::RngState );
+}
+
+vector<MsgPtr> ReplayReader::getInitialStates()
+{
+    vector<MsgPtr> initialStates;
+
+    for ( uint64_t offset : _index.initialStates )
+    {
+        MsgPtr msg = read ( offset, MsgType::InitialGameState );
+
+        if ( msg )
+            initialStates.push_back ( msg );
+    }
+
+    return initialStates;
+}
+
+MsgPtr ReplayReader::getKeyframeBefore ( IndexedFrame indexedFrame )
+{
+    // Find the first keyframe after the given frame
+    auto it = upper_bound ( _index.keyframeFrames.begin(), _index.keyframeFrames.end(), indexedFrame.value );
+
+    if ( it == _index.keyframeFrames.begin() )
+        return 0;
+
+    --it;
+
+    IndexedFrame keyframe;
+    keyframe.value = *it;
+
+    // Keyframes can't be used across transition indices
+    if ( keyframe.parts.index != indexedFrame.parts.index )
+        return 0;
+
+    return read ( _index.keyframes[it - _index.keyframeFrames.begin()], MsgType::ReplayKeyframe );
+}
+
+MsgPtr ReplayReader::read ( uint64_t offset )
+{
+    _fin.clear();
+    _fin.seekg ( offset );
+
+    uint32_t size = 0;
+
+    if ( ! _fin.read ( ( char * ) &size, sizeof ( size ) ) || size == 0 )
+        return 0;
+
+    // Don't trust the size of a truncated or corrupt record
+    if ( offset + sizeof ( size ) + size > _fileSize )
+        return 0;
+
+    string bytes ( size, ( char ) 0 );
+
+    if ( ! _fin.read ( &bytes[0], size ) )
+        return 0;
+
+    size_t consumed;
+    return Protocol::decode ( &bytes[0], bytes.size(), consumed );
+}
+
+MsgPtr ReplayReader::read ( uint64_t offset, MsgType type )
+{
+    MsgPtr msg = read ( offset );
+
+    if ( ! msg || msg->getMsgType() != type )
+        return 0;
+
+    return msg;
+}
+
+bool ReplayReader::isIndexValid() const
+{
+    return ( _index.keyframeFrames.size() == _index.keyframes.size()
+             && is_sorted ( _index.keyframeFrames.begin(), _index.keyframeFrames.end() ) );
+}
+
+void ReplayReader::rebuildIndex()
+{
+    _index = ReplayIndex();
+
+    uint64_t offset = REPLAY_MAGIC_SIZE + sizeof ( uint32_t );
+
+    for ( ;; )
+    {
+        MsgPtr msg = read ( offset );
+
+        if ( ! msg )
+            break;
+
+        addToIndex ( _index, msg, offset );
+
+        // Skip over the record
+        _fin.clear();
+        _fin.seekg ( offset );
+
+        uint32_t size = 0;
+        _fin.read ( ( char * ) &size, sizeof ( size ) );
+        offset += sizeof ( size ) + size;
+    }
+}
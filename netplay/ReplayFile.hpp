@@ -0,0 +1,189 @@
+#pragma once
+
+#include "Constants.hpp"
+#include "Protocol.hpp"
+#include "NetplayStates.hpp"
+
+#include <cereal/types/vector.hpp>
+#include <cereal/types/string.hpp>
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+
+/* Replay file binary structure:
+
+    4 byte  magic "CCRP"
+    4 byte  version
+    ...     records
+    ...     ReplayIndex record
+    8 byte  offset of the ReplayIndex record
+    4 byte  magic "CCRP"
+
+Each record:
+
+    4 byte  encoded message size
+    ...     encoded message (see Protocol)
+
+*/
+
+
+// Number of in-game frames between each state keyframe
+#define REPLAY_KEYFRAME_INTERVAL ( 300 )
+
+// Replay file format version
+#define REPLAY_FILE_VERSION ( 1 )
+
+
+// The final inputs for both players during a single transition index
+struct ReplayInputs : public SerializableSequence
+{
+    uint32_t index = 0, gameMode = 0;
+
+    NetplayState netplayState;
+
+    std::vector<uint16_t> p1, p2;
+
+    ReplayInputs ( uint32_t index, uint32_t gameMode, NetplayState netplayState )
+        : index ( index ), gameMode ( gameMode ), netplayState ( netplayState ) {}
+
+    std::string str() const override { return format ( "ReplayInputs[%u]", index ); }
+
+    PROTOCOL_MESSAGE_BOILERPLATE ( ReplayInputs, index, gameMode, netplayState, p1, p2 )
+};
+
+
+// Snapshot of the game state at the start of a frame, the dump is compressed by the Protocol
+struct ReplayKeyframe : public SerializableSequence
+{
+    IndexedFrame indexedFrame = {{ 0, 0 }};
+
+    NetplayState netplayState;
+
+    uint32_t startWorldTime = 0;
+
+    std::string fpEnv, dump;
+
+    std::string str() const override { return format ( "ReplayKeyframe[%s]", indexedFrame ); }
+
+    PROTOCOL_MESSAGE_BOILERPLATE ( ReplayKeyframe, indexedFrame.value, netplayState, startWorldTime, fpEnv, dump )
+};
+
+
+// Seek index of all the records in a replay file, each offset is 0 if there is no record
+struct ReplayIndex : public SerializableSequence
+{
+    // Offsets of the ReplayInputs and RngState for each transition index
+    std::vector<uint64_t> inputs, rngStates;
+
+    // Offsets of each InitialGameState
+    std::vector<uint64_t> initialStates;
+
+    // IndexedFrame values and offsets of each ReplayKeyframe, in chronological order
+    std::vector<uint64_t> keyframeFrames, keyframes;
+
+    PROTOCOL_MESSAGE_BOILERPLATE ( ReplayIndex, inputs, rngStates, initialStates, keyframeFrames, keyframes )
+};
+
+
+// Writes a replay file incrementally during a session.
+// Records are encoded and written on a separate thread, so the caller never waits on compression or the disk.
+class ReplayWriter
+{
+public:
+
+    ~ReplayWriter() { close(); }
+
+    // Open / close the replay file, closing waits for all the records then writes the seek index
+    bool open ( const std::string& replayFile );
+    void close();
+    bool isOpen() const { return ( bool ) _writerThread; }
+
+    // Set the final inputs for a frame, later calls for the same frame overwrite earlier ones (ie rollback)
+    void setInputs ( IndexedFrame indexedFrame, uint32_t gameMode, NetplayState netplayState,
+                     uint16_t p1, uint16_t p2 );
+
+    // Write the RngState for a transition index
+    void writeRngState ( const MsgPtr& msgRngState );
+
+    // Write an InitialGameState
+    void writeInitialState ( const MsgPtr& msgInitialState );
+
+    // Check if a keyframe should be written for this frame
+    bool shouldWriteKeyframe ( IndexedFrame indexedFrame ) const;
+
+    // Write a ReplayKeyframe, the message must not be modified afterwards
+    void writeKeyframe ( const MsgPtr& msgKeyframe );
+
+private:
+
+    // ONLY accessed by the writer thread while it is running
+    std::ofstream _fout;
+
+    // ONLY accessed by the writer thread while it is running
+    ReplayIndex _index;
+
+    // Thread that encodes and writes the queued records
+    struct WriterThread;
+    std::shared_ptr<WriterThread> _writerThread;
+
+    // Inputs for the current transition index, not written until the index changes
+    MsgPtr _inputs;
+
+    // Last frame a keyframe was written
+    IndexedFrame _lastKeyframe = {{ 0, 0 }};
+
+    // Write the current inputs if any
+    void flushInputs();
+
+    // Queue a record to be written by the writer thread
+    void queue ( const MsgPtr& msg );
+
+    // Write a record, returns the offset of the record
+    uint64_t write ( const MsgPtr& msg );
+};
+
+
+// Reads a replay file, records are loaded lazily using the seek index
+class ReplayReader
+{
+public:
+
+    // Open the replay file, rebuilds the seek index if the file wasn't closed properly
+    bool open ( const std::string& replayFile );
+
+    // Check if the file is a binary replay file
+    static bool isReplayFile ( const std::string& replayFile );
+
+    // Get the seek index
+    const ReplayIndex& getIndex() const { return _index; }
+
+    // Get the records for a transition index
+    MsgPtr getInputs ( uint32_t index );
+    MsgPtr getRngState ( uint32_t index );
+
+    // Get all the InitialGameStates
+    std::vector<MsgPtr> getInitialStates();
+
+    // Get the latest keyframe at or before the given frame, null if there is none
+    MsgPtr getKeyframeBefore ( IndexedFrame indexedFrame );
+
+private:
+
+    std::ifstream _fin;
+
+    uint64_t _fileSize = 0;
+
+    ReplayIndex _index;
+
+    // Read the record at the given offset, null on failure or if it isn't the given type
+    MsgPtr read ( uint64_t offset );
+    MsgPtr read ( uint64_t offset, MsgType type );
+
+    // Check the seek index can be used for lookups
+    bool isIndexValid() const;
+
+    // Rebuild the seek index by scanning all the records
+    void rebuildIndex();
+};
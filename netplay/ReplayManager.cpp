@@ -11,6 +11,10 @@ using namespace std;
 
 bool ReplayManager::load ( const string& replayFile, bool real )
 {
+    // Binary replays only contain the final inputs, so they are always real
+    if ( ReplayReader::isReplayFile ( replayFile ) )
+        return loadBinary ( replayFile );
+
     ifstream fin ( replayFile.c_str() );
     bool good = fin.good();
 
@@ -209,6 +213,50 @@ bool ReplayManager::load ( const string& replayFile, bool real )
     return good;
 }
 
+bool ReplayManager::loadBinary ( const string& replayFile )
+{
+    if ( ! _reader.open ( replayFile ) )
+        return false;
+
+    const ReplayIndex& index = _reader.getIndex();
+
+    _modes.resize ( index.inputs.size(), 0 );
+    _states.resize ( index.inputs.size() );
+    _inputs.resize ( index.inputs.size() );
+
+    for ( uint32_t i = 0; i < index.inputs.size(); ++i )
+    {
+        MsgPtr msgInputs = _reader.getInputs ( i );
+
+        if ( ! msgInputs )
+            continue;
+
+        const ReplayInputs& inputs = msgInputs->getAs<ReplayInputs>();
+
+        _modes[i] = inputs.gameMode;
+        _states[i] = inputs.netplayState.str();
+        _inputs[i].resize ( inputs.p1.size() );
+
+        for ( uint32_t j = 0; j < inputs.p1.size(); ++j )
+        {
+            _inputs[i][j].indexedFrame.parts.index = i;
+            _inputs[i][j].indexedFrame.parts.frame = j;
+            _inputs[i][j].p1 = inputs.p1[j];
+            _inputs[i][j].p2 = inputs.p2[j];
+        }
+    }
+
+    _rngStates.resize ( index.rngStates.size() );
+
+    for ( uint32_t i = 0; i < index.rngStates.size(); ++i )
+        _rngStates[i] = _reader.getRngState ( i );
+
+    _initialStates = _reader.getInitialStates();
+
+    LOG ( "Processed up to [%u:%u]", getLastIndex(), getLastFrame() );
+    return true;
+}
+
 uint32_t ReplayManager::getGameMode ( IndexedFrame indexedFrame )
 {
     if ( indexedFrame.parts.index >= _modes.size() )
@@ -325,3 +373,8 @@ MsgPtr ReplayManager::getInitialStateBefore ( uint32_t index ) const
 
     return 0;
 }
+
+MsgPtr ReplayManager::getKeyframeBefore ( IndexedFrame indexedFrame )
+{
+    return _reader.getKeyframeBefore ( indexedFrame );
+}
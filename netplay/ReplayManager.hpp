@@ -2,6 +2,7 @@
 
 #include "Constants.hpp"
 #include "Protocol.hpp"
+#include "ReplayFile.hpp"
 
 #include <string>
 #include <vector>
@@ -37,8 +38,16 @@ public:
 
     MsgPtr getInitialStateBefore ( uint32_t index ) const;
 
+    // Get the latest game state keyframe at or before the given frame, only for binary replays
+    MsgPtr getKeyframeBefore ( IndexedFrame indexedFrame );
+
 private:
 
+    // Reader for binary replays
+    ReplayReader _reader;
+
+    bool loadBinary ( const std::string& replayFile );
+
     std::vector<uint32_t> _modes;
 
     std::vector<std::string> _states;
@@ -60,3 +60,28 @@ void SpectatorManager::timerExpired ( Timer *timerPtr )
     _pendingSockets.erase ( it->second );
     _pendingTimerToSocket.erase ( timerPtr );
 }
+
+SocketPtr SpectatorManager::getSocket ( Socket *socketPtr ) const
+{
+    const auto it = _pendingSockets.find ( socketPtr );
+
+    if ( it != _pendingSockets.end() )
+        return it->second;
+
+    const auto jt = _spectatorMap.find ( socketPtr );
+
+    if ( jt != _spectatorMap.end() )
+        return jt->second.socket;
+
+    return 0;
+}
+
+TimerPtr SpectatorManager::getTimer ( Timer *timerPtr ) const
+{
+    const auto it = _pendingTimerToSocket.find ( timerPtr );
+
+    if ( it == _pendingTimerToSocket.end() )
+        return 0;
+
+    return _pendingSocketTimers.at ( it->second );
+}
@@ -54,6 +54,12 @@ public:
 
     void timerExpired ( Timer *timer );
 
+    // Get the reference to a pending socket or spectator, returns null if it isn't one
+    SocketPtr getSocket ( Socket *socket ) const;
+
+    // Get the reference to a pending socket timer, returns null if it isn't one
+    TimerPtr getTimer ( Timer *timer ) const;
+
 
     size_t numSpectators() const { return _spectatorMap.size(); }
 
@@ -68,6 +74,9 @@ public:
 
     void frameStepSpectators();
 
+    // Send a message to a spectator, override to send the message elsewhere, ie a network thread
+    virtual void sendSpectator ( const SocketPtr& socket, const MsgPtr& msg ) { socket->send ( msg ); }
+
 private:
 
     std::unordered_map<Socket *, SocketPtr> _pendingSockets;
@@ -0,0 +1,52 @@
+#include "TimeSync.hpp"
+#include "Algorithms.hpp"
+#include "Logger.hpp"
+
+using namespace std;
+
+
+void TimeSync::update ( int localAdvantage, int remoteAdvantage )
+{
+    _localAdvantage.set ( localAdvantage );
+    _remoteAdvantage.set ( remoteAdvantage );
+
+    // Wait for a full window before correcting
+    if ( ! _localAdvantage.full() )
+        return;
+
+    const double imbalance = getImbalance();
+
+    if ( !_correcting && imbalance >= TIME_SYNC_START_THRESHOLD )
+    {
+        LOG ( "Start correcting: local=%.2f; remote=%.2f; imbalance=%.2f",
+              _localAdvantage.get(), _remoteAdvantage.get(), imbalance );
+        _correcting = true;
+    }
+    else if ( _correcting && imbalance <= TIME_SYNC_STOP_THRESHOLD )
+    {
+        LOG ( "Stop correcting: local=%.2f; remote=%.2f; imbalance=%.2f",
+              _localAdvantage.get(), _remoteAdvantage.get(), imbalance );
+        _correcting = false;
+    }
+}
+
+double TimeSync::getFrameStretch() const
+{
+    if ( ! _correcting )
+        return 1.0;
+
+    // Spread the extra time needed to lose the imbalance over the next window
+    return 1.0 + clamped<double> ( getImbalance() / TIME_SYNC_WINDOW, 0.0, TIME_SYNC_MAX_STRETCH );
+}
+
+double TimeSync::getImbalance() const
+{
+    return ( _localAdvantage.get() - _remoteAdvantage.get() ) / 2;
+}
+
+void TimeSync::reset()
+{
+    _localAdvantage.reset();
+    _remoteAdvantage.reset();
+    _correcting = false;
+}
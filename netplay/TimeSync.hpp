@@ -0,0 +1,50 @@
+#pragma once
+
+#include "RollingAverage.hpp"
+
+#include <cstdint>
+
+
+// Number of frames to average the frame advantage over
+#define TIME_SYNC_WINDOW ( 60 )
+
+// Frame advantage imbalance needed before we start correcting
+#define TIME_SYNC_START_THRESHOLD ( 1.0 )
+
+// Frame advantage imbalance needed before we stop correcting
+#define TIME_SYNC_STOP_THRESHOLD ( 0.5 )
+
+// Maximum fraction each frame can be stretched by, so the slow down isn't noticeable
+#define TIME_SYNC_MAX_STRETCH ( 0.05 )
+
+
+// Balances the frame advantage between both sides, similar to GGPO's time sync.
+// The frame advantage is how many frames we are ahead of the latest remote frame we've received.
+// If both sides are running in sync, then both frame advantages should be about the same (ie the latency).
+// If one side is further ahead, it eats less rollbacks and the other side eats more, so the side that is ahead
+// should slow down slightly until both are balanced.
+class TimeSync
+{
+public:
+
+    // Update with the local frame advantage for this frame, and the latest remote frame advantage
+    void update ( int localAdvantage, int remoteAdvantage );
+
+    // How much longer the next frame should take, 1.0 means normal speed
+    double getFrameStretch() const;
+
+    // Half the difference between the average local and remote frame advantages, ie how many frames we are ahead
+    double getImbalance() const;
+
+    // If we are currently slowing down
+    bool isCorrecting() const { return _correcting; }
+
+    void reset();
+
+private:
+
+    // Rolling averages of the local and remote frame advantages
+    RollingAverage<double, TIME_SYNC_WINDOW> _localAdvantage, _remoteAdvantage;
+
+    bool _correcting = false;
+};
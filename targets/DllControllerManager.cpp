@@ -33,6 +33,37 @@ void DllControllerManager::initControllers ( const ControllerMappings& mappings
     _controllerAttached = ( _allControllers.size() > 1 );
 }
 
+void DllControllerManager::updatePlayerInputs ( uint16_t *localInputs )
+{
+    const ControllerSamples samples = ControllerManager::get().getLatestSamples();
+    const uint64_t frameClockUs = TimerManager::get().getFrameClockUs();
+    const uint8_t players[2] = { localPlayer, remotePlayer };
+
+    for ( uint8_t i = 0; i < 2; ++i )
+    {
+        const Controller *controller = _playerControllers[players[i] - 1];
+
+        if ( ! controller )
+            continue;
+
+        const ControllerSamples::Sample *sample = samples.find ( controller );
+
+        localInputs[i] = getInput ( sample );
+
+        if ( !sample || sample->state == _lastSampledStates[i] )
+            continue;
+
+        _lastSampledStates[i] = sample->state;
+
+        if ( i == 0 )
+            inputCapturedUs = sample->changedUs;
+
+        // Measure how long ago the new state was sampled
+        if ( frameClockUs > sample->changedUs )
+            inputAgeStats.addSample ( ( frameClockUs - sample->changedUs ) / 1000.0 );
+    }
+}
+
 bool DllControllerManager::isNotMapping() const
 {
     Lock lock ( ControllerManager::get().mutex );
@@ -43,9 +74,26 @@ bool DllControllerManager::isNotMapping() const
 
 void DllControllerManager::updateControls ( uint16_t *localInputs )
 {
+    inputCapturedUs = 0;
+
     if ( stopping )
         return;
 
+    const bool isAssigned = ( isSinglePlayer
+                              ? _playerControllers[localPlayer - 1] != 0
+                              : ( _playerControllers[0] && _playerControllers[1] ) );
+
+    // Skip locking if nothing but the player inputs can change, so we don't wait while the polling thread checks
+    if ( isAssigned
+            && !DllOverlayUi::isEnabled()
+            && !DllOverlayUi::isShowingMessage()
+            && !KeyboardState::isPressed ( VK_TOGGLE_OVERLAY )
+            && *CC_GAME_MODE_ADDR != CC_GAME_MODE_CHARA_SELECT )
+    {
+        updatePlayerInputs ( localInputs );
+        return;
+    }
+
     Lock lock ( ControllerManager::get().mutex );
 
     bool toggleOverlay = false;
@@ -156,12 +204,7 @@ void DllControllerManager::updateControls ( uint16_t *localInputs )
     // Only update player controls when the overlay is NOT enabled
     if ( !DllOverlayUi::isEnabled() || ProcessManager::isWine() )
     {
-        if ( _playerControllers[localPlayer - 1] )
-            localInputs[0] = getInput ( _playerControllers[localPlayer - 1] );
-
-        if ( _playerControllers[remotePlayer - 1] )
-            localInputs[1] = getInput ( _playerControllers[remotePlayer - 1] );
-
+        updatePlayerInputs ( localInputs );
         return;
     }
 
@@ -5,6 +5,7 @@
 #include "ControllerManager.hpp"
 #include "Controller.hpp"
 #include "DllControllerUtils.hpp"
+#include "Statistics.hpp"
 
 #include <vector>
 #include <array>
@@ -24,6 +25,12 @@ public:
     // Single player setting
     bool isSinglePlayer = false;
 
+    // Milliseconds from when a controller state changed until the start of the frame that used it
+    Statistics inputAgeStats;
+
+    // Time in microseconds the local input changed, only set on the frame it changed, otherwise 0
+    uint64_t inputCapturedUs = 0;
+
     // Initialize all controllers with the given mappings
     void initControllers ( const ControllerMappings& mappings );
 
@@ -57,4 +64,10 @@ private:
     std::array<bool, 2> _finishedMapping = {{ false, false }};
 
     bool _controllerAttached = false;
+
+    // Last sampled controller states for the local inputs, to detect changes
+    std::array<uint32_t, 2> _lastSampledStates = {{ 0, 0 }};
+
+    // Update the local inputs from the latest controller samples
+    void updatePlayerInputs ( uint16_t *localInputs );
 };
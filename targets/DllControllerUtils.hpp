@@ -2,6 +2,7 @@
 
 #include "ProcessManager.hpp"
 #include "Controller.hpp"
+#include "ControllerManager.hpp"
 
 
 struct DllControllerUtils
@@ -67,6 +68,14 @@ struct DllControllerUtils
         return convertInputState ( controller->getState(), controller->isKeyboard() );
     }
 
+    static uint16_t getInput ( const ControllerSamples::Sample *sample )
+    {
+        if ( ! sample )
+            return 0;
+
+        return convertInputState ( sample->state, sample->isKeyboard );
+    }
+
     static bool isButtonPressed ( const Controller *controller, uint16_t button )
     {
         if ( ! controller )
@@ -4,12 +4,32 @@
 #include "ProcessManager.hpp"
 #include "DllAsmHacks.hpp"
 
+#include <windows.h>
+#include <mmsystem.h>
 #include <d3dx9.h>
 
 using namespace std;
 using namespace DllFrameRate;
 
 
+// Not defined in older headers, only supported on Windows 10 1803+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION ( 0x00000002 )
+#endif
+
+// Not declared for _WIN32_WINNT=0x501
+#ifndef TIMER_ALL_ACCESS
+#define TIMER_ALL_ACCESS ( 0x1F0003 )
+#endif
+
+// Log the frame time stats when the worst frame takes this much longer than the frame period
+#define FRAME_SPIKE_FACTOR      ( 1.5 )
+
+// Microseconds before the deadline to stop sleeping and start spinning
+#define SPIN_THRESHOLD_HI_RES   ( 1000 )
+#define SPIN_THRESHOLD_LO_RES   ( 2000 )
+
+
 namespace DllFrameRate
 {
 
@@ -19,6 +39,16 @@ double actualFps = 60.0;
 
 bool isEnabled = false;
 
+Statistics frameTimeStats;
+
+Histogram frameTimeHistogram;
+
+// Waitable timer used to sleep until just before the deadline
+HANDLE waitableTimer = 0;
+
+// If the waitable timer has high resolution, otherwise we need timeBeginPeriod
+bool isHiResWaitableTimer = false;
+
 
 void enable()
 {
@@ -29,11 +59,70 @@ void enable()
     WRITE_ASM_HACK ( AsmHacks::disableFpsLimit );
     WRITE_ASM_HACK ( AsmHacks::disableFpsCounter );
 
+    // Only available on Vista+, so load it dynamically instead of failing to load the DLL on XP
+    typedef HANDLE ( WINAPI * CreateWaitableTimerExW_ ) ( LPSECURITY_ATTRIBUTES lpTimerAttributes,
+            LPCWSTR lpTimerName, DWORD dwFlags, DWORD dwDesiredAccess ); // kernel32!CreateWaitableTimerExW
+
+    CreateWaitableTimerExW_ CreateWaitableTimerExW = reinterpret_cast<CreateWaitableTimerExW_> ( GetProcAddress (
+                GetModuleHandle ( "kernel32.dll" ), "CreateWaitableTimerExW" ) );
+
+    // Fails before Windows 10 1803, which doesn't support CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+    if ( CreateWaitableTimerExW )
+        waitableTimer = CreateWaitableTimerExW ( 0, 0, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS );
+
+    isHiResWaitableTimer = ( waitableTimer != 0 );
+
+    if ( ! waitableTimer )
+        waitableTimer = CreateWaitableTimer ( 0, TRUE, 0 );
+
     isEnabled = true;
 
-    LOG ( "Enabling FPS control!" );
+    LOG ( "Enabling FPS control! waitableTimer=%08x; isHiResWaitableTimer=%u", waitableTimer, isHiResWaitableTimer );
 }
 
+void resetFrameTimes()
+{
+    frameTimeStats.reset();
+    frameTimeHistogram.reset();
+}
+
+string frameTimeReport()
+{
+    if ( frameTimeHistogram.getNumSamples() == 0 )
+        return "no samples";
+
+    return format ( "frames=%u; mean=%.2f ms; stddev=%.2f ms; worst=%.2f ms; p50=%.1f ms; p99=%.1f ms; p99.9=%.1f ms",
+                    frameTimeStats.getNumSamples(), frameTimeStats.getMean(), frameTimeStats.getStdDev(),
+                    frameTimeStats.getWorst(), frameTimeHistogram.getPercentile ( 50 ),
+                    frameTimeHistogram.getPercentile ( 99 ), frameTimeHistogram.getPercentile ( 99.9 ) );
+}
+
+}
+
+
+// Sleep for the given number of microseconds
+static void sleepUs ( uint64_t duration )
+{
+    if ( ! waitableTimer )
+    {
+        timeBeginPeriod ( 1 );
+        Sleep ( duration / 1000 );
+        timeEndPeriod ( 1 );
+        return;
+    }
+
+    // Negative means relative time, in 100 nanosecond units
+    LARGE_INTEGER dueTime;
+    dueTime.QuadPart = - ( int64_t ) ( duration * 10 );
+
+    if ( ! isHiResWaitableTimer )
+        timeBeginPeriod ( 1 );
+
+    if ( SetWaitableTimer ( waitableTimer, &dueTime, 0, 0, 0, FALSE ) )
+        WaitForSingleObject ( waitableTimer, INFINITE );
+
+    if ( ! isHiResWaitableTimer )
+        timeEndPeriod ( 1 );
 }
 
 
@@ -42,50 +131,79 @@ void PresentFrameEnd ( IDirect3DDevice9 *device )
     if ( !isEnabled || *CC_SKIP_FRAMES_ADDR )
         return;
 
-    static uint64_t last1f = 0, last5f = 0, last30f = 0, last60f = 0;
+    // Deadline for the current frame, and the accumulated fractional microseconds of the frame period
+    static uint64_t deadline = 0;
+    static double fractional = 0;
+
+    static uint64_t lastFrame = 0, last60f = 0;
     static uint8_t counter = 0;
 
+    // Frame times of the last 60 frames, to detect spikes
+    static Statistics window;
+
     ++counter;
 
-    uint64_t now = TimerManager::get().getNow ( true );
+    uint64_t now = TimerManager::get().getNowUs ( true );
 
     /**
-     * The best timer resolution is only in milliseconds, and we need to make
-     * sure the spacing between frames is as close to even as possible.
-     *
-     * What this code does is check every 30f, 5f, and 1f how many milliseconds have
-     * passed since the last check and make sure we are close to or under the desired FPS.
+     * Sleep with the waitable timer until just before the deadline, then spin for the rest,
+     * since sleeping alone can overshoot. Each deadline is the previous deadline plus the frame
+     * period, and the fractional microseconds are accumulated, so the long-run rate is exactly desiredFps.
      */
-    if ( counter % 30 == 0 )
-    {
-        while ( now - last30f < ( 30 * 1000 ) / desiredFps )
-            now = TimerManager::get().getNow ( true );
+    const double period = 1000000.0 / desiredFps;
 
-        last30f = now;
+    if ( period < 1.0 || deadline == 0 || now > deadline + uint64_t ( period ) )
+    {
+        // Don't wait when running uncapped, and re-sync instead of catching up if we're more than a frame behind
+        deadline = now;
+        fractional = 0;
     }
-    else if ( counter % 5 == 0 )
+    else if ( now < deadline )
     {
-        while ( now - last5f < ( 5 * 1000 ) / desiredFps )
-            now = TimerManager::get().getNow ( true );
+        const uint64_t spinThreshold = ( isHiResWaitableTimer ? SPIN_THRESHOLD_HI_RES : SPIN_THRESHOLD_LO_RES );
+
+        if ( deadline - now > spinThreshold )
+            sleepUs ( deadline - now - spinThreshold );
 
-        last5f = now;
+        do
+        {
+            now = TimerManager::get().getNowUs ( true );
+        }
+        while ( now < deadline );
     }
-    else
+
+    if ( period >= 1.0 )
     {
-        while ( now - last1f < 1000 / desiredFps )
-            now = TimerManager::get().getNow ( true );
+        fractional += period;
+        deadline += uint64_t ( fractional );
+        fractional -= uint64_t ( fractional );
     }
 
-    last1f = now;
+    if ( lastFrame )
+    {
+        const double frameTime = ( now - lastFrame ) / 1000.0;
+
+        window.addSample ( frameTime );
+        frameTimeStats.addSample ( frameTime );
+        frameTimeHistogram.addSample ( frameTime );
+    }
+
+    lastFrame = now;
 
     if ( counter >= 60 )
     {
-        now = TimerManager::get().getNow ( true );
-
-        actualFps = 1000.0 / ( ( now - last60f ) / 60.0 );
+        actualFps = 1000000.0 / ( ( now - last60f ) / 60.0 );
 
         *CC_FPS_COUNTER_ADDR = uint32_t ( actualFps + 0.5 );
 
+        if ( period >= 1.0 && window.getWorst() > FRAME_SPIKE_FACTOR * period / 1000.0 )
+        {
+            LOG ( "Frame time spike: mean=%.2f ms; stddev=%.2f ms; worst=%.2f ms; period=%.2f ms",
+                  window.getMean(), window.getStdDev(), window.getWorst(), period / 1000.0 );
+        }
+
+        window.reset();
+
         counter = 0;
         last60f = now;
     }
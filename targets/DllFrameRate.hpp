@@ -1,6 +1,10 @@
 #pragma once
 
+#include "Statistics.hpp"
+#include "Histogram.hpp"
+
 #include <cstdint>
+#include <string>
 
 
 namespace DllFrameRate
@@ -10,6 +14,17 @@ extern double desiredFps;
 
 extern double actualFps;
 
+// Frame times in milliseconds since the start of the session
+extern Statistics frameTimeStats;
+
+extern Histogram frameTimeHistogram;
+
 void enable();
 
+// Reset the frame time stats, when a new session starts
+void resetFrameTimes();
+
+// Format the frame time stats of the session
+std::string frameTimeReport();
+
 }
@@ -15,7 +15,13 @@
 #include "DllControllerManager.hpp"
 #include "DllFrameRate.hpp"
 #include "ReplayManager.hpp"
+#include "ReplayFile.hpp"
 #include "DllRollbackManager.hpp"
+#include "LatencyTracker.hpp"
+#include "TimeSync.hpp"
+#include "NetworkThread.hpp"
+#include "MessageRegistry.hpp"
+#include "InputResender.hpp"
 
 #include <windows.h>
 
@@ -41,9 +47,6 @@ using namespace std;
 // The number of milliseconds to wait to perform a delayed stop so that ErrorMessages are received before sockets die
 #define DELAYED_STOP                ( 100 )
 
-// The number of milliseconds before resending inputs while waiting for more inputs
-#define RESEND_INPUTS_INTERVAL      ( 100 )
-
 // The maximum number of milliseconds to wait for inputs before timeout
 #define MAX_WAIT_INPUTS_INTERVAL    ( 10000 )
 
@@ -117,8 +120,23 @@ struct DllMain
     // Timer for resending inputs while waiting
     TimerPtr resendTimer;
 
-    // Timer for waiting for inputs
-    int waitInputsTimer = -1;
+    // Measures the round trip time during the session, for automatic delay adjustment
+    LatencyTracker latencyTracker;
+
+    // Balances the frame advantage with the remote side during rollback
+    TimeSync timeSync;
+
+    // Latest remote frame advantage
+    int remoteFrameAdvantage = 0;
+
+    // Records the final inputs and periodic game state keyframes of this session
+    ReplayWriter replayWriter;
+
+    // Dedicated thread for socket and timer events, only if enabled with Options::NetworkThread
+    shared_ptr<NetworkThread> networkThread;
+
+    // Schedules resending inputs while waiting, and how long we've waited
+    InputResender inputResender;
 
     // Indicates if we should sync the game RngState on this frame
     bool shouldSyncRngState = false;
@@ -130,6 +148,9 @@ struct DllMain
     // Initial connect timer
     TimerPtr initialTimer;
 
+    // Times in milliseconds when the config was received and when Initial was entered, for logging
+    uint64_t configTime = 0, initialTime = 0;
+
     // Local player inputs
     array<uint16_t, 2> localInputs = {{ 0, 0 }};
 
@@ -185,6 +206,7 @@ struct DllMain
     uint32_t replaySpeed = 2;
     IndexedFrame replayStop = MaxIndexedFrame;
     IndexedFrame replayCheck = MaxIndexedFrame;
+    IndexedFrame replaySeek = MaxIndexedFrame;
     string replayCheckRngHexStr;
 #endif // NOT RELEASE
 
@@ -200,6 +222,23 @@ struct DllMain
                 break;
 
             case NetplayState::InGame:
+                // Periodically save game state keyframes, only once the inputs up to this frame are final.
+                // Only the copy of the game state happens here, the replay writer thread compresses and writes it.
+                if ( !fastFwdStopFrame.value
+                        && replayWriter.shouldWriteKeyframe ( netMan.getIndexedFrame() )
+                        && ( clientMode.isLocal()
+                             || ( netMan.getRemoteIndexedFrame().value >= netMan.getIndexedFrame().value
+                                  && netMan.getLastChangedFrame().value >= netMan.getIndexedFrame().value ) ) )
+                {
+                    replayWriter.writeKeyframe ( rollMan.saveKeyframe ( netMan ) );
+                }
+
+#ifndef RELEASE
+                // Record which bytes change between frames, to minimize the rollback data
+                if ( options[Options::Discovery] )
+                    rollMan.trackWrites ( netMan );
+#endif
+
                 if ( netMan.getRollback() )
                 {
                     // Only save rollback states in-game
@@ -327,7 +366,8 @@ struct DllMain
                 }
 
 #ifndef RELEASE
-                DllOverlayUi::debugText = format ( "%+d [%s]", netMan.getRemoteFrameDelta(), netMan.getIndexedFrame() );
+                DllOverlayUi::debugText = format ( "%+d %+.1f [%s]", netMan.getRemoteFrameDelta(),
+                                                   timeSync.getImbalance(), netMan.getIndexedFrame() );
                 DllOverlayUi::debugTextAlign = 1;
 
                 // Replay inputs and rollback
@@ -344,6 +384,36 @@ struct DllMain
                     netMan.setInput ( 1, inputs.p1 );
                     netMan.setInput ( 2, inputs.p2 );
 
+                    // Seek by loading the latest keyframe before the target, then fast-forward the rest
+                    if ( netMan.isInGame() && netMan.getIndex() == replaySeek.parts.index )
+                    {
+                        const IndexedFrame target = replaySeek;
+                        replaySeek = MaxIndexedFrame;
+
+                        MsgPtr msgKeyframe = repMan.getKeyframeBefore ( target );
+                        const IndexedFrame keyframe = ( msgKeyframe ? msgKeyframe->getAs<ReplayKeyframe>().indexedFrame
+                                                        : MaxIndexedFrame );
+
+                        if ( msgKeyframe
+                                && keyframe.value > netMan.getIndexedFrame().value
+                                && rollMan.loadKeyframe ( msgKeyframe, netMan ) )
+                        {
+                            for ( uint32_t i = netMan.getFrame(); i <= target.parts.frame; ++i )
+                            {
+                                const IndexedFrame indexedFrame = {{ i, target.parts.index }};
+                                const auto& reinputs = repMan.getInputs ( indexedFrame );
+                                netMan.assignInput ( 1, reinputs.p1, i );
+                                netMan.assignInput ( 2, reinputs.p2, i );
+                            }
+
+                            fastFwdStopFrame = target;
+                            *CC_SKIP_FRAMES_ADDR = 1;
+
+                            LOG_TO ( syncLog, "Seek: target=[%s]; keyframe=[%s]", target, netMan.getIndexedFrame() );
+                            return;
+                        }
+                    }
+
                     const IndexedFrame target = repMan.getRollbackTarget ( netMan.getIndexedFrame() );
 
                     // Rollback
@@ -443,7 +513,7 @@ struct DllMain
                         netMan.assignInput ( localPlayer, localInputs[0], netMan.getFrame() + netMan.getDelay() );
                     else
 #endif // NOT RELEASE
-                        netMan.setInput ( localPlayer, localInputs[0] );
+                        netMan.setInput ( localPlayer, localInputs[0], inputCapturedUs );
                 }
 
                 if ( clientMode.isNetplay() )
@@ -454,7 +524,7 @@ struct DllMain
                         MsgPtr msgMenuIndex = netMan.getLocalRetryMenuIndex();
 
                         // Lazy disconnect now once the retry menu option has been selected
-                        if ( msgMenuIndex && ( !dataSocket || !dataSocket->isConnected() ) )
+                        if ( msgMenuIndex && ! isDataConnected() )
                         {
                             if ( lazyDisconnect )
                             {
@@ -468,12 +538,12 @@ struct DllMain
                         if ( msgMenuIndex && !localRetryMenuIndexSent )
                         {
                             localRetryMenuIndexSent = true;
-                            dataSocket->send ( msgMenuIndex );
+                            sendData ( msgMenuIndex );
                         }
                         break;
                     }
 
-                    dataSocket->send ( netMan.getInputs ( localPlayer ) );
+                    sendInputs();
                 }
                 else if ( clientMode.isLocal() )
                 {
@@ -491,7 +561,7 @@ struct DllMain
                     netMan.setRngState ( msgRngState->getAs<RngState>() );
 
                     if ( clientMode.isHost() )
-                        dataSocket->send ( msgRngState );
+                        sendData ( msgRngState );
                 }
                 break;
             }
@@ -505,10 +575,24 @@ struct DllMain
         if ( rollbackTimer == minRollbackSpacing )
             netMan.clearLastChangedFrame();
 
-        for ( ;; )
+        for ( bool first = true;; first = false )
         {
             // Poll until we are ready to run
-            if ( ! EventManager::get().poll ( POLL_TIMEOUT ) )
+            if ( networkThread )
+            {
+                // The network thread polls in the background, so only wait if we are not ready yet
+                if ( ! first )
+                    networkThread->waitEvents ( POLL_TIMEOUT );
+
+                networkThread->dispatch();
+
+                if ( ! EventManager::get().isRunning() )
+                {
+                    appState = AppState::Stopping;
+                    return;
+                }
+            }
+            else if ( ! EventManager::get().poll ( POLL_TIMEOUT ) )
             {
                 appState = AppState::Stopping;
                 return;
@@ -533,21 +617,33 @@ struct DllMain
                 // Stop resending inputs if we're ready
                 if ( ready )
                 {
-                    resendTimer.reset();
-                    waitInputsTimer = -1;
+                    if ( resendTimer )
+                    {
+                        NetworkThread::GameLock lock ( networkThread.get() );
+                        resendTimer.reset();
+                    }
+
+                    inputResender.reset();
                     break;
                 }
 
                 // Start resending inputs since we are waiting
                 if ( ! resendTimer )
                 {
+                    NetworkThread::GameLock lock ( networkThread.get() );
                     resendTimer.reset ( new Timer ( this ) );
-                    resendTimer->start ( RESEND_INPUTS_INTERVAL );
-                    waitInputsTimer = 0;
+                    resendTimer->start ( inputResender.start() );
                 }
             }
         }
 
+        // Slow down slightly if we are further ahead than the remote side
+        if ( netMan.isInRollback() )
+        {
+            timeSync.update ( netMan.getRemoteFrameDelta(), remoteFrameAdvantage );
+            DllFrameRate::desiredFps = 60.0 / timeSync.getFrameStretch();
+        }
+
         if ( rollbackTimer < minRollbackSpacing )
         {
             --rollbackTimer;
@@ -608,7 +704,10 @@ struct DllMain
             MsgPtr msgRngState = netMan.getRngState();
 
             if ( msgRngState )
+            {
                 procMan.setRngState ( msgRngState->getAs<RngState>() );
+                replayWriter.writeRngState ( msgRngState );
+            }
         }
 
         // Update delay and/or rollback if necessary
@@ -621,7 +720,7 @@ struct DllMain
                 LOG ( "Input delay was changed %u -> %u", netMan.getDelay(), changeConfig.delay );
                 DllOverlayUi::showMessage ( format ( "Input delay was changed to %u", changeConfig.delay ) );
                 netMan.setDelay ( changeConfig.delay );
-                procMan.ipcSend ( changeConfig );
+                ipcSend ( changeConfig );
             }
 
             if ( changeConfig.rollback <= MAX_ROLLBACK && changeConfig.rollback != netMan.getRollback() )
@@ -630,7 +729,7 @@ struct DllMain
                 DllOverlayUi::showMessage ( format ( "Rollback was changed to %u", changeConfig.rollback ) );
                 netMan.setRollback ( changeConfig.rollback );
                 minRollbackSpacing = clamped<uint8_t> ( netMan.getRollback(), 2, 4 );
-                procMan.ipcSend ( changeConfig );
+                ipcSend ( changeConfig );
             }
         }
 
@@ -644,7 +743,7 @@ struct DllMain
                 LOG ( "Input delay was changed %u -> %u", netMan.getDelay(), changeConfig.delay );
                 DllOverlayUi::showMessage ( format ( "Input delay was changed to %u", changeConfig.delay ) );
                 netMan.setDelay ( changeConfig.delay );
-                procMan.ipcSend ( changeConfig );
+                ipcSend ( changeConfig );
             }
 
             if ( changeConfig.rollback <= MAX_ROLLBACK && changeConfig.rollback != netMan.getRollback() )
@@ -653,7 +752,7 @@ struct DllMain
                 DllOverlayUi::showMessage ( format ( "Rollback was changed to %u", changeConfig.rollback ) );
                 netMan.setRollback ( changeConfig.rollback );
                 minRollbackSpacing = clamped<uint8_t> ( netMan.getRollback(), 2, 4 );
-                procMan.ipcSend ( changeConfig );
+                ipcSend ( changeConfig );
             }
         }
 
@@ -690,7 +789,7 @@ struct DllMain
 
                 }
 
-                procMan.ipcSend ( new MatchStartedMessage ( matchStartedInfo ) );
+                ipcSend ( new MatchStartedMessage ( matchStartedInfo ) );
             }
         }
 
@@ -730,7 +829,7 @@ struct DllMain
 
                 }
 
-                procMan.ipcSend ( new MatchEndedMessage ( matchEndedResult ) );
+                ipcSend ( new MatchEndedMessage ( matchEndedResult ) );
             }
 
             matchIndex = matchIndex + 1;
@@ -840,7 +939,7 @@ struct DllMain
             }
         }
 
-        if ( dataSocket && dataSocket->isConnected()
+        if ( isDataConnected()
                 && ( ( netMan.getFrame() % ( 5 * 60 ) == 0 ) || ( netMan.getFrame() % 150 == 149 ) )
                 && netMan.getState().value >= NetplayState::CharaSelect && netMan.getState() != NetplayState::Loading
                 && netMan.getState() != NetplayState::Skippable && netMan.getState() != NetplayState::RetryMenu )
@@ -851,7 +950,7 @@ struct DllMain
                     || ( randomInputs && netMan.getFrame() % 150 == 149 ) )
             {
                 MsgPtr msgSyncHash ( new SyncHash ( netMan.getIndexedFrame() ) );
-                dataSocket->send ( msgSyncHash );
+                sendData ( msgSyncHash );
                 localSync.push_back ( msgSyncHash );
             }
         }
@@ -886,6 +985,9 @@ struct DllMain
             LOG_TO ( syncLog, "< %s", L.dump() );
             LOG_TO ( syncLog, "> %s", R.dump() );
 
+            if ( rollMan.saveDesyncDump ( ProcessManager::appDir + DESYNC_DUMP_FILE, L.indexedFrame, netMan ) )
+                LOG_TO ( syncLog, "Dumped states to: '%s'", DESYNC_DUMP_FILE );
+
 #undef L
 #undef R
 
@@ -1022,9 +1124,14 @@ struct DllMain
     void frameStep()
     {
         // New frame
+        TimerManager::get().updateFrameClock();
         netMan.updateFrame();
         procMan.clearInputs();
 
+        // Handle the messages received on the network thread since the last frame
+        if ( networkThread )
+            networkThread->dispatch();
+
         // Check for changes to important variables for state transitions
         ChangeMonitor::get().check();
 
@@ -1053,6 +1160,13 @@ struct DllMain
         procMan.writeGameInput ( localPlayer, netMan.getInput ( localPlayer ) );
         procMan.writeGameInput ( remotePlayer, netMan.getInput ( remotePlayer ) );
 
+        // Resolve the input latency traces for this frame
+        netMan.tracer.applied ( netMan.getIndexedFrame(), TimerManager::get().queryNowUs() );
+
+        // Record inputs, these are overwritten when re-running the same frame after a rollback
+        replayWriter.setInputs ( netMan.getIndexedFrame(), *CC_GAME_MODE_ADDR, netMan.getState(),
+                                 netMan.getRawInput ( 1 ), netMan.getRawInput ( 2 ) );
+
 #ifndef RELEASE
         if ( replayInputs && ( replaySpeed == 1 || KeyboardState::isDown ( VK_SPACE ) ) )
             DllFrameRate::desiredFps = numeric_limits<double>::max();
@@ -1061,6 +1175,217 @@ struct DllMain
 #endif
     }
 
+    void sendInputs()
+    {
+        MsgPtr msgInputs = netMan.getInputs ( localPlayer );
+
+        if ( clientMode.isNetplay() )
+        {
+            msgInputs->getAs<PlayerInputs>().frameAdvantage = clamped ( netMan.getRemoteFrameDelta(), -128, 127 );
+            latencyTracker.stamp ( msgInputs->getAs<PlayerInputs>() );
+        }
+
+        sendData ( msgInputs );
+    }
+
+    // Send a message on the data socket, via the network thread if enabled
+    void sendData ( const MsgPtr& msg )
+    {
+        if ( networkThread )
+            networkThread->send ( dataSocket, msg );
+        else
+            dataSocket->send ( msg );
+    }
+
+    // Send a message to a spectator, via the network thread if enabled
+    void sendSpectator ( const SocketPtr& socket, const MsgPtr& msg ) override
+    {
+        if ( networkThread )
+            networkThread->send ( socket, msg );
+        else
+            socket->send ( msg );
+    }
+
+    // Send a message to the main process, the IPC socket is also used on the network thread if enabled
+    void ipcSend ( Serializable& msg )
+    {
+        NetworkThread::GameLock lock ( networkThread.get() );
+        procMan.ipcSend ( msg );
+    }
+
+    void ipcSend ( Serializable *msg )
+    {
+        NetworkThread::GameLock lock ( networkThread.get() );
+        procMan.ipcSend ( msg );
+    }
+
+    // Check if the data socket is connected, its state is also changed on the network thread if enabled
+    bool isDataConnected()
+    {
+        NetworkThread::GameLock lock ( networkThread.get() );
+        return ( dataSocket && dataSocket->isConnected() );
+    }
+
+    // Callbacks on the network thread are posted to run on the game thread, so game state is only used by the game
+    // thread. Returns false if not called on the network thread, then the callback should be handled now.
+    bool postToGame ( const NetworkThread::Event& event )
+    {
+        if ( ! networkThread || ! networkThread->isDispatching() )
+            return false;
+
+        networkThread->post ( event );
+        return true;
+    }
+
+    // Post a socket callback, holding a reference so the socket stays alive until it is handled on the game thread
+    bool postToGame ( Socket *socket, const function<void ( Socket * )>& callback )
+    {
+        if ( ! networkThread || ! networkThread->isDispatching() )
+            return false;
+
+        const SocketPtr ref = getSocket ( socket );
+
+        if ( ! ref )
+        {
+            LOG ( "Ignoring callback from unknown socket=%08x", socket );
+            return true;
+        }
+
+        networkThread->post ( [this, ref, callback]
+        {
+            // Ignore callbacks from sockets that were released after this was posted
+            if ( getSocket ( ref.get() ) )
+                callback ( ref.get() );
+        } );
+        return true;
+    }
+
+    // Get the reference to a socket owned here, returns null if it isn't
+    SocketPtr getSocket ( Socket *socket ) const
+    {
+        for ( const SocketPtr& owned : { serverCtrlSocket, ctrlSocket, serverDataSocket, dataSocket } )
+        {
+            if ( owned.get() == socket )
+                return owned;
+        }
+
+        return SpectatorManager::getSocket ( socket );
+    }
+
+    // Get the reference to a timer owned here, returns null if it isn't
+    TimerPtr getTimer ( Timer *timer ) const
+    {
+        for ( const TimerPtr& owned : { resendTimer, initialTimer, stopTimer } )
+        {
+            if ( owned.get() == timer )
+                return owned;
+        }
+
+        return SpectatorManager::getTimer ( timer );
+    }
+
+    // Check if a message is remote inputs or an RngState, these are applied by the game thread
+    bool isRemoteInputs ( MsgType type ) const
+    {
+        switch ( type )
+        {
+            case MsgType::RngState:
+                return true;
+
+            case MsgType::PlayerInputs:
+                return clientMode.isNetplay();
+
+            case MsgType::BothInputs:
+                return clientMode.isSpectate();
+
+            default:
+                return false;
+        }
+    }
+
+    // Message types accepted by isRemoteInputs, dispatched straight to the typed applyRemoteInputs
+    typedef MessageList<PlayerInputs, BothInputs, RngState> RemoteInputTypes;
+
+    // Calls the applyRemoteInputs overload for each type
+    struct RemoteInputsApplier
+    {
+        DllMain& main;
+
+        template<typename T>
+        void operator() ( const T& msg ) { main.applyRemoteInputs ( msg ); }
+    };
+
+    // Apply remote inputs or an RngState
+    void applyRemoteInputs ( MsgType type, const MsgPtr& msg )
+    {
+        if ( ! dispatchMessage ( RemoteInputTypes(), type, msg, RemoteInputsApplier { *this } ) )
+            ASSERT_IMPOSSIBLE;
+    }
+
+    void applyRemoteInputs ( const RngState& rngState )
+    {
+        netMan.setRngState ( rngState );
+    }
+
+    void applyRemoteInputs ( const PlayerInputs& playerInputs )
+    {
+        if ( playerInputs.getIndex() == netMan.getIndex() )
+            remoteFrameAdvantage = playerInputs.frameAdvantage;
+
+        // Remote input traces assume the one-way latency is half the mean round trip time,
+        // the input latency report logged on exit states the value that was used
+        if ( latencyTracker.getStats().getNumSamples() )
+            netMan.tracer.oneWayUs = uint64_t ( latencyTracker.getStats().getMean() * 500 );
+
+        netMan.setInputs ( remotePlayer, playerInputs );
+    }
+
+    void applyRemoteInputs ( const BothInputs& bothInputs )
+    {
+        netMan.setBothInputs ( bothInputs );
+    }
+
+    void checkAutoDelay()
+    {
+        if ( ! clientMode.isNetplay() || ! latencyTracker.isEnabled() )
+            return;
+
+        uint8_t delay = netMan.getGameDelay();
+        uint8_t rollback = netMan.getRollback();
+
+        if ( ! latencyTracker.recommend ( delay, rollback ) )
+            return;
+
+        changeConfig.value = ChangeConfig::Delay;
+        changeConfig.indexedFrame = netMan.getIndexedFrame();
+        changeConfig.delay = delay;
+        changeConfig.rollback = rollback;
+
+        if ( delay != netMan.getGameDelay() )
+        {
+            LOG ( "Input delay was automatically changed to %u", delay );
+
+            netMan.setGameDelay ( delay );
+
+            changeConfig.invalidate();
+            ipcSend ( changeConfig );
+        }
+
+        if ( rollback != netMan.getRollback() )
+        {
+            LOG ( "Rollback was automatically changed to %u", rollback );
+
+            netMan.setRollback ( rollback );
+            minRollbackSpacing = clamped<uint8_t> ( netMan.getRollback(), 2, 4 );
+
+            changeConfig.value = ChangeConfig::Rollback;
+            changeConfig.invalidate();
+            ipcSend ( changeConfig );
+        }
+
+        DllOverlayUi::showMessage ( format ( "Input delay: %u, rollback: %u (auto)", delay, rollback ) );
+    }
+
     void netplayStateChanged ( NetplayState state )
     {
         // Catch invalid transitions
@@ -1080,9 +1405,16 @@ struct DllMain
             DllOverlayUi::disable();
         }
 
+        // Entering Initial
+        if ( state == NetplayState::Initial )
+            initialTime = TimerManager::get().getNow ( true );
+
         // Leaving Initial or AutoCharaSelect
         if ( netMan.getState() == NetplayState::Initial || netMan.getState() == NetplayState::AutoCharaSelect )
         {
+            LOG ( "Startup stages: config->Initial=%llu ms; Initial->%s=%llu ms",
+                  initialTime - configTime, state, TimerManager::get().getNow ( true ) - initialTime );
+
 #ifdef RELEASE
             // Try to focus the game window
             SetForegroundWindow ( ( HWND ) DllHacks::windowHandle );
@@ -1123,6 +1455,20 @@ struct DllMain
         {
             if ( netMan.getRollback() )
                 rollMan.deallocateStates();
+
+            LOG ( "Input age: samples=%u; mean=%.3f ms; stddev=%.3f ms; worst=%.3f ms",
+                  inputAgeStats.getNumSamples(), inputAgeStats.getMean(),
+                  inputAgeStats.getStdDev(), inputAgeStats.getWorst() );
+
+            inputAgeStats.reset();
+
+            // Reset time sync and run at normal speed
+            if ( clientMode.isNetplay() )
+            {
+                timeSync.reset();
+                remoteFrameAdvantage = 0;
+                DllFrameRate::desiredFps = 60.0;
+            }
         }
 
         // Entering CharaSelect OR entering InGame
@@ -1146,7 +1492,7 @@ struct DllMain
             lazyDisconnect = false;
 
             // If not entering RetryMenu and we're already disconnected...
-            if ( !dataSocket || !dataSocket->isConnected() )
+            if ( ! isDataConnected() )
             {
                 delayedStop ( "Disconnected!" );
                 return;
@@ -1156,9 +1502,20 @@ struct DllMain
         // Update local state
         netMan.setState ( state );
 
+        // Record the characters and stage for each game
+        if ( state == NetplayState::Loading )
+        {
+            replayWriter.writeInitialState (
+                MsgPtr ( new InitialGameState ( netMan.getIndexedFrame(), state.value, clientMode.isTraining() ) ) );
+        }
+
+        // Entering Loading or RetryMenu, the inputs aren't being rolled back so it's safe to change delay/rollback
+        if ( state == NetplayState::Loading || state == NetplayState::RetryMenu )
+            checkAutoDelay();
+
         // Update remote index
-        if ( dataSocket && dataSocket->isConnected() )
-            dataSocket->send ( new TransitionIndex ( netMan.getIndex() ) );
+        if ( isDataConnected() )
+            sendData ( MsgPtr ( new TransitionIndex ( netMan.getIndex() ) ) );
     }
 
     void gameModeChanged ( uint32_t previous, uint32_t current )
@@ -1222,6 +1579,8 @@ struct DllMain
 
     void delayedStop ( const string& error )
     {
+        NetworkThread::GameLock lock ( networkThread.get() );
+
         if ( ! error.empty() )
             procMan.ipcSend ( new ErrorMessage ( error ) );
 
@@ -1306,6 +1665,9 @@ struct DllMain
     // Socket callbacks
     void socketAccepted ( Socket *serverSocket ) override
     {
+        if ( postToGame ( serverSocket, [this] ( Socket *socket ) { socketAccepted ( socket ); } ) )
+            return;
+
         LOG ( "socketAccepted ( %08x )", serverSocket );
 
         if ( serverSocket == serverCtrlSocket.get() )
@@ -1347,6 +1709,11 @@ struct DllMain
             ASSERT ( dataSocket != 0 );
             ASSERT ( dataSocket->isConnected() == true );
 
+            if ( clientMode.isFastCodecs() )
+                dataSocket->setCodecs ( Protocol::AllCodecs );
+
+            dataSocket->setMultipath ( options[Options::Multipath] );
+
             netplayStateChanged ( NetplayState::Initial );
 
             initialTimer.reset();
@@ -1361,11 +1728,19 @@ struct DllMain
 
     void socketConnected ( Socket *socket ) override
     {
+        if ( postToGame ( socket, [this] ( Socket *socket ) { socketConnected ( socket ); } ) )
+            return;
+
         LOG ( "socketConnected ( %08x )", socket );
 
         ASSERT ( dataSocket.get() != 0 );
         ASSERT ( dataSocket->isConnected() == true );
 
+        if ( clientMode.isFastCodecs() )
+            dataSocket->setCodecs ( Protocol::AllCodecs );
+
+        dataSocket->setMultipath ( options[Options::Multipath] );
+
         dataSocket->send ( serverCtrlSocket->address );
 
         netplayStateChanged ( NetplayState::Initial );
@@ -1375,6 +1750,9 @@ struct DllMain
 
     void socketDisconnected ( Socket *socket ) override
     {
+        if ( postToGame ( socket, [this] ( Socket *socket ) { socketDisconnected ( socket ); } ) )
+            return;
+
         LOG ( "socketDisconnected ( %08x )", socket );
 
         if ( socket == dataSocket.get() )
@@ -1399,6 +1777,17 @@ struct DllMain
     }
 
     void socketRead ( Socket *socket, const MsgPtr& msg, const IpAddrPort& address ) override
+    {
+        // Measure the latency on arrival, before any time spent waiting for the game thread
+        const uint32_t now = TimerManager::get().getNow ( true );
+
+        const auto read = [this, msg, address, now] ( Socket *socket ) { socketRead ( socket, msg, address, now ); };
+
+        if ( ! postToGame ( socket, read ) )
+            read ( socket );
+    }
+
+    void socketRead ( Socket *socket, const MsgPtr& msg, const IpAddrPort& address, uint32_t now )
     {
         LOG ( "socketRead ( %08x, %s, %s )", socket, msg, address );
 
@@ -1408,7 +1797,18 @@ struct DllMain
         if ( redirectedSockets.find ( socket ) != redirectedSockets.end() )
             return;
 
-        switch ( msg->getMsgType() )
+        const MsgType type = msg->getMsgType();
+
+        if ( isRemoteInputs ( type ) )
+        {
+            if ( type == MsgType::PlayerInputs )
+                latencyTracker.gotInputs ( msg->getAs<PlayerInputs>(), now );
+
+            applyRemoteInputs ( type, msg );
+            return;
+        }
+
+        switch ( type )
         {
             case MsgType::VersionConfig:
             {
@@ -1437,6 +1837,9 @@ struct DllMain
                     return;
                 }
 
+                if ( msg->getAs<VersionConfig>().mode.isFastCodecs() )
+                    socket->setCodecs ( Protocol::AllCodecs );
+
                 socket->send ( new SpectateConfig ( netMan.config, netMan.getState().value ) );
                 return;
             }
@@ -1452,10 +1855,6 @@ struct DllMain
                 pushSpectator ( socket, { socket->address.addr, msg->getAs<IpAddrPort>().port } );
                 return;
 
-            case MsgType::RngState:
-                netMan.setRngState ( msg->getAs<RngState>() );
-                return;
-
 #ifndef RELEASE
             case MsgType::SyncHash:
                 remoteSync.push_back ( msg );
@@ -1469,7 +1868,7 @@ struct DllMain
         switch ( clientMode.value )
         {
             case ClientMode::Host:
-                if ( msg->getMsgType() == MsgType::IpAddrPort && socket == dataSocket.get() )
+                if ( type == MsgType::IpAddrPort && socket == dataSocket.get() )
                 {
                     clientServerAddr = msg->getAs<IpAddrPort>();
                     clientServerAddr.addr = dataSocket->address.addr;
@@ -1478,12 +1877,8 @@ struct DllMain
                 }
 
             case ClientMode::Client:
-                switch ( msg->getMsgType() )
+                switch ( type )
                 {
-                    case MsgType::PlayerInputs:
-                        netMan.setInputs ( remotePlayer, msg->getAs<PlayerInputs>() );
-                        return;
-
                     case MsgType::MenuIndex:
                         netMan.setRemoteRetryMenuIndex ( msg->getAs<MenuIndex>().menuIndex );
                         return;
@@ -1519,7 +1914,7 @@ struct DllMain
 
             case ClientMode::SpectateNetplay:
             case ClientMode::SpectateBroadcast:
-                switch ( msg->getMsgType() )
+                switch ( type )
                 {
                     case MsgType::InitialGameState:
                         netMan.initial = msg->getAs<InitialGameState>();
@@ -1545,10 +1940,6 @@ struct DllMain
                         netplayStateChanged ( NetplayState::Initial );
                         return;
 
-                    case MsgType::BothInputs:
-                        netMan.setBothInputs ( msg->getAs<BothInputs>() );
-                        return;
-
                     case MsgType::MenuIndex:
                         netMan.setRetryMenuIndex ( msg->getAs<MenuIndex>().index, msg->getAs<MenuIndex>().menuIndex );
                         return;
@@ -1576,6 +1967,9 @@ struct DllMain
 
     void ipcDisconnected() override
     {
+        if ( postToGame ( [this] { ipcDisconnected(); } ) )
+            return;
+
         appState = AppState::Stopping;
         EventManager::get().stop();
         stopping = true;
@@ -1583,7 +1977,7 @@ struct DllMain
 
     void ipcRead ( const MsgPtr& msg ) override
     {
-        if ( ! msg.get() )
+        if ( ! msg.get() || postToGame ( [this, msg] { ipcRead ( msg ); } ) )
             return;
 
         switch ( msg->getMsgType() )
@@ -1598,6 +1992,19 @@ struct DllMain
                 if ( options[Options::HeldStartDuration] )
                     netMan.heldStartDuration = lexical_cast<uint32_t> ( options.arg ( Options::HeldStartDuration ) );
 
+                if ( options[Options::InputRepairs] )
+                    inputResender.repairs = lexical_cast<uint32_t> ( options.arg ( Options::InputRepairs ) );
+
+                if ( options[Options::AutoDelay] )
+                {
+                    const vector<string> args = split ( options.arg ( Options::AutoDelay ), " " );
+
+                    latencyTracker.policy = AutoDelayPolicy::Enum ( lexical_cast<uint32_t> ( args[0] ) );
+
+                    if ( args.size() > 1 )
+                        latencyTracker.rollbackBudget = lexical_cast<uint32_t> ( args[1], DEFAULT_ROLLBACK_BUDGET );
+                }
+
                 // This will log in the previous appDir folder it not the same
                 LOG ( "appDir='%s'", ProcessManager::appDir );
 
@@ -1612,6 +2019,9 @@ struct DllMain
                 syncLog.initialize ( ProcessManager::appDir + SYNC_LOG_FILE, 0 );
                 syncLog.logVersion();
 
+                if ( options[Options::RecordReplay] && ! options[Options::Replay] )
+                    replayWriter.open ( ProcessManager::appDir + REPLAY_FILE );
+
                 // Manually hit Alt+Enter to enable fullscreen
                 if ( options[Options::Fullscreen] && DllHacks::windowHandle == GetForegroundWindow() )
                 {
@@ -1671,6 +2081,16 @@ struct DllMain
                         replayStop.parts.frame = lexical_cast<uint32_t> ( *it++ );
                     }
 
+                    // Parse seek index and frame
+                    it = find ( args.begin(), args.end(), "seek" );
+                    if ( it != args.end() )
+                        ++it;
+                    if ( it != args.end() && ( args.end() - it ) >= 2 )
+                    {
+                        replaySeek.parts.index = lexical_cast<uint32_t> ( *it++ );
+                        replaySeek.parts.frame = lexical_cast<uint32_t> ( *it++ );
+                    }
+
                     // Parse check RngState args
                     it = find ( args.begin(), args.end(), "check" );
                     if ( it != args.end() )
@@ -1745,6 +2165,8 @@ struct DllMain
             case MsgType::SpectateConfig:
                 ASSERT ( clientMode.isSpectate() == true );
 
+                configTime = TimerManager::get().getNow ( true );
+
                 netMan.config.mode       = clientMode;
                 netMan.config.mode.flags |= msg->getAs<SpectateConfig>().mode.flags;
                 netMan.config.sessionId  = Logger::get().sessionId;
@@ -1789,7 +2211,7 @@ struct DllMain
                 serverCtrlSocket = SmartSocket::listenTCP ( this, 0 );
                 LOG ( "serverCtrlSocket=%08x", serverCtrlSocket.get() );
 
-                procMan.ipcSend ( serverCtrlSocket->address );
+                ipcSend ( serverCtrlSocket->address );
 
                 *CC_DAMAGE_LEVEL_ADDR = 2;
                 *CC_TIMER_SPEED_ADDR = 2;
@@ -1805,6 +2227,8 @@ struct DllMain
                 if ( netMan.config.delay != 0xFF )
                     break;
 
+                configTime = TimerManager::get().getNow ( true );
+
                 netMan.config = msg->getAs<NetplayConfig>();
                 netMan.config.mode = clientMode;
                 netMan.config.sessionId = Logger::get().sessionId;
@@ -1866,7 +2290,7 @@ struct DllMain
                     netMan.config.broadcastPort = serverCtrlSocket->address.port;
                     netMan.config.invalidate();
 
-                    procMan.ipcSend ( netMan.config );
+                    ipcSend ( netMan.config );
 
                     netplayStateChanged ( NetplayState::Initial );
                 }
@@ -1907,6 +2331,9 @@ struct DllMain
 
                 LOG ( "SessionId '%s'", netMan.config.sessionId );
 
+                // Only count the frame times of this session, not the loading before it
+                DllFrameRate::resetFrameTimes();
+
                 LOG ( "NetplayConfig: %s; flags={ %s }; delay=%d; rollback=%d; rollbackDelay=%d; winCount=%d; "
                       "hostPlayer=%d; localPlayer=%d; remotePlayer=%d; names={ '%s', '%s' }",
                       netMan.config.mode, netMan.config.mode.flagString(), netMan.config.delay, netMan.config.rollback,
@@ -1929,14 +2356,28 @@ struct DllMain
     // Timer callback
     void timerExpired ( Timer *timer ) override
     {
-        if ( timer == resendTimer.get() )
+        if ( networkThread && networkThread->isDispatching() )
         {
-            dataSocket->send ( netMan.getInputs ( localPlayer ) );
-            resendTimer->start ( RESEND_INPUTS_INTERVAL );
+            const TimerPtr ref = getTimer ( timer );
 
-            ++waitInputsTimer;
+            // Ignore timers that were released or restarted before this is handled on the game thread
+            if ( ref )
+            {
+                networkThread->post ( [this, ref]
+                {
+                    if ( getTimer ( ref.get() ) && ! ref->isStarted() )
+                        timerExpired ( ref.get() );
+                } );
+            }
+            return;
+        }
 
-            if ( waitInputsTimer > ( MAX_WAIT_INPUTS_INTERVAL / RESEND_INPUTS_INTERVAL ) )
+        if ( timer == resendTimer.get() )
+        {
+            sendInputs();
+            resendTimer->start ( inputResender.next() );
+
+            if ( inputResender.getWaited() > MAX_WAIT_INPUTS_INTERVAL )
                 delayedStop ( "Timed out!" );
         }
         else if ( timer == initialTimer.get() )
@@ -1958,10 +2399,34 @@ struct DllMain
 
     // DLL callback
     void callback()
+    {
+        // Start the network thread once the options have been received
+        if ( options[Options::NetworkThread] && !networkThread && appState == AppState::Polling && !stopping )
+        {
+            LOG ( "Starting network thread" );
+
+            networkThread.reset ( new NetworkThread() );
+            networkThread->start();
+        }
+
+        if ( ! networkThread )
+        {
+            gameCallback();
+            return;
+        }
+
+        // Handle the callbacks posted by the network thread, the game logic itself runs without blocking it
+        networkThread->dispatch();
+        gameCallback();
+    }
+
+    void gameCallback()
     {
         // Check if the game is being closed
         if ( ! ( * CC_ALIVE_FLAG_ADDR ) )
         {
+            NetworkThread::GameLock lock ( networkThread.get() );
+
             // Disconnect the main data socket if netplay
             if ( clientMode.isNetplay() && dataSocket )
                 dataSocket->disconnect();
@@ -2012,12 +2477,43 @@ struct DllMain
     // Destructor
     ~DllMain()
     {
+        // Stop dispatching callbacks before anything is destroyed
+        if ( networkThread )
+        {
+            networkThread->join();
+            networkThread.reset();
+        }
+
+        LOG ( "Input latency report:\n%s", netMan.tracer.report() );
+
+        LOG ( "Frame times: %s", DllFrameRate::frameTimeReport() );
+
+        // Path stats are only counted for relayed peers, see Socket::setMultipath
+        const auto paths = ( dataSocket ? dataSocket->getPathStats() : array<Socket::PathStats, 2>() );
+
+        if ( paths[0].received || paths[1].received )
+        {
+            for ( size_t i = 0; i < paths.size(); ++i )
+            {
+                LOG ( "Path %s: sent=%u; received=%u; first=%u; lead=%.2f ms; worstLead=%.2f ms",
+                      ( i ? "relay" : "direct" ), paths[i].sent, paths[i].received, paths[i].first,
+                      paths[i].lead.getMean(), ( paths[i].lead.getNumSamples() ? paths[i].lead.getWorst() : 0.0 ) );
+            }
+        }
+
         rollMan.deallocateStates();
 
         KeyboardManager::get().unhook();
 
         syncLog.deinitialize();
 
+        replayWriter.close();
+
+#ifndef RELEASE
+        if ( options[Options::Discovery] )
+            rollMan.saveWriteActivity ( ProcessManager::appDir + WRITE_ACTIVITY_FILE );
+#endif
+
         procMan.disconnectPipe();
 
         ControllerManager::get().owner = 0;
@@ -3,6 +3,7 @@
 #include "ProcessManager.hpp"
 #include "Exceptions.hpp"
 #include "CharacterSelect.hpp"
+#include "TimerManager.hpp"
 
 #include <algorithm>
 #include <cmath>
@@ -628,23 +629,23 @@ uint16_t NetplayManager::getRawInput ( uint8_t player, uint32_t frame ) const
     return _inputs[player - 1].get ( getIndex() - _startIndex, frame );
 }
 
-void NetplayManager::setInput ( uint8_t player, uint16_t input )
+void NetplayManager::setInput ( uint8_t player, uint16_t input, uint64_t captureUs )
 {
     ASSERT ( player == 1 || player == 2 );
     ASSERT ( getIndex() >= _startIndex );
 
+    uint32_t frame = getFrame();
+
     if ( isInRollback() )
-    {
-        _inputs[player - 1].set ( getIndex() - _startIndex, getFrame() + config.rollbackDelay, input );
-    }
-    else if ( _state == NetplayState::RetryMenu )
-    {
-        _inputs[player - 1].set ( getIndex() - _startIndex, getFrame(), input );
-    }
-    else
-    {
-        _inputs[player - 1].set ( getIndex() - _startIndex, getFrame() + config.delay, input );
-    }
+        frame += config.rollbackDelay;
+    else if ( _state != NetplayState::RetryMenu )
+        frame += config.delay;
+
+    _inputs[player - 1].set ( getIndex() - _startIndex, frame, input );
+
+    // Trace when this input will be written to the game
+    if ( captureUs )
+        tracer.captured ( {{ frame, getIndex() }}, captureUs );
 }
 
 void NetplayManager::assignInput ( uint8_t player, uint16_t input, uint32_t frame )
@@ -673,6 +674,9 @@ MsgPtr NetplayManager::getInputs ( uint8_t player ) const
     _inputs[player - 1].get ( playerInputs->getIndex() - _startIndex, playerInputs->getStartFrame(),
                               &playerInputs->inputs[0], playerInputs->size() );
 
+    if ( player != _remotePlayer )
+        tracer.stamp ( *playerInputs, TimerManager::get().queryNowUs() );
+
     return MsgPtr ( playerInputs );
 }
 
@@ -686,10 +690,19 @@ void NetplayManager::setInputs ( uint8_t player, const PlayerInputs& playerInput
     ASSERT ( getIndex() >= _startIndex );
     ASSERT ( playerInputs.getIndex() >= _startIndex );
 
+    // The same inputs can arrive more than once, eg. when resent while waiting, or sent over multiple paths.
+    // They only carry inputs that were already set, since the inputs for a frame never change.
+    if ( playerInputs.indexedFrame.value == _lastInputsFrame[player - 1] )
+        return;
+
+    _lastInputsFrame[player - 1] = playerInputs.indexedFrame.value;
+
     const uint32_t checkStartingFromIndex = ( isInRollback() ? getIndex() - _startIndex : UINT_MAX );
 
     _inputs[player - 1].set ( playerInputs.getIndex() - _startIndex, playerInputs.getStartFrame(),
                               &playerInputs.inputs[0], playerInputs.size(), checkStartingFromIndex );
+
+    tracer.gotInputs ( playerInputs, TimerManager::get().queryNowUs() );
 }
 
 MsgPtr NetplayManager::getBothInputs ( IndexedFrame& pos ) const
@@ -3,6 +3,7 @@
 #include "Messages.hpp"
 #include "InputsContainer.hpp"
 #include "NetplayStates.hpp"
+#include "InputTracer.hpp"
 
 #include <vector>
 #include <climits>
@@ -25,6 +26,9 @@ public:
     // The number of frames it takes to register a held start button input
     uint32_t heldStartDuration = 0;
 
+    // Traces the latency of local inputs, carried through setInput and PlayerInputs
+    InputTracer tracer;
+
     // Indicate which player is the remote player
     void setRemotePlayer ( uint8_t player );
 
@@ -61,13 +65,14 @@ public:
     NetplayState getState() const { return _state; }
     void setState ( NetplayState state );
     bool isInGame() const { return _state == NetplayState::InGame; }
-    bool isInRollback() const { return isInGame() && config.rollback && config.mode.isNetplay(); }
+    bool isInRollback() const { return isInGame() && isRollbackEnabled(); }
+    bool isRollbackEnabled() const { return config.rollback && config.mode.isNetplay(); }
 
     // Get / set the input for the current frame given the player
     uint16_t getInput ( uint8_t player );
     uint16_t getRawInput ( uint8_t player ) const { return getRawInput ( player, getFrame() ); }
     uint16_t getRawInput ( uint8_t player, uint32_t frame ) const;
-    void setInput ( uint8_t player, uint16_t input );
+    void setInput ( uint8_t player, uint16_t input, uint64_t captureUs = 0 );
     void assignInput ( uint8_t player, uint16_t input, uint32_t frame );
     void assignInput ( uint8_t player, uint16_t input, IndexedFrame indexedFrame );
 
@@ -100,10 +105,20 @@ public:
     void setRetryMenuIndex ( uint32_t index, int8_t menuIndex );
 
     // Get / set input delay frames
-    uint8_t getDelay() const { return ( isInRollback() ? config.rollbackDelay : config.delay ); }
+    uint8_t getDelay() const { return ( isInGame() ? getGameDelay() : config.delay ); }
     void setDelay ( uint8_t delay )
     {
-        if ( isInRollback() )
+        if ( isInGame() )
+            setGameDelay ( delay );
+        else
+            config.delay = delay;
+    }
+
+    // Get / set the input delay frames used in-game, which is the rollback delay when using rollback
+    uint8_t getGameDelay() const { return ( isRollbackEnabled() ? config.rollbackDelay : config.delay ); }
+    void setGameDelay ( uint8_t delay )
+    {
+        if ( isRollbackEnabled() )
             config.rollbackDelay = delay;
         else
             config.delay = delay;
@@ -165,6 +180,9 @@ private:
     // Mapping: player -> index offset -> frame -> input
     std::array<InputsContainer<uint16_t>, 2> _inputs;
 
+    // Mapping: player -> indexedFrame of the last PlayerInputs passed to setInputs, to skip duplicates
+    std::array<uint64_t, 2> _lastInputsFrame = {{ UINT64_MAX, UINT64_MAX }};
+
     // Mapping: index offset -> RngState (can be null)
     std::vector<MsgPtr> _rngStates;
 
@@ -99,6 +99,8 @@ void ProcessManager::connectPipe()
 
     LOG ( "processId=%08x", _processId );
 
+    openRings ( true );
+
     if ( ! WriteFile ( _pipe, &_processId, sizeof ( _processId ), &bytes, 0 ) )
         THROW_WIN_EXCEPTION ( GetLastError(), "WriteFile failed", ERROR_PIPE_RW );
 
@@ -2,6 +2,12 @@
 #include "MemDump.hpp"
 #include "DllAsmHacks.hpp"
 #include "ErrorStringsExt.hpp"
+#include "ReplayFile.hpp"
+#include "StateDump.hpp"
+
+#ifndef RELEASE
+#include "tools/RollbackAddrs.hpp"
+#endif
 
 #include <utility>
 #include <algorithm>
@@ -19,6 +25,18 @@ static MemDumpList allAddrs;
 template<typename T>
 static inline void deleteArray ( T *ptr ) { delete[] ptr; }
 
+static void loadAllAddrs()
+{
+    if ( allAddrs.empty() )
+    {
+        const size_t size = ( ( char * ) &binary_res_rollback_bin_end ) - ( char * ) &binary_res_rollback_bin_start;
+        allAddrs.load ( ( char * ) &binary_res_rollback_bin_start, size );
+    }
+
+    if ( allAddrs.empty() )
+        THROW_EXCEPTION ( "Failed to load rollback data!", ERROR_BAD_ROLLBACK_DATA );
+}
+
 
 void DllRollbackManager::GameState::save()
 {
@@ -48,14 +66,7 @@ void DllRollbackManager::GameState::load()
 
 void DllRollbackManager::allocateStates()
 {
-    if ( allAddrs.empty() )
-    {
-        const size_t size = ( ( char * ) &binary_res_rollback_bin_end ) - ( char * ) &binary_res_rollback_bin_start;
-        allAddrs.load ( ( char * ) &binary_res_rollback_bin_start, size );
-    }
-
-    if ( allAddrs.empty() )
-        THROW_EXCEPTION ( "Failed to load rollback data!", ERROR_BAD_ROLLBACK_DATA );
+    loadAllAddrs();
 
     if ( ! _memoryPool )
         _memoryPool.reset ( new char[NUM_ROLLBACK_STATES * allAddrs.totalSize], deleteArray<char> );
@@ -183,6 +194,184 @@ bool DllRollbackManager::loadState ( IndexedFrame indexedFrame, NetplayManager&
     return false;
 }
 
+MsgPtr DllRollbackManager::saveKeyframe ( const NetplayManager& netMan ) const
+{
+    loadAllAddrs();
+
+    ReplayKeyframe *keyframe = new ReplayKeyframe();
+    keyframe->indexedFrame = netMan._indexedFrame;
+    keyframe->netplayState = netMan._state;
+    keyframe->startWorldTime = netMan._startWorldTime;
+
+    // Compressed on the replay writer thread, a fast level keeps it well ahead of one keyframe per interval
+    keyframe->compressionLevel = 1;
+
+    std::fenv_t fp_env;
+    fegetenv ( &fp_env );
+    keyframe->fpEnv.assign ( ( const char * ) &fp_env, sizeof ( fp_env ) );
+
+    keyframe->dump.resize ( allAddrs.totalSize );
+
+    char *dump = &keyframe->dump[0];
+
+    for ( const MemDump& mem : allAddrs.addrs )
+        mem.saveDump ( dump );
+
+    ASSERT ( dump == &keyframe->dump[0] + allAddrs.totalSize );
+
+    return MsgPtr ( keyframe );
+}
+
+bool DllRollbackManager::loadKeyframe ( const MsgPtr& msgKeyframe, NetplayManager& netMan )
+{
+    loadAllAddrs();
+
+    if ( ! msgKeyframe || msgKeyframe->getMsgType() != MsgType::ReplayKeyframe )
+        return false;
+
+    const ReplayKeyframe& keyframe = msgKeyframe->getAs<ReplayKeyframe>();
+
+    if ( keyframe.dump.size() != allAddrs.totalSize || keyframe.fpEnv.size() != sizeof ( std::fenv_t ) )
+    {
+        LOG ( "Invalid keyframe: indexedFrame=%s; size=%u; expected=%u",
+              keyframe.indexedFrame, keyframe.dump.size(), allAddrs.totalSize );
+        return false;
+    }
+
+    LOG ( "Loaded keyframe: indexedFrame=%s", keyframe.indexedFrame );
+
+    // Overwrite the current game state
+    netMan._state = keyframe.netplayState;
+    netMan._startWorldTime = keyframe.startWorldTime;
+    netMan._indexedFrame = keyframe.indexedFrame;
+
+    std::fenv_t fp_env;
+    memcpy ( &fp_env, &keyframe.fpEnv[0], sizeof ( fp_env ) );
+    fesetenv ( &fp_env );
+
+    const char *dump = &keyframe.dump[0];
+
+    for ( const MemDump& mem : allAddrs.addrs )
+        mem.loadDump ( dump );
+
+    ASSERT ( dump == &keyframe.dump[0] + allAddrs.totalSize );
+
+    // Saved rollback states are no longer valid
+    for ( const GameState& state : _statesList )
+        _freeStack.push ( state.rawBytes - _memoryPool.get() );
+
+    _statesList.clear();
+
+    // Don't filter any sound effects from before the keyframe
+    memset ( AsmHacks::sfxFilterArray, 0, CC_SFX_ARRAY_LEN );
+    return true;
+}
+
+bool DllRollbackManager::saveDesyncDump ( const string& file, IndexedFrame desyncFrame,
+                                          const NetplayManager& netMan ) const
+{
+    loadAllAddrs();
+
+    vector<pair<uint64_t, const char *>> states;
+
+    for ( const GameState& state : _statesList )
+        states.push_back ( { state.indexedFrame.value, state.rawBytes } );
+
+    // Also dump the current game state if it wasn't saved this frame
+    string current;
+
+    if ( states.empty() || states.back().first != netMan._indexedFrame.value )
+    {
+        current.resize ( allAddrs.totalSize );
+
+        char *dump = &current[0];
+
+        for ( const MemDump& mem : allAddrs.addrs )
+            mem.saveDump ( dump );
+
+        states.push_back ( { netMan._indexedFrame.value, &current[0] } );
+    }
+
+    if ( ! StateDump::save ( file, allAddrs, desyncFrame.value, states ) )
+    {
+        LOG ( "Failed to save desync dump: '%s'", file );
+        return false;
+    }
+
+    LOG ( "Saved desync dump: '%s'; %u states", file, states.size() );
+    return true;
+}
+
+#ifndef RELEASE
+
+// Full rollback data layout, before it is minimized by the generator
+static MemDumpList fullAddrs;
+
+void DllRollbackManager::trackWrites ( const NetplayManager& netMan )
+{
+    if ( fullAddrs.empty() )
+    {
+        getRollbackAddrs ( fullAddrs );
+
+        _currentTracked.assign ( fullAddrs.totalSize, ( char ) 0 );
+        _lastTracked.assign ( fullAddrs.totalSize, ( char ) 0 );
+        _changedMask.assign ( fullAddrs.totalSize, ( char ) 0 );
+    }
+
+    char *dump = &_currentTracked[0];
+
+    for ( const MemDump& mem : fullAddrs.addrs )
+        mem.saveDump ( dump );
+
+    ASSERT ( dump == &_currentTracked[0] + fullAddrs.totalSize );
+
+    // Only compare consecutive frames, so transitions and rollbacks aren't counted as writes
+    if ( netMan._indexedFrame.parts.index == _lastTrackedFrame.parts.index
+            && netMan._indexedFrame.parts.frame == _lastTrackedFrame.parts.frame + 1 )
+    {
+        for ( size_t i = 0; i < fullAddrs.totalSize; ++i )
+            _changedMask[i] |= ( _currentTracked[i] ^ _lastTracked[i] );
+
+        ++_trackedFrames;
+    }
+
+    _lastTracked.swap ( _currentTracked );
+    _lastTrackedFrame = netMan._indexedFrame;
+}
+
+bool DllRollbackManager::saveWriteActivity ( const string& file )
+{
+    if ( _trackedFrames == 0 )
+        return false;
+
+    WriteActivity activity;
+
+    // Accumulate with any previous sessions
+    if ( activity.load ( file ) && activity.changed.size() == _changedMask.size() )
+    {
+        for ( size_t i = 0; i < _changedMask.size(); ++i )
+            activity.changed[i] |= _changedMask[i];
+
+        activity.frameCount += _trackedFrames;
+    }
+    else
+    {
+        activity.changed = _changedMask;
+        activity.frameCount = _trackedFrames;
+    }
+
+    if ( ! WriteActivity::save ( file, fullAddrs, activity.frameCount, activity.changed ) )
+    {
+        LOG ( "Failed to save write activity: '%s'", file );
+        return false;
+    }
+
+    LOG ( "Saved write activity: '%s'; %u frames", file, activity.frameCount );
+    return true;
+}
+
+#endif // NOT RELEASE
+
 void DllRollbackManager::saveRerunSounds ( uint32_t frame )
 {
     uint8_t *currentSfxArray = &_sfxHistory [ frame % NUM_ROLLBACK_STATES ][0];
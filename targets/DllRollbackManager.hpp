@@ -22,6 +22,21 @@ public:
     void saveState ( const NetplayManager& netMan );
     bool loadState ( IndexedFrame indexedFrame, NetplayManager& netMan );
 
+    // Save / load the current game state as a replay keyframe
+    MsgPtr saveKeyframe ( const NetplayManager& netMan ) const;
+    bool loadKeyframe ( const MsgPtr& msgKeyframe, NetplayManager& netMan );
+
+    // Dump all saved game states and the current game state to a file for offline diffing
+    bool saveDesyncDump ( const std::string& file, IndexedFrame desyncFrame, const NetplayManager& netMan ) const;
+
+#ifndef RELEASE
+    // Record which bytes of the full (unminimized) rollback data change between consecutive frames
+    void trackWrites ( const NetplayManager& netMan );
+
+    // Merge the recorded write activity into the given file
+    bool saveWriteActivity ( const std::string& file );
+#endif
+
     // Save sounds during rollback re-run
     void saveRerunSounds ( uint32_t frame );
 
@@ -58,4 +73,16 @@ private:
 
     // History of sound effect playbacks
     std::array<std::array<uint8_t, CC_SFX_ARRAY_LEN>, NUM_ROLLBACK_STATES> _sfxHistory;
+
+#ifndef RELEASE
+    // Full game state of the current and last tracked frames
+    std::string _currentTracked, _lastTracked;
+
+    // Non-zero for each byte that has changed
+    std::string _changedMask;
+
+    // Last tracked frame, and the number of frames compared
+    IndexedFrame _lastTrackedFrame = MaxIndexedFrame;
+    uint32_t _trackedFrames = 0;
+#endif
 };
@@ -171,7 +171,7 @@ void SpectatorManager::frameStepSpectators()
 
         // Send inputs if available
         if ( msgBothInputs )
-            socket->send ( msgBothInputs );
+            sendSpectator ( spectator.socket, msgBothInputs );
 
         // Clear sent flags whenever the index changes
         if ( spectator.pos.parts.index > oldIndex )
@@ -185,7 +185,7 @@ void SpectatorManager::frameStepSpectators()
         // Send RngState ONCE if available
         if ( msgRngState && !spectator.sentRngState )
         {
-            socket->send ( msgRngState );
+            sendSpectator ( spectator.socket, msgRngState );
             spectator.sentRngState = true;
         }
 
@@ -194,7 +194,7 @@ void SpectatorManager::frameStepSpectators()
         // Send retry menu index ONCE if available
         if ( msgMenuIndex && !spectator.sentRetryMenuIndex )
         {
-            socket->send ( msgMenuIndex );
+            sendSpectator ( spectator.socket, msgMenuIndex );
             spectator.sentRetryMenuIndex = true;
         }
 
@@ -248,6 +248,29 @@ int main ( int argc, char *argv[] )
             "  --no-ui, -n          No UI, just quits after running once.\n"
         },
 
+        {
+            Options::NetworkThread, 0, "", "network-thread", Arg::None,
+            "  --network-thread     Handle network events on a separate thread in-game.\n"
+        },
+
+        {
+            Options::Multipath, 0, "", "multipath", Arg::None,
+            "  --multipath          Send inputs over both the direct and relay paths\n"
+            "                         when connected over the UDP tunnel.\n"
+        },
+
+        {
+            Options::InputRepairs, 0, "", "input-repairs", Arg::Numeric,
+            "  --input-repairs N    Quickly resend inputs N times when waiting on the\n"
+            "                         remote side, to recover from packet loss faster.\n"
+        },
+
+        {
+            Options::RecordReplay, 0, "", "record-replay", Arg::None,
+            "  --record-replay      Record each game session to " REPLAY_FILE ",\n"
+            "                         overwriting the previous one.\n"
+        },
+
         {
             Options::Tournament, 0, "T", "tournament", Arg::None,
             "  --tournament, -T     Tournament mode.\n"
@@ -283,6 +306,12 @@ int main ( int argc, char *argv[] )
             "  --replay, -R args    Replay the given file with options.\n"
             "                         TODO list possible arguments.\n"
         },
+
+        {
+            Options::Discovery, 0, "", "discovery", Arg::None,
+            "  --discovery          Record which rollback bytes change in-game.\n"
+            "                         Pass the output to the generator to minimize rollback.bin.\n"
+        },
 #else
         { Options::Tunnel, 0, "", "tunnel", Arg::None, 0 },
         { Options::Dummy, 0, "", "dummy", Arg::None, 0 },
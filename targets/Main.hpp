@@ -16,6 +16,15 @@
 // Log file that contains all the data needed to keep games in sync
 #define SYNC_LOG_FILE FOLDER "sync.log"
 
+// Binary replay of the last session
+#define REPLAY_FILE FOLDER "replay.ccr"
+
+// Game states around the last desync, for offline diffing with tools/statediff
+#define DESYNC_DUMP_FILE FOLDER "desync.dump"
+
+// Bytes of the rollback data that changed in-game, accumulated over sessions with --discovery
+#define WRITE_ACTIVITY_FILE FOLDER "rollback.activity"
+
 // Controller mappings file extension
 #define MAPPINGS_EXT ".mappings"
 
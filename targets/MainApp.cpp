@@ -22,6 +22,12 @@ using namespace std;
 
 #define NUM_PINGS ( 10 )
 
+// Extra milliseconds to wait for the final configs, enough for a few GoBackN resends if one is lost
+#define START_DELAY_MIN ( 4 * DEFAULT_SEND_INTERVAL )
+
+// Max milliseconds to wait for the final configs to be delivered before disconnecting the sockets
+#define START_DELAY_MAX ( 1000 )
+
 
 extern vector<option::Option> opt;
 
@@ -246,6 +252,9 @@ struct MainApp
 
     TimerPtr startTimer;
 
+    // Times in milliseconds of each stage of starting the game, for logging
+    uint64_t startGameTime = 0, openGameTime = 0;
+
     IndexedFrame dummyFrame = {{ 0, 0 }};
 
     bool delayChanged = false;
@@ -463,6 +472,13 @@ struct MainApp
             return;
         }
 
+        // Only encode with the extra codecs if the remote can decode them
+        if ( versionConfig.mode.isFastCodecs() )
+        {
+            socket->setCodecs ( Protocol::AllCodecs );
+            clientMode.flags |= ClientMode::FastCodecs;
+        }
+
         // Switch to spectate mode if the game is already started
         if ( clientMode.isClient() && versionConfig.mode.isGameStarted() )
             clientMode.value = ClientMode::SpectateNetplay;
@@ -555,6 +571,32 @@ struct MainApp
         LOG ( "InitialConfig: mode=%s; flags={ %s }; dataPort=%u; localName='%s'; remoteName='%s'; winCount=%u",
               initialConfig.mode, initialConfig.mode.flagString(),
               initialConfig.dataPort, initialConfig.localName, initialConfig.remoteName, initialConfig.winCount );
+
+        prewarmGame();
+    }
+
+    // Launch the game in the background while pinging and waiting for the user, only if enabled in the config
+    void prewarmGame()
+    {
+        if ( options[Options::Dummy] || ! ui.getConfig().getInteger ( "prewarmGame" ) )
+            return;
+
+        procMan.prewarmGame ( ui.getConfig().getInteger ( "highCpuPriority" ) );
+    }
+
+    // Milliseconds to wait before starting the game, this covers a round trip plus resends for the final configs
+    uint64_t getStartDelay() const
+    {
+        if ( clientMode.isLocal() )
+            return 1;
+
+        if ( clientMode.isNetplay() && pingStats.histogram.getNumSamples() )
+        {
+            return min<uint64_t> ( 2 * pingStats.histogram.getPercentile ( 99 ) + START_DELAY_MIN,
+                                   START_DELAY_MAX );
+        }
+
+        return START_DELAY_MAX;
     }
 
     void gotPingStats ( const PingStats& pingStats )
@@ -583,11 +625,16 @@ struct MainApp
               pingStats.latency.getStdErr(), pingStats.latency.getStdDev(), pingStats.packetLoss );
 
         pingStats.latency.merge ( pinger.getStats() );
+        pingStats.histogram.merge ( pinger.getHistogram() );
         pingStats.packetLoss = ( pingStats.packetLoss + pinger.getPacketLoss() ) / 2;
 
         LOG ( "PingStats (merged): latency=%.2f ms; worst=%.2f ms; stderr=%.2f ms; stddev=%.2f ms; packetLoss=%d%%",
               pingStats.latency.getMean(), pingStats.latency.getWorst(),
               pingStats.latency.getStdErr(), pingStats.latency.getStdDev(), pingStats.packetLoss );
+
+        LOG ( "PingStats (merged): p50=%.1f ms; p90=%.1f ms; p99=%.1f ms; p99.9=%.1f ms",
+              pingStats.histogram.getPercentile ( 50 ), pingStats.histogram.getPercentile ( 90 ),
+              pingStats.histogram.getPercentile ( 99 ), pingStats.histogram.getPercentile ( 99.9 ) );
     }
 
     void gotSpectateConfig ( const SpectateConfig& spectateConfig )
@@ -611,6 +658,8 @@ struct MainApp
 
         this->spectateConfig = spectateConfig;
 
+        prewarmGame();
+
         ui.spectate ( spectateConfig );
 
         getUserConfirmation();
@@ -645,7 +694,7 @@ struct MainApp
 
     void checkDelayAndContinue()
     {
-        const int delay = computeDelay ( this->pingStats.latency.getMean() );
+        const int delay = computeDelay ( this->pingStats.histogram.getPercentile ( 50 ) );
         const int maxDelay = ui.getConfig().getInteger ( "maxRealDelay" );
 
         if ( delay > maxDelay )
@@ -689,7 +738,7 @@ struct MainApp
             if ( clientMode.isHost() )
             {
                 // TODO parse these from SyncTest args
-                netplayConfig.delay = computeDelay ( pingStats.latency.getWorst() ) + 1;
+                netplayConfig.delay = computeDelay ( pingStats.histogram.getPercentile ( 99 ) ) + 1;
                 netplayConfig.rollback = 4;
                 netplayConfig.rollbackDelay = 0;
                 netplayConfig.hostPlayer = 1;
@@ -1007,9 +1056,11 @@ struct MainApp
         ui.display ( format ( "Starting %s mode...", getGameModeString() ),
                      clientMode.isNetplay() ); // Only replace last message if netplaying
 
+        startGameTime = TimerManager::get().getNow ( true );
+
         // Start game (and disconnect sockets) after a small delay since the final configs are still in flight
         startTimer.reset ( new Timer ( this ) );
-        startTimer->start ( 1000 );
+        startTimer->start ( getStartDelay() );
     }
 
     // Pinger callbacks
@@ -1026,11 +1077,12 @@ struct MainApp
         dataSocket->send ( ping );
     }
 
-    void pingerCompleted ( Pinger *pinger, const Statistics& stats, uint8_t packetLoss ) override
+    void pingerCompleted ( Pinger *pinger, const Statistics& stats, const Histogram& histogram,
+                           uint8_t packetLoss ) override
     {
         ASSERT ( pinger == &this->pinger );
 
-        ctrlSocket->send ( new PingStats ( stats, packetLoss ) );
+        ctrlSocket->send ( new PingStats ( stats, histogram, packetLoss ) );
 
         if ( clientMode.isClient() )
         {
@@ -1069,6 +1121,9 @@ struct MainApp
             ASSERT ( dataSocket != 0 );
             ASSERT ( dataSocket->isConnected() == true );
 
+            if ( clientMode.isFastCodecs() )
+                dataSocket->setCodecs ( Protocol::AllCodecs );
+
             pinger.start();
         }
         else
@@ -1098,6 +1153,9 @@ struct MainApp
             ASSERT ( dataSocket.get() != 0 );
             ASSERT ( dataSocket->isConnected() == true );
 
+            if ( clientMode.isFastCodecs() )
+                dataSocket->setCodecs ( Protocol::AllCodecs );
+
             stopTimer.reset();
         }
         else
@@ -1249,6 +1307,8 @@ struct MainApp
     {
         ASSERT ( clientMode != ClientMode::Unknown );
 
+        const uint64_t ipcConnectedTime = TimerManager::get().getNow ( true );
+
         procMan.ipcSend ( options );
         procMan.ipcSend ( ControllerManager::get().getMappings() );
         procMan.ipcSend ( clientMode );
@@ -1267,6 +1327,12 @@ struct MainApp
 
         procMan.ipcSend ( netplayConfig );
 
+        const uint64_t now = TimerManager::get().getNow ( true );
+
+        LOG ( "Start stages: delay=%llu ms; launch=%llu ms; config=%llu ms; total=%llu ms",
+              openGameTime - startGameTime, ipcConnectedTime - openGameTime, now - ipcConnectedTime,
+              now - startGameTime );
+
         ui.display ( format ( "Started %s mode", getGameModeString() ) );
     }
 
@@ -1362,15 +1428,17 @@ struct MainApp
 
             if ( ! clientMode.isSpectate() )
             {
-                // We must disconnect the sockets before the game process is created,
-                // otherwise Windows say conflicting ports EVEN if they are created later.
+                // Disconnect the sockets before the DLL gets its config, since it binds the same ports.
+                // Our sockets aren't inherited by the game process, so it can be pre-warmed before this.
                 dataSocket.reset();
                 serverDataSocket.reset();
                 ctrlSocket.reset();
                 serverCtrlSocket.reset();
             }
 
-            // Open the game and wait for callback to ipcConnected
+            openGameTime = TimerManager::get().getNow ( true );
+
+            // Open the game (or use the pre-warmed one) and wait for callback to ipcConnected
             procMan.openGame ( ui.getConfig().getInteger ( "highCpuPriority" ) );
         }
         else
@@ -1436,6 +1504,15 @@ struct MainApp
                           format ( "%u", uint32_t ( 60 * ui.getConfig().getDouble ( "heldStartDuration" ) ) ) );
         }
 
+        if ( ui.getConfig().getInteger ( "autoDelayPolicy" ) > 0 )
+        {
+            options.set ( Options::AutoDelay, 1, format ( "%d %d", ui.getConfig().getInteger ( "autoDelayPolicy" ),
+                          ui.getConfig().getInteger ( "autoDelayRollbackBudget" ) ) );
+        }
+
+        if ( ui.getConfig().getInteger ( "recordReplay" ) )
+            options.set ( Options::RecordReplay, 1 );
+
         if ( ! ProcessManager::getIsWindowed() )
         {
             ProcessManager::setIsWindowed ( true );
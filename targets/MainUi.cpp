@@ -900,11 +900,15 @@ void MainUi::initialize()
     _config.setString ( "statsApiKey", "" );
     _config.setInteger ( "fullCharacterName", 0 );
     _config.setInteger ( "highCpuPriority", 1 );
+    _config.setInteger ( "prewarmGame", 0 );
     _config.setInteger ( "versusWinCount", 2 );
     _config.setInteger ( "maxRealDelay", 254 );
     _config.setInteger ( "defaultRollback", 4 );
     _config.setInteger ( "autoCheckUpdates", 0 );
     _config.setDouble ( "heldStartDuration", 1.5 );
+    _config.setInteger ( "autoDelayPolicy", 0 );
+    _config.setInteger ( "autoDelayRollbackBudget", 4 );
+    _config.setInteger ( "recordReplay", 0 );
     // [MeltyStats] => Lobby enter verification
     _config.setInteger ( "shouldEnterMeltyStatsLobby", 0 ); 
 
@@ -1166,11 +1170,14 @@ bool MainUi::configure ( const PingStats& pingStats )
 
     ASSERT ( _ui.get() != 0 );
 
-    const int delay = computeDelay ( pingStats.latency.getMean() );
-    const int worst = computeDelay ( pingStats.latency.getWorst() );
-    const int variance = computeDelay ( pingStats.latency.getVariance() );
+    // Use percentiles so a spiky or bimodal connection isn't hidden by the mean, while a single outlier
+    // doesn't dominate the way the worst ping would
+    const int delay = computeDelay ( pingStats.histogram.getPercentile ( 50 ) );
+    const int worst = computeDelay ( pingStats.histogram.getPercentile ( 99 ) );
+    const int spread = computeDelay ( pingStats.histogram.getPercentile ( 99.9 )
+                                      - pingStats.histogram.getPercentile ( 50 ) );
 
-    int rollback = clamped ( delay + worst + variance, 0, _config.getInteger ( "defaultRollback" ) );
+    int rollback = clamped ( delay + worst + spread, 0, _config.getInteger ( "defaultRollback" ) );
 
     _netplayConfig.delay = worst + 1;
 
@@ -1344,14 +1351,16 @@ string MainUi::formatStats ( const PingStats& pingStats )
 {
     return format (
                "%-" INDENT_STATS "s Ping: %.2f ms"
+               "\n%-" INDENT_STATS "s p99: %.2f ms"
 #ifndef NDEBUG
                "\n%-" INDENT_STATS "s Worst: %.2f ms"
                "\n%-" INDENT_STATS "s StdErr: %.2f ms"
                "\n%-" INDENT_STATS "s StdDev: %.2f ms"
                "\n%-" INDENT_STATS "s Packet Loss: %d%%"
 #endif
-               , format ( "Network delay: %d", computeDelay ( pingStats.latency.getMean() ) )
+               , format ( "Network delay: %d", computeDelay ( pingStats.histogram.getPercentile ( 50 ) ) )
                , pingStats.latency.getMean()
+               , "", pingStats.histogram.getPercentile ( 99 )
 #ifndef NDEBUG
                , "", pingStats.latency.getWorst()
                , "", pingStats.latency.getStdErr()
@@ -1502,7 +1511,10 @@ void MainUi::fetchFailed ( MainUpdater *updater, const MainUpdater::Type& type )
             break;
 
         case MainUpdater::Type::Archive:
-            sessionMessage = "Cannot download latest version";
+            if ( updater->isChecksumMissing() )
+                sessionMessage = "Cannot verify latest version, the update server has no valid checksum";
+            else
+                sessionMessage = "Cannot download latest version";
             break;
 
         default:
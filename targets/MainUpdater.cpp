@@ -3,7 +3,10 @@
 #include "ProcessManager.hpp"
 
 #include <vector>
+#include <fstream>
 #include <unordered_set>
+#include <algorithm>
+#include <cctype>
 
 #include <windows.h>
 
@@ -13,12 +16,21 @@ using namespace std;
 // Path of the latest version file
 #define LATEST_VERSION_PATH "LatestVersion"
 
-// Main update archive file name
-#define UPDATE_ARCHIVE_FILE "update.zip"
+// Main update archive file name, the same as on the server
+#define UPDATE_ARCHIVE_FORMAT "cccaster.v%s.zip"
+
+// Suffix of the archive checksum on the server, in md5sum format
+#define ARCHIVE_MD5_SUFFIX ".md5"
+
+// Number of parallel requests when downloading the archive
+#define ARCHIVE_CONNECTIONS ( 4 )
 
 // Timeout for update version check
 #define VERSION_CHECK_TIMEOUT ( 1000 )
 
+// Timeout for the archive checksum, the archive is never downloaded without one, so allow for a slow server
+#define ARCHIVE_MD5_TIMEOUT ( 10000 )
+
 
 static const vector<string> updateServers =
 {
@@ -49,6 +61,10 @@ void MainUpdater::fetch ( const Type& type )
 
     _currentServerIdx = 0;
 
+    _checksumMissing = false;
+
+    _downloadedBytes = 0;
+
     doFetch ( type );
 }
 
@@ -80,9 +96,10 @@ void MainUpdater::doFetch ( const Type& type )
                 return;
             }
 
-            url += format ( "cccaster.v%s.zip", _latestVersion.code );
-            _httpDownload.reset ( new HttpDownload ( this, url, _downloadDir + UPDATE_ARCHIVE_FILE ) );
-            _httpDownload->start();
+            // Get the checksum first, the archive is only downloaded from a server that has one
+            url += format ( UPDATE_ARCHIVE_FORMAT, _latestVersion.code ) + ARCHIVE_MD5_SUFFIX;
+            _httpGet.reset ( new HttpGet ( this, url, ARCHIVE_MD5_TIMEOUT ) );
+            _httpGet->start();
             break;
 
         default:
@@ -90,6 +107,29 @@ void MainUpdater::doFetch ( const Type& type )
     }
 }
 
+void MainUpdater::fetchArchive()
+{
+    const string url = updateServers[_currentServerIdx] + format ( UPDATE_ARCHIVE_FORMAT, _latestVersion.code );
+    const string archive = getArchiveFile();
+    const string folder = archive.substr ( 0, archive.rfind ( '.' ) ) + "\\";
+
+    // Extract while downloading, any existing bytes are extracted again when resuming
+    DeleteFile ( ( archive + EXTRACTED_MARKER_SUFFIX ).c_str() );
+    CreateDirectory ( folder.c_str(), 0 );
+
+    _unzipStream.reset ( new UnzipStream ( folder ) );
+
+    _httpDownload.reset ( new HttpDownload ( this, url, archive ) );
+    _httpDownload->connections = ARCHIVE_CONNECTIONS;
+    _httpDownload->md5 = _archiveMd5;
+    _httpDownload->start();
+}
+
+string MainUpdater::getArchiveFile() const
+{
+    return _downloadDir + format ( UPDATE_ARCHIVE_FORMAT, _latestVersion.code );
+}
+
 bool MainUpdater::openChangeLog() const
 {
     unordered_set<string> folders = { _downloadDir, ProcessManager::appDir };
@@ -117,17 +157,17 @@ bool MainUpdater::openChangeLog() const
 
 bool MainUpdater::extractArchive() const
 {
-    DWORD val = GetFileAttributes ( ( _downloadDir + UPDATE_ARCHIVE_FILE ).c_str() );
-
-    if ( val == INVALID_FILE_ATTRIBUTES )
+    if ( _latestVersion.empty() )
     {
-        LOG ( "Missing: %s", _downloadDir + UPDATE_ARCHIVE_FILE );
+        LOG ( "Latest version is unknown" );
         return false;
     }
 
-    if ( _latestVersion.empty() )
+    DWORD val = GetFileAttributes ( getArchiveFile().c_str() );
+
+    if ( val == INVALID_FILE_ATTRIBUTES )
     {
-        LOG ( "Latest version is unknown" );
+        LOG ( "Missing: %s", getArchiveFile() );
         return false;
     }
 
@@ -142,7 +182,7 @@ bool MainUpdater::extractArchive() const
     const string command = format ( "\"" + tmpUpdater + "\" %d %s %s %s",
                                     GetCurrentProcessId(),
                                     binary,
-                                    _downloadDir + UPDATE_ARCHIVE_FILE,
+                                    getArchiveFile(),
                                     ProcessManager::appDir );
 
     LOG ( "Binary: %s", binary );
@@ -159,6 +199,29 @@ bool MainUpdater::extractArchive() const
 void MainUpdater::httpResponse ( HttpGet *httpGet, int code, const string& data, uint32_t remainingBytes )
 {
     ASSERT ( _httpGet.get() == httpGet );
+
+    if ( _type == Type::Archive )
+    {
+        const string md5 = trimmed ( data ).substr ( 0, 32 );
+
+        if ( code != 200 || md5.size() != 32 || ! all_of ( md5.begin(), md5.end(), ::isxdigit ) )
+        {
+            LOG ( "Invalid archive md5: code=%d; data='%s'", code, trimmed ( data ) );
+            httpFailed ( httpGet );
+            return;
+        }
+
+        _httpGet.reset();
+
+        _archiveMd5 = md5;
+        _checksumMissing = false;
+
+        LOG ( "Archive md5=%s", _archiveMd5 );
+
+        fetchArchive();
+        return;
+    }
+
     ASSERT ( _type == Type::Version );
 
     Version version ( trimmed ( data ) );
@@ -182,20 +245,28 @@ void MainUpdater::httpResponse ( HttpGet *httpGet, int code, const string& data,
 void MainUpdater::httpFailed ( HttpGet *httpGet )
 {
     ASSERT ( _httpGet.get() == httpGet );
-    ASSERT ( _type == Type::Version );
 
     _httpGet.reset();
 
+    ASSERT ( _type == Type::Version || _type == Type::Archive );
+
+    // Never download the archive without a checksum, try the next server instead
+    if ( _type == Type::Archive )
+    {
+        _archiveMd5.clear();
+        _checksumMissing = true;
+    }
+
     ++_currentServerIdx;
 
     if ( _currentServerIdx >= updateServers.size() )
     {
         if ( owner )
-            owner->fetchFailed ( this, Type::Version );
+            owner->fetchFailed ( this, _type );
         return;
     }
 
-    doFetch ( Type::Version );
+    doFetch ( _type );
 }
 
 void MainUpdater::downloadComplete ( HttpDownload *httpDownload )
@@ -205,6 +276,16 @@ void MainUpdater::downloadComplete ( HttpDownload *httpDownload )
 
     _httpDownload.reset();
 
+    // Let the updater know it can use the extracted files
+    if ( _unzipStream && _unzipStream->isFinished() )
+    {
+        ofstream marker ( ( getArchiveFile() + EXTRACTED_MARKER_SUFFIX ).c_str() );
+
+        LOG ( "Extracted %u files", _unzipStream->getFileCount() );
+    }
+
+    _unzipStream.reset();
+
     if ( owner )
         owner->fetchCompleted ( this, _type );
 }
@@ -214,9 +295,16 @@ void MainUpdater::downloadFailed ( HttpDownload *httpDownload )
     ASSERT ( _httpDownload.get() == httpDownload );
     ASSERT ( _type == Type::ChangeLog || _type == Type::Archive );
 
+    const uint32_t downloadedBytes = httpDownload->getDownloadedBytes();
+
     _httpDownload.reset();
+    _unzipStream.reset();
 
-    ++_currentServerIdx;
+    // Resume from the same server if this attempt made progress
+    if ( downloadedBytes <= _downloadedBytes )
+        ++_currentServerIdx;
+
+    _downloadedBytes = downloadedBytes;
 
     if ( _currentServerIdx >= updateServers.size() )
     {
@@ -226,9 +314,6 @@ void MainUpdater::downloadFailed ( HttpDownload *httpDownload )
     }
 
     doFetch ( _type );
-
-    // Reset the download progress to zero
-    downloadProgress ( _httpDownload.get(), 0, 1 );
 }
 
 void MainUpdater::downloadProgress ( HttpDownload *httpDownload, uint32_t downloadedBytes, uint32_t totalBytes )
@@ -238,3 +323,9 @@ void MainUpdater::downloadProgress ( HttpDownload *httpDownload, uint32_t downlo
 
     LOG ( "%u / %u", downloadedBytes, totalBytes );
 }
+
+void MainUpdater::downloadData ( HttpDownload *httpDownload, const char *bytes, size_t len )
+{
+    if ( _unzipStream )
+        _unzipStream->write ( bytes, len );
+}
@@ -3,6 +3,7 @@
 #include "Enum.hpp"
 #include "HttpDownload.hpp"
 #include "HttpGet.hpp"
+#include "UnzipStream.hpp"
 #include "Version.hpp"
 
 #include <string>
@@ -39,6 +40,10 @@ public:
 
     const Version& getLatestVersion() const { return _latestVersion; }
 
+    // Indicates if the archive checksum was missing or invalid on the last server tried,
+    // the archive is never downloaded without it
+    bool isChecksumMissing() const { return _checksumMissing; }
+
 private:
 
     Type _type;
@@ -47,14 +52,30 @@ private:
 
     std::shared_ptr<HttpDownload> _httpDownload;
 
+    // Extracts the archive while it downloads
+    std::shared_ptr<UnzipStream> _unzipStream;
+
     uint32_t _currentServerIdx = 0;
 
+    // Bytes downloaded before the last failure, a download that made progress is retried on the same server
+    uint32_t _downloadedBytes = 0;
+
+    // Expected MD5 of the archive
+    std::string _archiveMd5;
+
+    // If the archive checksum was missing or invalid on the last server tried
+    bool _checksumMissing = false;
+
     Version _latestVersion;
 
     std::string _downloadDir;
 
     void doFetch ( const Type& type );
 
+    void fetchArchive();
+
+    std::string getArchiveFile() const;
+
     void httpResponse ( HttpGet *httpGet, int code, const std::string& data, uint32_t remainingBytes ) override;
     void httpFailed ( HttpGet *httpGet ) override;
     void httpProgress ( HttpGet *httpGet, uint32_t receivedBytes, uint32_t totalBytes ) override {}
@@ -62,4 +83,5 @@ private:
     void downloadComplete ( HttpDownload *httpDownload ) override;
     void downloadFailed ( HttpDownload *httpDownload ) override;
     void downloadProgress ( HttpDownload *httpDownload, uint32_t downloadedBytes, uint32_t totalBytes ) override;
+    void downloadData ( HttpDownload *httpDownload, const char *bytes, size_t len ) override;
 };
@@ -0,0 +1,136 @@
+#ifndef RELEASE
+
+#include "Compression.hpp"
+#include "Messages.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+#define NUM_ITERATIONS  ( 1000 )
+#define MAX_DATA_SIZE   ( 4096 )
+
+
+static string randomData ( size_t size )
+{
+    string data ( size, ( char ) 0 );
+
+    // Mix of random bytes and repeated runs, so there is something to compress
+    for ( size_t i = 0; i < size; )
+    {
+        const size_t run = 1 + rand() % 32;
+        const char value = ( char ) ( rand() % 0x100 );
+
+        for ( size_t j = 0; j < run && i < size; ++j, ++i )
+            data[i] = ( rand() % 4 == 0 ? ( char ) ( rand() % 0x100 ) : value );
+    }
+
+    return data;
+}
+
+static bool roundTrip ( const string& data, const string& dict )
+{
+    string buffer ( lzCompressBound ( data.size() ), ( char ) 0 );
+    const size_t size = lzCompress ( &data[0], data.size(), &buffer[0], buffer.size(),
+                                     dict.empty() ? 0 : &dict[0], dict.size() );
+
+    if ( size == 0 )
+        return false;
+
+    string output ( data.size(), ( char ) 0 );
+    const size_t outputSize = lzUncompress ( &buffer[0], size, &output[0], output.size(),
+                                             dict.empty() ? 0 : &dict[0], dict.size() );
+
+    return ( outputSize == data.size() && output == data );
+}
+
+
+TEST ( Compression, LzRoundTrip )
+{
+    for ( size_t i = 0; i < NUM_ITERATIONS; ++i )
+    {
+        const string data = randomData ( 1 + rand() % MAX_DATA_SIZE );
+        EXPECT_TRUE ( roundTrip ( data, "" ) );
+    }
+}
+
+TEST ( Compression, LzDictionaryRoundTrip )
+{
+    vector<string> samples;
+
+    for ( size_t i = 0; i < 64; ++i )
+        samples.push_back ( randomData ( 64 + rand() % 256 ) );
+
+    const string dict = trainDictionary ( samples, 1024 );
+
+    EXPECT_FALSE ( dict.empty() );
+    EXPECT_LE ( dict.size(), 1024 );
+
+    for ( size_t i = 0; i < NUM_ITERATIONS; ++i )
+    {
+        const string data = randomData ( 1 + rand() % MAX_DATA_SIZE );
+        EXPECT_TRUE ( roundTrip ( data, dict ) );
+    }
+}
+
+TEST ( Compression, LzDictionaryHelps )
+{
+    const string sample = "CCCaster protocol message 0123456789";
+
+    const vector<string> samples ( 4, sample );
+    const string dict = trainDictionary ( samples, 256 );
+
+    string buffer ( lzCompressBound ( sample.size() ), ( char ) 0 );
+
+    const size_t plainSize = lzCompress ( &sample[0], sample.size(), &buffer[0], buffer.size() );
+    const size_t dictSize = lzCompress ( &sample[0], sample.size(), &buffer[0], buffer.size(), &dict[0], dict.size() );
+
+    EXPECT_LT ( dictSize, plainSize );
+}
+
+TEST ( Compression, LzCorruptInput )
+{
+    const string data = randomData ( MAX_DATA_SIZE );
+
+    string buffer ( lzCompressBound ( data.size() ), ( char ) 0 );
+    const size_t size = lzCompress ( &data[0], data.size(), &buffer[0], buffer.size() );
+
+    ASSERT_GT ( size, 0 );
+
+    // Truncated input should fail cleanly
+    string output ( data.size(), ( char ) 0 );
+    EXPECT_NE ( lzUncompress ( &buffer[0], size / 2, &output[0], output.size() ), data.size() );
+
+    // So should a too small output buffer
+    EXPECT_EQ ( lzUncompress ( &buffer[0], size, &output[0], output.size() / 2 ), 0 );
+}
+
+TEST ( Compression, ProtocolCodecs )
+{
+    const uint8_t codecs[] = { 0, Protocol::FastLz, Protocol::FastLzDict, Protocol::AllCodecs };
+
+    for ( uint8_t codec : codecs )
+    {
+        InitialConfig initialConfig;
+        initialConfig.localName = string ( 200, 'a' ) + randomData ( 200 );
+        initialConfig.remoteName = initialConfig.localName;
+
+        const string bytes = Protocol::encode ( initialConfig, codec );
+
+        size_t consumed;
+        MsgPtr msg = Protocol::decode ( &bytes[0], bytes.size(), consumed );
+
+        ASSERT_TRUE ( msg.get() != 0 );
+        EXPECT_EQ ( bytes.size(), consumed );
+        EXPECT_EQ ( MsgType::InitialConfig, msg->getMsgType() );
+        EXPECT_EQ ( initialConfig.localName, msg->getAs<InitialConfig>().localName );
+        EXPECT_EQ ( initialConfig.remoteName, msg->getAs<InitialConfig>().remoteName );
+    }
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,148 @@
+#ifndef RELEASE
+
+#include "Test.Socket.hpp"
+#include "Statistics.hpp"
+#include "Pinger.hpp"
+#include "Thread.hpp"
+
+#include <windows.h>
+#include <mmsystem.h>
+
+using namespace std;
+
+
+#define NUM_PACKETS         ( 200 )
+#define SEND_INTERVAL       ( 5 )
+#define STOP_DELAY          ( 100 )
+#define DEFAULT_TIMEOUT     ( 1000 )
+
+
+// Sends packets at a fixed interval and records the latency from each packet arriving to the socketRead callback
+struct LatencyTest : public Socket::Owner, public Timer::Owner
+{
+    SocketPtr server, client;
+    Timer timer;
+    size_t count = 0;
+    Statistics latency;
+
+    void socketAccepted ( Socket *socket ) override {}
+    void socketConnected ( Socket *socket ) override {}
+    void socketDisconnected ( Socket *socket ) override {}
+
+    void socketRead ( Socket *socket, const MsgPtr& msg, const IpAddrPort& address ) override
+    {
+        if ( socket != server.get() || ! msg || msg->getMsgType() != MsgType::Ping )
+            return;
+
+        latency.addSample ( ( TimerManager::get().getNowUs ( true ) - msg->getAs<Ping>().timestamp ) / 1000.0 );
+    }
+
+    void timerExpired ( Timer *timer ) override
+    {
+        if ( count >= NUM_PACKETS )
+        {
+            EventManager::get().stop();
+            return;
+        }
+
+        const uint64_t now = TimerManager::get().getNowUs ( true );
+        client->send ( new Ping ( now ), IpAddrPort ( "127.0.0.1", server->address.port ) );
+        ++count;
+
+        timer->start ( SEND_INTERVAL );
+    }
+
+    LatencyTest()
+        : server ( UdpSocket::bind ( this, 0 ) )
+        , client ( UdpSocket::bind ( this, 0 ) )
+        , timer ( this )
+    {
+        timer.start ( SEND_INTERVAL );
+    }
+};
+
+// Benchmark the latency from a packet arriving to the socketRead callback,
+// compared to the previous event loop that slept for 1 ms before each check.
+// Disabled by default since it takes a few seconds, run with --gtest_also_run_disabled_tests.
+TEST ( EventManager, DISABLED_PacketToCallbackLatency )
+{
+    TimerManager::get().initialize();
+    SocketManager::get().initialize();
+
+    Statistics before, after;
+
+    {
+        LatencyTest test;
+
+        EventManager::get().startPolling();
+
+        timeBeginPeriod ( 1 );
+
+        do
+        {
+            Sleep ( 1 );
+        }
+        while ( EventManager::get().poll ( DEFAULT_TIMEOUT ) );
+
+        timeEndPeriod ( 1 );
+
+        before.merge ( test.latency );
+    }
+
+    {
+        LatencyTest test;
+
+        EventManager::get().start();
+
+        after.merge ( test.latency );
+    }
+
+    PRINT ( "Packet to callback latency before: samples=%u; mean=%.3f ms; stddev=%.3f ms; worst=%.3f ms",
+            before.getNumSamples(), before.getMean(), before.getStdDev(), before.getWorst() );
+
+    PRINT ( "Packet to callback latency after: samples=%u; mean=%.3f ms; stddev=%.3f ms; worst=%.3f ms",
+            after.getNumSamples(), after.getMean(), after.getStdDev(), after.getWorst() );
+
+    EXPECT_GT ( before.getNumSamples(), NUM_PACKETS / 2 );
+    EXPECT_GT ( after.getNumSamples(), NUM_PACKETS / 2 );
+
+    SocketManager::get().deinitialize();
+    TimerManager::get().deinitialize();
+}
+
+// Stopping from another thread should wake up the event loop immediately
+TEST ( EventManager, WakeFromThread )
+{
+    struct StopThread : public Thread
+    {
+        void run() override
+        {
+            Sleep ( STOP_DELAY );
+            EventManager::get().stop();
+        }
+    };
+
+    TimerManager::get().initialize();
+    SocketManager::get().initialize();
+
+    StopThread thread;
+
+    const uint64_t start = TimerManager::get().getNow ( true );
+
+    thread.start();
+
+    EventManager::get().start();
+
+    const uint64_t elapsed = TimerManager::get().getNow ( true ) - start;
+
+    thread.join();
+
+    PRINT ( "Stopped event loop after %llu ms", elapsed );
+
+    EXPECT_LT ( elapsed, STOP_DELAY + 50 );
+
+    SocketManager::get().deinitialize();
+    TimerManager::get().deinitialize();
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,120 @@
+#ifndef RELEASE
+
+#include "Histogram.hpp"
+#include "Messages.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+
+
+#define NUM_SAMPLES     ( 10000 )
+
+// Conservative UDP payload size that shouldn't get fragmented
+#define MAX_PACKET_SIZE ( 1200 )
+
+
+// Bimodal latencies, mostly around 40 ms with occasional spikes around 150 ms
+static double randomLatency()
+{
+    const double base = ( rand() % 20 == 0 ? 150.0 : 40.0 );
+
+    return base + ( rand() % 1000 ) / 100.0;
+}
+
+static double exactPercentile ( vector<double> samples, double percentile )
+{
+    sort ( samples.begin(), samples.end() );
+
+    const size_t index = size_t ( max ( 1.0, samples.size() * percentile / 100.0 ) + 0.5 ) - 1;
+
+    return samples[min ( index, samples.size() - 1 )];
+}
+
+
+TEST ( Histogram, Percentiles )
+{
+    Histogram histogram;
+    vector<double> samples;
+
+    for ( size_t i = 0; i < NUM_SAMPLES; ++i )
+    {
+        samples.push_back ( randomLatency() );
+        histogram.addSample ( samples.back() );
+    }
+
+    EXPECT_EQ ( NUM_SAMPLES, histogram.getNumSamples() );
+
+    for ( double percentile : { 50.0, 90.0, 99.0, 99.9 } )
+    {
+        const double exact = exactPercentile ( samples, percentile );
+        const double approx = histogram.getPercentile ( percentile );
+
+        // Upper bound of the bucket, so never less than the exact value (within resolution)
+        EXPECT_GE ( approx + 1.0 / HISTOGRAM_UNITS, exact ) << "p" << percentile;
+        EXPECT_LE ( approx, exact * ( 1 + 1.0 / HISTOGRAM_SUB_BUCKETS ) + 1.0 / HISTOGRAM_UNITS ) << "p" << percentile;
+    }
+
+    // The spikes show up at p99, even though the mean doesn't reveal them
+    EXPECT_GT ( histogram.getPercentile ( 99 ), 140.0 );
+    EXPECT_LT ( histogram.getPercentile ( 50 ), 55.0 );
+
+    EXPECT_LE ( histogram.getPercentile ( 100 ), *max_element ( samples.begin(), samples.end() ) );
+}
+
+TEST ( Histogram, Merge )
+{
+    Histogram all, first, second;
+
+    for ( size_t i = 0; i < NUM_SAMPLES; ++i )
+    {
+        const double latency = randomLatency();
+
+        all.addSample ( latency );
+        ( i % 2 ? first : second ).addSample ( latency );
+    }
+
+    first.merge ( second );
+
+    EXPECT_EQ ( all.getNumSamples(), first.getNumSamples() );
+
+    for ( double percentile : { 0.0, 50.0, 90.0, 99.0, 99.9, 100.0 } )
+        EXPECT_EQ ( all.getPercentile ( percentile ), first.getPercentile ( percentile ) );
+
+    first.reset();
+
+    EXPECT_EQ ( 0, first.getNumSamples() );
+    EXPECT_EQ ( 0, first.getPercentile ( 50 ) );
+}
+
+TEST ( Histogram, PingStatsSize )
+{
+    Statistics latency;
+    Histogram histogram;
+
+    for ( size_t i = 0; i < NUM_SAMPLES; ++i )
+    {
+        const double value = randomLatency();
+
+        latency.addSample ( value );
+        histogram.addSample ( value );
+    }
+
+    // Even a full histogram must fit in a single packet
+    const string bytes = Protocol::encode ( PingStats ( latency, histogram, 0 ) );
+
+    EXPECT_LE ( bytes.size(), MAX_PACKET_SIZE );
+
+    size_t consumed;
+    const MsgPtr msg = Protocol::decode ( &bytes[0], bytes.size(), consumed );
+
+    ASSERT_TRUE ( msg.get() );
+    ASSERT_EQ ( MsgType::PingStats, msg->getMsgType() );
+    EXPECT_EQ ( histogram.getPercentile ( 99 ), msg->getAs<PingStats>().histogram.getPercentile ( 99 ) );
+}
+
+#endif // NOT RELEASE
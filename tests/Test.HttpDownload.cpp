@@ -0,0 +1,465 @@
+#ifndef RELEASE
+
+#include "HttpDownload.hpp"
+#include "UnzipStream.hpp"
+#include "TcpSocket.hpp"
+#include "EventManager.hpp"
+#include "SocketManager.hpp"
+#include "TimerManager.hpp"
+#include "Timer.hpp"
+#include "StringUtils.hpp"
+#include "Logger.hpp"
+
+#include <miniz.h>
+
+#include <gtest/gtest.h>
+
+#include <windows.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+// Test files are written to the current folder
+#define TEST_FILE           "HttpDownloadTest.zip"
+
+// Archives are extracted into this folder
+#define TEST_FOLDER         "HttpDownloadTest/"
+
+// Bytes sent on each connection per tick, so parallel responses are interleaved
+#define SEND_CHUNK_SIZE     ( 16 * 1024 )
+
+// Stop the test if the download hasn't finished by then
+#define TEST_TIMEOUT        ( 10000 )
+
+
+// Stand-in HTTP server that supports range requests, and sends the responses a chunk at a time
+struct TestHttpServer : public Socket::Owner, public Timer::Owner
+{
+    // Range of a request, end is exclusive
+    struct Range
+    {
+        uint32_t begin, end;
+        bool partial;
+    };
+
+    struct Connection
+    {
+        SocketPtr socket;
+        string request, pending;
+    };
+
+    const string content;
+
+    SocketPtr socket;
+
+    vector<Connection> connections;
+
+    // Every request received
+    vector<Range> requests;
+
+    // Drop the connection once this many bytes have been sent in total, only once
+    uint32_t dropAfter = 0;
+
+    uint32_t sentBytes = 0;
+
+    Timer timer;
+
+    TestHttpServer ( const string& content )
+        : content ( content ), socket ( TcpSocket::listen ( this, 0, true ) ), timer ( this ) // Raw socket
+    {
+        timer.start ( 1 );
+    }
+
+    string getUrl() const
+    {
+        return format ( "http://127.0.0.1:%u/" TEST_FILE, socket->address.port );
+    }
+
+    void socketAccepted ( Socket *serverSocket ) override
+    {
+        connections.push_back ( Connection() );
+        connections.back().socket = serverSocket->accept ( this );
+    }
+
+    void socketConnected ( Socket *socket ) override {}
+    void socketDisconnected ( Socket *socket ) override {}
+    void socketRead ( Socket *socket, const MsgPtr& msg, const IpAddrPort& address ) override {}
+
+    void socketRead ( Socket *socket, const char *bytes, size_t len, const IpAddrPort& address ) override
+    {
+        auto it = find_if ( connections.begin(), connections.end(),
+                            [socket] ( const Connection & c ) { return c.socket.get() == socket; } );
+
+        ASSERT_TRUE ( it != connections.end() );
+
+        it->request.append ( bytes, len );
+
+        if ( it->request.find ( "\r\n\r\n" ) == string::npos )
+            return;
+
+        Range range = { 0, ( uint32_t ) content.size(), false };
+
+        const size_t i = it->request.find ( "Range: bytes=" );
+
+        if ( i != string::npos )
+        {
+            range.partial = true;
+
+            if ( sscanf ( &it->request[i], "Range: bytes=%u-%u", &range.begin, &range.end ) == 2 )
+                ++range.end;
+        }
+
+        requests.push_back ( range );
+        it->request.clear();
+
+        if ( range.begin >= content.size() )
+        {
+            it->pending = "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Length: 0\r\n\r\n";
+            return;
+        }
+
+        if ( range.partial )
+        {
+            it->pending = format ( "HTTP/1.1 206 Partial Content\r\nContent-Length: %u\r\nContent-Range: bytes %u-%u/%u\r\n\r\n",
+                                   range.end - range.begin, range.begin, range.end - 1, content.size() );
+        }
+        else
+        {
+            it->pending = format ( "HTTP/1.1 200 OK\r\nContent-Length: %u\r\n\r\n", content.size() );
+        }
+
+        it->pending += content.substr ( range.begin, range.end - range.begin );
+    }
+
+    void timerExpired ( Timer *timer ) override
+    {
+        for ( Connection& c : connections )
+        {
+            if ( c.pending.empty() || ! c.socket || ! c.socket->isConnected() )
+                continue;
+
+            const size_t len = min<size_t> ( SEND_CHUNK_SIZE, c.pending.size() );
+
+            if ( dropAfter && sentBytes + len > dropAfter )
+            {
+                dropAfter = 0;
+                c.pending.clear();
+                c.socket->disconnect();
+                continue;
+            }
+
+            c.socket->send ( &c.pending[0], len );
+            c.pending.erase ( 0, len );
+            sentBytes += len;
+        }
+
+        this->timer.start ( 1 );
+    }
+};
+
+struct TestDownloader : public HttpDownload::Owner, public Timer::Owner
+{
+    HttpDownload download;
+
+    // Bytes passed to downloadData
+    string data;
+
+    uint32_t completed = 0, failed = 0;
+
+    // Optionally extract the downloaded data
+    shared_ptr<UnzipStream> unzip;
+
+    Timer timer;
+
+    TestDownloader ( const string& url ) : download ( this, url, TEST_FILE ), timer ( this ) {}
+
+    void run()
+    {
+        timer.start ( TEST_TIMEOUT );
+        EventManager::get().start();
+        timer.stop();
+    }
+
+    void downloadComplete ( HttpDownload *httpDownload ) override
+    {
+        ++completed;
+        EventManager::get().stop();
+    }
+
+    void downloadFailed ( HttpDownload *httpDownload ) override
+    {
+        ++failed;
+        EventManager::get().stop();
+    }
+
+    void downloadProgress ( HttpDownload *httpDownload, uint32_t downloadedBytes, uint32_t totalBytes ) override
+    {
+        EXPECT_LE ( downloadedBytes, totalBytes );
+    }
+
+    void downloadData ( HttpDownload *httpDownload, const char *bytes, size_t len ) override
+    {
+        data.append ( bytes, len );
+
+        if ( unzip )
+            unzip->write ( bytes, len );
+    }
+
+    void timerExpired ( Timer *timer ) override
+    {
+        LOG ( "Stopping because of timeout" );
+        EventManager::get().stop();
+    }
+};
+
+static string randomData ( size_t len )
+{
+    string data ( len, '\0' );
+
+    for ( char& c : data )
+        c = rand();
+
+    return data;
+}
+
+static string md5Hex ( const string& data )
+{
+    MD5_CTX ctx;
+    MD5_Init ( &ctx );
+    MD5_Update ( &ctx, &data[0], data.size() );
+
+    unsigned char digest[16];
+    MD5_Final ( digest, &ctx );
+
+    string hash;
+    for ( unsigned char c : digest )
+        hash += format ( "%02x", c );
+    return hash;
+}
+
+static string readFile ( const string& file )
+{
+    ifstream fin ( file.c_str(), ios::binary );
+    stringstream ss;
+    ss << fin.rdbuf();
+    return ss.str();
+}
+
+static bool fileExists ( const string& file )
+{
+    return ( GetFileAttributes ( file.c_str() ) != INVALID_FILE_ATTRIBUTES );
+}
+
+static void removeTestFiles()
+{
+    remove ( TEST_FILE );
+    remove ( TEST_FILE ".part" );
+}
+
+static void initialize()
+{
+    TimerManager::get().initialize();
+    SocketManager::get().initialize();
+
+    removeTestFiles();
+}
+
+static void deinitialize()
+{
+    SocketManager::get().deinitialize();
+    TimerManager::get().deinitialize();
+
+    removeTestFiles();
+}
+
+
+TEST ( HttpDownload, DownloadAndExtract )
+{
+    srand ( 1234 );
+
+    initialize();
+
+    const vector<pair<string, string>> files =
+    {
+        { "cccaster.exe", randomData ( 200 * 1024 ) },
+        { "cccaster/hook.dll", string ( 300 * 1024, 'x' ) },
+        { "readme.txt", "Readme" },
+    };
+
+    mz_zip_archive zip;
+    memset ( &zip, 0, sizeof ( zip ) );
+    ASSERT_TRUE ( mz_zip_writer_init_heap ( &zip, 0, 0 ) );
+
+    for ( const auto& file : files )
+        ASSERT_TRUE ( mz_zip_writer_add_mem ( &zip, file.first.c_str(), &file.second[0], file.second.size(), 6 ) );
+
+    void *buffer = 0;
+    size_t size = 0;
+    ASSERT_TRUE ( mz_zip_writer_finalize_heap_archive ( &zip, &buffer, &size ) );
+
+    const string archive ( ( const char * ) buffer, size );
+
+    mz_free ( buffer );
+    mz_zip_writer_end ( &zip );
+
+    CreateDirectory ( TEST_FOLDER, 0 );
+
+    {
+        TestHttpServer server ( archive );
+        TestDownloader client ( server.getUrl() );
+
+        client.unzip.reset ( new UnzipStream ( TEST_FOLDER ) );
+        client.download.md5 = md5Hex ( archive );
+        client.download.start();
+        client.run();
+
+        EXPECT_EQ ( 1, client.completed );
+        EXPECT_EQ ( 0, client.failed );
+        EXPECT_EQ ( 1, server.requests.size() );
+        EXPECT_TRUE ( archive == client.data );
+        EXPECT_TRUE ( archive == readFile ( TEST_FILE ) );
+        EXPECT_FALSE ( fileExists ( TEST_FILE ".part" ) );
+
+        EXPECT_TRUE ( client.unzip->isFinished() );
+        EXPECT_EQ ( files.size(), client.unzip->getFileCount() );
+
+        for ( const auto& file : files )
+        {
+            EXPECT_TRUE ( file.second == readFile ( TEST_FOLDER + file.first ) ) << file.first;
+            remove ( ( TEST_FOLDER + file.first ).c_str() );
+        }
+    }
+
+    deinitialize();
+}
+
+TEST ( HttpDownload, Resume )
+{
+    srand ( 1234 );
+
+    initialize();
+
+    const string content = randomData ( 1024 * 1024 );
+
+    {
+        TestHttpServer server ( content );
+        server.dropAfter = 300 * 1024;
+
+        TestDownloader client ( server.getUrl() );
+        client.download.md5 = md5Hex ( content );
+        client.download.start();
+        client.run();
+
+        EXPECT_EQ ( 0, client.completed );
+        EXPECT_EQ ( 1, client.failed );
+
+        // The received bytes are kept for the next attempt
+        const uint32_t downloadedBytes = client.download.getDownloadedBytes();
+
+        EXPECT_GT ( downloadedBytes, 0 );
+        EXPECT_LT ( downloadedBytes, content.size() );
+        EXPECT_EQ ( downloadedBytes, readFile ( TEST_FILE ".part" ).size() );
+
+        client.data.clear();
+        client.download.start();
+        client.run();
+
+        EXPECT_EQ ( 1, client.completed );
+        EXPECT_EQ ( 1, client.failed );
+
+        ASSERT_EQ ( 2, server.requests.size() );
+        EXPECT_EQ ( 0, server.requests[0].begin );
+        EXPECT_EQ ( downloadedBytes, server.requests[1].begin );
+
+        // The bytes from the previous attempt are passed along again before the new bytes
+        EXPECT_TRUE ( content == client.data );
+        EXPECT_TRUE ( content == readFile ( TEST_FILE ) );
+        EXPECT_FALSE ( fileExists ( TEST_FILE ".part" ) );
+    }
+
+    deinitialize();
+}
+
+TEST ( HttpDownload, Parallel )
+{
+    srand ( 1234 );
+
+    initialize();
+
+    const string content = randomData ( 2 * 1024 * 1024 + 123 );
+
+    {
+        TestHttpServer server ( content );
+        TestDownloader client ( server.getUrl() );
+
+        client.download.connections = 4;
+        client.download.md5 = md5Hex ( content );
+        client.download.start();
+        client.run();
+
+        EXPECT_EQ ( 1, client.completed );
+        EXPECT_EQ ( 0, client.failed );
+
+        ASSERT_EQ ( 4, server.requests.size() );
+
+        // The first request is for the whole file, then the rest is split into ranges without overlapping
+        EXPECT_TRUE ( server.requests[0].partial );
+        EXPECT_EQ ( 0, server.requests[0].begin );
+
+        uint32_t begin = server.requests[1].begin;
+
+        EXPECT_GT ( begin, 0 );
+
+        for ( size_t i = 1; i < server.requests.size(); ++i )
+        {
+            EXPECT_TRUE ( server.requests[i].partial );
+            EXPECT_EQ ( begin, server.requests[i].begin );
+            begin = server.requests[i].end;
+        }
+
+        EXPECT_EQ ( content.size(), begin );
+
+        EXPECT_TRUE ( content == client.data );
+        EXPECT_TRUE ( content == readFile ( TEST_FILE ) );
+    }
+
+    deinitialize();
+}
+
+TEST ( HttpDownload, BadMd5 )
+{
+    srand ( 1234 );
+
+    initialize();
+
+    const string content = randomData ( 100 * 1024 );
+
+    {
+        TestHttpServer server ( content );
+        TestDownloader client ( server.getUrl() );
+
+        client.download.md5 = string ( 32, '0' );
+        client.download.start();
+        client.run();
+
+        EXPECT_EQ ( 0, client.completed );
+        EXPECT_EQ ( 1, client.failed );
+
+        // Corrupt downloads are deleted so the next attempt starts over
+        EXPECT_FALSE ( fileExists ( TEST_FILE ) );
+        EXPECT_FALSE ( fileExists ( TEST_FILE ".part" ) );
+    }
+
+    deinitialize();
+}
+
+#endif // NOT RELEASE
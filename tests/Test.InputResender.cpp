@@ -0,0 +1,226 @@
+#ifndef RELEASE
+
+#include "InputResender.hpp"
+#include "StringUtils.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+
+// One minute of frames at 60 fps
+#define NUM_FRAMES          ( 3600 )
+#define FRAME_INTERVAL_US   ( 16667 )
+
+// One-way latency, and the input delay needed to hide it with a few ms to spare
+#define LATENCY_US          ( 40000 )
+#define INPUT_DELAY         ( 3 )
+
+#define NUM_REPAIRS         ( 3 )
+
+// Number of seeded sessions to total for each case
+#define NUM_SESSIONS        ( 10 )
+
+
+// Result of a simulated session
+struct SessionStats
+{
+    // Frames lost to waiting on remote inputs, totaled for both sides
+    double stallFrames = 0;
+
+    // Longest single wait in frames
+    double worstStall = 0;
+
+    // Packets sent by both sides, including resends
+    uint32_t packets = 0;
+
+    SessionStats& operator+= ( const SessionStats& other )
+    {
+        stallFrames += other.stallFrames;
+        worstStall = max ( worstStall, other.worstStall );
+        packets += other.packets;
+        return *this;
+    }
+};
+
+// Simulates two peers exchanging PlayerInputs over a lossy link, in 1 ms steps. Each packet carries the latest
+// frame of inputs, which covers every earlier frame, like the real PlayerInputs. Each side sends one packet per
+// frame, and can only run a frame once it has the remote inputs for it. While waiting it resends its latest
+// inputs on the InputResender schedule. Deterministic for a given seed.
+static SessionStats simulate ( double loss, uint32_t repairs, uint32_t seed )
+{
+    struct Packet
+    {
+        uint64_t arrivalUs;
+        size_t dest;
+        uint32_t frame;
+    };
+
+    struct Peer
+    {
+        uint32_t frame = 0;
+        uint64_t nextFrameUs = 0, waitStartUs = 0, nextResendUs = 0;
+        uint32_t remoteFrame = INPUT_DELAY - 1;
+        InputResender resender;
+    };
+
+    mt19937 rng ( seed );
+    bernoulli_distribution lost ( loss );
+
+    SessionStats stats;
+    vector<Packet> inFlight;
+    Peer peers[2];
+
+    // Send the latest inputs, ie up to the last frame run plus the input delay
+    auto send = [&] ( size_t from, uint64_t nowUs )
+    {
+        ++stats.packets;
+
+        if ( ! lost ( rng ) )
+            inFlight.push_back ( { nowUs + LATENCY_US, 1 - from, peers[from].frame + INPUT_DELAY - 1 } );
+    };
+
+    for ( Peer& peer : peers )
+        peer.resender.repairs = repairs;
+
+    for ( uint64_t nowUs = 0; min ( peers[0].frame, peers[1].frame ) < NUM_FRAMES; nowUs += 1000 )
+    {
+        // Deliver packets
+        for ( size_t i = 0; i < inFlight.size(); )
+        {
+            if ( inFlight[i].arrivalUs > nowUs )
+            {
+                ++i;
+                continue;
+            }
+
+            Peer& peer = peers[inFlight[i].dest];
+            peer.remoteFrame = max ( peer.remoteFrame, inFlight[i].frame );
+
+            inFlight[i] = inFlight.back();
+            inFlight.pop_back();
+        }
+
+        for ( size_t i = 0; i < 2; ++i )
+        {
+            Peer& peer = peers[i];
+
+            if ( peer.frame >= NUM_FRAMES || nowUs < peer.nextFrameUs )
+                continue;
+
+            // Ready, run the next frame and send the inputs for it
+            if ( peer.remoteFrame >= peer.frame )
+            {
+                if ( peer.resender.isWaiting() )
+                {
+                    const double stall = ( nowUs - peer.waitStartUs ) / double ( FRAME_INTERVAL_US );
+
+                    stats.stallFrames += stall;
+                    stats.worstStall = max ( stats.worstStall, stall );
+
+                    peer.resender.reset();
+                    peer.nextFrameUs = nowUs;
+                }
+
+                ++peer.frame;
+                send ( i, peer.nextFrameUs );
+
+                peer.nextFrameUs += FRAME_INTERVAL_US;
+                continue;
+            }
+
+            // Waiting, resend the latest inputs on schedule
+            if ( ! peer.resender.isWaiting() )
+            {
+                peer.waitStartUs = nowUs;
+                peer.nextResendUs = nowUs + 1000 * peer.resender.start();
+            }
+            else if ( nowUs >= peer.nextResendUs )
+            {
+                send ( i, nowUs );
+                peer.nextResendUs = nowUs + 1000 * peer.resender.next();
+            }
+        }
+    }
+
+    return stats;
+}
+
+
+TEST ( InputResender, Schedule )
+{
+    InputResender resender;
+    resender.repairs = 2;
+
+    EXPECT_FALSE ( resender.isWaiting() );
+    EXPECT_EQ ( REPAIR_INPUTS_INTERVAL, resender.start() );
+    EXPECT_TRUE ( resender.isWaiting() );
+
+    EXPECT_EQ ( REPAIR_INPUTS_INTERVAL, resender.next() );
+    EXPECT_EQ ( RESEND_INPUTS_INTERVAL, resender.next() );
+    EXPECT_EQ ( RESEND_INPUTS_INTERVAL, resender.next() );
+
+    EXPECT_EQ ( 3, resender.getResends() );
+    EXPECT_EQ ( 2 * REPAIR_INPUTS_INTERVAL + RESEND_INPUTS_INTERVAL, resender.getWaited() );
+
+    // Each wait starts with fresh repairs
+    resender.reset();
+
+    EXPECT_FALSE ( resender.isWaiting() );
+    EXPECT_EQ ( 0, resender.getWaited() );
+    EXPECT_EQ ( REPAIR_INPUTS_INTERVAL, resender.start() );
+
+    // Without repairs it is the old fixed interval
+    resender.repairs = 0;
+
+    EXPECT_EQ ( RESEND_INPUTS_INTERVAL, resender.start() );
+    EXPECT_EQ ( RESEND_INPUTS_INTERVAL, resender.next() );
+
+    // Repairs are capped
+    resender.repairs = 1000;
+    resender.start();
+
+    for ( size_t i = 1; i < MAX_INPUT_REPAIRS; ++i )
+        EXPECT_EQ ( REPAIR_INPUTS_INTERVAL, resender.next() );
+
+    EXPECT_EQ ( RESEND_INPUTS_INTERVAL, resender.next() );
+}
+
+TEST ( InputResender, StallFrames )
+{
+    PRINT ( "  loss  repairs  stall frames  worst stall  packets" );
+
+    for ( double loss : { 0.1, 0.2, 0.3 } )
+    {
+        SessionStats plain, repaired;
+
+        for ( uint32_t seed = 0; seed < NUM_SESSIONS; ++seed )
+        {
+            plain += simulate ( loss, 0, seed );
+            repaired += simulate ( loss, NUM_REPAIRS, seed );
+        }
+
+        for ( const SessionStats *stats : { &plain, &repaired } )
+        {
+            PRINT ( "  %3.0f%%  %7u  %12.1f  %11.1f  %7u", 100 * loss, ( stats == &plain ? 0 : NUM_REPAIRS ),
+                    stats->stallFrames, stats->worstStall, stats->packets );
+        }
+
+        // Repairs recover from tail loss within a frame or two instead of a whole resend interval, which matters
+        // once mutual waits are common. At low loss most stalls are one sided, and already end with the next frame.
+        if ( loss >= 0.2 )
+        {
+            EXPECT_LT ( repaired.stallFrames, plain.stallFrames ) << "loss=" << loss;
+            EXPECT_LT ( repaired.worstStall, plain.worstStall ) << "loss=" << loss;
+        }
+
+        // The extra packets are only sent while waiting, so the overhead stays small
+        EXPECT_LT ( repaired.packets, plain.packets * 1.2 ) << "loss=" << loss;
+    }
+}
+
+#endif // NOT RELEASE
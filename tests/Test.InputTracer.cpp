@@ -0,0 +1,158 @@
+#ifndef RELEASE
+
+#include "Test.Socket.hpp"
+#include "InputTracer.hpp"
+#include "Messages.hpp"
+
+using namespace std;
+
+
+#define NUM_FRAMES          ( 300 )
+#define FRAME_INTERVAL_US   ( 16667 )
+#define CHANGE_INTERVAL     ( 5 )
+
+
+TEST ( InputTracer, Resolve )
+{
+    InputTracer local, remote;
+
+    const IndexedFrame traceFrame = {{ 12, 1 }};
+
+    local.captured ( traceFrame, 1000 );
+
+    // Stamped inputs carry the age of the latest trace
+    PlayerInputs playerInputs ( traceFrame );
+    playerInputs.inputs.fill ( 0 );
+    local.stamp ( playerInputs, 3000 );
+
+    EXPECT_EQ ( 12, playerInputs.traceFrame.parts.frame );
+    EXPECT_EQ ( 1, playerInputs.traceFrame.parts.index );
+    EXPECT_EQ ( 2000, playerInputs.traceAge );
+
+    // Inputs from a different transition index are not stamped
+    const IndexedFrame otherFrame = {{ 12, 2 }};
+
+    PlayerInputs otherInputs ( otherFrame );
+    otherInputs.inputs.fill ( 0 );
+    local.stamp ( otherInputs, 3000 );
+
+    EXPECT_EQ ( 0, otherInputs.traceFrame.value );
+
+    remote.oneWayUs = 1000;
+    remote.gotInputs ( playerInputs, 10000 );
+
+    // Duplicate inputs are only traced once
+    remote.gotInputs ( playerInputs, 11000 );
+
+    // Nothing is resolved until the traced frame is applied
+    local.applied ( {{ 11, 1 }}, 4000 );
+    remote.applied ( {{ 11, 1 }}, 12000 );
+
+    EXPECT_EQ ( 0, local.getLocalStats().getNumSamples() );
+    EXPECT_EQ ( 0, remote.getRemoteStats().getNumSamples() );
+
+    local.applied ( {{ 12, 1 }}, 6000 );
+    remote.applied ( {{ 12, 1 }}, 14000 );
+
+    ASSERT_EQ ( 1, local.getLocalStats().getNumSamples() );
+    ASSERT_EQ ( 1, remote.getRemoteStats().getNumSamples() );
+
+    // Local: captured at 1000 and applied at 6000
+    EXPECT_DOUBLE_EQ ( 5.0, local.getLocalStats().getMean() );
+
+    // Remote: received at 10000 with an age of 2000 + 1000, then applied at 14000
+    EXPECT_DOUBLE_EQ ( 7.0, remote.getRemoteStats().getMean() );
+
+    // The histograms count the same samples
+    EXPECT_DOUBLE_EQ ( 5.0, local.getLocalHistogram().getPercentile ( 50 ) );
+    EXPECT_DOUBLE_EQ ( 7.0, remote.getRemoteHistogram().getPercentile ( 50 ) );
+
+    // Traces from an older transition index are dropped
+    local.captured ( {{ 20, 1 }}, 7000 );
+    local.applied ( {{ 0, 2 }}, 8000 );
+
+    EXPECT_EQ ( 1, local.getLocalStats().getNumSamples() );
+}
+
+// Benchmark the end-to-end input latency between two tracers over UDP loopback at 60 fps, for each input delay
+static void inputLatency ( uint32_t delay )
+{
+    struct TestSocket : public Socket::Owner
+    {
+        SocketPtr socket;
+        InputTracer tracer;
+
+        void socketAccepted ( Socket *socket ) override {}
+        void socketConnected ( Socket *socket ) override {}
+        void socketDisconnected ( Socket *socket ) override {}
+
+        void socketRead ( Socket *socket, const MsgPtr& msg, const IpAddrPort& address ) override
+        {
+            if ( msg && msg->getMsgType() == MsgType::PlayerInputs )
+                tracer.gotInputs ( msg->getAs<PlayerInputs>(), TimerManager::get().queryNowUs() );
+        }
+
+        TestSocket() : socket ( UdpSocket::bind ( this, 0 ) ) {}
+    };
+
+    TimerManager::get().initialize();
+    SocketManager::get().initialize();
+
+    TestSocket local, remote;
+
+    EventManager::get().startPolling();
+
+    const IpAddrPort remoteAddress ( "127.0.0.1", remote.socket->address.port );
+
+    uint64_t deadline = TimerManager::get().queryNowUs();
+
+    for ( uint32_t frame = 0; frame < NUM_FRAMES; ++frame )
+    {
+        const IndexedFrame current = {{ frame, 0 }};
+        const IndexedFrame target = {{ frame + delay, 0 }};
+
+        if ( frame % CHANGE_INTERVAL == 0 )
+            local.tracer.captured ( target, TimerManager::get().queryNowUs() );
+
+        PlayerInputs *playerInputs = new PlayerInputs ( target );
+        playerInputs->inputs.fill ( 0 );
+
+        local.tracer.stamp ( *playerInputs, TimerManager::get().queryNowUs() );
+        local.socket->send ( MsgPtr ( playerInputs ), remoteAddress );
+
+        local.tracer.applied ( current, TimerManager::get().queryNowUs() );
+        remote.tracer.applied ( current, TimerManager::get().queryNowUs() );
+
+        // Poll the sockets for the rest of the frame
+        deadline += FRAME_INTERVAL_US;
+
+        while ( TimerManager::get().queryNowUs() < deadline )
+            EventManager::get().poll ( 1 );
+    }
+
+    PRINT ( "Input delay %u: local p50=%.1f ms; p99=%.1f ms; remote p50=%.1f ms; p99=%.1f ms", delay,
+            local.tracer.getLocalHistogram().getPercentile ( 50 ),
+            local.tracer.getLocalHistogram().getPercentile ( 99 ),
+            remote.tracer.getRemoteHistogram().getPercentile ( 50 ),
+            remote.tracer.getRemoteHistogram().getPercentile ( 99 ) );
+
+    EXPECT_GT ( local.tracer.getLocalStats().getNumSamples(), 0 );
+    EXPECT_GT ( remote.tracer.getRemoteStats().getNumSamples(), 0 );
+
+    EventManager::get().stop();
+
+    local.socket.reset();
+    remote.socket.reset();
+
+    SocketManager::get().deinitialize();
+    TimerManager::get().deinitialize();
+}
+
+// Disabled by default since it runs in real time, run with --gtest_also_run_disabled_tests
+TEST ( InputTracer, DISABLED_LatencyBenchmark )
+{
+    for ( uint32_t delay : { 0, 2 } )
+        inputLatency ( delay );
+}
+
+#endif // NOT RELEASE
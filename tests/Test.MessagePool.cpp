@@ -0,0 +1,181 @@
+#ifndef RELEASE
+
+#include "GoBackN.hpp"
+#include "Messages.hpp"
+#include "MessagePool.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <vector>
+
+using namespace std;
+
+
+// One minute at 60 fps, broadcasting inputs to a few spectators
+#define NUM_FRAMES      ( 3600 )
+#define NUM_SPECTATORS  ( 4 )
+
+// Frames to run before counting, so the pools are warmed up
+#define WARMUP_FRAMES   ( 60 )
+
+
+// Queues raw GoBackN messages for the other end, like a lossless socket
+struct LoopbackOwner : public GoBackN::Owner
+{
+    vector<MsgPtr> outbox;
+
+    uint32_t received = 0;
+
+    void goBackNSendRaw ( GoBackN *gbn, const MsgPtr& msg ) override { outbox.push_back ( msg ); }
+    void goBackNRecvRaw ( GoBackN *gbn, const MsgPtr& msg ) override {}
+    void goBackNRecvMsg ( GoBackN *gbn, const MsgPtr& msg ) override { ++received; }
+    void goBackNTimeout ( GoBackN *gbn ) override {}
+};
+
+static void deliver ( LoopbackOwner& from, GoBackN& to )
+{
+    vector<MsgPtr> outbox;
+    outbox.swap ( from.outbox );
+
+    for ( const MsgPtr& msg : outbox )
+        to.recvFromSocket ( msg );
+}
+
+
+TEST ( MessagePool, MsgPtr )
+{
+    MessagePool::clear();
+
+    MsgPtr msg ( new AckSequence ( 1 ) );
+    MsgPtr copy = msg;
+
+    EXPECT_EQ ( msg, copy );
+    EXPECT_EQ ( 0, MessagePool::getStats().pooled );
+
+    // Still owned by the copy
+    msg.reset();
+
+    EXPECT_FALSE ( msg );
+    EXPECT_TRUE ( copy );
+    EXPECT_EQ ( 0, MessagePool::getStats().pooled );
+
+    // Moving doesn't change ownership
+    MsgPtr moved = move ( copy );
+
+    EXPECT_FALSE ( copy );
+    EXPECT_EQ ( 1, moved->getAs<AckSequence>().getSequence() );
+    EXPECT_EQ ( 0, MessagePool::getStats().pooled );
+
+    // Clones are separate messages, with their own count
+    MsgPtr clone = moved->clone();
+
+    EXPECT_NE ( moved, clone );
+
+    moved.reset();
+
+    EXPECT_EQ ( 1, MessagePool::getStats().pooled );
+    EXPECT_EQ ( 1, clone->getAs<AckSequence>().getSequence() );
+
+    // Freed memory is reused for the next message of the same type
+    Serializable *const freed = clone.get();
+    clone.reset();
+
+    EXPECT_EQ ( 2, MessagePool::getStats().pooled );
+    EXPECT_EQ ( freed, MsgPtr ( new AckSequence ( 2 ) ).get() );
+
+    // Non-owning pointers never free the message
+    AckSequence local ( 3 );
+    {
+        MsgPtr unowned ( &local, ignoreMsgPtr );
+        MsgPtr unownedCopy = unowned;
+
+        EXPECT_EQ ( &local, unownedCopy.get() );
+    }
+
+    EXPECT_EQ ( 3, local.getSequence() );
+    EXPECT_EQ ( 2, MessagePool::getStats().pooled );
+
+    MessagePool::clear();
+
+    EXPECT_EQ ( 0, MessagePool::getStats().pooled );
+}
+
+TEST ( MessagePool, Allocations )
+{
+    LoopbackOwner hostOwners[NUM_SPECTATORS], spectatorOwners[NUM_SPECTATORS];
+    vector<GoBackN> hosts, spectators;
+
+    // Reserved so the GoBackN instances never move once their timers are created
+    hosts.reserve ( NUM_SPECTATORS );
+    spectators.reserve ( NUM_SPECTATORS );
+
+    for ( size_t i = 0; i < NUM_SPECTATORS; ++i )
+    {
+        hosts.emplace_back ( &hostOwners[i] );
+        spectators.emplace_back ( &spectatorOwners[i] );
+    }
+
+    MessagePool::clear();
+
+    uint64_t startUs = 0;
+
+    for ( uint32_t frame = 0; frame < WARMUP_FRAMES + NUM_FRAMES; ++frame )
+    {
+        if ( frame == WARMUP_FRAMES )
+        {
+            MessagePool::resetStats();
+
+            startUs = chrono::duration_cast<chrono::microseconds> (
+                          chrono::steady_clock::now().time_since_epoch() ).count();
+        }
+
+        const IndexedFrame indexedFrame = {{ frame, 1 }};
+
+        // Unreliable inputs sent to the remote player every frame
+        MsgPtr playerInputs ( new PlayerInputs ( indexedFrame ) );
+        playerInputs->getAs<PlayerInputs>().inputs.fill ( 0 );
+
+        // Inputs broadcast to every spectator, cloned by GoBackN after the first
+        MsgPtr bothInputs ( new BothInputs ( indexedFrame ) );
+
+        for ( auto& inputs : bothInputs->getAs<BothInputs>().inputs )
+            inputs.fill ( 0 );
+
+        for ( GoBackN& host : hosts )
+            host.sendViaGoBackN ( bothInputs );
+
+        // Each spectator ACKs every message
+        for ( size_t i = 0; i < NUM_SPECTATORS; ++i )
+        {
+            deliver ( hostOwners[i], spectators[i] );
+            deliver ( spectatorOwners[i], hosts[i] );
+        }
+    }
+
+    const uint64_t elapsedUs = chrono::duration_cast<chrono::microseconds> (
+                                   chrono::steady_clock::now().time_since_epoch() ).count() - startUs;
+
+    const MessagePool::Stats stats = MessagePool::getStats();
+    const uint32_t messages = stats.heapAllocs + stats.poolAllocs;
+
+    for ( size_t i = 0; i < NUM_SPECTATORS; ++i )
+    {
+        EXPECT_EQ ( WARMUP_FRAMES + NUM_FRAMES, spectatorOwners[i].received );
+        EXPECT_EQ ( WARMUP_FRAMES + NUM_FRAMES, hosts[i].getAckCount() );
+    }
+
+    PRINT ( "Messages: %u in %u frames (%.1f per frame); %.2f us per frame", messages, NUM_FRAMES,
+            double ( messages ) / NUM_FRAMES, double ( elapsedUs ) / NUM_FRAMES );
+    // Only message allocations are counted, other allocations such as the GoBackN send list nodes are not
+    PRINT ( "Message heap allocations: %u; pooled: %u", stats.heapAllocs, stats.poolAllocs );
+
+    // Inputs, clones, and ACKs per frame
+    EXPECT_EQ ( NUM_FRAMES * ( 2 + ( NUM_SPECTATORS - 1 ) + NUM_SPECTATORS ), messages );
+
+    // Once warmed up, every message comes from a pool
+    EXPECT_EQ ( 0, stats.heapAllocs );
+    EXPECT_EQ ( 0, stats.heapFrees );
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,91 @@
+#ifndef RELEASE
+
+#include "MessageRegistry.hpp"
+#include "Messages.hpp"
+#include "GoBackN.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+
+typedef MessageList<PlayerInputs, BothInputs, AckSequence> InputTypes;
+
+// Records which typed handler was called
+struct TypedHandler
+{
+    uint32_t playerInputs = 0, bothInputs = 0, acks = 0;
+
+    void operator() ( const PlayerInputs& msg ) { playerInputs = msg.getFrame(); }
+    void operator() ( const BothInputs& msg ) { bothInputs = msg.getFrame(); }
+    void operator() ( const AckSequence& msg ) { acks = msg.getSequence(); }
+};
+
+
+TEST ( MessageRegistry, Decode )
+{
+    const IndexedFrame indexedFrame = {{ 123, 4 }};
+
+    PlayerInputs playerInputs ( indexedFrame );
+    playerInputs.inputs.fill ( 0x0102 );
+    playerInputs.frameAdvantage = -3;
+
+    BothInputs bothInputs ( indexedFrame );
+    bothInputs.inputs[0].fill ( 0x0304 );
+    bothInputs.inputs[1].fill ( 0x0506 );
+    bothInputs.setSequence ( 77 );
+
+    // Not compressed, so this only tests the decoders
+    playerInputs.compressionLevel = bothInputs.compressionLevel = 0;
+
+    size_t consumed;
+    string bytes = Protocol::encode ( playerInputs );
+    MsgPtr msg = Protocol::decode ( &bytes[0], bytes.size(), consumed );
+
+    ASSERT_TRUE ( msg.get() );
+    ASSERT_EQ ( MsgType::PlayerInputs, msg->getMsgType() );
+    EXPECT_EQ ( bytes.size(), consumed );
+    EXPECT_EQ ( 123, msg->getAs<PlayerInputs>().getFrame() );
+    EXPECT_EQ ( playerInputs.inputs, msg->getAs<PlayerInputs>().inputs );
+    EXPECT_EQ ( -3, msg->getAs<PlayerInputs>().frameAdvantage );
+
+    // Sequenced messages also load the base data
+    bytes = Protocol::encode ( bothInputs );
+    msg = Protocol::decode ( &bytes[0], bytes.size(), consumed );
+
+    ASSERT_TRUE ( msg.get() );
+    ASSERT_EQ ( MsgType::BothInputs, msg->getMsgType() );
+    EXPECT_EQ ( 77, msg->getAs<BothInputs>().getSequence() );
+    EXPECT_EQ ( bothInputs.inputs, msg->getAs<BothInputs>().inputs );
+
+    bytes = Protocol::encodeLocal ( MsgPtr ( &bothInputs, ignoreMsgPtr ) );
+    msg = Protocol::decodeLocal ( &bytes[0], bytes.size() );
+
+    ASSERT_TRUE ( msg.get() );
+    ASSERT_EQ ( MsgType::BothInputs, msg->getMsgType() );
+    EXPECT_EQ ( 77, msg->getAs<BothInputs>().getSequence() );
+
+    // Unknown message types are rejected
+    bytes[0] = char ( MsgType::LastType );
+    EXPECT_FALSE ( Protocol::decodeLocal ( &bytes[0], bytes.size() ) );
+}
+
+TEST ( MessageRegistry, Dispatch )
+{
+    const IndexedFrame indexedFrame = {{ 42, 1 }};
+
+    TypedHandler handler;
+
+    EXPECT_TRUE ( dispatchMessage ( InputTypes(), MsgPtr ( new PlayerInputs ( indexedFrame ) ), handler ) );
+    EXPECT_TRUE ( dispatchMessage ( InputTypes(), MsgPtr ( new AckSequence ( 9 ) ), handler ) );
+
+    EXPECT_EQ ( 42, handler.playerInputs );
+    EXPECT_EQ ( 0, handler.bothInputs );
+    EXPECT_EQ ( 9, handler.acks );
+
+    // Types not in the list are not handled
+    EXPECT_FALSE ( dispatchMessage ( InputTypes(), MsgPtr ( new RngState() ), handler ) );
+    EXPECT_FALSE ( dispatchMessage ( InputTypes(), NullMsg, handler ) );
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,187 @@
+#ifndef RELEASE
+
+#include "Test.Socket.hpp"
+#include "NetworkThread.hpp"
+#include "SpscQueue.hpp"
+#include "Thread.hpp"
+
+#include <windows.h>
+
+#include <algorithm>
+
+using namespace std;
+
+
+#define NUM_ELEMENTS        ( 1000000 )
+#define NUM_FRAMES          ( 300 )
+#define FRAME_GAP           ( 2 )
+#define INPUTS_SIZE         ( 120 )
+
+
+TEST ( NetworkThread, SpscQueueOrder )
+{
+    struct Producer : public Thread
+    {
+        SpscQueue<size_t, 256>& queue;
+
+        Producer ( SpscQueue<size_t, 256>& queue ) : queue ( queue ) {}
+
+        void run() override
+        {
+            for ( size_t i = 0; i < NUM_ELEMENTS; ++i )
+            {
+                while ( ! queue.push ( i ) )
+                    Sleep ( 0 );
+            }
+        }
+    };
+
+    SpscQueue<size_t, 256> queue;
+    Producer producer ( queue );
+
+    producer.start();
+
+    size_t expected = 0, value = 0;
+
+    while ( expected < NUM_ELEMENTS )
+    {
+        if ( ! queue.pop ( value ) )
+        {
+            Sleep ( 0 );
+            continue;
+        }
+
+        ASSERT_EQ ( expected, value );
+        ++expected;
+    }
+
+    producer.join();
+
+    EXPECT_TRUE ( queue.empty() );
+    EXPECT_FALSE ( queue.pop ( value ) );
+}
+
+static double percentile99 ( vector<double>& samples )
+{
+    sort ( samples.begin(), samples.end() );
+    return samples[ ( samples.size() * 99 ) / 100 ];
+}
+
+// Benchmark the frame time spent on the network when sending inputs to every spectator, with sockets used inline on
+// the game thread versus on the network thread. Both paths time the same game thread work for one frame: handling
+// the messages received since the last frame, then sending. Inline, that includes polling to dispatch the received
+// messages. Threaded, the network thread posts them, then the game thread runs them with dispatch, which includes
+// acquiring the GameLock.
+static double frameTimeP99 ( size_t numSpectators, bool threaded )
+{
+    struct TestSocket : public Socket::Owner
+    {
+        SocketPtr server;
+        vector<SocketPtr> spectators;
+        shared_ptr<NetworkThread> thread;
+        size_t received = 0;
+
+        void socketAccepted ( Socket *socket ) override {}
+        void socketConnected ( Socket *socket ) override {}
+        void socketDisconnected ( Socket *socket ) override {}
+
+        void socketRead ( Socket *socket, const MsgPtr& msg, const IpAddrPort& address ) override
+        {
+            // Callbacks on the network thread only post work for the game thread
+            if ( thread && thread->isDispatching() )
+                thread->post ( [this] { ++received; } );
+            else
+                ++received;
+        }
+
+        TestSocket ( size_t numSpectators ) : server ( UdpSocket::bind ( this, 0 ) )
+        {
+            for ( size_t i = 0; i < numSpectators; ++i )
+                spectators.push_back ( UdpSocket::bind ( this, 0 ) );
+        }
+    };
+
+    TimerManager::get().initialize();
+    SocketManager::get().initialize();
+    EventManager::get().startPolling();
+
+    TestSocket test ( numSpectators );
+
+    if ( threaded )
+    {
+        test.thread.reset ( new NetworkThread() );
+        test.thread->start();
+    }
+
+    vector<double> frames;
+
+    for ( size_t i = 0; i < NUM_FRAMES; ++i )
+    {
+        const uint64_t start = TimerManager::get().getNowUs ( true );
+
+        if ( test.thread )
+        {
+            test.thread->dispatch();
+
+            for ( const SocketPtr& spectator : test.spectators )
+            {
+                test.thread->send ( test.server, MsgPtr ( new TestMessage ( string ( INPUTS_SIZE, 'x' ) ) ),
+                                    IpAddrPort ( "127.0.0.1", spectator->address.port ) );
+            }
+        }
+        else
+        {
+            // The inputs sent last frame are already waiting, so this returns once they are dispatched
+            if ( numSpectators )
+                EventManager::get().poll ( 1 );
+
+            for ( const SocketPtr& spectator : test.spectators )
+            {
+                test.server->send ( MsgPtr ( new TestMessage ( string ( INPUTS_SIZE, 'x' ) ) ),
+                                    IpAddrPort ( "127.0.0.1", spectator->address.port ) );
+            }
+        }
+
+        frames.push_back ( ( TimerManager::get().getNowUs ( true ) - start ) / 1000.0 );
+
+        // The rest of the frame, when the game runs
+        Sleep ( FRAME_GAP );
+    }
+
+    EventManager::get().stop();
+
+    if ( test.thread )
+    {
+        test.thread->join();
+        test.thread->dispatch();
+    }
+
+    PRINT ( "%s with %u spectators: received=%u", ( threaded ? "Threaded" : "Inline" ), numSpectators, test.received );
+
+    if ( numSpectators )
+        EXPECT_GT ( test.received, 0 );
+
+    test.thread.reset();
+    test.server.reset();
+    test.spectators.clear();
+
+    SocketManager::get().deinitialize();
+    TimerManager::get().deinitialize();
+
+    return percentile99 ( frames );
+}
+
+// Disabled by default since it runs in real time, run with --gtest_also_run_disabled_tests
+TEST ( NetworkThread, DISABLED_FrameTimeBenchmark )
+{
+    for ( size_t numSpectators : { 0, 50 } )
+    {
+        const double inlineP99 = frameTimeP99 ( numSpectators, false );
+        const double threadedP99 = frameTimeP99 ( numSpectators, true );
+
+        PRINT ( "Frame time p99 with %u spectators: inline=%.3f ms; threaded=%.3f ms",
+                numSpectators, inlineP99, threadedP99 );
+    }
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,164 @@
+#ifndef RELEASE
+
+#include "PaletteManager.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+
+#define NUM_PALETTES    ( 36 )
+#define NUM_COLORS      ( 256 )
+
+// Number of times to apply all the palettes when timing
+#define NUM_APPLIES     ( 200 )
+
+
+// Game palette data with random colors and alphas
+static vector<uint32_t> randomPaletteData()
+{
+    vector<uint32_t> data ( NUM_PALETTES * NUM_COLORS );
+
+    for ( uint32_t& color : data )
+        color = ( uint32_t ( rand() & 0xFFFF ) << 16 ) | uint32_t ( rand() & 0xFFFF );
+
+    return data;
+}
+
+// Apply using the sparse overrides, like PaletteManager used to
+static void applySparse ( const map<uint32_t, map<uint32_t, uint32_t>>& palettes, const vector<uint32_t>& originals,
+                          uint32_t *data )
+{
+    for ( uint32_t i = 0; i < NUM_PALETTES; ++i )
+    {
+        for ( uint32_t j = 0; j < NUM_COLORS; ++j )
+        {
+            uint32_t color = SWAP_R_AND_B ( originals[i * NUM_COLORS + j] );
+
+            const auto it = palettes.find ( i );
+
+            if ( it != palettes.end() )
+            {
+                const auto jt = it->second.find ( j );
+
+                if ( jt != it->second.end() )
+                    color = jt->second;
+            }
+
+            data[i * NUM_COLORS + j] = ( data[i * NUM_COLORS + j] & 0xFF000000 ) | ( 0xFFFFFF & SWAP_R_AND_B ( color ) );
+        }
+    }
+}
+
+static uint64_t nowUs()
+{
+    return chrono::duration_cast<chrono::microseconds> ( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+TEST ( PaletteManager, Apply )
+{
+    srand ( 1234 );
+
+    const vector<uint32_t> originals = randomPaletteData();
+
+    PaletteManager palMan;
+    palMan.cache ( &originals[0] );
+
+    // Override about a quarter of the colors, including the first and last of each palette
+    map<uint32_t, map<uint32_t, uint32_t>> palettes;
+
+    for ( uint32_t i = 0; i < NUM_PALETTES; ++i )
+    {
+        for ( uint32_t j = 0; j < NUM_COLORS; ++j )
+        {
+            if ( j != 0 && j + 1 != NUM_COLORS && rand() % 4 )
+                continue;
+
+            const uint32_t color = 0xFFFFFF & ( ( uint32_t ( rand() ) << 12 ) ^ uint32_t ( rand() ) );
+
+            palettes[i][j] = color;
+            palMan.set ( i, j, color );
+        }
+    }
+
+    // Clearing restores the original color
+    palettes[5].erase ( 17 );
+    palMan.clear ( 5, 17 );
+    palettes.erase ( 7 );
+    palMan.clear ( 7 );
+
+    EXPECT_EQ ( palMan.getOriginal ( 5, 17 ), palMan.get ( 5, 17 ) );
+    EXPECT_EQ ( palettes[3][0], palMan.get ( 3, 0 ) );
+
+    // Applied to different game data, so only the alpha comes from the game data
+    const vector<uint32_t> gameData = randomPaletteData();
+
+    vector<uint32_t> expected = gameData, actual = gameData;
+
+    applySparse ( palettes, originals, &expected[0] );
+    palMan.apply ( &actual[0] );
+
+    EXPECT_EQ ( expected, actual );
+
+    // Per palette pointers and single palettes
+    vector<uint32_t> pointers = gameData;
+    vector<uint32_t *> allPaletteData;
+
+    for ( uint32_t i = 0; i < NUM_PALETTES; ++i )
+        allPaletteData.push_back ( &pointers[i * NUM_COLORS] );
+
+    palMan.apply ( &allPaletteData[0] );
+
+    EXPECT_EQ ( expected, pointers );
+
+    vector<uint32_t> single ( gameData.begin() + 3 * NUM_COLORS, gameData.begin() + 4 * NUM_COLORS );
+    palMan.apply ( 3, &single[0] );
+
+    EXPECT_TRUE ( equal ( single.begin(), single.end(), expected.begin() + 3 * NUM_COLORS ) );
+
+    // Timing, compared to the old sparse lookups
+    uint64_t start = nowUs();
+
+    for ( size_t i = 0; i < NUM_APPLIES; ++i )
+        applySparse ( palettes, originals, &expected[0] );
+
+    const double sparseUs = double ( nowUs() - start ) / NUM_APPLIES;
+
+    start = nowUs();
+
+    for ( size_t i = 0; i < NUM_APPLIES; ++i )
+        palMan.apply ( &actual[0] );
+
+    const double denseUs = double ( nowUs() - start ) / NUM_APPLIES;
+
+    PRINT ( "Apply all palettes: %.2f us dense; %.2f us sparse", denseUs, sparseUs );
+
+    EXPECT_EQ ( expected, actual );
+}
+
+TEST ( PaletteManager, Serialize )
+{
+    PaletteManager palMan;
+    palMan.set ( 2, 100, 0x123456 );
+    palMan.set ( 35, 255, 0xABCDEF );
+
+    // The dense overrides are rebuilt after loading
+    const string bytes = Protocol::encode ( palMan );
+
+    size_t consumed;
+    const MsgPtr msg = Protocol::decode ( &bytes[0], bytes.size(), consumed );
+
+    ASSERT_TRUE ( msg.get() );
+    ASSERT_EQ ( MsgType::PaletteManager, msg->getMsgType() );
+
+    EXPECT_EQ ( 0x123456, msg->getAs<PaletteManager>().get ( 2, 100 ) );
+    EXPECT_EQ ( 0xABCDEF, msg->getAs<PaletteManager>().get ( 35, 255 ) );
+}
+
+#endif // NOT RELEASE
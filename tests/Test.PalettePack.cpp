@@ -0,0 +1,206 @@
+#ifndef RELEASE
+
+#include "PaletteManager.hpp"
+#include "CharacterSelect.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+// Test files are written to the current folder
+#define TEST_FOLDER     ""
+
+#define NUM_PALETTES    ( 36 )
+#define NUM_COLORS      ( 256 )
+
+
+// Every character with a short name
+static vector<string> allCharaNames()
+{
+    vector<string> charaNames;
+
+    for ( uint32_t chara = 0; chara < 64; ++chara )
+    {
+        const string name = getShortCharaName ( chara );
+
+        if ( name != "Unknown!" && name != "Random" )
+            charaNames.push_back ( name );
+    }
+
+    return charaNames;
+}
+
+// Black original colors with full alpha, so every random override is kept
+static const vector<uint32_t>& originalPaletteData()
+{
+    static const vector<uint32_t> data ( NUM_PALETTES * NUM_COLORS, 0xFF000000 );
+    return data;
+}
+
+// Override every color of every palette
+static void setAllColors ( PaletteManager& palMan )
+{
+    for ( uint32_t i = 0; i < NUM_PALETTES; ++i )
+        for ( uint32_t j = 0; j < NUM_COLORS; ++j )
+            palMan.set ( i, j, ( ( uint32_t ( rand() ) << 8 ) ^ uint32_t ( rand() ) ) | 0x010101 );
+}
+
+static void removeTestFiles ( const vector<string>& charaNames )
+{
+    for ( const string& charaName : charaNames )
+        remove ( ( TEST_FOLDER + charaName + "_palettes.txt" ).c_str() );
+
+    remove ( TEST_FOLDER PALETTES_PACK_FILE );
+}
+
+static uint64_t nowUs()
+{
+    return chrono::duration_cast<chrono::microseconds> ( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+TEST ( PalettePack, SaveLoad )
+{
+    srand ( 1234 );
+
+    const vector<string> charaNames = { "Arc", "Ciel", "Len" };
+
+    removeTestFiles ( charaNames );
+
+    vector<PaletteManager> saved ( charaNames.size() );
+
+    for ( size_t i = 0; i < charaNames.size(); ++i )
+    {
+        saved[i].cache ( &originalPaletteData() [0] );
+
+        for ( uint32_t j = 0; j < 100; ++j )
+            saved[i].set ( rand() % NUM_PALETTES, rand() % NUM_COLORS, rand() | 1 );
+
+        // Each save keeps the other characters in the pack
+        EXPECT_TRUE ( saved[i].save ( TEST_FOLDER, charaNames[i] ) );
+    }
+
+    PalettePack pack;
+    ASSERT_TRUE ( pack.open ( TEST_FOLDER PALETTES_PACK_FILE ) );
+
+    uint32_t count = 0;
+    EXPECT_FALSE ( pack.find ( "Sion", count ) );
+
+    for ( size_t i = 0; i < charaNames.size(); ++i )
+    {
+        ASSERT_TRUE ( pack.find ( charaNames[i], count ) );
+
+        PaletteManager packed, text;
+        packed.cache ( &originalPaletteData() [0] );
+        text.cache ( &originalPaletteData() [0] );
+
+        EXPECT_TRUE ( packed.load ( pack, charaNames[i] ) );
+        EXPECT_TRUE ( text.importText ( TEST_FOLDER, charaNames[i] ) );
+
+        for ( uint32_t j = 0; j < NUM_PALETTES; ++j )
+        {
+            for ( uint32_t k = 0; k < NUM_COLORS; ++k )
+            {
+                EXPECT_EQ ( saved[i].get ( j, k ), packed.get ( j, k ) );
+                EXPECT_EQ ( saved[i].get ( j, k ), text.get ( j, k ) );
+            }
+        }
+    }
+
+    pack.close();
+
+    // A truncated pack is rejected, and loading falls back to the text file
+    {
+        ifstream fin ( TEST_FOLDER PALETTES_PACK_FILE, ios::binary );
+        const string bytes ( ( istreambuf_iterator<char> ( fin ) ), istreambuf_iterator<char>() );
+        fin.close();
+
+        ofstream fout ( TEST_FOLDER PALETTES_PACK_FILE, ios::binary );
+        fout.write ( bytes.c_str(), bytes.size() - 1 );
+    }
+
+    EXPECT_FALSE ( pack.open ( TEST_FOLDER PALETTES_PACK_FILE ) );
+
+    PaletteManager fallback;
+    fallback.cache ( &originalPaletteData() [0] );
+
+    EXPECT_TRUE ( fallback.load ( TEST_FOLDER, charaNames[0] ) );
+    EXPECT_FALSE ( fallback.empty() );
+
+    removeTestFiles ( charaNames );
+}
+
+TEST ( PalettePack, LoadAllCharas )
+{
+    srand ( 1234 );
+
+    const vector<string> charaNames = allCharaNames();
+
+    removeTestFiles ( charaNames );
+
+    // Fully custom palettes for every character, saved as text then imported into one pack
+    for ( const string& charaName : charaNames )
+    {
+        PaletteManager palMan;
+        palMan.cache ( &originalPaletteData() [0] );
+
+        setAllColors ( palMan );
+
+        ASSERT_TRUE ( palMan.exportText ( TEST_FOLDER, charaName ) );
+    }
+
+    ASSERT_TRUE ( PaletteManager::importAllText ( TEST_FOLDER, charaNames ) );
+
+    vector<PaletteManager> text ( charaNames.size() ), packed ( charaNames.size() );
+
+    uint64_t start = nowUs();
+
+    for ( size_t i = 0; i < charaNames.size(); ++i )
+    {
+        text[i].cache ( &originalPaletteData() [0] );
+        text[i].importText ( TEST_FOLDER, charaNames[i] );
+    }
+
+    const uint64_t textUs = nowUs() - start;
+
+    // Open the pack for each character, like the DLL does
+    start = nowUs();
+
+    for ( size_t i = 0; i < charaNames.size(); ++i )
+    {
+        PalettePack pack;
+        pack.open ( TEST_FOLDER PALETTES_PACK_FILE );
+
+        packed[i].cache ( &originalPaletteData() [0] );
+        packed[i].load ( pack, charaNames[i] );
+    }
+
+    const uint64_t packUs = nowUs() - start;
+
+    PRINT ( "Load %u characters x %u palettes: %llu us pack; %llu us text",
+            ( uint32_t ) charaNames.size(), NUM_PALETTES, packUs, textUs );
+
+    for ( size_t i = 0; i < charaNames.size(); ++i )
+    {
+        for ( uint32_t j = 0; j < NUM_PALETTES; ++j )
+        {
+            for ( uint32_t k = 0; k < NUM_COLORS; ++k )
+            {
+                ASSERT_NE ( 0, packed[i].get ( j, k ) );
+                ASSERT_EQ ( text[i].get ( j, k ), packed[i].get ( j, k ) );
+            }
+        }
+    }
+
+    removeTestFiles ( charaNames );
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,65 @@
+#ifndef RELEASE
+
+#include "RelayHistory.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+
+TEST ( RelayHistory, Rank )
+{
+    RelayHistory history;
+
+    const IpAddrPort near ( "127.0.0.1:3939" ), far ( "127.0.0.2:3939" ), lossy ( "127.0.0.3:3939" ),
+          dead ( "127.0.0.4:3939" ), unknown ( "127.0.0.5:3939" );
+
+    for ( size_t i = 0; i < RELAY_HISTORY_SIZE; ++i )
+    {
+        history.addRtt ( near, 20 );
+        history.addRtt ( far, 150 );
+        history.addFailure ( dead );
+
+        // Lowest RTT, but fails to connect half the time
+        if ( i % 2 )
+            history.addRtt ( lossy, 10 );
+        else
+            history.addFailure ( lossy );
+    }
+
+    const vector<IpAddrPort> ranked = history.rank ( { dead, unknown, lossy, far, near } );
+
+    ASSERT_EQ ( 5u, ranked.size() );
+    EXPECT_EQ ( near, ranked[0] );
+    EXPECT_EQ ( far, ranked[1] );
+    EXPECT_EQ ( unknown, ranked[2] );
+    EXPECT_EQ ( lossy, ranked[3] );
+    EXPECT_EQ ( dead, ranked[4] );
+}
+
+TEST ( RelayHistory, Recent )
+{
+    RelayHistory history;
+
+    const IpAddrPort first ( "127.0.0.1:3939" ), second ( "127.0.0.2:3939" );
+
+    // Equal scores keep the original order
+    EXPECT_EQ ( second, history.rank ( { second, first } )[0] );
+
+    history.addRtt ( first, 50 );
+    history.addRtt ( second, 60 );
+
+    // Only the recent history counts, so a relay that recovers ranks well again
+    for ( size_t i = 0; i < RELAY_HISTORY_SIZE; ++i )
+        history.addFailure ( first );
+
+    EXPECT_EQ ( second, history.rank ( { first, second } )[0] );
+
+    for ( size_t i = 0; i < RELAY_HISTORY_SIZE; ++i )
+        history.addRtt ( first, 30 );
+
+    EXPECT_EQ ( first, history.rank ( { first, second } )[0] );
+    EXPECT_EQ ( 30, history.getScore ( first ) );
+}
+
+#endif // NOT RELEASE
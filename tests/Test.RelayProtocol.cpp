@@ -0,0 +1,44 @@
+#ifndef RELEASE
+
+#include "RelayProtocol.hpp"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace std;
+
+
+// Number of sequential matchIds to spread across the shards
+#define NUM_MATCHES ( 5000 )
+
+
+TEST ( RelayProtocol, ShardSpread )
+{
+    // The relay server assigns sequential matchIds, starting from 1 and after wrapping around
+    for ( uint32_t firstMatchId : { 1u, 123456789u, 0xFFFFF000u } )
+    {
+        for ( size_t numShards : { 2, 3, 4, 8, 16 } )
+        {
+            vector<size_t> counts ( numShards, 0 );
+
+            for ( uint32_t i = 0; i < NUM_MATCHES; ++i )
+            {
+                const size_t shard = relayShard ( firstMatchId + i, numShards );
+
+                ASSERT_LT ( shard, numShards );
+
+                ++counts[shard];
+            }
+
+            // Every shard gets within 10% of an even share
+            for ( size_t count : counts )
+            {
+                EXPECT_GT ( count, NUM_MATCHES / numShards * 9 / 10 ) << firstMatchId << " " << numShards;
+                EXPECT_LT ( count, NUM_MATCHES / numShards * 11 / 10 ) << firstMatchId << " " << numShards;
+            }
+        }
+    }
+}
+
+#endif // NOT RELEASE
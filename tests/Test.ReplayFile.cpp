@@ -0,0 +1,276 @@
+#ifndef RELEASE
+
+#include "ReplayFile.hpp"
+#include "Messages.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+
+#define TEST_REPLAY_FILE    "ReplayFileTest.ccr"
+#define CORRUPT_REPLAY_FILE "ReplayFileTestCorrupt.ccr"
+
+#define NUM_FRAMES          ( 2 * REPLAY_KEYFRAME_INTERVAL + 100 )
+#define DUMP_SIZE           ( 64 * 1024 )
+
+
+static uint16_t testInput ( uint32_t index, uint32_t frame, uint8_t player )
+{
+    return ( ( index * 7 + frame * 13 + player ) & 0xFFF );
+}
+
+static string testDump ( uint32_t frame )
+{
+    string dump ( DUMP_SIZE, ( char ) 0 );
+
+    for ( size_t i = 0; i < dump.size(); ++i )
+        dump[i] = char ( ( i * 31 + frame ) >> 3 );
+
+    return dump;
+}
+
+// Write a replay with 2 transition indices, an RngState and InitialGameState, and keyframes during index 1
+static void writeTestReplay()
+{
+    ReplayWriter writer;
+
+    ASSERT_TRUE ( writer.open ( TEST_REPLAY_FILE ) );
+
+    for ( uint32_t index = 0; index < 2; ++index )
+    {
+        RngState *rngState = new RngState ( index );
+        rngState->rngState0 = 1000 + index;
+        writer.writeRngState ( MsgPtr ( rngState ) );
+
+        IndexedFrame indexedFrame = {{ 0, index }};
+        InitialGameState *initialState = new InitialGameState ( indexedFrame );
+        initialState->stage = 10 + index;
+        writer.writeInitialState ( MsgPtr ( initialState ) );
+
+        for ( uint32_t frame = 0; frame < NUM_FRAMES; ++frame )
+        {
+            indexedFrame.parts.frame = frame;
+
+            if ( index == 1 && writer.shouldWriteKeyframe ( indexedFrame ) )
+            {
+                ReplayKeyframe *keyframe = new ReplayKeyframe();
+                keyframe->indexedFrame = indexedFrame;
+                keyframe->netplayState = NetplayState::InGame;
+                keyframe->compressionLevel = 1;
+                keyframe->dump = testDump ( frame );
+                writer.writeKeyframe ( MsgPtr ( keyframe ) );
+            }
+
+            writer.setInputs ( indexedFrame, 0, NetplayState::InGame,
+                               testInput ( index, frame, 1 ), testInput ( index, frame, 2 ) );
+        }
+    }
+
+    writer.close();
+
+    EXPECT_FALSE ( writer.isOpen() );
+}
+
+static string readFile ( const string& file )
+{
+    ifstream fin ( file.c_str(), ios::binary );
+    stringstream ss;
+    ss << fin.rdbuf();
+    return ss.str();
+}
+
+static void writeFile ( const string& file, const string& bytes )
+{
+    ofstream fout ( file.c_str(), ios::binary | ios::trunc );
+    fout.write ( &bytes[0], bytes.size() );
+}
+
+// Check every record that can be loaded has the expected contents
+static void checkRecords ( ReplayReader& reader )
+{
+    for ( uint32_t index = 0; index < reader.getIndex().inputs.size(); ++index )
+    {
+        MsgPtr msg = reader.getInputs ( index );
+
+        if ( ! msg )
+            continue;
+
+        const ReplayInputs& inputs = msg->getAs<ReplayInputs>();
+
+        EXPECT_EQ ( index, inputs.index );
+        ASSERT_EQ ( NUM_FRAMES, inputs.p1.size() );
+        ASSERT_EQ ( NUM_FRAMES, inputs.p2.size() );
+
+        for ( uint32_t frame = 0; frame < NUM_FRAMES; ++frame )
+        {
+            EXPECT_EQ ( testInput ( index, frame, 1 ), inputs.p1[frame] );
+            EXPECT_EQ ( testInput ( index, frame, 2 ), inputs.p2[frame] );
+        }
+    }
+
+    for ( uint32_t index = 0; index < reader.getIndex().rngStates.size(); ++index )
+    {
+        MsgPtr msg = reader.getRngState ( index );
+
+        if ( msg )
+            EXPECT_EQ ( 1000 + index, msg->getAs<RngState>().rngState0 );
+    }
+
+    for ( const MsgPtr& msg : reader.getInitialStates() )
+        EXPECT_EQ ( 10 + msg->getAs<InitialGameState>().indexedFrame.parts.index, msg->getAs<InitialGameState>().stage );
+
+    for ( uint32_t frame = 0; frame < NUM_FRAMES; frame += 50 )
+    {
+        const IndexedFrame target = {{ frame, 1 }};
+
+        MsgPtr msg = reader.getKeyframeBefore ( target );
+
+        if ( ! msg )
+            continue;
+
+        const ReplayKeyframe& keyframe = msg->getAs<ReplayKeyframe>();
+
+        EXPECT_LE ( keyframe.indexedFrame.value, target.value );
+        EXPECT_EQ ( testDump ( keyframe.indexedFrame.parts.frame ), keyframe.dump );
+    }
+}
+
+
+TEST ( ReplayFile, RoundTrip )
+{
+    writeTestReplay();
+
+    ReplayReader reader;
+
+    ASSERT_TRUE ( ReplayReader::isReplayFile ( TEST_REPLAY_FILE ) );
+    ASSERT_TRUE ( reader.open ( TEST_REPLAY_FILE ) );
+
+    EXPECT_EQ ( 2, reader.getIndex().inputs.size() );
+    EXPECT_EQ ( 2, reader.getIndex().rngStates.size() );
+    EXPECT_EQ ( 2, reader.getInitialStates().size() );
+    EXPECT_EQ ( 3, reader.getIndex().keyframes.size() );
+
+    ASSERT_TRUE ( reader.getInputs ( 0 ).get() );
+    ASSERT_TRUE ( reader.getInputs ( 1 ).get() );
+    EXPECT_FALSE ( reader.getInputs ( 2 ).get() );
+
+    // Keyframes are only used within the same transition index
+    EXPECT_FALSE ( reader.getKeyframeBefore ( {{ NUM_FRAMES, 0 }} ).get() );
+
+    MsgPtr msg = reader.getKeyframeBefore ( {{ REPLAY_KEYFRAME_INTERVAL + 50, 1 }} );
+
+    ASSERT_TRUE ( msg.get() );
+    EXPECT_EQ ( REPLAY_KEYFRAME_INTERVAL, msg->getAs<ReplayKeyframe>().indexedFrame.parts.frame );
+
+    checkRecords ( reader );
+
+    remove ( TEST_REPLAY_FILE );
+}
+
+TEST ( ReplayFile, Truncated )
+{
+    writeTestReplay();
+
+    const string replay = readFile ( TEST_REPLAY_FILE );
+
+    ASSERT_GT ( replay.size(), 1000 );
+
+    // Too short for the header
+    for ( size_t size : { 0, 3, 7 } )
+    {
+        writeFile ( CORRUPT_REPLAY_FILE, replay.substr ( 0, size ) );
+
+        ReplayReader reader;
+        EXPECT_FALSE ( reader.open ( CORRUPT_REPLAY_FILE ) ) << size;
+    }
+
+    // Missing the footer, or cut off in the middle of any record, only the complete records are loaded
+    size_t lastKeyframes = 0;
+
+    for ( size_t size = replay.size() - 1; size >= 8; size -= max<size_t> ( 1, size / 50 ) )
+    {
+        writeFile ( CORRUPT_REPLAY_FILE, replay.substr ( 0, size ) );
+
+        ReplayReader reader;
+        ASSERT_TRUE ( reader.open ( CORRUPT_REPLAY_FILE ) ) << size;
+
+        EXPECT_LE ( reader.getIndex().inputs.size(), 2 );
+        EXPECT_LE ( reader.getIndex().keyframes.size(), 3 );
+
+        if ( size < replay.size() - 1 )
+            EXPECT_LE ( reader.getIndex().keyframes.size(), lastKeyframes );
+
+        lastKeyframes = reader.getIndex().keyframes.size();
+
+        checkRecords ( reader );
+    }
+
+    remove ( TEST_REPLAY_FILE );
+    remove ( CORRUPT_REPLAY_FILE );
+}
+
+TEST ( ReplayFile, Corrupt )
+{
+    srand ( 1234 );
+
+    writeTestReplay();
+
+    const string replay = readFile ( TEST_REPLAY_FILE );
+
+    // Bad magic or version
+    for ( size_t pos : { 0, 4 } )
+    {
+        string corrupt = replay;
+        corrupt[pos] ^= 0x55;
+        writeFile ( CORRUPT_REPLAY_FILE, corrupt );
+
+        ReplayReader reader;
+        EXPECT_FALSE ( reader.open ( CORRUPT_REPLAY_FILE ) ) << pos;
+    }
+
+    EXPECT_TRUE ( ReplayReader::isReplayFile ( CORRUPT_REPLAY_FILE ) );
+
+    // Corrupt footer offset, the index is rebuilt by scanning
+    {
+        string corrupt = replay;
+        const uint64_t offset = corrupt.size() / 2;
+        corrupt.replace ( corrupt.size() - 12, sizeof ( offset ), ( const char * ) &offset, sizeof ( offset ) );
+        writeFile ( CORRUPT_REPLAY_FILE, corrupt );
+
+        ReplayReader reader;
+        ASSERT_TRUE ( reader.open ( CORRUPT_REPLAY_FILE ) );
+
+        EXPECT_EQ ( 2, reader.getIndex().inputs.size() );
+        EXPECT_EQ ( 3, reader.getIndex().keyframes.size() );
+
+        checkRecords ( reader );
+    }
+
+    // Flip random bytes anywhere after the header, corrupt records are rejected instead of loaded
+    for ( size_t i = 0; i < 200; ++i )
+    {
+        string corrupt = replay;
+
+        for ( size_t j = 0; j < 4; ++j )
+            corrupt[8 + rand() % ( corrupt.size() - 8 )] ^= char ( 1 + rand() % 255 );
+
+        writeFile ( CORRUPT_REPLAY_FILE, corrupt );
+
+        ReplayReader reader;
+        ASSERT_TRUE ( reader.open ( CORRUPT_REPLAY_FILE ) );
+
+        checkRecords ( reader );
+    }
+
+    remove ( TEST_REPLAY_FILE );
+    remove ( CORRUPT_REPLAY_FILE );
+}
+
+#endif // NOT RELEASE
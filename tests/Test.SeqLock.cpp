@@ -0,0 +1,63 @@
+#ifndef RELEASE
+
+#include "SeqLock.hpp"
+#include "Thread.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+
+#define NUM_ITERATIONS ( 1000000 )
+
+
+// Readers should never see a partially written value
+TEST ( SeqLock, Consistent )
+{
+    struct Value
+    {
+        uint64_t a = 0, b = 0, c = 0;
+    };
+
+    struct Writer : public Thread
+    {
+        SeqLock<Value>& seqLock;
+
+        Writer ( SeqLock<Value>& seqLock ) : seqLock ( seqLock ) {}
+
+        void run() override
+        {
+            Value value;
+
+            for ( uint64_t i = 1; i <= NUM_ITERATIONS; ++i )
+            {
+                value.a = i;
+                value.b = i * 2;
+                value.c = i * 3;
+                seqLock.store ( value );
+            }
+        }
+    };
+
+    SeqLock<Value> seqLock;
+    Writer writer ( seqLock );
+
+    writer.start();
+
+    uint64_t last = 0;
+
+    while ( last < NUM_ITERATIONS )
+    {
+        const Value value = seqLock.load();
+
+        ASSERT_EQ ( value.a * 2, value.b );
+        ASSERT_EQ ( value.a * 3, value.c );
+        ASSERT_GE ( value.a, last );
+
+        last = value.a;
+    }
+
+    writer.join();
+}
+
+#endif // NOT RELEASE
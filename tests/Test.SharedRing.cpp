@@ -0,0 +1,97 @@
+#ifndef RELEASE
+
+#include "SharedRing.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <deque>
+#include <string>
+
+using namespace std;
+
+
+#define RING_NAME       "Local\\cccaster_test_ring"
+#define RING_CAPACITY   ( 1024 )
+#define NUM_ITERATIONS  ( 100000 )
+#define MAX_MSG_SIZE    ( 300 )
+
+
+TEST ( SharedRing, WrapAround )
+{
+    SharedRing writer, reader;
+
+    ASSERT_TRUE ( writer.open ( RING_NAME, RING_CAPACITY ) );
+    ASSERT_TRUE ( reader.open ( RING_NAME, RING_CAPACITY ) );
+
+    deque<string> expected;
+
+    for ( size_t i = 0; i < NUM_ITERATIONS; ++i )
+    {
+        if ( rand() % 2 )
+        {
+            string msg ( rand() % MAX_MSG_SIZE, ( char ) 0 );
+
+            for ( char& c : msg )
+                c = ( char ) ( rand() % 0x100 );
+
+            if ( writer.write ( &msg[0], msg.size() ) )
+                expected.push_back ( msg );
+        }
+        else
+        {
+            string msg;
+
+            if ( ! reader.read ( msg ) )
+            {
+                EXPECT_TRUE ( expected.empty() );
+                continue;
+            }
+
+            ASSERT_FALSE ( expected.empty() );
+            EXPECT_EQ ( expected.front(), msg );
+            expected.pop_front();
+        }
+    }
+
+    // Drain the remaining messages
+    string msg;
+
+    while ( reader.read ( msg ) )
+    {
+        ASSERT_FALSE ( expected.empty() );
+        EXPECT_EQ ( expected.front(), msg );
+        expected.pop_front();
+    }
+
+    EXPECT_TRUE ( expected.empty() );
+    EXPECT_TRUE ( reader.isEmpty() );
+}
+
+TEST ( SharedRing, Full )
+{
+    SharedRing writer, reader;
+
+    ASSERT_TRUE ( writer.open ( RING_NAME, RING_CAPACITY ) );
+    ASSERT_TRUE ( reader.open ( RING_NAME, RING_CAPACITY ) );
+
+    const string msg ( RING_CAPACITY / 4, 'x' );
+
+    // Each message also has a length prefix, so only 3 messages fit
+    EXPECT_TRUE ( writer.write ( &msg[0], msg.size() ) );
+    EXPECT_TRUE ( writer.write ( &msg[0], msg.size() ) );
+    EXPECT_TRUE ( writer.write ( &msg[0], msg.size() ) );
+    EXPECT_FALSE ( writer.write ( &msg[0], msg.size() ) );
+
+    // Reading frees up space for another message
+    string read;
+    EXPECT_TRUE ( reader.read ( read ) );
+    EXPECT_EQ ( msg, read );
+    EXPECT_TRUE ( writer.write ( &msg[0], msg.size() ) );
+
+    // Too large to ever fit
+    const string large ( RING_CAPACITY, 'x' );
+    EXPECT_FALSE ( writer.write ( &large[0], large.size() ) );
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,116 @@
+#ifndef RELEASE
+
+#include "StateDump.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+
+using namespace std;
+
+
+#define TEST_ACTIVITY_FILE  "StateDumpTest.activity"
+
+
+// Two game state regions, the first one has a pointer to 16 bytes of child memory at offset 100
+static void getTestAddrs ( MemDumpList& addrs )
+{
+    addrs.append ( MemDump ( 0x400000, 0x400100, { MemDumpPtr ( 100, 0, 16 ) } ) );
+    addrs.append ( MemDump ( 0x500000, 0x500040 ) );
+    addrs.update();
+}
+
+
+TEST ( StateDump, MinimizeWriteActivity )
+{
+    MemDumpList fullAddrs;
+    getTestAddrs ( fullAddrs );
+
+    ASSERT_EQ ( 256 + 16 + 64, fullAddrs.totalSize );
+
+    WriteActivity activity;
+    activity.changed.assign ( fullAddrs.totalSize, ( char ) 0 );
+
+    // Bytes 10, 11 and 30 are merged across the small gap, byte 200 is far enough to be a separate range
+    activity.changed[10] = activity.changed[11] = activity.changed[30] = 1;
+    activity.changed[200] = 1;
+
+    // Changes in the child memory don't matter, it is always kept whole with its pointer
+    activity.changed[256 + 5] = 1;
+
+    MemDumpList minAddrs;
+    activity.minimize ( fullAddrs, minAddrs );
+
+    ASSERT_EQ ( 3, minAddrs.addrs.size() );
+
+    EXPECT_EQ ( ( char * ) 0x40000A, minAddrs.addrs[0].addr );
+    EXPECT_EQ ( 21, minAddrs.addrs[0].size );
+    EXPECT_TRUE ( minAddrs.addrs[0].ptrs.empty() );
+
+    // The pointer is kept even though it never changed, with its offset moved to the new start
+    EXPECT_EQ ( ( char * ) 0x400064, minAddrs.addrs[1].addr );
+    EXPECT_EQ ( sizeof ( char * ), minAddrs.addrs[1].size );
+    ASSERT_EQ ( 1, minAddrs.addrs[1].ptrs.size() );
+    EXPECT_EQ ( 0, minAddrs.addrs[1].ptrs[0].srcOffset );
+    EXPECT_EQ ( 16, minAddrs.addrs[1].ptrs[0].size );
+    EXPECT_EQ ( &minAddrs.addrs[1], minAddrs.addrs[1].ptrs[0].parent );
+
+    EXPECT_EQ ( ( char * ) 0x4000C8, minAddrs.addrs[2].addr );
+    EXPECT_EQ ( 1, minAddrs.addrs[2].size );
+
+    // Bytes that never changed are not rolled back, including the whole second region
+    EXPECT_EQ ( 21 + sizeof ( char * ) + 16 + 1, minAddrs.totalSize );
+
+    for ( const MemDump& mem : minAddrs.addrs )
+        EXPECT_LT ( mem.addr, ( char * ) 0x500000 );
+}
+
+TEST ( StateDump, MinimizeAllChanged )
+{
+    MemDumpList fullAddrs;
+    getTestAddrs ( fullAddrs );
+
+    WriteActivity activity;
+    activity.changed.assign ( fullAddrs.totalSize, ( char ) 1 );
+
+    MemDumpList minAddrs;
+    activity.minimize ( fullAddrs, minAddrs );
+
+    // Nothing is dropped when every byte changed
+    ASSERT_EQ ( fullAddrs.addrs.size(), minAddrs.addrs.size() );
+    EXPECT_EQ ( fullAddrs.totalSize, minAddrs.totalSize );
+
+    for ( size_t i = 0; i < fullAddrs.addrs.size(); ++i )
+    {
+        EXPECT_EQ ( fullAddrs.addrs[i].addr, minAddrs.addrs[i].addr );
+        EXPECT_EQ ( fullAddrs.addrs[i].size, minAddrs.addrs[i].size );
+        EXPECT_EQ ( fullAddrs.addrs[i].ptrs.size(), minAddrs.addrs[i].ptrs.size() );
+    }
+}
+
+TEST ( StateDump, WriteActivityFile )
+{
+    MemDumpList fullAddrs;
+    getTestAddrs ( fullAddrs );
+
+    string changed ( fullAddrs.totalSize, ( char ) 0 );
+
+    for ( size_t i = 0; i < changed.size(); i += 7 )
+        changed[i] = 1;
+
+    ASSERT_TRUE ( WriteActivity::save ( TEST_ACTIVITY_FILE, fullAddrs, 1234, changed ) );
+
+    WriteActivity activity;
+
+    ASSERT_TRUE ( activity.load ( TEST_ACTIVITY_FILE ) );
+
+    EXPECT_EQ ( 1234, activity.frameCount );
+    EXPECT_EQ ( fullAddrs.totalSize, activity.layout.totalSize );
+    EXPECT_EQ ( fullAddrs.addrs.size(), activity.layout.addrs.size() );
+    EXPECT_EQ ( changed, activity.changed );
+
+    remove ( TEST_ACTIVITY_FILE );
+}
+
+#endif // NOT RELEASE
@@ -71,4 +71,51 @@ TEST ( Timer, RepeatRandom )
     TimerManager::get().deinitialize();
 }
 
+TEST ( Timer, SubMillisecond )
+{
+    struct TestTimer : public Timer::Owner
+    {
+        Timer timer;
+        int count;
+        uint64_t expectedExpiry;
+        vector<bool> notEarly;
+
+        void timerExpired ( Timer *timer ) override
+        {
+            notEarly.push_back ( TimerManager::get().getNowUs ( true ) >= expectedExpiry );
+
+            if ( count <= 0 )
+            {
+                EventManager::get().stop();
+                return;
+            }
+
+            uint64_t delay = 100 + rand() % 900;
+            expectedExpiry = TimerManager::get().getNowUs ( true ) + delay;
+            timer->startUs ( delay );
+            --count;
+        }
+
+        TestTimer() : timer ( this ), count ( NUM_ITERATIONS ), expectedExpiry ( 0 )
+        {
+            timer.startUs ( 500 );
+        }
+    };
+
+    TimerManager::get().initialize();
+    SocketManager::get().initialize();
+
+    TestTimer test;
+
+    EventManager::get().start();
+
+    EXPECT_EQ ( NUM_ITERATIONS + 1, test.notEarly.size() );
+
+    for ( bool valid : test.notEarly )
+        EXPECT_TRUE ( valid );
+
+    SocketManager::get().deinitialize();
+    TimerManager::get().deinitialize();
+}
+
 #endif // NOT RELEASE
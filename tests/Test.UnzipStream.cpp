@@ -0,0 +1,277 @@
+#ifndef RELEASE
+
+#include "UnzipStream.hpp"
+
+#include <miniz.h>
+
+#include <gtest/gtest.h>
+
+#include <windows.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+// Test files are extracted into this folder
+#define TEST_FOLDER     "UnzipStreamTest/"
+
+
+struct TestEntry
+{
+    string name, data;
+
+    // Compression level, 0 for stored
+    mz_uint level;
+};
+
+// Text that compresses well, mixed with some random bytes
+static string testData ( size_t len )
+{
+    string data;
+
+    while ( data.size() < len )
+    {
+        data += "The quick brown fox jumps over the lazy dog. ";
+        data += char ( rand() );
+    }
+
+    data.resize ( len );
+    return data;
+}
+
+static string buildZip ( const vector<TestEntry>& entries )
+{
+    mz_zip_archive zip;
+    memset ( &zip, 0, sizeof ( zip ) );
+
+    EXPECT_TRUE ( mz_zip_writer_init_heap ( &zip, 0, 0 ) );
+
+    for ( const TestEntry& entry : entries )
+        EXPECT_TRUE ( mz_zip_writer_add_mem ( &zip, entry.name.c_str(), entry.data.c_str(), entry.data.size(), entry.level ) );
+
+    void *buffer = 0;
+    size_t size = 0;
+
+    EXPECT_TRUE ( mz_zip_writer_finalize_heap_archive ( &zip, &buffer, &size ) );
+
+    const string archive ( ( const char * ) buffer, size );
+
+    mz_free ( buffer );
+    mz_zip_writer_end ( &zip );
+
+    return archive;
+}
+
+// Feed the archive in random sized chunks, like a download
+static void extract ( UnzipStream& unzip, const string& archive, size_t maxChunk )
+{
+    for ( size_t pos = 0; pos < archive.size(); )
+    {
+        const size_t len = min<size_t> ( 1 + rand() % maxChunk, archive.size() - pos );
+
+        if ( ! unzip.write ( &archive[pos], len ) )
+            return;
+
+        pos += len;
+    }
+}
+
+static string readFile ( const string& file )
+{
+    ifstream fin ( file.c_str(), ios::binary );
+    stringstream ss;
+    ss << fin.rdbuf();
+    return ss.str();
+}
+
+static bool fileExists ( const string& file )
+{
+    return ( GetFileAttributes ( file.c_str() ) != INVALID_FILE_ATTRIBUTES );
+}
+
+static void append16 ( string& bytes, uint16_t value )
+{
+    bytes += char ( value );
+    bytes += char ( value >> 8 );
+}
+
+static void append32 ( string& bytes, uint32_t value )
+{
+    append16 ( bytes, value );
+    append16 ( bytes, value >> 16 );
+}
+
+
+TEST ( UnzipStream, Extract )
+{
+    srand ( 1234 );
+
+    CreateDirectory ( TEST_FOLDER, 0 );
+
+    const vector<TestEntry> entries =
+    {
+        { "readme.txt", "Stored file", 0 },
+        { "empty.txt", "", 0 },
+        { "folder/", "", 0 },
+        { "folder/deflated.bin", testData ( 200 * 1024 ), 6 },
+        { "folder/nested/stored.bin", testData ( 100 * 1024 ), 0 },
+        { "last.txt", testData ( 1000 ), 9 },
+    };
+
+    const string archive = buildZip ( entries );
+
+    for ( size_t maxChunk : { 1, 7, 1024, 64 * 1024 } )
+    {
+        UnzipStream unzip ( TEST_FOLDER );
+
+        extract ( unzip, archive, maxChunk );
+
+        EXPECT_TRUE ( unzip.isFinished() );
+        EXPECT_FALSE ( unzip.hasFailed() );
+        EXPECT_EQ ( 5, unzip.getFileCount() );
+
+        for ( const TestEntry& entry : entries )
+        {
+            if ( entry.name.back() == '/' )
+                continue;
+
+            EXPECT_EQ ( entry.data, readFile ( TEST_FOLDER + entry.name ) ) << entry.name;
+
+            remove ( ( TEST_FOLDER + entry.name ).c_str() );
+        }
+    }
+}
+
+TEST ( UnzipStream, DataDescriptor )
+{
+    srand ( 1234 );
+
+    CreateDirectory ( TEST_FOLDER, 0 );
+
+    const string name = "streamed.bin";
+    const string data = testData ( 50 * 1024 );
+
+    // Raw deflate, since the sizes aren't known while streaming
+    string compressed ( mz_compressBound ( data.size() ), '\0' );
+
+    mz_stream stream;
+    memset ( &stream, 0, sizeof ( stream ) );
+
+    ASSERT_EQ ( MZ_OK, mz_deflateInit2 ( &stream, MZ_DEFAULT_LEVEL, MZ_DEFLATED, -MZ_DEFAULT_WINDOW_BITS, 9, MZ_DEFAULT_STRATEGY ) );
+
+    stream.next_in = ( const unsigned char * ) &data[0];
+    stream.avail_in = data.size();
+    stream.next_out = ( unsigned char * ) &compressed[0];
+    stream.avail_out = compressed.size();
+
+    ASSERT_EQ ( MZ_STREAM_END, mz_deflate ( &stream, MZ_FINISH ) );
+
+    compressed.resize ( stream.total_out );
+    mz_deflateEnd ( &stream );
+
+    const uint32_t crc = mz_crc32 ( MZ_CRC32_INIT, ( const unsigned char * ) &data[0], data.size() );
+
+    for ( bool signature : { true, false } )
+    {
+        // Local header with the data descriptor flag and zero CRC and sizes
+        string archive;
+        append32 ( archive, 0x04034b50 );
+        append16 ( archive, 20 );
+        append16 ( archive, 0x8 );
+        append16 ( archive, MZ_DEFLATED );
+        append32 ( archive, 0 );
+        append32 ( archive, 0 );
+        append32 ( archive, 0 );
+        append32 ( archive, 0 );
+        append16 ( archive, name.size() );
+        append16 ( archive, 0 );
+        archive += name;
+        archive += compressed;
+
+        // Data descriptor, the signature is optional
+        if ( signature )
+            append32 ( archive, 0x08074b50 );
+        append32 ( archive, crc );
+        append32 ( archive, compressed.size() );
+        append32 ( archive, data.size() );
+
+        // Only the signature of the central directory is checked
+        append32 ( archive, 0x02014b50 );
+
+        UnzipStream unzip ( TEST_FOLDER );
+
+        extract ( unzip, archive, 333 );
+
+        EXPECT_TRUE ( unzip.isFinished() ) << signature;
+        EXPECT_EQ ( 1, unzip.getFileCount() );
+        EXPECT_EQ ( data, readFile ( TEST_FOLDER + name ) );
+
+        remove ( ( TEST_FOLDER + name ).c_str() );
+    }
+}
+
+TEST ( UnzipStream, CorruptData )
+{
+    srand ( 1234 );
+
+    CreateDirectory ( TEST_FOLDER, 0 );
+
+    for ( mz_uint level : { 0, 6 } )
+    {
+        const string data = testData ( 10 * 1024 );
+
+        string archive = buildZip ( { { "corrupt.bin", data, level } } );
+
+        // Flip a byte in the middle of the file data
+        archive[30 + strlen ( "corrupt.bin" ) + 100] ^= 0x55;
+
+        UnzipStream unzip ( TEST_FOLDER );
+
+        extract ( unzip, archive, 1024 );
+
+        EXPECT_TRUE ( unzip.hasFailed() );
+        EXPECT_FALSE ( unzip.isFinished() );
+        EXPECT_EQ ( 0, unzip.getFileCount() );
+        EXPECT_FALSE ( unzip.write ( &archive[0], 1 ) );
+
+        remove ( TEST_FOLDER "corrupt.bin" );
+    }
+}
+
+TEST ( UnzipStream, UnsafePath )
+{
+    CreateDirectory ( TEST_FOLDER, 0 );
+
+    for ( const string& name : { "../escaped.txt", "folder/../../escaped.txt", "/escaped.txt", "C:/escaped.txt" } )
+    {
+        // The zip writer rejects absolute paths, so rename the entry afterwards
+        string placeholder = name;
+        replace ( placeholder.begin(), placeholder.end(), ':', '_' );
+        placeholder[0] = ( placeholder[0] == '/' ? '_' : placeholder[0] );
+
+        string archive = buildZip ( { { "safe.txt", "Safe", 0 }, { placeholder, "Escaped", 0 } } );
+
+        for ( size_t i = archive.find ( placeholder ); i != string::npos; i = archive.find ( placeholder, i + name.size() ) )
+            archive.replace ( i, name.size(), name );
+
+        UnzipStream unzip ( TEST_FOLDER );
+
+        extract ( unzip, archive, 1024 );
+
+        EXPECT_TRUE ( unzip.hasFailed() ) << name;
+        EXPECT_EQ ( 1, unzip.getFileCount() );
+        EXPECT_FALSE ( fileExists ( "escaped.txt" ) );
+
+        remove ( TEST_FOLDER "safe.txt" );
+    }
+}
+
+#endif // NOT RELEASE
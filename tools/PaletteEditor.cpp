@@ -31,6 +31,19 @@ bool PaletteEditor::init ( const string& _palettesFolder, const string& dataFile
         _charaIndexToNum[index] = i;
     }
 
+    // Build the palette pack from the existing text files the first time
+    PalettePack pack;
+
+    if ( ! pack.open ( _palettesFolder + PALETTES_PACK_FILE ) )
+    {
+        vector<string> charaNames;
+
+        for ( int i = 0; i < getCharaCount(); ++i )
+            charaNames.push_back ( getCharaName ( i ) );
+
+        PaletteManager::importAllText ( _palettesFolder, charaNames );
+    }
+
     return true;
 }
 
@@ -0,0 +1,277 @@
+#include "RollbackAddrs.hpp"
+#include "StateDump.hpp"
+
+#include <emmintrin.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+
+#define LOG_FILE "statediff.log"
+
+// Maximum number of diverging byte ranges to print for the first diverging frame
+#define MAX_PRINTED_RUNS ( 64 )
+
+
+// A named range of game memory, arrays of structs have a non-zero stride
+struct NamedRange
+{
+    uint32_t start, end, stride;
+    string name;
+};
+
+// A contiguous range of bytes in a state, maps back to game memory
+struct Segment
+{
+    // Offset and size in the state
+    size_t offset, size;
+
+    // Game memory address, or the address of the pointer that points to this segment
+    uint32_t addr;
+
+    // Pointer dereference depth, and the offset applied to the final pointer value
+    size_t depth, dstOffset;
+};
+
+
+static vector<NamedRange> namedRanges;
+
+static vector<Segment> segments;
+
+
+static void initNamedRanges()
+{
+    for ( const auto& group : miscAddrs )
+    {
+        for ( const MemDump& mem : group.second )
+            namedRanges.push_back ( { ( uint32_t ) mem.addr, ( uint32_t ) ( mem.addr + mem.size ), 0, group.first } );
+    }
+
+    static const char *playerNames[CC_PLR_STRUCT_COUNT] = { "player 1", "player 2", "puppet 1", "puppet 2" };
+
+    const uint32_t playerStart = ( uint32_t ) playerAddrs.front().addr;
+
+    for ( size_t i = 0; i < CC_PLR_STRUCT_COUNT; ++i )
+    {
+        const uint32_t start = playerStart + i * CC_PLR_STRUCT_SIZE;
+        namedRanges.push_back ( { start, start + CC_PLR_STRUCT_SIZE, 0, playerNames[i] } );
+    }
+
+    namedRanges.push_back ( { ( uint32_t ) CC_EFFECTS_ARRAY_ADDR,
+                              ( uint32_t ) CC_EFFECTS_ARRAY_ADDR + CC_EFFECTS_ARRAY_COUNT * CC_EFFECT_ELEMENT_SIZE,
+                              CC_EFFECT_ELEMENT_SIZE, "effects" } );
+}
+
+static void initSegments ( const MemDumpBase& mem, size_t& offset, uint32_t addr, size_t depth, size_t dstOffset )
+{
+    segments.push_back ( { offset, mem.size, addr, depth, dstOffset } );
+
+    offset += mem.size;
+
+    for ( const MemDumpPtr& ptr : mem.ptrs )
+        initSegments ( ptr, offset, ( depth == 0 ? addr + ptr.srcOffset : addr ), depth + 1, ptr.dstOffset );
+}
+
+static void initSegments ( const MemDumpList& layout )
+{
+    size_t offset = 0;
+
+    for ( const MemDump& mem : layout.addrs )
+        initSegments ( mem, offset, ( uint32_t ) mem.addr, 0, 0 );
+
+    ASSERT ( offset == layout.totalSize );
+}
+
+static string getAddrName ( uint32_t addr )
+{
+    for ( const NamedRange& range : namedRanges )
+    {
+        if ( addr < range.start || addr >= range.end )
+            continue;
+
+        if ( range.stride )
+        {
+            const uint32_t i = ( addr - range.start ) / range.stride;
+            return format ( "%s[%u]+0x%03X", range.name, i, ( addr - range.start ) % range.stride );
+        }
+
+        return format ( "%s+0x%03X", range.name, addr - range.start );
+    }
+
+    return "unnamed";
+}
+
+static string getRegionName ( size_t offset )
+{
+    // Find the last segment starting at or before the offset
+    auto it = upper_bound ( segments.begin(), segments.end(), offset,
+                            [] ( size_t offset, const Segment& seg ) { return offset < seg.offset; } );
+
+    ASSERT ( it != segments.begin() );
+
+    const Segment& seg = * ( --it );
+
+    if ( seg.depth == 0 )
+    {
+        const uint32_t addr = seg.addr + ( offset - seg.offset );
+        return format ( "0x%06X %s", addr, getAddrName ( addr ) );
+    }
+
+    return format ( "[0x%06X %s]%s+0x%X+0x%X", seg.addr, getAddrName ( seg.addr ), string ( seg.depth - 1, '*' ),
+                    seg.dstOffset, offset - seg.offset );
+}
+
+// Find the first position from pos where the bytes of a and b are different (or the same if match is true)
+template<bool match>
+static size_t scan ( const char *a, const char *b, size_t pos, size_t size )
+{
+    for ( ; pos + 16 <= size; pos += 16 )
+    {
+        const __m128i x = _mm_loadu_si128 ( ( const __m128i * ) ( a + pos ) );
+        const __m128i y = _mm_loadu_si128 ( ( const __m128i * ) ( b + pos ) );
+
+        // Bit i is set if byte i is the same
+        uint32_t mask = _mm_movemask_epi8 ( _mm_cmpeq_epi8 ( x, y ) );
+
+        if ( ! match )
+            mask = ( ~mask ) & 0xFFFF;
+
+        if ( mask )
+            return pos + __builtin_ctz ( mask );
+    }
+
+    for ( ; pos < size; ++pos )
+    {
+        if ( ( a[pos] == b[pos] ) == match )
+            return pos;
+    }
+
+    return size;
+}
+
+// Get the list of [start, end) byte ranges that are different
+static vector<pair<size_t, size_t>> diff ( const string& a, const string& b )
+{
+    ASSERT ( a.size() == b.size() );
+
+    vector<pair<size_t, size_t>> runs;
+
+    for ( size_t pos = scan<false> ( &a[0], &b[0], 0, a.size() ); pos < a.size(); )
+    {
+        const size_t end = scan<true> ( &a[0], &b[0], pos, a.size() );
+        runs.push_back ( { pos, end } );
+        pos = scan<false> ( &a[0], &b[0], end, a.size() );
+    }
+
+    return runs;
+}
+
+static string frameStr ( uint64_t value )
+{
+    IndexedFrame indexedFrame;
+    indexedFrame.value = value;
+    return format ( "%s", indexedFrame );
+}
+
+static bool loadDump ( const string& filename, StateDump& stateDump )
+{
+    if ( ! stateDump.load ( filename ) )
+    {
+        PRINT ( "Failed to load '%s'", filename );
+        return false;
+    }
+
+    if ( stateDump.frames.empty() )
+    {
+        PRINT ( "No states in '%s'", filename );
+        return false;
+    }
+
+    PRINT ( "'%s': %u states from [%s] to [%s]; desync at [%s]", filename, stateDump.frames.size(),
+            frameStr ( stateDump.frames.front().indexedFrame ), frameStr ( stateDump.frames.back().indexedFrame ),
+            frameStr ( stateDump.desyncFrame ) );
+    return true;
+}
+
+
+int main ( int argc, char *argv[] )
+{
+    if ( argc < 3 )
+    {
+        PRINT ( "Usage: statediff [local desync.dump] [remote desync.dump]" );
+        return -1;
+    }
+
+    Logger::get().initialize ( LOG_FILE, 0 );
+
+    StateDump a, b;
+
+    if ( ! loadDump ( argv[1], a ) || ! loadDump ( argv[2], b ) )
+        return -1;
+
+    if ( a.layout.totalSize != b.layout.totalSize )
+    {
+        PRINT ( "Mismatched layouts: %u != %u bytes", a.layout.totalSize, b.layout.totalSize );
+        return -1;
+    }
+
+    initNamedRanges();
+    initSegments ( a.layout );
+
+    size_t compared = 0, diverged = 0;
+
+    // Compare the states with matching frames in chronological order
+    for ( auto it = a.frames.begin(), jt = b.frames.begin(); it != a.frames.end() && jt != b.frames.end(); )
+    {
+        if ( it->indexedFrame < jt->indexedFrame )
+        {
+            ++it;
+            continue;
+        }
+
+        if ( jt->indexedFrame < it->indexedFrame )
+        {
+            ++jt;
+            continue;
+        }
+
+        const vector<pair<size_t, size_t>> runs = diff ( it->bytes, jt->bytes );
+
+        ++compared;
+
+        if ( ! runs.empty() && diverged++ == 0 )
+        {
+            PRINT ( "First diverging frame: [%s]; %u ranges", frameStr ( it->indexedFrame ), runs.size() );
+
+            for ( size_t i = 0; i < runs.size() && i < MAX_PRINTED_RUNS; ++i )
+            {
+                PRINT ( "  %8u: %s; %u bytes", runs[i].first, getRegionName ( runs[i].first ),
+                        runs[i].second - runs[i].first );
+            }
+
+            if ( runs.size() > MAX_PRINTED_RUNS )
+                PRINT ( "  ... %u more", runs.size() - MAX_PRINTED_RUNS );
+        }
+        else if ( ! runs.empty() )
+        {
+            LOG ( "[%s]: %u ranges; first at %s", frameStr ( it->indexedFrame ), runs.size(),
+                  getRegionName ( runs[0].first ) );
+        }
+
+        ++it;
+        ++jt;
+    }
+
+    if ( compared == 0 )
+        PRINT ( "No matching frames to compare!" );
+    else if ( diverged == 0 )
+        PRINT ( "All %u matching frames are identical", compared );
+    else
+        PRINT ( "%u / %u matching frames diverged", diverged, compared );
+
+    Logger::get().deinitialize();
+    return ( diverged ? 1 : 0 );
+}
@@ -1,6 +1,10 @@
 #include "StringUtils.hpp"
+#include "UnzipStream.hpp"
+
+#include <miniz.h>
 
 #include <cstdlib>
+#include <cstring>
 
 #include <windows.h>
 #include <psapi.h>
@@ -11,6 +15,99 @@ using namespace std;
 #define UNZIP "cccaster\\unzip.exe -o "
 
 
+// Create the parent folders of a relative path
+static void createParentFolders ( const string& path )
+{
+    for ( size_t i = 0; i < path.size(); ++i )
+    {
+        if ( path[i] == '/' || path[i] == '\\' )
+            CreateDirectory ( path.substr ( 0, i ).c_str(), 0 );
+    }
+}
+
+// Move the files already extracted while downloading into the current folder
+static bool moveExtractedFiles ( const string& src, const string& dst )
+{
+    WIN32_FIND_DATA data;
+    HANDLE find = FindFirstFile ( ( src + "*" ).c_str(), &data );
+
+    if ( find == INVALID_HANDLE_VALUE )
+        return false;
+
+    bool good = true;
+
+    do
+    {
+        const string name = data.cFileName;
+
+        if ( name == "." || name == ".." )
+            continue;
+
+        if ( data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+        {
+            CreateDirectory ( ( dst + name ).c_str(), 0 );
+            good = moveExtractedFiles ( src + name + "\\", dst + name + "\\" ) && good;
+            continue;
+        }
+
+        if ( ! MoveFileEx ( ( src + name ).c_str(), ( dst + name ).c_str(),
+                            MOVEFILE_REPLACE_EXISTING | MOVEFILE_COPY_ALLOWED ) )
+        {
+            PRINT ( "Failed to move: %s", dst + name );
+            good = false;
+        }
+    }
+    while ( FindNextFile ( find, &data ) );
+
+    FindClose ( find );
+    return good;
+}
+
+// Extract the archive into the current folder
+static bool extractArchive ( const string& archive )
+{
+    mz_zip_archive zip;
+    memset ( &zip, 0, sizeof ( zip ) );
+
+    if ( ! mz_zip_reader_init_file ( &zip, archive.c_str(), 0 ) )
+        return false;
+
+    bool good = true;
+
+    for ( mz_uint i = 0; i < mz_zip_reader_get_num_files ( &zip ); ++i )
+    {
+        mz_zip_archive_file_stat stat;
+
+        if ( ! mz_zip_reader_file_stat ( &zip, i, &stat ) )
+        {
+            good = false;
+            continue;
+        }
+
+        const string name = stat.m_filename;
+
+        // Only extract relative paths inside the current folder
+        if ( name.empty() || name[0] == '/' || name[0] == '\\'
+                || name.find ( ".." ) != string::npos || name.find ( ':' ) != string::npos )
+            continue;
+
+        createParentFolders ( name );
+
+        if ( mz_zip_reader_is_file_a_directory ( &zip, i ) )
+            continue;
+
+        if ( ! mz_zip_reader_extract_to_file ( &zip, i, name.c_str(), 0 ) )
+        {
+            PRINT ( "Failed to extract: %s", name );
+            good = false;
+        }
+    }
+
+    mz_zip_reader_end ( &zip );
+    return good;
+}
+
+
 int main ( int argc, char *argv[] )
 {
     if ( argc < 4 )
@@ -57,7 +154,14 @@ int main ( int argc, char *argv[] )
 
     SetCurrentDirectory ( appDir.c_str() );
 
-    system ( ( UNZIP + archive ).c_str() );
+    // Use the files extracted during the download if they are complete, otherwise extract the archive now
+    const string extracted = archive.substr ( 0, archive.rfind ( '.' ) ) + "\\";
+
+    const bool moved = ( GetFileAttributes ( ( archive + EXTRACTED_MARKER_SUFFIX ).c_str() ) != INVALID_FILE_ATTRIBUTES
+                         && moveExtractedFiles ( extracted, "" ) );
+
+    if ( ! moved && ! extractArchive ( archive ) )
+        system ( ( UNZIP + archive ).c_str() );
 
     system ( ( "start \"\" " + binary ).c_str() );
 
@@ -0,0 +1,772 @@
+#include "RelayProtocol.hpp"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+
+#define LOG(FORMAT, ...)                                                                                    \
+    do { fprintf ( stderr, "%ld: " FORMAT "\n", ( long ) time ( 0 ), ## __VA_ARGS__ ); } while ( 0 )
+
+#define TCP_BACKLOG             ( 128 )
+
+#define READ_BUFFER_SIZE        ( 4096 )
+
+// Max number of epoll events handled per wait
+#define MAX_EVENTS              ( 256 )
+
+// Number of datagrams received and sent per syscall
+#define RELAY_BATCH_SIZE        ( 64 )
+
+// Seconds without any UdpData or RelayData before a match is removed from its shard
+#define RELAY_IDLE_TIMEOUT      ( 60 )
+
+// Seconds between logging stats
+#define STATS_INTERVAL          ( 10 )
+
+
+static bool setNonBlocking ( int fd )
+{
+    const int flags = fcntl ( fd, F_GETFL, 0 );
+    return ( flags >= 0 && fcntl ( fd, F_SETFL, flags | O_NONBLOCK ) == 0 );
+}
+
+static string formatAddress ( const sockaddr_in& addr )
+{
+    char ip[INET_ADDRSTRLEN] = { 0 };
+    inet_ntop ( AF_INET, &addr.sin_addr, ip, sizeof ( ip ) );
+    return string ( ip ) + ":" + to_string ( ntohs ( addr.sin_port ) );
+}
+
+static bool operator== ( const sockaddr_in& a, const sockaddr_in& b )
+{
+    return ( a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port );
+}
+
+
+class Control;
+
+// Owns the UDP state of every match where relayShard ( matchId ) is this shard's index. All the shards share the
+// same UDP port with SO_REUSEPORT, and the kernel steers each datagram to the right shard, so the match state is
+// never shared between threads.
+class Shard
+{
+public:
+
+    // Stats, read by the control thread
+    atomic<uint64_t> forwarded { 0 }, forwardedBytes { 0 }, dropped { 0 };
+    atomic<size_t> numMatches { 0 };
+
+    Shard ( int fd, Control& control ) : _fd ( fd ), _control ( control )
+    {
+        _eventFd = eventfd ( 0, EFD_NONBLOCK );
+
+        // Each received datagram is forwarded straight out of the same buffer
+        for ( size_t i = 0; i < RELAY_BATCH_SIZE; ++i )
+        {
+            _recvIovs[i].iov_base = _buffers[i];
+            _recvIovs[i].iov_len = sizeof ( _buffers[i] );
+            _recvMsgs[i].msg_hdr.msg_iov = &_recvIovs[i];
+            _recvMsgs[i].msg_hdr.msg_iovlen = 1;
+            _recvMsgs[i].msg_hdr.msg_name = &_sources[i];
+            _recvMsgs[i].msg_hdr.msg_namelen = sizeof ( _sources[i] );
+        }
+    }
+
+    ~Shard()
+    {
+        close ( _eventFd );
+        close ( _fd );
+    }
+
+    // Add a new match, called from the control thread
+    void addMatch ( uint32_t matchId )
+    {
+        {
+            lock_guard<mutex> lock ( _mutex );
+            _newMatches.push_back ( matchId );
+        }
+
+        const uint64_t one = 1;
+
+        if ( write ( _eventFd, &one, sizeof ( one ) ) < 0 )
+            LOG ( "Failed to wake shard: %s", strerror ( errno ) );
+    }
+
+    void run();
+
+private:
+
+    struct Match
+    {
+        // UDP addresses registered by the host (index 0) and client (index 1)
+        sockaddr_in addresses[2];
+        bool registered[2] = { false, false };
+
+        // Last time any datagram for this match was received
+        time_t lastActive = 0;
+    };
+
+    int _fd = -1, _eventFd = -1;
+
+    Control& _control;
+
+    // Matches added by the control thread
+    mutex _mutex;
+    vector<uint32_t> _newMatches;
+
+    // matchId -> match, ONLY accessed by this shard's thread
+    unordered_map<uint32_t, Match> _matches;
+
+    // Batched datagram buffers
+    char _buffers[RELAY_BATCH_SIZE][RELAY_MAX_DATAGRAM];
+    iovec _recvIovs[RELAY_BATCH_SIZE], _sendIovs[RELAY_BATCH_SIZE];
+    mmsghdr _recvMsgs[RELAY_BATCH_SIZE], _sendMsgs[RELAY_BATCH_SIZE];
+    sockaddr_in _sources[RELAY_BATCH_SIZE];
+
+    void addNewMatches ( time_t now );
+
+    // Handle a batch of received datagrams, returns the number of datagrams to forward
+    size_t handleBatch ( size_t count, time_t now );
+
+    void removeIdleMatches ( time_t now );
+};
+
+
+// Handles matchmaking over TCP, and sends TunInfo when a shard gets a new UdpData address
+class Control
+{
+public:
+
+    Control ( int listenFd, vector<unique_ptr<Shard>>& shards ) : _listenFd ( listenFd ), _shards ( shards )
+    {
+        _eventFd = eventfd ( 0, EFD_NONBLOCK );
+    }
+
+    // A shard got UdpData from a new address, called from the shard threads
+    void registered ( uint32_t matchId, uint8_t isClient, const sockaddr_in& address )
+    {
+        {
+            lock_guard<mutex> lock ( _mutex );
+            _registrations.push_back ( { matchId, isClient, address } );
+        }
+
+        const uint64_t one = 1;
+
+        if ( write ( _eventFd, &one, sizeof ( one ) ) < 0 )
+            LOG ( "Failed to wake control: %s", strerror ( errno ) );
+    }
+
+    void run();
+
+private:
+
+    struct Registration
+    {
+        uint32_t matchId;
+        uint8_t isClient;
+        sockaddr_in address;
+    };
+
+    struct Connection
+    {
+        // IP address of the peer
+        string ip;
+
+        // TypedHostingAddress, if this connection is a host
+        string hostAddress;
+    };
+
+    int _listenFd = -1, _eventFd = -1, _epollFd = -1;
+
+    vector<unique_ptr<Shard>>& _shards;
+
+    // UdpData addresses from the shards
+    mutex _mutex;
+    vector<Registration> _registrations;
+
+    // fd -> connection
+    unordered_map<int, Connection> _connections;
+
+    // TypedHostingAddress -> host fd
+    unordered_map<string, int> _hosts;
+
+    // matchId -> [ client fd, host fd ], each is set to -1 once TunInfo is sent
+    unordered_map<uint32_t, array<int, 2>> _matches;
+
+    uint32_t _currentMatchId = 0;
+
+    uint32_t nextMatchId();
+
+    void accept();
+
+    void read ( int fd );
+
+    void disconnect ( int fd );
+
+    void handleRegistrations();
+
+    void logStats();
+};
+
+
+void Shard::run()
+{
+    const int epollFd = epoll_create1 ( 0 );
+
+    epoll_event event;
+    event.events = EPOLLIN;
+
+    event.data.fd = _fd;
+    epoll_ctl ( epollFd, EPOLL_CTL_ADD, _fd, &event );
+
+    event.data.fd = _eventFd;
+    epoll_ctl ( epollFd, EPOLL_CTL_ADD, _eventFd, &event );
+
+    epoll_event events[2];
+    time_t lastSweep = time ( 0 );
+
+    for ( ;; )
+    {
+        const int numEvents = epoll_wait ( epollFd, events, 2, 1000 );
+        const time_t now = time ( 0 );
+
+        // Add new matches before reading any datagrams, since the first UdpData may already be waiting
+        for ( int i = 0; i < numEvents; ++i )
+        {
+            if ( events[i].data.fd == _eventFd )
+                addNewMatches ( now );
+        }
+
+        for ( int i = 0; i < numEvents; ++i )
+        {
+            if ( events[i].data.fd == _eventFd )
+                continue;
+
+            // Drain the socket in batches
+            for ( ;; )
+            {
+                for ( size_t j = 0; j < RELAY_BATCH_SIZE; ++j )
+                    _recvMsgs[j].msg_hdr.msg_namelen = sizeof ( _sources[j] );
+
+                const int count = recvmmsg ( _fd, _recvMsgs, RELAY_BATCH_SIZE, MSG_DONTWAIT, 0 );
+
+                if ( count <= 0 )
+                    break;
+
+                const size_t numForward = handleBatch ( count, now );
+
+                for ( size_t sent = 0; sent < numForward; )
+                {
+                    const int ret = sendmmsg ( _fd, &_sendMsgs[sent], numForward - sent, 0 );
+
+                    if ( ret <= 0 )
+                    {
+                        // Drop the datagram that failed to send and continue with the rest
+                        ++dropped;
+                        ++sent;
+                        continue;
+                    }
+
+                    sent += ret;
+                }
+
+                if ( count < RELAY_BATCH_SIZE )
+                    break;
+            }
+        }
+
+        if ( now - lastSweep >= 1 )
+        {
+            removeIdleMatches ( now );
+            lastSweep = now;
+        }
+    }
+}
+
+void Shard::addNewMatches ( time_t now )
+{
+    uint64_t value;
+
+    if ( ::read ( _eventFd, &value, sizeof ( value ) ) < 0 )
+        return;
+
+    vector<uint32_t> newMatches;
+
+    {
+        lock_guard<mutex> lock ( _mutex );
+        newMatches.swap ( _newMatches );
+    }
+
+    for ( uint32_t matchId : newMatches )
+    {
+        Match& match = _matches[matchId];
+        match = Match();
+        match.lastActive = now;
+    }
+
+    numMatches = _matches.size();
+}
+
+size_t Shard::handleBatch ( size_t count, time_t now )
+{
+    size_t numForward = 0;
+
+    for ( size_t i = 0; i < count; ++i )
+    {
+        const char *buffer = _buffers[i];
+        const size_t len = _recvMsgs[i].msg_len;
+        const sockaddr_in& source = _sources[i];
+
+        uint8_t flag;
+        uint32_t matchId;
+
+        if ( ! relayHeader ( buffer, len, flag, matchId ) )
+        {
+            ++dropped;
+            continue;
+        }
+
+        const auto it = _matches.find ( matchId );
+
+        if ( it == _matches.end() )
+        {
+            ++dropped;
+            continue;
+        }
+
+        Match& match = it->second;
+
+        if ( flag < RELAY_DATA_FLAG && len == RELAY_HEADER_SIZE )
+        {
+            // UdpData, register the address and let the control thread send TunInfo
+            match.lastActive = now;
+
+            if ( match.registered[flag] && match.addresses[flag] == source )
+                continue;
+
+            match.addresses[flag] = source;
+            match.registered[flag] = true;
+
+            _control.registered ( matchId, flag, source );
+            continue;
+        }
+
+        const uint8_t index = flag - RELAY_DATA_FLAG;
+
+        if ( index > 1 || ! match.registered[index] || ! ( match.addresses[index] == source )
+                || ! match.registered[1 - index] )
+        {
+            ++dropped;
+            continue;
+        }
+
+        match.lastActive = now;
+
+        // Forward the datagram as-is from the receive buffer
+        _sendIovs[numForward].iov_base = _buffers[i];
+        _sendIovs[numForward].iov_len = len;
+
+        msghdr& header = _sendMsgs[numForward].msg_hdr;
+        header = msghdr();
+        header.msg_iov = &_sendIovs[numForward];
+        header.msg_iovlen = 1;
+        header.msg_name = &match.addresses[1 - index];
+        header.msg_namelen = sizeof ( sockaddr_in );
+
+        ++numForward;
+
+        ++forwarded;
+        forwardedBytes += len;
+    }
+
+    return numForward;
+}
+
+void Shard::removeIdleMatches ( time_t now )
+{
+    for ( auto it = _matches.begin(); it != _matches.end(); )
+    {
+        if ( now - it->second.lastActive > RELAY_IDLE_TIMEOUT )
+            it = _matches.erase ( it );
+        else
+            ++it;
+    }
+
+    numMatches = _matches.size();
+}
+
+
+void Control::run()
+{
+    _epollFd = epoll_create1 ( 0 );
+
+    epoll_event event;
+    event.events = EPOLLIN;
+
+    event.data.fd = _listenFd;
+    epoll_ctl ( _epollFd, EPOLL_CTL_ADD, _listenFd, &event );
+
+    event.data.fd = _eventFd;
+    epoll_ctl ( _epollFd, EPOLL_CTL_ADD, _eventFd, &event );
+
+    epoll_event events[MAX_EVENTS];
+    time_t lastStats = time ( 0 );
+
+    for ( ;; )
+    {
+        const int numEvents = epoll_wait ( _epollFd, events, MAX_EVENTS, 1000 );
+
+        for ( int i = 0; i < numEvents; ++i )
+        {
+            const int fd = events[i].data.fd;
+
+            if ( fd == _listenFd )
+                accept();
+            else if ( fd == _eventFd )
+                handleRegistrations();
+            else
+                read ( fd );
+        }
+
+        if ( time ( 0 ) - lastStats >= STATS_INTERVAL )
+        {
+            logStats();
+            lastStats = time ( 0 );
+        }
+    }
+}
+
+uint32_t Control::nextMatchId()
+{
+    do
+    {
+        ++_currentMatchId;
+    }
+    while ( _currentMatchId == 0 || _matches.find ( _currentMatchId ) != _matches.end() );
+
+    return _currentMatchId;
+}
+
+void Control::accept()
+{
+    for ( ;; )
+    {
+        sockaddr_in addr;
+        socklen_t addrLen = sizeof ( addr );
+
+        const int fd = accept4 ( _listenFd, ( sockaddr * ) &addr, &addrLen, SOCK_NONBLOCK );
+
+        if ( fd < 0 )
+            return;
+
+        const int one = 1;
+        setsockopt ( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof ( one ) );
+
+        char ip[INET_ADDRSTRLEN] = { 0 };
+        inet_ntop ( AF_INET, &addr.sin_addr, ip, sizeof ( ip ) );
+
+        _connections[fd].ip = ip;
+
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl ( _epollFd, EPOLL_CTL_ADD, fd, &event );
+    }
+}
+
+void Control::read ( int fd )
+{
+    char buffer[READ_BUFFER_SIZE];
+
+    const ssize_t len = recv ( fd, buffer, sizeof ( buffer ), 0 );
+
+    if ( len < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+        return;
+
+    Connection& connection = _connections[fd];
+
+    if ( len == 3 )
+    {
+        // TypedHostingPort
+        uint16_t port;
+        memcpy ( &port, &buffer[1], sizeof ( port ) );
+
+        if ( buffer[0] && port )
+        {
+            connection.hostAddress = buffer[0] + connection.ip + ":" + to_string ( port );
+            _hosts[connection.hostAddress] = fd;
+            return;
+        }
+    }
+    else if ( len >= 10 && len <= 22 ) // min data "T1.1.1.1:0", max data "T255.255.255.255:65535"
+    {
+        // TypedConnectionAddress
+        const auto it = _hosts.find ( string ( buffer, len ) );
+
+        if ( it != _hosts.end() )
+        {
+            const uint32_t matchId = nextMatchId();
+            const string matchInfo = encodeMatchInfo ( matchId );
+
+            // Add the match to its shard first, so it is ready for the UdpData
+            _shards[relayShard ( matchId, _shards.size() )]->addMatch ( matchId );
+
+            _matches[matchId] = {{ fd, it->second }};
+
+            send ( fd, &matchInfo[0], matchInfo.size(), MSG_NOSIGNAL );
+            send ( it->second, &matchInfo[0], matchInfo.size(), MSG_NOSIGNAL );
+            return;
+        }
+    }
+
+    // Otherwise disconnect the client
+    disconnect ( fd );
+}
+
+void Control::disconnect ( int fd )
+{
+    const auto it = _connections.find ( fd );
+
+    if ( it != _connections.end() )
+    {
+        const auto jt = _hosts.find ( it->second.hostAddress );
+
+        if ( jt != _hosts.end() && jt->second == fd )
+            _hosts.erase ( jt );
+
+        _connections.erase ( it );
+    }
+
+    for ( auto jt = _matches.begin(); jt != _matches.end(); )
+    {
+        if ( jt->second[0] == fd || jt->second[1] == fd )
+            jt = _matches.erase ( jt );
+        else
+            ++jt;
+    }
+
+    epoll_ctl ( _epollFd, EPOLL_CTL_DEL, fd, 0 );
+    close ( fd );
+}
+
+void Control::handleRegistrations()
+{
+    uint64_t value;
+
+    if ( ::read ( _eventFd, &value, sizeof ( value ) ) < 0 )
+        return;
+
+    vector<Registration> registrations;
+
+    {
+        lock_guard<mutex> lock ( _mutex );
+        registrations.swap ( _registrations );
+    }
+
+    for ( const Registration& reg : registrations )
+    {
+        const auto it = _matches.find ( reg.matchId );
+
+        if ( it == _matches.end() )
+            continue;
+
+        // Send TunInfo ONCE to the other side
+        int& fd = it->second[reg.isClient ? 1 : 0];
+
+        if ( fd >= 0 )
+        {
+            const string tunInfo = encodeTunInfo ( reg.matchId, formatAddress ( reg.address ) );
+            send ( fd, &tunInfo[0], tunInfo.size(), MSG_NOSIGNAL );
+            fd = -1;
+        }
+
+        // Remove the match once both have been sent, the shard keeps relaying until it is idle
+        if ( it->second[0] < 0 && it->second[1] < 0 )
+            _matches.erase ( it );
+    }
+}
+
+void Control::logStats()
+{
+    uint64_t forwarded = 0, forwardedBytes = 0, dropped = 0;
+    size_t numMatches = 0;
+
+    // Matches on each shard, to check they are spread evenly
+    string perShard;
+
+    for ( const auto& shard : _shards )
+    {
+        forwarded += shard->forwarded.exchange ( 0 );
+        forwardedBytes += shard->forwardedBytes.exchange ( 0 );
+        dropped += shard->dropped.exchange ( 0 );
+        numMatches += shard->numMatches;
+
+        perShard += ( perShard.empty() ? "" : "/" ) + to_string ( shard->numMatches );
+    }
+
+    if ( ! forwarded && ! dropped && ! numMatches && _connections.empty() )
+        return;
+
+    LOG ( "connections=%u; hosts=%u; pending=%u; matches=%u (%s); forwarded=%.0f/s (%.1f KB/s); dropped=%.0f/s",
+          ( unsigned ) _connections.size(), ( unsigned ) _hosts.size(), ( unsigned ) _matches.size(),
+          ( unsigned ) numMatches, perShard.c_str(), double ( forwarded ) / STATS_INTERVAL,
+          double ( forwardedBytes ) / STATS_INTERVAL / 1024, double ( dropped ) / STATS_INTERVAL );
+}
+
+
+// Steer each datagram to the socket at index relayShard ( matchId, numShards ), the same hash of the big-endian matchId
+static bool attachShardFilter ( int fd, size_t numShards )
+{
+    sock_filter code[] =
+    {
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, 1 },
+        { BPF_MISC | BPF_TAX, 0, 0, 0 },
+        { BPF_ALU | BPF_RSH | BPF_K, 0, 0, 16 },
+        { BPF_ALU | BPF_XOR | BPF_X, 0, 0, 0 },
+        { BPF_ALU | BPF_MUL | BPF_K, 0, 0, RELAY_SHARD_HASH },
+        { BPF_ALU | BPF_RSH | BPF_K, 0, 0, 16 },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, ( uint32_t ) numShards },
+        { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+
+    sock_fprog program;
+    program.len = sizeof ( code ) / sizeof ( code[0] );
+    program.filter = code;
+
+    return ( setsockopt ( fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof ( program ) ) == 0 );
+}
+
+static int bindSocket ( int type, uint16_t port )
+{
+    const int fd = socket ( AF_INET, type, 0 );
+
+    if ( fd < 0 )
+        return -1;
+
+    const int one = 1;
+    setsockopt ( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof ( one ) );
+
+    if ( type == SOCK_DGRAM )
+        setsockopt ( fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof ( one ) );
+
+    sockaddr_in addr = sockaddr_in();
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl ( INADDR_ANY );
+    addr.sin_port = htons ( port );
+
+    if ( bind ( fd, ( sockaddr * ) &addr, sizeof ( addr ) ) != 0 || ! setNonBlocking ( fd ) )
+    {
+        close ( fd );
+        return -1;
+    }
+
+    return fd;
+}
+
+int main ( int argc, char *argv[] )
+{
+    if ( argc > 3 || ( argc > 1 && string ( argv[1] ) == "-h" ) )
+    {
+        printf ( "Usage: %s [port] [shards]\n", argv[0] );
+        return 0;
+    }
+
+    const uint16_t port = ( argc > 1 ? atoi ( argv[1] ) : RELAY_DEFAULT_PORT );
+
+    size_t numShards = ( argc > 2 ? atoi ( argv[2] ) : thread::hardware_concurrency() );
+
+    if ( numShards < 1 )
+        numShards = 1;
+
+    // Each match uses a TCP socket per side while matchmaking
+    rlimit limit;
+
+    if ( getrlimit ( RLIMIT_NOFILE, &limit ) == 0 )
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit ( RLIMIT_NOFILE, &limit );
+    }
+
+    const int listenFd = bindSocket ( SOCK_STREAM, port );
+
+    if ( listenFd < 0 || listen ( listenFd, TCP_BACKLOG ) != 0 )
+    {
+        LOG ( "Failed to listen on TCP port %u: %s", port, strerror ( errno ) );
+        return -1;
+    }
+
+    vector<int> udpFds;
+
+    for ( size_t i = 0; i < numShards; ++i )
+    {
+        const int fd = bindSocket ( SOCK_DGRAM, port );
+
+        if ( fd < 0 )
+        {
+            LOG ( "Failed to bind UDP port %u: %s", port, strerror ( errno ) );
+            return -1;
+        }
+
+        const int size = 4 * 1024 * 1024;
+        setsockopt ( fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof ( size ) );
+        setsockopt ( fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof ( size ) );
+
+        udpFds.push_back ( fd );
+    }
+
+    // Without the filter the kernel hashes by address, so both sides of a match could land on different shards
+    if ( numShards > 1 && ! attachShardFilter ( udpFds[0], numShards ) )
+    {
+        LOG ( "Failed to attach shard filter: %s; using 1 shard", strerror ( errno ) );
+
+        for ( size_t i = 1; i < numShards; ++i )
+            close ( udpFds[i] );
+
+        udpFds.resize ( 1 );
+        numShards = 1;
+    }
+
+    vector<unique_ptr<Shard>> shards;
+    Control control ( listenFd, shards );
+
+    for ( int fd : udpFds )
+        shards.emplace_back ( new Shard ( fd, control ) );
+
+    vector<thread> threads;
+
+    for ( auto& shard : shards )
+        threads.emplace_back ( &Shard::run, shard.get() );
+
+    LOG ( "Relay listening on port %u with %u shards", port, ( unsigned ) numShards );
+
+    control.run();
+
+    for ( thread& t : threads )
+        t.join();
+
+    return 0;
+}
@@ -0,0 +1,330 @@
+#include "RelayProtocol.hpp"
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+// Datagrams sent per second by each side of a match, ie one PlayerInputs per frame
+#define SEND_RATE           ( 60 )
+
+// Seconds to wait for each matchmaking reply
+#define REPLY_TIMEOUT       ( 5 )
+
+#define MAX_EVENTS          ( 256 )
+
+
+// Simulated match, both sides send RelayData to each other through the relay
+struct Match
+{
+    uint32_t matchId = 0;
+
+    // Host (index 0) and client (index 1) sockets
+    int tcp[2] = { -1, -1 };
+    int udp[2] = { -1, -1 };
+};
+
+// Header of each simulated datagram after the RelayData header
+struct Payload
+{
+    uint32_t sequence;
+    uint64_t sendNs;
+};
+
+
+static uint64_t nowNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds> ( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static int connectTcp ( const sockaddr_in& server )
+{
+    const int fd = socket ( AF_INET, SOCK_STREAM, 0 );
+
+    timeval timeout = { REPLY_TIMEOUT, 0 };
+    setsockopt ( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof ( timeout ) );
+
+    if ( connect ( fd, ( const sockaddr * ) &server, sizeof ( server ) ) != 0 )
+    {
+        close ( fd );
+        return -1;
+    }
+
+    return fd;
+}
+
+static int bindUdp ( uint16_t& port )
+{
+    const int fd = socket ( AF_INET, SOCK_DGRAM, 0 );
+
+    sockaddr_in addr = sockaddr_in();
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+
+    socklen_t addrLen = sizeof ( addr );
+
+    if ( bind ( fd, ( sockaddr * ) &addr, sizeof ( addr ) ) != 0
+            || getsockname ( fd, ( sockaddr * ) &addr, &addrLen ) != 0 )
+    {
+        close ( fd );
+        return -1;
+    }
+
+    port = ntohs ( addr.sin_port );
+    return fd;
+}
+
+// Read a reply that starts with the given header, returns the matchId or 0 on failure
+static uint32_t readReply ( int fd, const string& header )
+{
+    char buffer[64];
+
+    const ssize_t len = recv ( fd, buffer, sizeof ( buffer ), 0 );
+
+    if ( len < ( ssize_t ) ( header.size() + sizeof ( uint32_t ) ) || string ( buffer, header.size() ) != header )
+        return 0;
+
+    uint32_t matchId;
+    memcpy ( &matchId, &buffer[header.size()], sizeof ( matchId ) );
+    return matchId;
+}
+
+// Matchmake over TCP like SmartSocket, then register both UDP sockets with UdpData
+static bool setupMatch ( const sockaddr_in& server, Match& match )
+{
+    uint16_t ports[2];
+
+    for ( size_t i = 0; i < 2; ++i )
+    {
+        match.udp[i] = bindUdp ( ports[i] );
+
+        if ( match.udp[i] < 0 )
+            return false;
+    }
+
+    // TypedHostingPort
+    match.tcp[0] = connectTcp ( server );
+
+    char hosting[3] = { 'U' };
+    memcpy ( &hosting[1], &ports[0], sizeof ( ports[0] ) );
+
+    if ( match.tcp[0] < 0 || send ( match.tcp[0], hosting, sizeof ( hosting ), 0 ) != sizeof ( hosting ) )
+        return false;
+
+    // TypedConnectionAddress, retried since the relay may not have handled the host yet
+    const string connection = "U127.0.0.1:" + to_string ( ports[0] );
+
+    for ( size_t retry = 0; retry < 10 && ! match.matchId; ++retry )
+    {
+        if ( match.tcp[1] >= 0 )
+        {
+            close ( match.tcp[1] );
+            this_thread::sleep_for ( chrono::milliseconds ( 10 ) );
+        }
+
+        match.tcp[1] = connectTcp ( server );
+
+        if ( match.tcp[1] < 0 || send ( match.tcp[1], &connection[0], connection.size(), 0 ) < 0 )
+            return false;
+
+        match.matchId = readReply ( match.tcp[1], "MatchInfo" );
+    }
+
+    if ( ! match.matchId || readReply ( match.tcp[0], "MatchInfo" ) != match.matchId )
+        return false;
+
+    // UdpData, each side gets the other's address in TunInfo once the relay has registered it
+    for ( size_t i = 0; i < 2; ++i )
+    {
+        char data[RELAY_HEADER_SIZE];
+        relayHeader ( data, i, match.matchId );
+
+        if ( sendto ( match.udp[i], data, sizeof ( data ), 0, ( const sockaddr * ) &server, sizeof ( server ) ) < 0 )
+            return false;
+    }
+
+    for ( size_t i = 0; i < 2; ++i )
+    {
+        if ( readReply ( match.tcp[i], "TunInfo" ) != match.matchId )
+            return false;
+
+        close ( match.tcp[i] );
+        match.tcp[i] = -1;
+    }
+
+    return true;
+}
+
+static double percentile ( const vector<uint32_t>& sorted, double percentile )
+{
+    if ( sorted.empty() )
+        return 0;
+
+    const size_t index = min ( sorted.size() - 1, size_t ( sorted.size() * percentile / 100.0 ) );
+    return sorted[index] / 1000.0;
+}
+
+int main ( int argc, char *argv[] )
+{
+    if ( argc > 6 || ( argc > 1 && string ( argv[1] ) == "-h" ) )
+    {
+        printf ( "Usage: %s [matches] [seconds] [payload] [address] [port]\n", argv[0] );
+        return 0;
+    }
+
+    const size_t numMatches = ( argc > 1 ? atoi ( argv[1] ) : 1000 );
+    const size_t seconds = ( argc > 2 ? atoi ( argv[2] ) : 10 );
+    const size_t payloadSize = max ( sizeof ( Payload ), size_t ( argc > 3 ? atoi ( argv[3] ) : 64 ) );
+
+    sockaddr_in server = sockaddr_in();
+    server.sin_family = AF_INET;
+    server.sin_port = htons ( argc > 5 ? atoi ( argv[5] ) : RELAY_DEFAULT_PORT );
+    inet_pton ( AF_INET, ( argc > 4 ? argv[4] : "127.0.0.1" ), &server.sin_addr );
+
+    if ( RELAY_HEADER_SIZE + payloadSize > RELAY_MAX_DATAGRAM )
+    {
+        printf ( "Payload too large\n" );
+        return -1;
+    }
+
+    // Two UDP sockets per match, plus two TCP sockets while matchmaking
+    rlimit limit;
+
+    if ( getrlimit ( RLIMIT_NOFILE, &limit ) == 0 )
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit ( RLIMIT_NOFILE, &limit );
+    }
+
+    vector<Match> matches ( numMatches );
+
+    const uint64_t setupStart = nowNs();
+
+    for ( size_t i = 0; i < numMatches; ++i )
+    {
+        if ( ! setupMatch ( server, matches[i] ) )
+        {
+            printf ( "Failed to set up match %u\n", ( unsigned ) i );
+            return -1;
+        }
+    }
+
+    printf ( "Set up %u matches in %.2f s\n", ( unsigned ) numMatches, ( nowNs() - setupStart ) / 1e9 );
+
+    const int epollFd = epoll_create1 ( 0 );
+
+    for ( size_t i = 0; i < numMatches; ++i )
+    {
+        for ( size_t j = 0; j < 2; ++j )
+        {
+            epoll_event event;
+            event.events = EPOLLIN;
+            event.data.u64 = ( i << 1 ) | j;
+            epoll_ctl ( epollFd, EPOLL_CTL_ADD, matches[i].udp[j], &event );
+        }
+    }
+
+    vector<char> datagram ( RELAY_HEADER_SIZE + payloadSize, 0 );
+    vector<uint32_t> latencies;
+    latencies.reserve ( numMatches * 2 * SEND_RATE * seconds );
+
+    uint64_t sent = 0, received = 0, invalid = 0;
+
+    const uint64_t interval = 1000000000ULL / SEND_RATE;
+    const uint64_t start = nowNs(), end = start + seconds * 1000000000ULL;
+
+    epoll_event events[MAX_EVENTS];
+
+    for ( uint64_t tick = start; tick < end; tick += interval )
+    {
+        // Every side of every match sends one datagram per tick
+        for ( size_t i = 0; i < numMatches; ++i )
+        {
+            for ( size_t j = 0; j < 2; ++j )
+            {
+                relayHeader ( &datagram[0], RELAY_DATA_FLAG + j, matches[i].matchId );
+
+                const Payload payload = { uint32_t ( sent ), nowNs() };
+                memcpy ( &datagram[RELAY_HEADER_SIZE], &payload, sizeof ( payload ) );
+
+                if ( sendto ( matches[i].udp[j], &datagram[0], datagram.size(), 0,
+                              ( const sockaddr * ) &server, sizeof ( server ) ) > 0 )
+                {
+                    ++sent;
+                }
+            }
+        }
+
+        // Receive until the next tick, but at least once if sending is falling behind
+        for ( uint64_t now = nowNs();; now = nowNs() )
+        {
+            const int timeout = ( now < tick + interval ? ( tick + interval - now ) / 1000000 : 0 );
+            const int numEvents = epoll_wait ( epollFd, events, MAX_EVENTS, timeout );
+
+            for ( int k = 0; k < numEvents; ++k )
+            {
+                const Match& match = matches[events[k].data.u64 >> 1];
+                const size_t side = events[k].data.u64 & 1;
+
+                char buffer[RELAY_MAX_DATAGRAM];
+
+                for ( ;; )
+                {
+                    const ssize_t len = recv ( match.udp[side], buffer, sizeof ( buffer ), MSG_DONTWAIT );
+
+                    if ( len <= 0 )
+                        break;
+
+                    uint8_t flag;
+                    uint32_t matchId;
+
+                    // Should be relayed from the other side of the same match
+                    if ( size_t ( len ) < RELAY_HEADER_SIZE + sizeof ( Payload )
+                            || ! relayHeader ( buffer, len, flag, matchId )
+                            || matchId != match.matchId || flag != RELAY_DATA_FLAG + ( 1 - side ) )
+                    {
+                        ++invalid;
+                        continue;
+                    }
+
+                    Payload payload;
+                    memcpy ( &payload, &buffer[RELAY_HEADER_SIZE], sizeof ( payload ) );
+
+                    latencies.push_back ( uint32_t ( ( nowNs() - payload.sendNs ) / 1000 ) );
+                    ++received;
+                }
+            }
+
+            if ( numEvents < MAX_EVENTS && nowNs() >= tick + interval )
+                break;
+        }
+    }
+
+    const double elapsed = ( nowNs() - start ) / 1e9;
+
+    sort ( latencies.begin(), latencies.end() );
+
+    printf ( "Matches: %u; payload: %u bytes; duration: %.2f s\n", ( unsigned ) numMatches,
+             ( unsigned ) payloadSize, elapsed );
+    printf ( "Sent: %llu (%.0f/s); received: %llu (%.0f/s); lost: %.2f%%; invalid: %llu\n",
+             ( unsigned long long ) sent, sent / elapsed, ( unsigned long long ) received, received / elapsed,
+             ( sent ? 100.0 * ( sent - min ( sent, received ) ) / sent : 0.0 ), ( unsigned long long ) invalid );
+    printf ( "Latency: p50=%.3f ms; p90=%.3f ms; p99=%.3f ms; p99.9=%.3f ms; worst=%.3f ms\n",
+             percentile ( latencies, 50 ), percentile ( latencies, 90 ), percentile ( latencies, 99 ),
+             percentile ( latencies, 99.9 ), percentile ( latencies, 100 ) );
+
+    return 0;
+}
@@ -0,0 +1,476 @@
+#include "RelayProtocol.hpp"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+// Same as SmartSocket
+#define SEND_INTERVAL       ( 50 )
+#define PUNCH_TIMEOUT       ( 2000 )
+
+// Seconds to wait for the other side to be matched
+#define MATCH_TIMEOUT       ( 60 )
+
+// Seconds to wait for a connection after TunInfo
+#define CONNECT_TIMEOUT     ( 10 )
+
+// Number of pings to measure after connecting
+#define NUM_PINGS           ( 100 )
+
+// Same as Socket
+#define MULTIPATH_HISTORY   ( 32 )
+#define RELAY_DIRECT_TIMEOUT ( 1000 )
+#define RELAY_DIRECT_PROBE_INTERVAL ( 1000 )
+
+// Datagram types after the optional RelayData header
+#define PUNCH               ( 'P' )
+#define PING                ( 'I' )
+#define PONG                ( 'O' )
+
+
+// One side of a tunnel match, connects the same way as SmartSocket: punch a hole directly to the address in TunInfo,
+// then also send through the server as RelayData once PUNCH_TIMEOUT has passed. Only relay once RelayData from the
+// other side arrives and nothing directly, and go back to direct when direct datagrams arrive again.
+struct Peer
+{
+    bool isClient = false;
+
+    // Simulate a symmetric NAT by never sending or reading datagrams directly
+    bool blockDirect = false;
+
+    // Also block direct datagrams for this many milliseconds after TunInfo, to simulate hole punching that is slow
+    uint64_t blockDirectMs = 0;
+
+    // Send pings and pongs over both paths once connected, like Socket::setMultipath
+    bool multipath = false;
+
+    // Percentage of datagrams dropped on each path, to simulate loss
+    array<int, 2> loss = {{ 0, 0 }};
+
+    sockaddr_in relay = sockaddr_in();
+
+    int tcp = -1, udp = -1;
+
+    uint32_t matchId = 0;
+
+    // Bytes read over TCP after MatchInfo, since TunInfo can arrive in the same read
+    string tcpBuffer;
+
+    // Address of the other side from TunInfo, zero until known
+    sockaddr_in tunAddress = sockaddr_in();
+
+    uint64_t punchStartUs = 0, connectUs = 0;
+
+    bool probing = false, relayed = false, connected = false;
+
+    vector<double> rtts;
+
+    // Direct (index 0) and relay (index 1) datagrams received, and received before the other path
+    array<uint32_t, 2> received = {{ 0, 0 }}, first = {{ 0, 0 }};
+
+    // Recently received pings and pongs, to drop the copy from the other path
+    array<string, MULTIPATH_HISTORY> recent;
+    size_t recentPos = 0;
+
+    uint64_t lastDirectUs = 0, lastDirectSentUs = 0;
+};
+
+
+static uint64_t nowUs()
+{
+    return chrono::duration_cast<chrono::microseconds> ( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static bool operator== ( const sockaddr_in& a, const sockaddr_in& b )
+{
+    return ( a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port );
+}
+
+static bool isDirectBlocked ( const Peer& peer )
+{
+    return ( peer.blockDirect || nowUs() - peer.punchStartUs < 1000ULL * peer.blockDirectMs );
+}
+
+static bool parseAddress ( const string& str, sockaddr_in& addr )
+{
+    const size_t colon = str.rfind ( ':' );
+
+    if ( colon == string::npos )
+        return false;
+
+    addr = sockaddr_in();
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons ( atoi ( str.substr ( colon + 1 ).c_str() ) );
+
+    return ( inet_pton ( AF_INET, str.substr ( 0, colon ).c_str(), &addr.sin_addr ) == 1 );
+}
+
+// Parse a reply that starts with the given header, returns the matchId or 0 on failure
+static uint32_t parseReply ( const string& buffer, const string& header )
+{
+    if ( buffer.size() < header.size() + sizeof ( uint32_t ) || buffer.compare ( 0, header.size(), header ) != 0 )
+        return 0;
+
+    uint32_t matchId;
+    memcpy ( &matchId, &buffer[header.size()], sizeof ( matchId ) );
+    return matchId;
+}
+
+// Read a reply that starts with the given header into buffer, returns the matchId or 0 on failure
+static uint32_t readReply ( int fd, const string& header, string& buffer )
+{
+    buffer.resize ( 64 );
+
+    const ssize_t len = recv ( fd, &buffer[0], buffer.size(), 0 );
+
+    buffer.resize ( max<ssize_t> ( 0, len ) );
+    return parseReply ( buffer, header );
+}
+
+// Send a datagram to the other side, wrapped in RelayData once relaying, or over both paths if probing or multipath.
+// Punches and a datagram every RELAY_DIRECT_PROBE_INTERVAL are always sent directly, like Socket::sendDatagram.
+static void sendPeer ( Peer& peer, const char *data, size_t len, bool multipath = false )
+{
+    if ( peer.relayed || peer.probing || multipath )
+    {
+        char datagram[RELAY_MAX_DATAGRAM];
+        relayHeader ( datagram, RELAY_DATA_FLAG + peer.isClient, peer.matchId );
+        memcpy ( &datagram[RELAY_HEADER_SIZE], data, len );
+
+        sendto ( peer.udp, datagram, RELAY_HEADER_SIZE + len, 0, ( const sockaddr * ) &peer.relay,
+                 sizeof ( peer.relay ) );
+    }
+
+    const uint64_t now = nowUs();
+
+    if ( peer.relayed && ! multipath && data[0] != PUNCH
+            && now - peer.lastDirectSentUs < 1000ULL * RELAY_DIRECT_PROBE_INTERVAL )
+    {
+        return;
+    }
+
+    peer.lastDirectSentUs = now;
+
+    if ( ! isDirectBlocked ( peer ) )
+        sendto ( peer.udp, data, len, 0, ( const sockaddr * ) &peer.tunAddress, sizeof ( peer.tunAddress ) );
+}
+
+static void readPeer ( Peer& peer )
+{
+    char buffer[RELAY_MAX_DATAGRAM];
+    sockaddr_in addr;
+    socklen_t addrLen = sizeof ( addr );
+
+    const ssize_t len = recvfrom ( peer.udp, buffer, sizeof ( buffer ), 0, ( sockaddr * ) &addr, &addrLen );
+
+    if ( len <= 0 )
+        return;
+
+    const char *data = buffer;
+    size_t dataLen = len;
+
+    uint8_t flag;
+    uint32_t matchId;
+
+    const bool relayed = ( addr == peer.relay );
+
+    if ( relayed )
+    {
+        if ( ! relayHeader ( buffer, len, flag, matchId ) || matchId != peer.matchId
+                || flag != RELAY_DATA_FLAG + ! peer.isClient )
+        {
+            return;
+        }
+
+        data += RELAY_HEADER_SIZE;
+        dataLen -= RELAY_HEADER_SIZE;
+    }
+    else if ( isDirectBlocked ( peer ) || ! ( addr == peer.tunAddress ) )
+    {
+        return;
+    }
+
+    if ( dataLen < 1 || rand() % 100 < peer.loss[relayed] )
+        return;
+
+    const uint64_t now = nowUs();
+
+    if ( ! relayed )
+    {
+        peer.lastDirectUs = now;
+
+        if ( peer.relayed )
+        {
+            printf ( "Direct again after %.0f ms\n", ( now - peer.punchStartUs ) / 1000.0 );
+            peer.relayed = peer.probing = false;
+        }
+    }
+    else if ( ! peer.relayed && now - peer.lastDirectUs >= 1000ULL * RELAY_DIRECT_TIMEOUT )
+    {
+        // The relay forwards RelayData and nothing arrives directly, so only relay, like Socket::readRelayed
+        printf ( "Relaying after %.0f ms\n", ( now - peer.punchStartUs ) / 1000.0 );
+        peer.relayed = true;
+    }
+
+    ++peer.received[relayed];
+
+    if ( data[0] == PING || data[0] == PONG )
+    {
+        const string datagram ( data, dataLen );
+
+        // Drop the copy from the other path
+        if ( find ( peer.recent.begin(), peer.recent.end(), datagram ) != peer.recent.end() )
+            return;
+
+        peer.recent[peer.recentPos] = datagram;
+        peer.recentPos = ( peer.recentPos + 1 ) % MULTIPATH_HISTORY;
+    }
+
+    ++peer.first[relayed];
+
+    if ( ! peer.connected )
+    {
+        peer.connected = true;
+        peer.connectUs = nowUs();
+
+        printf ( "Connected %s after %.0f ms\n", ( peer.relayed ? "through the relay" : "directly" ),
+                 ( peer.connectUs - peer.punchStartUs ) / 1000.0 );
+    }
+
+    if ( data[0] == PING )
+    {
+        string pong ( data, dataLen );
+        pong[0] = PONG;
+        sendPeer ( peer, &pong[0], pong.size(), peer.multipath );
+    }
+    else if ( data[0] == PONG && dataLen == 1 + sizeof ( uint64_t ) )
+    {
+        uint64_t sendUs;
+        memcpy ( &sendUs, &data[1], sizeof ( sendUs ) );
+        peer.rtts.push_back ( ( nowUs() - sendUs ) / 1000.0 );
+    }
+}
+
+// Matchmake over TCP like SmartSocket, returns false on failure
+static bool matchmake ( Peer& peer, const string& hosting )
+{
+    peer.tcp = socket ( AF_INET, SOCK_STREAM, 0 );
+    peer.udp = socket ( AF_INET, SOCK_DGRAM, 0 );
+
+    timeval timeout = { MATCH_TIMEOUT, 0 };
+    setsockopt ( peer.tcp, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof ( timeout ) );
+
+    if ( connect ( peer.tcp, ( const sockaddr * ) &peer.relay, sizeof ( peer.relay ) ) != 0 )
+    {
+        printf ( "Failed to connect to the relay\n" );
+        return false;
+    }
+
+    string message;
+
+    if ( peer.isClient )
+    {
+        // TypedConnectionAddress
+        message = "U" + hosting;
+    }
+    else
+    {
+        // TypedHostingPort, the port only identifies this host, it is never bound
+        const uint16_t port = atoi ( hosting.c_str() );
+        message = "U" + string ( ( const char * ) &port, sizeof ( port ) );
+    }
+
+    if ( send ( peer.tcp, &message[0], message.size(), 0 ) < 0 )
+        return false;
+
+    string buffer;
+    peer.matchId = readReply ( peer.tcp, "MatchInfo", buffer );
+
+    if ( ! peer.matchId )
+    {
+        printf ( "Failed to match\n" );
+        return false;
+    }
+
+    peer.tcpBuffer = buffer.substr ( 9 + sizeof ( uint32_t ) );
+
+    printf ( "matchId=%u\n", peer.matchId );
+    return true;
+}
+
+static bool connectPeer ( Peer& peer )
+{
+    const uint64_t deadline = nowUs() + 1000000ULL * CONNECT_TIMEOUT;
+
+    uint64_t nextSendUs = 0;
+
+    size_t numPings = 0;
+
+    while ( nowUs() < deadline && peer.rtts.size() < NUM_PINGS )
+    {
+        const uint64_t now = nowUs();
+
+        if ( now >= nextSendUs )
+        {
+            // Keep sending UdpData so the relay has the current address
+            char data[RELAY_HEADER_SIZE];
+            relayHeader ( data, peer.isClient, peer.matchId );
+            sendto ( peer.udp, data, sizeof ( data ), 0, ( const sockaddr * ) &peer.relay, sizeof ( peer.relay ) );
+
+            if ( peer.punchStartUs )
+            {
+                if ( ! peer.connected && ! peer.probing && now - peer.punchStartUs >= 1000ULL * PUNCH_TIMEOUT )
+                {
+                    printf ( "Hole punching slow, also sending via the relay\n" );
+                    peer.probing = true;
+                }
+
+                // Only the client measures pings, the host just replies
+                if ( peer.connected && peer.isClient && numPings < NUM_PINGS )
+                {
+                    char ping[1 + sizeof ( uint64_t )] = { PING };
+                    memcpy ( &ping[1], &now, sizeof ( now ) );
+                    sendPeer ( peer, ping, sizeof ( ping ), peer.multipath );
+                    ++numPings;
+                }
+                else
+                {
+                    const char punch = PUNCH;
+                    sendPeer ( peer, &punch, 1 );
+                }
+            }
+
+            nextSendUs = now + 1000ULL * ( peer.connected ? 10 : SEND_INTERVAL );
+        }
+
+        pollfd fds[2] = { { peer.tcp, POLLIN, 0 }, { peer.udp, POLLIN, 0 } };
+
+        if ( poll ( fds, 2, ( peer.tcpBuffer.empty() ? max<int> ( 1, ( nextSendUs - nowUs() ) / 1000 ) : 0 ) ) < 0 )
+            continue;
+
+        if ( fds[0].revents || ! peer.tcpBuffer.empty() )
+        {
+            // TunInfo
+            string buffer = peer.tcpBuffer;
+            peer.tcpBuffer.clear();
+
+            const uint32_t matchId = ( buffer.empty() ? readReply ( peer.tcp, "TunInfo", buffer )
+                                       : parseReply ( buffer, "TunInfo" ) );
+
+            const string address = buffer.substr ( 11, buffer.find ( '\0', 11 ) - 11 );
+
+            if ( matchId == peer.matchId && parseAddress ( address, peer.tunAddress ) )
+            {
+                printf ( "TunInfo '%s'\n", buffer.c_str() + 11 );
+                peer.punchStartUs = nowUs();
+            }
+
+            close ( peer.tcp );
+            peer.tcp = -1;
+        }
+
+        if ( fds[1].revents && peer.punchStartUs )
+            readPeer ( peer );
+    }
+
+    // The host keeps replying a bit longer, so the client can finish
+    if ( ! peer.isClient && peer.connected )
+    {
+        for ( const uint64_t end = nowUs() + 1000000ULL; nowUs() < end; )
+        {
+            pollfd fds = { peer.udp, POLLIN, 0 };
+
+            if ( poll ( &fds, 1, 100 ) > 0 )
+                readPeer ( peer );
+        }
+    }
+
+    return peer.connected;
+}
+
+int main ( int argc, char *argv[] )
+{
+    Peer peer;
+
+    vector<string> args;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        const string arg = argv[i];
+
+        if ( arg == "--block-direct" )
+            peer.blockDirect = true;
+        else if ( arg.find ( "--block-direct=" ) == 0 )
+            peer.blockDirectMs = atoi ( arg.substr ( 15 ).c_str() );
+        else if ( arg == "--multipath" )
+            peer.multipath = true;
+        else if ( arg.find ( "--direct-loss=" ) == 0 )
+            peer.loss[0] = atoi ( arg.substr ( 14 ).c_str() );
+        else if ( arg.find ( "--relay-loss=" ) == 0 )
+            peer.loss[1] = atoi ( arg.substr ( 13 ).c_str() );
+        else
+            args.push_back ( arg );
+    }
+
+    if ( args.size() < 2 || args.size() > 3 || ( args[0] != "host" && args[0] != "client" ) )
+    {
+        printf ( "Usage: %s host <hosting port> [relay address] [options]\n", argv[0] );
+        printf ( "       %s client <host ip:hosting port> [relay address] [options]\n", argv[0] );
+        printf ( "Options: --block-direct[=MS] --multipath --direct-loss=PERCENT --relay-loss=PERCENT\n" );
+        return 0;
+    }
+
+    peer.isClient = ( args[0] == "client" );
+
+    if ( ! parseAddress ( args.size() > 2 ? args[2] : "127.0.0.1:" + to_string ( RELAY_DEFAULT_PORT ), peer.relay ) )
+    {
+        printf ( "Invalid relay address\n" );
+        return -1;
+    }
+
+    if ( ! matchmake ( peer, args[1] ) )
+        return -1;
+
+    if ( ! connectPeer ( peer ) )
+    {
+        printf ( "Failed to connect\n" );
+        return -1;
+    }
+
+    if ( peer.isClient )
+    {
+        sort ( peer.rtts.begin(), peer.rtts.end() );
+
+        if ( peer.rtts.empty() )
+        {
+            printf ( "No pings\n" );
+            return -1;
+        }
+
+        printf ( "%s; pings: %u; RTT: p50=%.3f ms; p99=%.3f ms; worst=%.3f ms\n",
+                 ( peer.multipath ? "Multipath" : peer.relayed ? "Relayed" : "Direct" ), ( unsigned ) peer.rtts.size(),
+                 peer.rtts[peer.rtts.size() / 2], peer.rtts[min ( peer.rtts.size() - 1, peer.rtts.size() * 99 / 100 )],
+                 peer.rtts.back() );
+    }
+
+    for ( size_t i = 0; i < 2; ++i )
+    {
+        printf ( "Path %s: received=%u; first=%u\n", ( i ? "relay" : "direct" ),
+                 ( unsigned ) peer.received[i], ( unsigned ) peer.first[i] );
+    }
+
+    return 0;
+}